@@ -0,0 +1,59 @@
+#!/bin/bash
+# Stress test of the parallel optimization: compiles a source of many small
+# functions with loops repeatedly with -j, and checks that every run succeeds
+# and the program computes the same result as the one compiled serially.
+# Races between the worker threads show up as sporadic failures, so it's
+# worth running with more threads than CPUs.
+#
+# Usage: benchmarks/parallel_stress.sh [compiler] [runs] [threads]
+
+COMPILER=${1:-./build/csompiler}
+RUNS=${2:-20}
+THREADS=${3:-8}
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# n functions with a loop each, and a main calling all of them
+generate() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "long f%d(int *a, int n, int k) {\n", i
+            printf "    while (n > 0) { k = k + a[n] * (k + %d) * (n + %d); n = n - 1; }\n", i, i
+            printf "    return k;\n"
+            printf "}\n"
+        }
+        printf "int A[8];\n"
+        printf "int main(void) {\n"
+        printf "    for (int i = 0; i < 8; i = i + 1) A[i] = i %% 3;\n"
+        printf "    long s = 0;\n"
+        for (i = 0; i < n; i++)
+            printf "    s = s + f%d(A, 7, %d);\n", i, i
+        printf "    return (int)(s %% 251);\n"
+        printf "}\n"
+    }'
+}
+
+source="$WORK_DIR/many.c"
+generate 80 > "$source"
+
+"$COMPILER" "$source" --optimize -o "$WORK_DIR/serial" || {
+    echo "Serial compilation failed"
+    exit 1
+}
+"$WORK_DIR/serial"
+expected=$?
+
+for ((run = 1; run <= RUNS; run++)); do
+    "$COMPILER" "$source" --optimize -j "$THREADS" -o "$WORK_DIR/parallel" 2> "$WORK_DIR/errors" || {
+        echo "Run $run failed:"
+        cat "$WORK_DIR/errors"
+        exit 1
+    }
+    "$WORK_DIR/parallel"
+    result=$?
+    if [ "$result" -ne "$expected" ]; then
+        echo "Run $run returned $result instead of $expected"
+        exit 1
+    fi
+done
+echo "$RUNS parallel runs with $THREADS threads passed"
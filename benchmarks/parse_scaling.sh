@@ -0,0 +1,42 @@
+#!/bin/bash
+# Measures how the lexing and parsing time scales with the number of tokens.
+# Generates sources from about 1K to 10M tokens and prints the time per token,
+# which should stay roughly constant.
+#
+# Usage: benchmarks/parse_scaling.sh [compiler] [max tokens]
+
+COMPILER=${1:-./build/csompiler}
+MAX_TOKENS=${2:-10000000}
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# One function is 81 tokens
+generate() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "int f%d(int a, int b) {\n", i
+            printf "    int x = a * 3 + (b << 1) - %d;\n", i
+            printf "    if (x > 10 && b != 0) { x = x - b; } else { x = x + a; }\n"
+            printf "    for (int i = 0; i < b; i = i + 1)\n"
+            printf "        x = x + i * 2;\n"
+            printf "    return x;\n"
+            printf "}\n"
+        }
+    }'
+}
+
+printf "%12s %12s %12s %14s\n" "tokens" "lexing ms" "parsing ms" "ns per token"
+for tokens in 1000 10000 100000 1000000 10000000; do
+    [ "$tokens" -gt "$MAX_TOKENS" ] && break
+    source="$WORK_DIR/gen_$tokens.c"
+    generate $((tokens / 81 + 1)) > "$source"
+    "$COMPILER" "$source" --parse --time-passes 2> "$WORK_DIR/report" > /dev/null || {
+        echo "Compilation failed: $source"
+        exit 1
+    }
+    awk '
+        / tokens +Lexing$/ { lexing = $1; count = $4 }
+        / Parsing$/ { parsing = $1 }
+        END { printf "%12d %12.1f %12.1f %14.1f\n", count, lexing, parsing, (lexing + parsing) * 1e6 / count }
+    ' "$WORK_DIR/report"
+done
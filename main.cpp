@@ -1,12 +1,17 @@
 #include "assembly/assembly.h"
 #include "common/context.h"
 #include "common/error.h"
+#include "common/pass_timer.h"
+#include "common/thread_pool.h"
 #include "lexer/lexer.h"
 #include "lexer/token.h"
+#include "parser/ast_counter.h"
 #include "parser/ast_printer.h"
 #include "parser/parser.h"
 #include "parser/semantic_analyzer.h"
 #include "parser/type_checker.h"
+#include "preprocessor/header_cache.h"
+#include "preprocessor/preprocessor.h"
 #include "tac/tac.h"
 #include "tac/tac_printer.h"
 #include <algorithm>
@@ -15,7 +20,9 @@
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <iterator>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
 
 static void deleteFile(std::filesystem::path file_path)
@@ -28,146 +35,210 @@ static void deleteFile(std::filesystem::path file_path)
     }
 }
 
-int main(int argc, char **argv)
+static bool hasFlag(const std::list<std::string> &flags, const std::string &name)
 {
-    // Command line arguments
-    std::list<std::string> inputs;
-    std::list<std::string> flags;
-    std::list<std::string> libraries;
-    auto has_flag = [&](const std::string &name) -> bool {
-        return std::find(flags.begin(), flags.end(), name) != flags.end();
-    };
+    return std::find(flags.begin(), flags.end(), name) != flags.end();
+}
 
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg.rfind("--", 0) == 0)
-            flags.push_back(arg.substr(2)); // --arg
-        else if (arg.rfind("-", 0) == 0) {
-            std::string flag = arg.substr(1);
-            if (flag.rfind("l") == 0 && flag.length() > 1) { // -llib
-                libraries.push_back(flag);
-                continue;
-            }
-            flags.push_back(arg.substr(1)); // -arg
-        } else
-            inputs.push_back(arg); // input arg
+// Value of a "--name=value" flag
+static std::optional<std::string> flagValue(
+    const std::list<std::string> &flags,
+    const std::string &name)
+{
+    std::string prefix = name + "=";
+    for (const std::string &flag : flags) {
+        if (flag.rfind(prefix, 0) == 0)
+            return flag.substr(prefix.length());
     }
+    return std::nullopt;
+}
 
-    if (inputs.empty()) {
-        std::cerr << "Missing input file from arguments. Usage: " << argv[0] << " <filename>" << std::endl;
-        return Error::DRIVER_ERROR;
-    }
+// Debug output requested with --dump=<kind>,<kind>...
+// It's printed to stderr, or to <input>.<kind> files with --dump-to-files.
+class Dumper {
+public:
+    static constexpr std::string_view s_kinds[] = {
+        "preproc", "tokens", "ast", "tac", "asm", "symbols", "types"
+    };
 
-    std::string lib_flags;
-    for (std::string &lib : libraries) {
-        lib_flags += std::format("-{} ", lib);
+    Dumper(const std::string &input, const std::list<std::string> &flags)
+        : m_input(input)
+        , m_toFiles(hasFlag(flags, "dump-to-files"))
+    {
+        std::optional<std::string> kinds = flagValue(flags, "dump");
+        if (!kinds)
+            return;
+        std::stringstream ss(*kinds);
+        std::string kind;
+        while (std::getline(ss, kind, ',')) {
+            if (std::find(std::begin(s_kinds), std::end(s_kinds), kind) == std::end(s_kinds))
+                m_unknown.push_back(kind);
+            else
+                m_kinds.insert(kind);
+        }
     }
 
-    // Preprocessor
-    std::filesystem::path output_preprocessed(inputs.front());
-    output_preprocessed.replace_extension(".i");
-    std::string preproc_command = std::format(
-        "gcc -E -P {} -o {}",
-        inputs.front(),
-        output_preprocessed.string());
-    if (std::system(preproc_command.c_str()) != 0) {
-        std::cerr << "Can't preprocess with gcc." << std::endl;
-        return Error::DRIVER_ERROR;
+    const std::vector<std::string> &UnknownKinds() const { return m_unknown; }
+
+    // The printers write to std::cout, so it's redirected
+    // while fn is running
+    template <typename Fn>
+    void operator()(const std::string &kind, Fn &&fn) const
+    {
+        if (!m_kinds.contains(kind))
+            return;
+        // Translation units are compiled in parallel
+        std::lock_guard<std::mutex> lock(s_mutex);
+        std::ofstream file;
+        std::ostream *out = &std::cerr;
+        if (m_toFiles) {
+            std::filesystem::path path(m_input);
+            path.replace_extension(kind);
+            file.open(path);
+            if (!file) {
+                std::cerr << "Can't open dump file: " << path << std::endl;
+                return;
+            }
+            out = &file;
+        } else
+            *out << "===== " << kind << ": " << m_input << " =====" << std::endl;
+        std::streambuf *original = std::cout.rdbuf(out->rdbuf());
+        fn();
+        std::cout.flush();
+        std::cout.rdbuf(original);
     }
 
-    // Reading the input file
-    std::ifstream file(output_preprocessed);
-    if (!file) {
-        std::cerr << "Could not open the file." << std::endl;
+private:
+    // Shared by every Fn, all of them redirect std::cout
+    static inline std::mutex s_mutex;
+
+    std::string m_input;
+    bool m_toFiles;
+    std::set<std::string> m_kinds;
+    std::vector<std::string> m_unknown;
+};
+
+// Compiles one translation unit into the output file,
+// an object file or an assembly source (with -S)
+static int compile(
+    const std::string &input,
+    const std::filesystem::path &output,
+    const std::list<std::string> &flags,
+    const preprocessor::Options &preprocessor_options,
+    Context *context)
+{
+    auto has_flag = [&](const std::string &name) -> bool {
+        return hasFlag(flags, name);
+    };
+    PassTimer *timer = context->passTimer.get();
+
+    Dumper dump(input, flags);
+    if (!dump.UnknownKinds().empty()) {
+        std::cerr << "Unknown dump kind: " << dump.UnknownKinds().front() << std::endl;
         return Error::DRIVER_ERROR;
     }
-    std::string file_content((std::istreambuf_iterator<char>(file)),
-                                std::istreambuf_iterator<char>());
-    deleteFile(output_preprocessed);
 
-#if 1
-    std::cout << "Preprocessed source code:" << std::endl;
-    std::cout << file_content << std::endl;
-#endif
+    // Preprocessor
+    std::string file_content;
+    {
+        auto t = timer->Time("Preprocessing");
+        preprocessor::Result preprocessor_result = preprocessor::preprocess(
+            input,
+            preprocessor_options,
+            context->headerCache.get());
+        if (preprocessor_result.return_code) {
+            std::cerr << preprocessor_result.error_message << std::endl;
+            return preprocessor_result.return_code;
+        }
+        file_content = std::move(preprocessor_result.output);
+        t.Count("bytes", [&]() { return file_content.size(); });
+    }
 
-    // Compilation context
-    std::unique_ptr<Context> context = std::make_unique<Context>();
+    dump("preproc", [&]() { std::cout << file_content << std::endl; });
 
     // Lexer
-    lexer::Result lexer_result = lexer::tokenize(file_content);
+    lexer::Result lexer_result;
+    {
+        auto t = timer->Time("Lexing");
+        lexer_result = lexer::tokenize(std::move(file_content));
+        t.Count("tokens", [&]() { return lexer_result.tokens.size(); });
+    }
     if (lexer_result.return_code) {
-        std::cout << lexer_result.error_message << std::endl;
+        std::cerr << lexer_result.error_message << std::endl;
         return lexer_result.return_code;
     }
 
-#if 0
-    for (auto it = lexer_result.tokens.begin(); it != lexer_result.tokens.end(); it++)
-        std::cout << *it << std::endl;
-#endif
+    dump("tokens", [&]() {
+        for (auto it = lexer_result.tokens.begin(); it != lexer_result.tokens.end(); it++)
+            std::cout << *it << std::endl;
+    });
 
     if (has_flag("lex"))
         return Error::ALL_OK;
 
     // Parser
-    parser::Result parser_result = parser::parse(lexer_result.tokens);
+    parser::Result parser_result;
+    {
+        auto t = timer->Time("Parsing");
+        parser_result = parser::parse(lexer_result.tokens);
+        t.Count("AST nodes", [&]() { return parser::ASTCounter::Count(parser_result.root); });
+    }
     if (parser_result.return_code) {
-        std::cout << parser_result.error_message << std::endl;
+        std::cerr << parser_result.error_message << std::endl;
         return parser_result.return_code;
     }
 
-#if 0
-    std::cout << std::endl << "AST:" << std::endl;
-    parser::ASTPrinter ast_printer;
-    ast_printer.print(parser_result.root);
-#endif
+    auto dump_ast = [&]() {
+        dump("ast", [&]() {
+            parser::ASTPrinter ast_printer;
+            ast_printer.print(parser_result.root);
+        });
+    };
 
-    if (has_flag("parse"))
+    if (has_flag("parse")) {
+        dump_ast();
         return Error::ALL_OK;
+    }
 
     // Semantic analysis
-    parser::SemanticAnalyzer semantic_analyzer;
-    if (Error error = semantic_analyzer.CheckAndMutate(parser_result.root))
-        return error;
-
-#if 0
-    std::cout << std::endl << "After semantic analysis:" << std::endl;
-    parser::ASTPrinter semantic_printer;
-    semantic_printer.print(parser_result.root);
-#endif
+    {
+        auto t = timer->Time("Semantic analysis");
+        t.Count("AST nodes", [&]() { return parser::ASTCounter::Count(parser_result.root); });
+        parser::SemanticAnalyzer semantic_analyzer(context);
+        if (Error error = semantic_analyzer.CheckAndMutate(parser_result.root))
+            return error;
+    }
 
-    parser::TypeChecker type_checker(context.get());
-    if (Error error = type_checker.CheckAndMutate(parser_result.root))
-        return error;
+    {
+        auto t = timer->Time("Type checking");
+        t.Count("AST nodes", [&]() { return parser::ASTCounter::Count(parser_result.root); });
+        parser::TypeChecker type_checker(context, *parser_result.arena);
+        if (Error error = type_checker.CheckAndMutate(parser_result.root))
+            return error;
+    }
 
-#if 0
-    std::cout << std::endl << "After type checking:" << std::endl;
-    parser::ASTPrinter type_printer;
-    type_printer.print(parser_result.root);
-#endif
+    // The AST is dumped with the resolved names and types
+    dump_ast();
 
     if (has_flag("validate"))
         return Error::ALL_OK;
 
     // Intermediate representation (TAC)
     std::list<tac::TopLevel> tac_list;
-    tac::from_ast(
-        parser_result.root,
-        tac_list,
-        context.get());
-#if 0
-    std::cout << std::endl << "TAC:" << std::endl;
-    tac::TACPrinter::Print(tac_list, context.get());
-#endif
-
-#if 0
-    std::cout << std::endl << "Symbol table:" << std::endl;
-    context->symbolTable->print();
-#endif
-
-#if 0
-    std::cout << std::endl << "Type table:" << std::endl;
-    context->typeTable->print();
-#endif
+    {
+        auto t = timer->Time("TAC generation");
+        tac::from_ast(
+            parser_result.root,
+            tac_list,
+            context);
+        t.Count("TAC instructions", [&]() { return tac::count_instructions(tac_list); });
+    }
+    // The AST is not needed anymore, the nodes are destroyed before
+    // their arena is released
+    parser_result.root.clear();
+    parser_result.arena.reset();
+    dump("symbols", [&]() { context->symbolTable->print(); });
+    dump("types", [&]() { context->typeTable->print(); });
 
     // TAC optimizations
     if (has_flag("optimize")) {
@@ -175,64 +246,255 @@ int main(int argc, char **argv)
         context->copy_propagation = true;
         context->unreachable_code_elimination = true;
         context->dead_store_elimination = true;
+        context->loop_invariant_code_motion = true;
+        context->induction_variables = true;
+        context->common_subexpression_elimination = true;
+        context->inlining = true;
+        context->ssa = true;
+        context->peephole = true;
     } else {
         context->constant_folding = has_flag("fold-constants");
         context->copy_propagation = has_flag("propagate-copies");
         context->unreachable_code_elimination = has_flag("eliminate-unreachable-code");
         context->dead_store_elimination = has_flag("eliminate-dead-stores");
+        context->loop_invariant_code_motion = has_flag("hoist-loop-invariants");
+        context->induction_variables = has_flag("reduce-induction-variables");
+        context->common_subexpression_elimination = has_flag("eliminate-common-subexpressions");
+        context->inlining = has_flag("inline-functions");
+        context->ssa = has_flag("ssa");
+        context->peephole = has_flag("peephole");
+        // Value numbering runs in SSA form
+        context->ssa |= context->common_subexpression_elimination;
+    }
+    {
+        auto t = timer->Time("TAC optimization");
+        tac::apply_optimizations(tac_list, context);
+        t.Count("TAC instructions", [&]() { return tac::count_instructions(tac_list); });
     }
-    tac::apply_optimizations(tac_list, context.get());
 
-#if 1
-    std::cout << std::endl << "TAC after optimizations:" << std::endl;
-    tac::TACPrinter::Print(tac_list, context.get());
-#endif
+    dump("tac", [&]() { tac::TACPrinter::Print(tac_list, context); });
 
     if (has_flag("tacky"))
         return Error::ALL_OK;
 
     // Assembly generation
-    std::string assembly_source = assembly::from_tac(
-        tac_list,
-        context.get());
-#if 1
-    std::cout << std::endl << "ASM:" << std::endl;
-    std::cout << assembly_source;
-#endif
+    std::list<assembly::TopLevel> asm_list;
+    {
+        auto t = timer->Time("Code generation");
+        asm_list = assembly::from_tac(
+            tac_list,
+            context);
+    }
+    dump("asm", [&]() { std::cout << assembly::to_text(asm_list, context); });
 
     if (has_flag("codegen"))
         return Error::ALL_OK;
 
     // Code emission
-    std::filesystem::path output_assembly_path(inputs.front());
+    if (!has_flag("S") && !has_flag("external-assembler")) {
+        std::vector<char> object = assembly::to_object(asm_list, context);
+        std::ofstream output_object_file(output, std::ios::binary);
+        if (!output_object_file)
+            throw std::runtime_error("Can't open file: " + output.string());
+        output_object_file.write(object.data(), static_cast<std::streamsize>(object.size()));
+        return Error::ALL_OK;
+    }
+
+    std::filesystem::path output_assembly_path(input);
     output_assembly_path.replace_extension(".s");
+    if (has_flag("S"))
+        output_assembly_path = output;
     std::ofstream output_assembly_file(output_assembly_path);
     if (!output_assembly_file)
         throw std::runtime_error("Can't open file: " + output_assembly_path.string());
-    output_assembly_file << assembly_source;
+    output_assembly_file << assembly::to_text(asm_list, context);
     output_assembly_file.close();
 
     if (has_flag("S"))
         return Error::ALL_OK;
 
-    // Compilation
-    bool standalone = !has_flag("c");
-    std::filesystem::path output_compiled(output_assembly_path);
-    if (standalone)
-        output_compiled.replace_extension();
-    else
-        output_compiled.replace_extension(".o");
-    std::string compile_command = std::format(
-        "gcc {} {} -o {} {}",
-        standalone ? "" : "-c",
+    // Assembling the object file with --external-assembler,
+    // linking is done after every translation unit is compiled
+    auto t = timer->Time("Assembling");
+    std::string assemble_command = std::format(
+        "gcc -c {} -o {}",
         output_assembly_path.string(),
-        output_compiled.string(),
-        lib_flags);
-    if (std::system(compile_command.c_str()) != 0) {
-        std::cerr << "Can't compile with gcc." << std::endl;
+        output.string());
+    if (std::system(assemble_command.c_str()) != 0) {
+        std::cerr << "Can't assemble with gcc." << std::endl;
         return Error::DRIVER_ERROR;
     }
     deleteFile(output_assembly_path);
 
     return Error::ALL_OK;
 }
+
+int main(int argc, char **argv)
+{
+    // Command line arguments
+    std::vector<std::string> inputs;
+    std::list<std::string> flags;
+    std::list<std::string> libraries;
+    std::optional<std::string> output_flag;
+    preprocessor::Options preprocessor_options;
+    size_t jobs = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o") {
+            if (++i == argc) {
+                std::cerr << "Missing file name after -o." << std::endl;
+                return Error::DRIVER_ERROR;
+            }
+            output_flag = argv[i];
+        } else if (arg.rfind("-j", 0) == 0) { // -j N or -jN
+            std::string value = arg.substr(2);
+            if (value.empty() && i + 1 < argc)
+                value = argv[++i];
+            try {
+                jobs = std::stoul(value);
+            } catch (const std::exception &) {
+                jobs = 0;
+            }
+            if (jobs == 0) {
+                std::cerr << "Invalid number of jobs: " << value << std::endl;
+                return Error::DRIVER_ERROR;
+            }
+        } else if (arg.rfind("-I", 0) == 0 || arg.rfind("-D", 0) == 0 || arg.rfind("-U", 0) == 0) {
+            // -Idir, -DNAME[=value], -UNAME (or with a separate argument)
+            std::string value = arg.substr(2);
+            if (value.empty() && i + 1 < argc)
+                value = argv[++i];
+            if (arg[1] == 'I')
+                preprocessor_options.include_dirs.push_back(value);
+            else
+                preprocessor_options.definitions.push_back(arg[1] == 'U' ? "-" + value : value);
+        } else if (arg.rfind("--", 0) == 0)
+            flags.push_back(arg.substr(2)); // --arg
+        else if (arg.rfind("-", 0) == 0) {
+            std::string flag = arg.substr(1);
+            if (flag.rfind("l") == 0 && flag.length() > 1) { // -llib
+                libraries.push_back(flag);
+                continue;
+            }
+            flags.push_back(arg.substr(1)); // -arg
+        } else
+            inputs.push_back(arg); // input arg
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "Missing input file from arguments. Usage: " << argv[0] << " <filename>..." << std::endl;
+        return Error::DRIVER_ERROR;
+    }
+
+#ifdef __APPLE__
+    // The integrated encoder only writes ELF object files
+    flags.push_back("external-assembler");
+#endif
+
+    bool emit_assembly = hasFlag(flags, "S");
+    bool emit_object = hasFlag(flags, "c");
+    if (output_flag && inputs.size() > 1 && (emit_assembly || emit_object)) {
+        std::cerr << "Can't specify -o with -S or -c and multiple input files." << std::endl;
+        return Error::DRIVER_ERROR;
+    }
+
+    // Stage flags stop the compilation before the linking
+    bool link = !emit_assembly && !emit_object;
+    for (const char *stage : { "lex", "parse", "validate", "tacky", "codegen" }) {
+        if (hasFlag(flags, stage))
+            link = false;
+    }
+
+    std::string lib_flags;
+    for (std::string &lib : libraries) {
+        lib_flags += std::format("-{} ", lib);
+    }
+
+    // --time-passes prints a text report, --time-passes=json a JSON one (both to stderr)
+    bool time_passes_json = hasFlag(flags, "time-passes=json");
+    bool time_passes = time_passes_json || hasFlag(flags, "time-passes");
+
+    // Translation units are compiled in parallel. With -j N functions are
+    // optimized in parallel too, and the pool has N threads.
+    auto pool = std::make_shared<ThreadPool>(jobs
+        ? jobs
+        : std::min(inputs.size(), ThreadPool::DefaultThreadCount()));
+
+    // Every translation unit has its own compilation context,
+    // they share the tokenized headers
+    auto header_cache = std::make_shared<preprocessor::HeaderCache>();
+    std::vector<std::unique_ptr<Context>> contexts;
+    std::vector<std::filesystem::path> outputs;
+    for (const std::string &input : inputs) {
+        contexts.push_back(std::make_unique<Context>());
+        contexts.back()->passTimer->enabled = time_passes;
+        contexts.back()->headerCache = header_cache;
+        if (jobs)
+            contexts.back()->threadPool = pool;
+
+        std::filesystem::path output(input);
+        output.replace_extension(emit_assembly ? ".s" : ".o");
+        if (output_flag && !link)
+            output = *output_flag;
+        outputs.push_back(output);
+    }
+
+    std::vector<int> results(inputs.size(), Error::ALL_OK);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        pool->Submit([&, i]() {
+            try {
+                results[i] = compile(inputs[i], outputs[i], flags, preprocessor_options, contexts[i].get());
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                results[i] = Error::DRIVER_ERROR;
+            }
+        });
+    }
+    pool->Wait();
+
+    // The JSON report is a single array with an element per input
+    if (time_passes_json)
+        std::cerr << "[";
+    for (size_t i = 0; i < inputs.size(); i++) {
+        PassTimer *timer = contexts[i]->passTimer.get();
+        if (time_passes_json) {
+            std::cerr << (i == 0 ? "\n" : ",\n");
+            timer->PrintJSON(std::cerr, inputs[i]);
+        } else if (time_passes)
+            timer->PrintText(std::cerr, inputs[i]);
+    }
+    if (time_passes_json)
+        std::cerr << "\n]" << std::endl;
+
+    for (int result : results) {
+        if (result != Error::ALL_OK)
+            return result;
+    }
+
+    if (!link)
+        return Error::ALL_OK;
+
+    // Linking
+    std::filesystem::path executable(inputs.front());
+    executable.replace_extension();
+    if (output_flag)
+        executable = *output_flag;
+    std::string objects;
+    for (auto &output : outputs)
+        objects += std::format("{} ", output.string());
+    std::string link_command = std::format(
+        "gcc {}-o {} {}",
+        objects,
+        executable.string(),
+        lib_flags);
+    int link_result = std::system(link_command.c_str());
+    for (auto &output : outputs)
+        deleteFile(output);
+    if (link_result != 0) {
+        std::cerr << "Can't link with gcc." << std::endl;
+        return Error::DRIVER_ERROR;
+    }
+
+    return Error::ALL_OK;
+}
@@ -97,7 +97,7 @@ WordType ASMBuilder::GetWordType(const tac::Value &value)
     return GetType(value).wordType();
 }
 
-TypeTable::AggregateEntry *ASMBuilder::GetAggregateEntry(const std::string *name)
+TypeTable::AggregateEntry *ASMBuilder::GetAggregateEntry(const Symbol *name)
 {
     if (!name)
         return nullptr;
@@ -108,7 +108,7 @@ TypeTable::AggregateEntry *ASMBuilder::GetAggregateEntry(const std::string *name
     return m_typeTable->get(aggr_type->tag);
 }
 
-void ASMBuilder::Comment(std::list<Instruction> &i, const std::string &text)
+void ASMBuilder::Comment(InstructionList &i, const std::string &text)
 {
     if (m_commentsEnabled)
         i.push_back(assembly::Comment{ text });
@@ -181,7 +181,7 @@ Operand ASMBuilder::operator()(const tac::Unary &u)
     if (u.op == UnaryOperator::Not) {
         if (srcType == Doubleword) {
             // Label for handling a potentional unordered (NaN) case
-            std::string end_label = MakeNameUnique("end_not");
+            Symbol end_label = MakeNameUnique(m_context, "end_not");
             AddInstruction(Binary{ BWXor_AB, Reg{ XMM0, 8 }, Reg{ XMM0, 8 }, srcType });
             AddInstruction(Cmp{ Reg{ XMM0, 8 }, src, srcType });
             // NaN evaluates to non-zero, !NaN is zero,
@@ -201,9 +201,9 @@ Operand ASMBuilder::operator()(const tac::Unary &u)
 
     if (u.op == Negate && srcType == Doubleword) {
         // Negating in floating point: XOR with -0.0
-        std::string minus_zero = AddConstant(
+        Symbol minus_zero = AddConstant(
             ConstantValue{ static_cast<double>(-0.0) },
-            GenerateTempVariableName()
+            GenerateTempVariableName(m_context)
         );
         AddInstruction(Mov{ src, dst, Doubleword });
         AddInstruction(Binary{
@@ -271,8 +271,8 @@ Operand ASMBuilder::operator()(const tac::Binary &b)
         Comment(m_instructions, std::format("Relational operator {}", toString(b.op)));
         if (srcType == Doubleword) {
             // Labels for handling a potentional unordered (NaN) case
-            std::string unordered_label = MakeNameUnique("unordered_comparison");
-            std::string end_label = MakeNameUnique("end_comparison");
+            Symbol unordered_label = MakeNameUnique(m_context, "unordered_comparison");
+            Symbol end_label = MakeNameUnique(m_context, "end_comparison");
             // Comparing arguments; result stored in RFLAGS
             AddInstruction(Cmp{ src2, src1, srcType });
             // The jp instruction jumps only in case of NaN comparison
@@ -308,12 +308,12 @@ Operand ASMBuilder::operator()(const tac::Binary &b)
 
 Operand ASMBuilder::operator()(const tac::Copy &c)
 {
-    const std::string *src_name = getString(c.src);
+    const Symbol *src_name = getSymbol(c.src);
     if (auto entry = GetAggregateEntry(src_name)) {
         CopyBytes(
             m_instructions,
             PseudoAggregate{ *src_name, 0 },
-            PseudoAggregate{ *getString(c.dst), 0 },
+            PseudoAggregate{ *getSymbol(c.dst), 0 },
             entry->size);
         return std::monostate();
     }
@@ -334,7 +334,7 @@ Operand ASMBuilder::operator()(const tac::GetAddress &g)
         std::visit(*this, g.src),
         std::visit(*this, g.dst)
     });
-    if (const std::string *src_name = getString(g.src))
+    if (const Symbol *src_name = getSymbol(g.src))
         m_aliasedVars.insert(*src_name);
     return std::monostate();
 }
@@ -349,7 +349,7 @@ Operand ASMBuilder::operator()(const tac::Load &l)
     });
 
     // Struct/union: copy chunks of data stored at offsets from the address in RAX
-    const std::string *dst_name = getString(l.dst);
+    const Symbol *dst_name = getSymbol(l.dst);
     if (auto entry = GetAggregateEntry(dst_name)) {
         CopyBytes(
             m_instructions,
@@ -378,7 +378,7 @@ Operand ASMBuilder::operator()(const tac::Store &s)
     });
 
     // Struct/union: copy chunks of data stored to the address in RAX
-    const std::string *src_name = getString(s.src);
+    const Symbol *src_name = getSymbol(s.src);
     if (auto entry = GetAggregateEntry(src_name)) {
         CopyBytes(
             m_instructions,
@@ -409,7 +409,7 @@ Operand ASMBuilder::operator()(const tac::JumpIfZero &j)
     Comment(m_instructions, "Jump if zero");
     WordType wordType = GetWordType(j.condition);
     if (wordType == Doubleword) {
-        std::string not_nan_label = MakeNameUnique("not_nan");
+        Symbol not_nan_label = MakeNameUnique(m_context, "not_nan");
         // Zero out the XMMO register
         AddInstruction(Binary{ BWXor_AB, Reg{ XMM0 }, Reg{ XMM0 }, Doubleword });
         // Compare with zero
@@ -445,6 +445,25 @@ Operand ASMBuilder::operator()(const tac::JumpIfNotZero &j)
     return std::monostate();
 }
 
+Operand ASMBuilder::operator()(const tac::JumpTable &j)
+{
+    Comment(m_instructions, "Jump table");
+    // The index is unsigned and already checked against the size of the table
+    Operand index = std::visit(*this, j.index);
+    WordType wordType = GetWordType(j.index);
+    if (wordType == Quadword)
+        AddInstruction(Mov{ index, Reg{ AX, 8 }, Quadword });
+    else
+        AddInstruction(MovZeroExtend{ index, Reg{ AX, 8 }, wordType, Quadword });
+    // The entries are 32-bit offsets of the targets from the table
+    Symbol table = MakeNameUnique(m_context, "jump_table");
+    AddInstruction(Lea{ Data{ table }, Reg{ DX, 8 } });
+    AddInstruction(Movsx{ Indexed{ DX, AX, 4 }, Reg{ AX, 8 }, Longword, Quadword });
+    AddInstruction(Binary{ Add_AB, Reg{ DX, 8 }, Reg{ AX, 8 }, Quadword });
+    AddInstruction(JmpIndirect{ Reg{ AX, 8 }, table, j.targets });
+    return std::monostate();
+}
+
 Operand ASMBuilder::operator()(const tac::Label &l)
 {
     AddInstruction(Label{ l.identifier });
@@ -694,12 +713,12 @@ Operand ASMBuilder::operator()(const tac::DoubleToUInt &d)
         AddInstruction(Mov{ Reg{ AX, 1 }, dst, Byte });
     } else if (basicType == ULong) {
         Comment(m_instructions, "Double to ULong");
-        std::string upper_bound = AddConstant(
+        Symbol upper_bound = AddConstant(
             ConstantValue{ 9223372036854775808.0 },
-            MakeNameUnique("double_upper_bound")
+            MakeNameUnique(m_context, "double_upper_bound")
         );
-        std::string oor_label = MakeNameUnique("out_of_range");
-        std::string end_label = MakeNameUnique("end");
+        Symbol oor_label = MakeNameUnique(m_context, "out_of_range");
+        Symbol end_label = MakeNameUnique(m_context, "end");
         AddInstruction(Cmp{ Data{ upper_bound }, src, Doubleword });
         AddInstruction(JmpCC{ "ae", oor_label });
         AddInstruction(Cvttsd2si{ src, dst, Quadword });
@@ -749,8 +768,8 @@ Operand ASMBuilder::operator()(const tac::UIntToDouble &u)
         AddInstruction(Cvtsi2sd{ Reg{ AX, 4 }, dst, Longword });
     } else if (basicType == ULong) {
         Comment(m_instructions, "ULong to Double");
-        std::string oor_label = MakeNameUnique("out_of_range");
-        std::string end_label = MakeNameUnique("end");
+        Symbol oor_label = MakeNameUnique(m_context, "out_of_range");
+        Symbol end_label = MakeNameUnique(m_context, "end");
         AddInstruction(Cmp{ Imm{ 0 }, src, Quadword });
         AddInstruction(JmpCC{ "l", oor_label });
         AddInstruction(Cvtsi2sd{ src, dst, Quadword });
@@ -813,19 +832,19 @@ Operand ASMBuilder::operator()(const tac::AddPtr &a)
 
 Operand ASMBuilder::operator()(const tac::CopyToOffset &c)
 {
-    const std::string *src_name = getString(c.src);
+    const Symbol *src_name = getSymbol(c.src);
     if (auto entry = GetAggregateEntry(src_name)) {
         CopyBytes(
             m_instructions,
             PseudoAggregate{ *src_name, 0 },
-            PseudoAggregate{ c.dst_identifier, c.offset },
+            PseudoAggregate{ c.dst_identifier.name, c.offset },
             entry->size);
         return std::monostate();
     }
 
     AddInstruction(Mov{
         std::visit(*this, c.src),
-        PseudoAggregate{ c.dst_identifier, c.offset },
+        PseudoAggregate{ c.dst_identifier.name, c.offset },
         GetWordType(c.src)
     });
     return std::monostate();
@@ -833,30 +852,37 @@ Operand ASMBuilder::operator()(const tac::CopyToOffset &c)
 
 Operand ASMBuilder::operator()(const tac::CopyFromOffset &c)
 {
-    const std::string *dst_name = getString(c.dst);
+    const Symbol *dst_name = getSymbol(c.dst);
     if (auto entry = GetAggregateEntry(dst_name)) {
         CopyBytes(
             m_instructions,
-            PseudoAggregate{ c.src_identifier, c.offset },
+            PseudoAggregate{ c.src_identifier.name, c.offset },
             PseudoAggregate{ *dst_name, 0 },
             entry->size);
         return std::monostate();
     }
 
     AddInstruction(Mov{
-        PseudoAggregate{ c.src_identifier, c.offset },
+        PseudoAggregate{ c.src_identifier.name, c.offset },
         std::visit(*this, c.dst),
         GetWordType(c.dst)
     });
     return std::monostate();
 }
 
+Operand ASMBuilder::operator()(const tac::Phi &)
+{
+    // Functions leave SSA form before code generation
+    assert(false);
+    return std::monostate();
+}
+
 Operand ASMBuilder::operator()(const tac::Constant &c)
 {
     if (getType(c.value).isBasic(Double)) {
         // Add the constant later to the data segment
         // and avoid duplications
-        return Data{ AddConstant(c.value, GenerateTempVariableName()) };
+        return Data{ AddConstant(c.value, GenerateTempVariableName(m_context)) };
     }
     return Imm{ castTo<int64_t>(c.value) };
 }
@@ -894,10 +920,10 @@ Operand ASMBuilder::operator()(const tac::FunctionDefinition &f)
         f.params,
         return_in_memory,
         m_typeTable,
-        [this](const std::string &name) {
+        [this](Symbol name) {
             return m_symbolTable->getType(name);
         },
-        [](const std::string &name) {
+        [](Symbol name) {
             return Pseudo{ name };
         }
     );
@@ -1026,13 +1052,14 @@ void ASMBuilder::ConvertTopLevel(
 }
 
 void ASMBuilder::ConvertFunctionBody(
-    const std::string &name,
-    const std::list<tac::CFGBlock> &tac_blocks,
-    std::list<CFGBlock> &block_list_out)
+    Symbol name,
+    const tac::CFG &tac_blocks,
+    CFG &block_list_out)
 {
     m_aliasedVars.clear();
     m_currentFunctionName = name;
     m_blocks = &block_list_out;
+    m_instructions = block_list_out.newList();
     for (auto &block : tac_blocks) {
         for (auto &i : block.instructions)
             std::visit(*this, i);
@@ -1040,7 +1067,7 @@ void ASMBuilder::ConvertFunctionBody(
     FinalizeControlFlowBlocks();
 }
 
-std::string ASMBuilder::AddConstant(const ConstantValue &c, const std::string &name)
+Symbol ASMBuilder::AddConstant(const ConstantValue &c, Symbol name)
 {
     auto it = m_constants->find(c);
     if (it != m_constants->end())
@@ -1051,12 +1078,12 @@ std::string ASMBuilder::AddConstant(const ConstantValue &c, const std::string &n
     }
 }
 
-std::set<std::string> ASMBuilder::AliasedVariables()
+std::set<Symbol> ASMBuilder::AliasedVariables()
 {
     return m_aliasedVars;
 }
 
-void ASMBuilder::CopyBytes(std::list<Instruction> &i, Operand src, Operand dst, size_t size)
+void ASMBuilder::CopyBytes(InstructionList &i, Operand src, Operand dst, size_t size)
 {
     std::vector<WordType> fragments = getMemoryFragments(size);
     size_t offset = 0;
@@ -1070,7 +1097,7 @@ void ASMBuilder::CopyBytes(std::list<Instruction> &i, Operand src, Operand dst,
     }
 }
 
-void ASMBuilder::CopyBytesToReg(std::list<Instruction> &i, Operand src, Register dst, size_t size)
+void ASMBuilder::CopyBytesToReg(InstructionList &i, Operand src, Register dst, size_t size)
 {
     assert(std::holds_alternative<Memory>(src) || std::holds_alternative<PseudoAggregate>(src));
     int offset = static_cast<int>(size) - 1;
@@ -1083,7 +1110,7 @@ void ASMBuilder::CopyBytesToReg(std::list<Instruction> &i, Operand src, Register
     }
 }
 
-void ASMBuilder::CopyBytesFromReg(std::list<Instruction> &i, Register src, Operand dst, size_t size)
+void ASMBuilder::CopyBytesFromReg(InstructionList &i, Register src, Operand dst, size_t size)
 {
     assert(std::holds_alternative<Memory>(dst) || std::holds_alternative<PseudoAggregate>(dst));
     size_t offset = 0;
@@ -26,6 +26,7 @@ public:
     Operand operator()(const tac::Jump &) override;
     Operand operator()(const tac::JumpIfZero &) override;
     Operand operator()(const tac::JumpIfNotZero &) override;
+    Operand operator()(const tac::JumpTable &) override;
     Operand operator()(const tac::Label &) override;
     Operand operator()(const tac::Constant &) override;
     Operand operator()(const tac::Variant &) override;
@@ -40,6 +41,7 @@ public:
     Operand operator()(const tac::AddPtr &) override;
     Operand operator()(const tac::CopyToOffset &) override;
     Operand operator()(const tac::CopyFromOffset &) override;
+    Operand operator()(const tac::Phi &) override;
     Operand operator()(const tac::FunctionDefinition &) override;
     Operand operator()(const tac::StaticVariable &) override;
     Operand operator()(const tac::StaticConstant &) override;
@@ -52,24 +54,24 @@ public:
         const std::list<tac::TopLevel> &top_level,
         std::list<TopLevel> &top_level_out);
     void ConvertFunctionBody(
-        const std::string &name,
-        const std::list<tac::CFGBlock> &tac_blocks,
-        std::list<CFGBlock> &block_list_out);
+        Symbol name,
+        const tac::CFG &tac_blocks,
+        CFG &block_list_out);
 
 private:
     Type GetType(const tac::Value &);
     BasicType GetBasicType(const tac::Value &);
     WordType GetWordType(const tac::Value &);
-    TypeTable::AggregateEntry *GetAggregateEntry(const std::string *name);
-    void Comment(std::list<Instruction> &i, const std::string &text);
-    std::string AddConstant(const ConstantValue &c, const std::string &name);
-    std::set<std::string> AliasedVariables();
+    TypeTable::AggregateEntry *GetAggregateEntry(const Symbol *name);
+    void Comment(InstructionList &i, const std::string &text);
+    Symbol AddConstant(const ConstantValue &c, Symbol name);
+    std::set<Symbol> AliasedVariables();
 
     // Copy between Memory and PseudoAggregate operands in a specified size
-    void CopyBytes(std::list<Instruction> &i, Operand src, Operand dst, size_t size);
+    void CopyBytes(InstructionList &i, Operand src, Operand dst, size_t size);
     // Only for copying irregular size structs between register and memory
-    void CopyBytesToReg(std::list<Instruction> &i, Operand src, Register dst, size_t size);
-    void CopyBytesFromReg(std::list<Instruction> &i, Register src, Operand dst, size_t size);
+    void CopyBytesToReg(InstructionList &i, Operand src, Register dst, size_t size);
+    void CopyBytesFromReg(InstructionList &i, Register src, Operand dst, size_t size);
 
     bool m_commentsEnabled = true;
     // Functions, static variables and constants of the translation unit
@@ -77,11 +79,11 @@ private:
     // Building blocks for a Control Flow Graph
     // The first block is built immediately at Function creation
     size_t m_nextBlockId = 2;
-    std::list<CFGBlock> *m_blocks;
+    CFG *m_blocks;
     // Storing the instructions of the currently built CFGBlock
-    std::list<Instruction> m_instructions;
+    InstructionList m_instructions;
     // Aliased vars of the function are needed later by the register allocator
-    std::set<std::string> m_aliasedVars;
+    std::set<Symbol> m_aliasedVars;
 
     // Add instruction to the currently built CFGBlock
     template <typename T>
@@ -94,6 +96,7 @@ private:
             m_instructions.emplace_back(std::forward<T>(instruction));
         } else if constexpr (std::same_as<U, Jmp>
             || std::same_as<U, JmpCC>
+            || std::same_as<U, JmpIndirect>
             || std::same_as<U, Ret>) {
             m_instructions.emplace_back(std::forward<T>(instruction));
             CommitBlock();
@@ -111,7 +114,7 @@ private:
     TypeTable *m_typeTable;
     SymbolTable *m_symbolTable;
     ASMSymbolTable *m_asmSymbolTable;
-    std::string m_currentFunctionName;
+    Symbol m_currentFunctionName;
     // Keep track of static constants and their IDs to avoid duplications
     std::shared_ptr<ConstantMap> m_constants;
 };
@@ -9,14 +9,14 @@ static bool isZeroImmediate(const Operand &op)
     return false;
 }
 
-const std::string *getString(const tac::Value &value)
+const Symbol *getSymbol(const tac::Value &value)
 {
     if (auto *var = std::get_if<tac::Variant>(&value))
         return &var->name;
     return nullptr;
 }
 
-const std::string *getString(const Operand &op)
+const Symbol *getSymbol(const Operand &op)
 {
     if (const Pseudo *p = std::get_if<Pseudo>(&op))
         return &p->name;
@@ -64,7 +64,7 @@ ClassifiedReturn classifyReturnValue(
         else {
             size_t offset = 0;
             for (auto &c : classes) {
-                Operand op = PseudoAggregate{ *getString(operand), offset };
+                Operand op = PseudoAggregate{ *getSymbol(operand), offset };
                 if (c == SSE)
                     ret.double_values.push_back(op);
                 else if (c == INTEGER) {
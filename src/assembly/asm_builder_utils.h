@@ -6,8 +6,8 @@
 
 namespace assembly {
 
-const std::string *getString(const tac::Value &value);
-const std::string *getString(const Operand &op);
+const Symbol *getSymbol(const tac::Value &value);
+const Symbol *getSymbol(const Operand &op);
 
 AssemblyType getAggregatePartType(size_t offset, size_t size);
 
@@ -66,7 +66,7 @@ ClassifiedParams classifyParameters(
             std::vector<Operand> tentative_doubles;
             size_t offset = 0;
             for (auto &c : classes) {
-                Operand pseudo = PseudoAggregate{ *getString(operand), offset };
+                Operand pseudo = PseudoAggregate{ *getSymbol(operand), offset };
                 if (c == SSE)
                     tentative_doubles.push_back(pseudo);
                 else {
@@ -91,7 +91,7 @@ ClassifiedParams classifyParameters(
         if (use_stack) {
             size_t offset = 0;
             for (auto &c : classes) {
-                Operand pseudo = PseudoAggregate{ *getString(operand), offset };
+                Operand pseudo = PseudoAggregate{ *getSymbol(operand), offset };
                 AssemblyType part_type;
                 if (c == SSE)
                     part_type = AssemblyType{ WordType::Doubleword };
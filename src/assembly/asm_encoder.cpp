@@ -0,0 +1,898 @@
+#include "asm_encoder.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace assembly {
+
+// Hardware register numbers in the order of ASM_REGISTER_LIST
+static constexpr uint8_t s_registerNumbers[] = {
+    0, 3, 1, 2, 7, 6, // AX, BX, CX, DX, DI, SI
+    8, 9, 10, 11, 12, 13, 14, 15, // R8 - R15
+    4, 5, // SP, BP
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, // XMM0 - XMM15
+};
+
+static uint8_t registerNumber(Register reg)
+{
+    return s_registerNumbers[reg];
+}
+
+static bool isXMM(Register reg)
+{
+    return reg >= XMM0;
+}
+
+static bool fitsInt8(int64_t value)
+{
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool fitsInt32(int64_t value)
+{
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static uint8_t conditionCode(const std::string &code)
+{
+    static const std::map<std::string, uint8_t> s_codes = {
+        { "o", 0 }, { "no", 1 },
+        { "b", 2 }, { "c", 2 }, { "nae", 2 },
+        { "ae", 3 }, { "nb", 3 }, { "nc", 3 },
+        { "e", 4 }, { "z", 4 }, { "ne", 5 }, { "nz", 5 },
+        { "be", 6 }, { "na", 6 }, { "a", 7 }, { "nbe", 7 },
+        { "s", 8 }, { "ns", 9 },
+        { "p", 10 }, { "pe", 10 }, { "np", 11 }, { "po", 11 },
+        { "l", 12 }, { "nge", 12 }, { "ge", 13 }, { "nl", 13 },
+        { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 },
+    };
+    auto it = s_codes.find(code);
+    if (it == s_codes.end())
+        throw std::runtime_error("Unknown condition code: " + code);
+    return it->second;
+}
+
+static uint8_t modRM(uint8_t mod, uint8_t reg, uint8_t rm)
+{
+    return static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+void ASMEncoder::operator()(const Reg &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const Imm &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const Pseudo &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const PseudoAggregate &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const Memory &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const Data &)
+{
+    assert(false);
+}
+
+void ASMEncoder::operator()(const Indexed &)
+{
+    assert(false);
+}
+
+void ASMEncoder::EmitRex(bool w, uint8_t reg, uint8_t index, uint8_t base, bool force)
+{
+    uint8_t rex = static_cast<uint8_t>(0x40
+        | (w ? 0x08 : 0)
+        | ((reg >> 3) << 2)
+        | ((index >> 3) << 1)
+        | (base >> 3));
+    if (rex != 0x40 || force)
+        m_code.push_back(rex);
+}
+
+void ASMEncoder::EmitImmediate(int64_t value, size_t size)
+{
+    uint64_t bits = static_cast<uint64_t>(value);
+    for (size_t i = 0; i < size; ++i)
+        m_code.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+}
+
+void ASMEncoder::Emit(const Encoding &encoding, const Operand &rm)
+{
+    uint8_t base = 0;
+    uint8_t index = 0;
+    // SPL, BPL, SIL and DIL instead of AH, CH, DH and BH
+    bool force_rex = encoding.byte_reg && encoding.reg >= 4 && encoding.reg < 8;
+    if (const Reg *r = std::get_if<Reg>(&rm)) {
+        base = registerNumber(r->reg);
+        force_rex |= encoding.byte_rm && !isXMM(r->reg) && base >= 4 && base < 8;
+    } else if (const Memory *m = std::get_if<Memory>(&rm))
+        base = registerNumber(m->reg);
+    else if (const Indexed *i = std::get_if<Indexed>(&rm)) {
+        base = registerNumber(i->base);
+        index = registerNumber(i->index);
+    }
+
+    if (encoding.prefix)
+        m_code.push_back(encoding.prefix);
+    EmitRex(encoding.rex_w, encoding.reg, index, base, force_rex);
+    m_code.insert(m_code.end(), encoding.opcode.begin(), encoding.opcode.end());
+
+    const Data *data = std::get_if<Data>(&rm);
+    size_t displacement = 0;
+    if (std::holds_alternative<Reg>(rm))
+        m_code.push_back(modRM(3, encoding.reg, base));
+    else if (const Memory *m = std::get_if<Memory>(&rm)) {
+        // [rbp] and [r13] can only be addressed with a displacement,
+        // [rsp] and [r12] need a SIB byte
+        uint8_t mod = 2;
+        if (m->offset == 0 && (base & 7) != 5)
+            mod = 0;
+        else if (fitsInt8(m->offset))
+            mod = 1;
+        m_code.push_back(modRM(mod, encoding.reg, base));
+        if ((base & 7) == 4)
+            m_code.push_back(0x24);
+        if (mod == 1)
+            EmitImmediate(m->offset, 1);
+        else if (mod == 2)
+            EmitImmediate(m->offset, 4);
+    } else if (const Indexed *i = std::get_if<Indexed>(&rm)) {
+        uint8_t scale = 0;
+        switch (i->scale) {
+        case 1: scale = 0; break;
+        case 2: scale = 1; break;
+        case 4: scale = 2; break;
+        case 8: scale = 3; break;
+        default:
+            throw std::runtime_error("Invalid scale: " + std::to_string(i->scale));
+        }
+        uint8_t mod = (base & 7) == 5 ? 1 : 0;
+        m_code.push_back(modRM(mod, encoding.reg, 4));
+        m_code.push_back(modRM(scale, index, base));
+        if (mod == 1)
+            m_code.push_back(0);
+    } else if (data) {
+        // RIP-relative
+        m_code.push_back(modRM(0, encoding.reg, 5));
+        displacement = m_code.size();
+        EmitImmediate(0, 4);
+        m_references.insert(data->name);
+    } else
+        throw std::runtime_error("Operand can't be encoded");
+
+    EmitImmediate(encoding.imm, encoding.imm_size);
+
+    // The displacement is relative to the end of the instruction
+    if (data) {
+        int64_t addend = static_cast<int64_t>(data->offset)
+            - static_cast<int64_t>(m_code.size() - displacement);
+        AddRelocation(displacement, data->name, ObjectFile::PCRelative32, addend);
+    }
+}
+
+void ASMEncoder::EmitJump(Symbol label, uint8_t short_opcode, std::vector<uint8_t> long_opcode)
+{
+    JumpSite site;
+    site.label = label;
+    site.start = m_code.size();
+    site.is_short = m_jumps.size() < m_shortJumps.size() && m_shortJumps[m_jumps.size()];
+    if (site.is_short) {
+        m_code.push_back(short_opcode);
+        site.displacement = m_code.size();
+        EmitImmediate(0, 1);
+    } else {
+        m_code.insert(m_code.end(), long_opcode.begin(), long_opcode.end());
+        site.displacement = m_code.size();
+        EmitImmediate(0, 4);
+    }
+    site.end = m_code.size();
+    m_jumps.push_back(std::move(site));
+}
+
+void ASMEncoder::EmitArithmetic(uint8_t extension, const Operand &src, const Operand &dst, WordType type)
+{
+    Encoding e;
+    e.rex_w = type == Quadword;
+    bool byte = type == Byte;
+    const Imm *imm = std::get_if<Imm>(&src);
+    if (imm && AX == dst && (byte || !fitsInt8(imm->value))) {
+        // Shorter form for the accumulator, without a ModRM byte
+        EmitRex(e.rex_w, 0, 0, 0);
+        m_code.push_back(static_cast<uint8_t>(extension * 8 + (byte ? 4 : 5)));
+        EmitImmediate(imm->value, byte ? 1 : 4);
+    } else if (imm) {
+        e.reg = extension;
+        e.byte_rm = byte;
+        e.imm = imm->value;
+        if (byte) {
+            e.opcode = { 0x80 };
+            e.imm_size = 1;
+        } else if (fitsInt8(imm->value)) {
+            e.opcode = { 0x83 };
+            e.imm_size = 1;
+        } else {
+            e.opcode = { 0x81 };
+            e.imm_size = 4;
+        }
+        Emit(e, dst);
+    } else if (const Reg *src_reg = std::get_if<Reg>(&src)) {
+        e.opcode = { static_cast<uint8_t>(extension * 8 + (byte ? 0 : 1)) };
+        e.reg = registerNumber(src_reg->reg);
+        e.byte_reg = e.byte_rm = byte;
+        Emit(e, dst);
+    } else if (const Reg *dst_reg = std::get_if<Reg>(&dst)) {
+        e.opcode = { static_cast<uint8_t>(extension * 8 + (byte ? 2 : 3)) };
+        e.reg = registerNumber(dst_reg->reg);
+        e.byte_reg = e.byte_rm = byte;
+        Emit(e, src);
+    } else
+        throw std::runtime_error("Invalid operands of an arithmetic instruction");
+}
+
+void ASMEncoder::AddRelocation(size_t offset, Symbol symbol, ObjectFile::RelocationType type, int64_t addend)
+{
+    ObjectFile::Relocation relocation;
+    relocation.section = ObjectFile::Text;
+    relocation.offset = offset;
+    relocation.symbol = symbol.str();
+    relocation.type = type;
+    relocation.addend = addend;
+    m_codeRelocations.push_back(std::move(relocation));
+}
+
+void ASMEncoder::DefineSymbol(Symbol name, ObjectFile::SectionId section, uint64_t value, bool global, bool function)
+{
+    ObjectFile::Symbol symbol;
+    symbol.name = name.str();
+    symbol.section = section;
+    symbol.value = value;
+    symbol.global = global;
+    symbol.function = function;
+    m_symbolIndex[name] = m_object.symbols.size();
+    m_object.symbols.push_back(std::move(symbol));
+}
+
+void ASMEncoder::AlignSection(ObjectFile::SectionId section_id, size_t alignment)
+{
+    ObjectFile::Section &section = m_object.sections[section_id];
+    section.alignment = std::max(section.alignment, alignment);
+    if (section_id == ObjectFile::Bss) {
+        section.size = (section.size + alignment - 1) / alignment * alignment;
+        return;
+    }
+    while (section.bytes.size() % alignment)
+        section.bytes.push_back(0);
+}
+
+void ASMEncoder::EmitInitializer(const ConstantValue &init, ObjectFile::SectionId section_id)
+{
+    ObjectFile::Section &section = m_object.sections[section_id];
+    std::vector<uint8_t> &bytes = section.bytes;
+
+    // Custom types
+    if (const ZeroBytes *zero = std::get_if<ZeroBytes>(&init)) {
+        if (section_id == ObjectFile::Bss)
+            section.size += zero->bytes;
+        else
+            bytes.insert(bytes.end(), zero->bytes, 0);
+        return;
+    }
+
+    if (const StringInit *string = std::get_if<StringInit>(&init)) {
+        bytes.insert(bytes.end(), string->text.begin(), string->text.end());
+        if (string->null_terminated)
+            bytes.push_back(0);
+        return;
+    }
+
+    if (const PointerInit *pointer = std::get_if<PointerInit>(&init)) {
+        if (section_id != ObjectFile::Data)
+            throw std::runtime_error("Pointer initializer outside of .data: " + pointer->name);
+        ObjectFile::Relocation relocation;
+        relocation.section = section_id;
+        relocation.offset = bytes.size();
+        relocation.symbol = pointer->name;
+        relocation.type = ObjectFile::Absolute64;
+        m_object.relocations.push_back(std::move(relocation));
+        m_references.insert(pointer->name);
+        bytes.insert(bytes.end(), 8, 0);
+        return;
+    }
+
+    // Atomic types
+    Type type = getType(init);
+    size_t size = GetBytesOfWordType(type.wordType());
+    if (section_id == ObjectFile::Bss) {
+        section.size += size;
+        return;
+    }
+    uint64_t bits = 0;
+    if (isPositiveZero(init))
+        bits = 0;
+    else if (const double *d = std::get_if<double>(&init)) {
+        if (isNan(init))
+            bits = 0x7ff8000000000000;
+        else
+            std::memcpy(&bits, d, sizeof(bits));
+    } else
+        bits = castTo<uint64_t>(init);
+    for (size_t i = 0; i < size; ++i)
+        bytes.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+}
+
+void ASMEncoder::operator()(const Comment &)
+{
+}
+
+void ASMEncoder::operator()(const Mov &m)
+{
+    const Reg *src_reg = std::get_if<Reg>(&m.src);
+    const Reg *dst_reg = std::get_if<Reg>(&m.dst);
+    bool src_xmm = src_reg && isXMM(src_reg->reg);
+    bool dst_xmm = dst_reg && isXMM(dst_reg->reg);
+
+    Encoding e;
+    if (m.type == Doubleword) {
+        // movsd
+        e.prefix = 0xF2;
+        if (dst_xmm) {
+            e.opcode = { 0x0F, 0x10 };
+            e.reg = registerNumber(dst_reg->reg);
+            Emit(e, m.src);
+        } else if (src_xmm) {
+            e.opcode = { 0x0F, 0x11 };
+            e.reg = registerNumber(src_reg->reg);
+            Emit(e, m.dst);
+        } else
+            throw std::runtime_error("movsd without an XMM register");
+        return;
+    }
+
+    if (src_xmm || dst_xmm) {
+        if (src_xmm && dst_xmm) {
+            // movq xmm, xmm
+            e.prefix = 0xF3;
+            e.opcode = { 0x0F, 0x7E };
+            e.reg = registerNumber(dst_reg->reg);
+            Emit(e, m.src);
+            return;
+        }
+        // movd / movq between general purpose and XMM registers
+        e.prefix = 0x66;
+        e.rex_w = m.type == Quadword;
+        if (dst_xmm) {
+            e.opcode = { 0x0F, 0x6E };
+            e.reg = registerNumber(dst_reg->reg);
+            Emit(e, m.src);
+        } else {
+            e.opcode = { 0x0F, 0x7E };
+            e.reg = registerNumber(src_reg->reg);
+            Emit(e, m.dst);
+        }
+        return;
+    }
+
+    bool byte = m.type == Byte;
+    e.rex_w = m.type == Quadword;
+    if (const Imm *imm = std::get_if<Imm>(&m.src)) {
+        if (dst_reg && (m.type != Quadword || !fitsInt32(imm->value))) {
+            // The register is encoded in the opcode
+            uint8_t r = registerNumber(dst_reg->reg);
+            EmitRex(e.rex_w, 0, 0, r, byte && r >= 4 && r < 8);
+            m_code.push_back(static_cast<uint8_t>((byte ? 0xB0 : 0xB8) + (r & 7)));
+            EmitImmediate(imm->value, GetBytesOfWordType(m.type));
+            return;
+        }
+        e.opcode = { static_cast<uint8_t>(byte ? 0xC6 : 0xC7) };
+        e.byte_rm = byte;
+        e.imm = imm->value;
+        e.imm_size = byte ? 1 : 4;
+        Emit(e, m.dst);
+    } else if (src_reg) {
+        e.opcode = { static_cast<uint8_t>(byte ? 0x88 : 0x89) };
+        e.reg = registerNumber(src_reg->reg);
+        e.byte_reg = e.byte_rm = byte;
+        Emit(e, m.dst);
+    } else if (dst_reg) {
+        e.opcode = { static_cast<uint8_t>(byte ? 0x8A : 0x8B) };
+        e.reg = registerNumber(dst_reg->reg);
+        e.byte_reg = e.byte_rm = byte;
+        Emit(e, m.src);
+    } else
+        throw std::runtime_error("mov between two memory operands");
+}
+
+void ASMEncoder::operator()(const Movsx &m)
+{
+    const Reg *dst = std::get_if<Reg>(&m.dst);
+    if (!dst)
+        throw std::runtime_error("movsx into memory");
+    Encoding e;
+    e.rex_w = m.dst_type == Quadword;
+    e.reg = registerNumber(dst->reg);
+    if (m.src_type == Byte) {
+        e.opcode = { 0x0F, 0xBE };
+        e.byte_rm = true;
+    } else if (m.src_type == Longword && m.dst_type == Quadword)
+        e.opcode = { 0x63 }; // movslq
+    else
+        throw std::runtime_error("Invalid movsx operand types");
+    Emit(e, m.src);
+}
+
+void ASMEncoder::operator()(const MovZeroExtend &m)
+{
+    const Reg *dst = std::get_if<Reg>(&m.dst);
+    if (!dst || m.src_type != Byte)
+        throw std::runtime_error("Invalid movzx operands");
+    Encoding e;
+    e.rex_w = m.dst_type == Quadword;
+    e.reg = registerNumber(dst->reg);
+    e.opcode = { 0x0F, 0xB6 };
+    e.byte_rm = true;
+    Emit(e, m.src);
+}
+
+void ASMEncoder::operator()(const Lea &l)
+{
+    const Reg *dst = std::get_if<Reg>(&l.dst);
+    if (!dst)
+        throw std::runtime_error("lea into memory");
+    Encoding e;
+    e.rex_w = true;
+    e.opcode = { 0x8D };
+    e.reg = registerNumber(dst->reg);
+    Emit(e, l.src);
+}
+
+void ASMEncoder::operator()(const Cvttsd2si &c)
+{
+    const Reg *dst = std::get_if<Reg>(&c.dst);
+    if (!dst)
+        throw std::runtime_error("cvttsd2si into memory");
+    Encoding e;
+    e.prefix = 0xF2;
+    e.rex_w = c.type == Quadword;
+    e.opcode = { 0x0F, 0x2C };
+    e.reg = registerNumber(dst->reg);
+    Emit(e, c.src);
+}
+
+void ASMEncoder::operator()(const Cvtsi2sd &c)
+{
+    const Reg *dst = std::get_if<Reg>(&c.dst);
+    if (!dst)
+        throw std::runtime_error("cvtsi2sd into memory");
+    Encoding e;
+    e.prefix = 0xF2;
+    e.rex_w = c.type == Quadword;
+    e.opcode = { 0x0F, 0x2A };
+    e.reg = registerNumber(dst->reg);
+    Emit(e, c.src);
+}
+
+void ASMEncoder::operator()(const Ret &)
+{
+    // Epilogue: movq %rbp, %rsp; popq %rbp; ret
+    m_code.insert(m_code.end(), { 0x48, 0x89, 0xEC, 0x5D, 0xC3 });
+}
+
+void ASMEncoder::operator()(const Unary &u)
+{
+    bool byte = u.type == Byte;
+    Encoding e;
+    e.rex_w = u.type == Quadword;
+    e.byte_rm = byte;
+    switch (u.op) {
+    case Neg_AU:
+    case Not_AU:
+        e.opcode = { static_cast<uint8_t>(byte ? 0xF6 : 0xF7) };
+        e.reg = u.op == Neg_AU ? 3 : 2;
+        break;
+    case Shl_AU:
+    case Shr_AU:
+        e.opcode = { static_cast<uint8_t>(byte ? 0xD0 : 0xD1) };
+        e.reg = u.op == Shl_AU ? 4 : 5;
+        break;
+    case Unknown_AU:
+        throw std::runtime_error("Unknown unary operator");
+    }
+    Emit(e, u.src);
+}
+
+void ASMEncoder::operator()(const Binary &b)
+{
+    const Reg *dst = std::get_if<Reg>(&b.dst);
+    Encoding e;
+    if (b.type == Doubleword) {
+        if (!dst)
+            throw std::runtime_error("Floating point operation into memory");
+        e.prefix = 0xF2;
+        e.reg = registerNumber(dst->reg);
+        switch (b.op) {
+        case Add_AB: e.opcode = { 0x0F, 0x58 }; break;
+        case Sub_AB: e.opcode = { 0x0F, 0x5C }; break;
+        case Mult_AB: e.opcode = { 0x0F, 0x59 }; break;
+        case DivDouble_AB: e.opcode = { 0x0F, 0x5E }; break;
+        case BWXor_AB:
+            // xorpd
+            e.prefix = 0x66;
+            e.opcode = { 0x0F, 0x57 };
+            break;
+        case Unknown_AB:
+        case ShiftL_AB:
+        case ShiftRU_AB:
+        case ShiftRS_AB:
+        case BWAnd_AB:
+        case BWOr_AB:
+            throw std::runtime_error("Invalid floating point operator: " + toString(b.op, b.type));
+        }
+        Emit(e, b.src);
+        return;
+    }
+
+    e.rex_w = b.type == Quadword;
+    e.byte_rm = b.type == Byte;
+    switch (b.op) {
+    case Add_AB: EmitArithmetic(0, b.src, b.dst, b.type); break;
+    case BWOr_AB: EmitArithmetic(1, b.src, b.dst, b.type); break;
+    case BWAnd_AB: EmitArithmetic(4, b.src, b.dst, b.type); break;
+    case Sub_AB: EmitArithmetic(5, b.src, b.dst, b.type); break;
+    case BWXor_AB: EmitArithmetic(6, b.src, b.dst, b.type); break;
+    case Mult_AB:
+        if (!dst)
+            throw std::runtime_error("imul into memory");
+        e.byte_rm = false;
+        e.reg = registerNumber(dst->reg);
+        if (const Imm *imm = std::get_if<Imm>(&b.src)) {
+            e.imm = imm->value;
+            e.imm_size = fitsInt8(imm->value) ? 1 : 4;
+            e.opcode = { static_cast<uint8_t>(e.imm_size == 1 ? 0x6B : 0x69) };
+            Emit(e, b.dst);
+        } else {
+            e.opcode = { 0x0F, 0xAF };
+            Emit(e, b.src);
+        }
+        break;
+    case ShiftL_AB:
+    case ShiftRU_AB:
+    case ShiftRS_AB:
+        e.reg = b.op == ShiftL_AB ? 4 : (b.op == ShiftRU_AB ? 5 : 7);
+        if (const Imm *imm = std::get_if<Imm>(&b.src); imm && imm->value == 1)
+            e.opcode = { static_cast<uint8_t>(e.byte_rm ? 0xD0 : 0xD1) };
+        else if (imm) {
+            e.opcode = { static_cast<uint8_t>(e.byte_rm ? 0xC0 : 0xC1) };
+            e.imm = imm->value;
+            e.imm_size = 1;
+        } else if (CX == b.src)
+            e.opcode = { static_cast<uint8_t>(e.byte_rm ? 0xD2 : 0xD3) };
+        else
+            throw std::runtime_error("Shift count has to be an immediate or CL");
+        Emit(e, b.dst);
+        break;
+    case DivDouble_AB:
+    case Unknown_AB:
+        throw std::runtime_error("Invalid integer operator: " + toString(b.op, b.type));
+    }
+}
+
+void ASMEncoder::operator()(const Idiv &i)
+{
+    Encoding e;
+    e.rex_w = i.type == Quadword;
+    e.byte_rm = i.type == Byte;
+    e.opcode = { static_cast<uint8_t>(e.byte_rm ? 0xF6 : 0xF7) };
+    e.reg = 7;
+    Emit(e, i.src);
+}
+
+void ASMEncoder::operator()(const Div &d)
+{
+    Encoding e;
+    e.rex_w = d.type == Quadword;
+    e.byte_rm = d.type == Byte;
+    e.opcode = { static_cast<uint8_t>(e.byte_rm ? 0xF6 : 0xF7) };
+    e.reg = 6;
+    Emit(e, d.src);
+}
+
+void ASMEncoder::operator()(const Cdq &c)
+{
+    // cdq or cqo
+    if (c.type != Longword)
+        m_code.push_back(0x48);
+    m_code.push_back(0x99);
+}
+
+void ASMEncoder::operator()(const Cmp &c)
+{
+    if (c.type == Doubleword) {
+        // comisd
+        const Reg *rhs = std::get_if<Reg>(&c.rhs);
+        if (!rhs)
+            throw std::runtime_error("comisd with a memory operand on the right");
+        Encoding e;
+        e.prefix = 0x66;
+        e.opcode = { 0x0F, 0x2F };
+        e.reg = registerNumber(rhs->reg);
+        Emit(e, c.lhs);
+        return;
+    }
+    EmitArithmetic(7, c.lhs, c.rhs, c.type);
+}
+
+void ASMEncoder::operator()(const Test &t)
+{
+    // test r/m, reg
+    const Reg *lhs = std::get_if<Reg>(&t.lhs);
+    if (!lhs)
+        throw std::runtime_error("test with a memory operand on the left");
+    bool byte = t.type == Byte;
+    Encoding e;
+    e.rex_w = t.type == Quadword;
+    e.opcode = { static_cast<uint8_t>(byte ? 0x84 : 0x85) };
+    e.reg = registerNumber(lhs->reg);
+    e.byte_reg = e.byte_rm = byte;
+    Emit(e, t.rhs);
+}
+
+void ASMEncoder::operator()(const Jmp &j)
+{
+    EmitJump(j.identifier, 0xEB, { 0xE9 });
+}
+
+void ASMEncoder::operator()(const JmpCC &j)
+{
+    uint8_t cc = conditionCode(j.cond_code);
+    EmitJump(j.identifier,
+        static_cast<uint8_t>(0x70 + cc),
+        { 0x0F, static_cast<uint8_t>(0x80 + cc) });
+}
+
+void ASMEncoder::operator()(const JmpIndirect &j)
+{
+    // jmp *target
+    Encoding e;
+    e.opcode = { 0xFF };
+    e.reg = 4;
+    Emit(e, j.target);
+    m_jumpTables.push_back(&j);
+}
+
+void ASMEncoder::operator()(const SetCC &s)
+{
+    Encoding e;
+    e.opcode = { 0x0F, static_cast<uint8_t>(0x90 + conditionCode(s.cond_code)) };
+    e.byte_rm = true;
+    Emit(e, s.op);
+}
+
+void ASMEncoder::operator()(const Label &l)
+{
+    m_labels[l.identifier] = m_code.size();
+}
+
+void ASMEncoder::operator()(const Push &p)
+{
+    if (const Reg *r = std::get_if<Reg>(&p.op)) {
+        uint8_t number = registerNumber(r->reg);
+        EmitRex(false, 0, 0, number);
+        m_code.push_back(static_cast<uint8_t>(0x50 + (number & 7)));
+    } else if (const Imm *imm = std::get_if<Imm>(&p.op)) {
+        bool short_imm = fitsInt8(imm->value);
+        m_code.push_back(short_imm ? 0x6A : 0x68);
+        EmitImmediate(imm->value, short_imm ? 1 : 4);
+    } else {
+        Encoding e;
+        e.opcode = { 0xFF };
+        e.reg = 6;
+        Emit(e, p.op);
+    }
+}
+
+void ASMEncoder::operator()(const Pop &p)
+{
+    uint8_t number = registerNumber(p.reg);
+    EmitRex(false, 0, 0, number);
+    m_code.push_back(static_cast<uint8_t>(0x58 + (number & 7)));
+}
+
+void ASMEncoder::operator()(const Call &c)
+{
+    m_code.push_back(0xE8);
+    AddRelocation(m_code.size(), c.identifier, ObjectFile::PLT32, -4);
+    EmitImmediate(0, 4);
+    m_references.insert(c.identifier);
+}
+
+void ASMEncoder::operator()(const Function &f)
+{
+    auto encode = [&]() {
+        m_code.clear();
+        m_codeRelocations.clear();
+        m_labels.clear();
+        m_jumps.clear();
+        m_jumpTables.clear();
+
+        // Prologue: pushq %rbp; movq %rsp, %rbp; subq $n, %rsp
+        m_code.insert(m_code.end(), { 0x55, 0x48, 0x89, 0xE5 });
+        if (f.stack_size) {
+            Encoding e;
+            e.rex_w = true;
+            e.reg = 5;
+            e.imm = f.stack_size;
+            e.imm_size = fitsInt8(f.stack_size) ? 1 : 4;
+            e.opcode = { static_cast<uint8_t>(e.imm_size == 1 ? 0x83 : 0x81) };
+            Emit(e, Reg{ SP, 8 });
+        }
+
+        for (auto &block : f.blocks) {
+            for (auto &i : block.instructions)
+                std::visit(*this, i);
+        }
+    };
+    auto target = [&](const JumpSite &jump) -> int64_t {
+        auto it = m_labels.find(jump.label);
+        if (it == m_labels.end())
+            throw std::runtime_error("Undefined label: " + jump.label.str());
+        return static_cast<int64_t>(it->second) - static_cast<int64_t>(jump.end);
+    };
+
+    // A long jump would reach its target from the end of the short form
+    // (2 bytes): the labels after it move back by the same amount, but the
+    // displacement of a backward jump grows by the bytes saved
+    auto short_target = [&](const JumpSite &jump) -> int64_t {
+        int64_t displacement = target(jump);
+        if (displacement < 0)
+            displacement += static_cast<int64_t>(jump.end - jump.start) - 2;
+        return displacement;
+    };
+
+    // Every jump is encoded with a 32-bit displacement first, then the ones
+    // reaching their target with 8 bits are shortened until nothing changes.
+    // Shortening only brings the labels closer, so short jumps stay short.
+    m_shortJumps.clear();
+    encode();
+    while (true) {
+        std::vector<bool> short_jumps;
+        bool changed = false;
+        for (const JumpSite &jump : m_jumps) {
+            short_jumps.push_back(jump.is_short || fitsInt8(short_target(jump)));
+            changed |= short_jumps.back() != jump.is_short;
+        }
+        if (!changed)
+            break;
+        m_shortJumps = std::move(short_jumps);
+        encode();
+    }
+
+    for (const JumpSite &jump : m_jumps) {
+        uint64_t bits = static_cast<uint64_t>(target(jump));
+        for (size_t i = 0; i < (jump.is_short ? 1u : 4u); ++i)
+            m_code[jump.displacement + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+
+    std::vector<uint8_t> &text = m_object.sections[ObjectFile::Text].bytes;
+    size_t start = text.size();
+    DefineSymbol(f.name, ObjectFile::Text, start, f.global, true);
+    m_object.symbols.back().size = m_code.size();
+    text.insert(text.end(), m_code.begin(), m_code.end());
+    for (ObjectFile::Relocation &relocation : m_codeRelocations) {
+        relocation.offset += start;
+        m_object.relocations.push_back(std::move(relocation));
+    }
+
+    // The entries of the jump tables are the offsets of the targets from the
+    // table, relocated against the function: S + A - P = target - table
+    // when the addend is the target's offset in the function plus the
+    // entry's offset in the table.
+    std::vector<uint8_t> &rodata = m_object.sections[ObjectFile::ROData].bytes;
+    for (const JmpIndirect *jump : m_jumpTables) {
+        AlignSection(ObjectFile::ROData, 4);
+        size_t table_start = rodata.size();
+        DefineSymbol(jump->table, ObjectFile::ROData, table_start, false, false);
+        for (Symbol label : jump->targets) {
+            auto it = m_labels.find(label);
+            if (it == m_labels.end())
+                throw std::runtime_error("Undefined label: " + label.str());
+            ObjectFile::Relocation relocation;
+            relocation.section = ObjectFile::ROData;
+            relocation.offset = rodata.size();
+            relocation.symbol = f.name.str();
+            relocation.type = ObjectFile::PCRelative32;
+            relocation.addend = static_cast<int64_t>(it->second + rodata.size() - table_start);
+            m_object.relocations.push_back(std::move(relocation));
+            rodata.insert(rodata.end(), 4, 0);
+        }
+        m_object.symbols.back().size = rodata.size() - table_start;
+    }
+}
+
+void ASMEncoder::operator()(const StaticVariable &s)
+{
+    bool isZero = std::ranges::all_of(s.list, [&](ConstantValue v) {
+        return std::holds_alternative<ZeroBytes>(v) || isPositiveZero(v);
+    });
+    bool isFloatingPoint = !s.list.empty() && std::holds_alternative<double>(s.list.front());
+    ObjectFile::SectionId section = (!isZero || isFloatingPoint) ? ObjectFile::Data : ObjectFile::Bss;
+
+    AlignSection(section, s.alignment);
+    auto sectionSize = [&]() {
+        const ObjectFile::Section &sec = m_object.sections[section];
+        return section == ObjectFile::Bss ? sec.size : sec.bytes.size();
+    };
+    size_t start = sectionSize();
+    DefineSymbol(s.name, section, start, s.global, false);
+    size_t index = m_object.symbols.size() - 1;
+    for (auto &i : s.list)
+        EmitInitializer(i, section);
+    m_object.symbols[index].size = sectionSize() - start;
+}
+
+void ASMEncoder::operator()(const StaticConstant &s)
+{
+    AlignSection(ObjectFile::ROData, s.alignment);
+    std::vector<uint8_t> &bytes = m_object.sections[ObjectFile::ROData].bytes;
+    size_t start = bytes.size();
+    DefineSymbol(s.name, ObjectFile::ROData, start, false, false);
+    EmitInitializer(s.init, ObjectFile::ROData);
+    m_object.symbols.back().size = bytes.size() - start;
+}
+
+void ASMEncoder::operator()(std::monostate)
+{
+    assert(false);
+}
+
+ObjectFile ASMEncoder::ToObject(const std::list<TopLevel> &top_level)
+{
+    for (auto &i : top_level)
+        std::visit(*this, i);
+
+    // Calls of the local functions are resolved here,
+    // they don't need relocations
+    std::vector<uint8_t> &text = m_object.sections[ObjectFile::Text].bytes;
+    std::erase_if(m_object.relocations, [&](const ObjectFile::Relocation &relocation) {
+        auto it = m_symbolIndex.find(relocation.symbol);
+        if (relocation.type != ObjectFile::PLT32 || it == m_symbolIndex.end())
+            return false;
+        const ObjectFile::Symbol &symbol = m_object.symbols[it->second];
+        if (symbol.global || symbol.section != ObjectFile::Text)
+            return false;
+        int64_t displacement = static_cast<int64_t>(symbol.value) + relocation.addend
+            - static_cast<int64_t>(relocation.offset);
+        uint64_t bits = static_cast<uint64_t>(displacement);
+        for (size_t i = 0; i < 4; ++i)
+            text[relocation.offset + i] = static_cast<uint8_t>(bits >> (8 * i));
+        return true;
+    });
+
+    // Symbols of the other translation units and the libraries
+    for (Symbol name : m_references) {
+        if (m_symbolIndex.contains(name))
+            continue;
+        ObjectFile::Symbol symbol;
+        symbol.name = name.str();
+        symbol.section = ObjectFile::Undefined;
+        symbol.global = true;
+        m_object.symbols.push_back(std::move(symbol));
+    }
+    return std::move(m_object);
+}
+
+}; // assembly
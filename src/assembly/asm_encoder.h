@@ -0,0 +1,101 @@
+#pragma once
+
+#include "asm_visitor.h"
+#include "object_file.h"
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace assembly {
+
+// Encodes the final x86-64 instructions into machine code,
+// the same program as the one printed by ASMPrinter
+struct ASMEncoder : public IASMVisitor<void> {
+    // Operands are encoded by their instructions
+    void operator()(const Reg &) override;
+    void operator()(const Imm &) override;
+    void operator()(const Pseudo &) override;
+    void operator()(const PseudoAggregate &) override;
+    void operator()(const Memory &) override;
+    void operator()(const Data &) override;
+    void operator()(const Indexed &) override;
+
+    void operator()(const Comment &) override;
+    void operator()(const Mov &) override;
+    void operator()(const Movsx &) override;
+    void operator()(const MovZeroExtend &) override;
+    void operator()(const Lea &) override;
+    void operator()(const Cvttsd2si &) override;
+    void operator()(const Cvtsi2sd &) override;
+    void operator()(const Ret &) override;
+    void operator()(const Unary &) override;
+    void operator()(const Binary &) override;
+    void operator()(const Idiv &) override;
+    void operator()(const Div &) override;
+    void operator()(const Cdq &) override;
+    void operator()(const Cmp &) override;
+    void operator()(const Test &) override;
+    void operator()(const Jmp &) override;
+    void operator()(const JmpCC &) override;
+    void operator()(const JmpIndirect &) override;
+    void operator()(const SetCC &) override;
+    void operator()(const Label &) override;
+    void operator()(const Push &) override;
+    void operator()(const Pop &) override;
+    void operator()(const Call &) override;
+    void operator()(const Function &) override;
+    void operator()(const StaticVariable &) override;
+    void operator()(const StaticConstant &) override;
+    void operator()(std::monostate) override;
+
+    ObjectFile ToObject(const std::list<TopLevel> &top_level);
+
+private:
+    // One instruction with a ModRM byte: [prefix] [REX] opcode ModRM [SIB] [disp] [imm]
+    struct Encoding {
+        uint8_t prefix = 0;
+        bool rex_w = false;
+        std::vector<uint8_t> opcode;
+        // Register number or opcode extension
+        uint8_t reg = 0;
+        // 1-byte register operands, SIL and DIL can only be used with a REX prefix
+        bool byte_reg = false;
+        bool byte_rm = false;
+        size_t imm_size = 0;
+        int64_t imm = 0;
+    };
+    void Emit(const Encoding &encoding, const Operand &rm);
+    void EmitRex(bool w, uint8_t reg, uint8_t index, uint8_t base, bool force = false);
+    void EmitImmediate(int64_t value, size_t size);
+    void EmitJump(Symbol label, uint8_t short_opcode, std::vector<uint8_t> long_opcode);
+    void EmitArithmetic(uint8_t extension, const Operand &src, const Operand &dst, WordType type);
+    void AddRelocation(size_t offset, Symbol symbol, ObjectFile::RelocationType type, int64_t addend);
+    void DefineSymbol(Symbol name, ObjectFile::SectionId section, uint64_t value, bool global, bool function);
+    void EmitInitializer(const ConstantValue &init, ObjectFile::SectionId section);
+    void AlignSection(ObjectFile::SectionId section, size_t alignment);
+
+    ObjectFile m_object;
+    std::unordered_map<Symbol, size_t> m_symbolIndex;
+    // Symbols referenced by the code and the data
+    std::set<Symbol> m_references;
+
+    // Code of the current function
+    std::vector<uint8_t> m_code;
+    std::vector<ObjectFile::Relocation> m_codeRelocations;
+    std::unordered_map<Symbol, size_t> m_labels;
+    struct JumpSite {
+        Symbol label;
+        // Position of the instruction, its displacement and its end
+        size_t start = 0;
+        size_t displacement = 0;
+        size_t end = 0;
+        bool is_short = false;
+    };
+    std::vector<JumpSite> m_jumps;
+    // Jumps which can be encoded with an 8-bit displacement
+    std::vector<bool> m_shortJumps;
+    // Indirect jumps of the function, their tables are emitted after it
+    std::vector<const JmpIndirect *> m_jumpTables;
+};
+
+}; // assembly
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "common/cfg.h"
 #include "common/macro.h"
 #include "common/operator.h"
+#include "common/symbol.h"
 #include "common/types.h"
 #include "common/values.h"
 #include <list>
@@ -51,15 +53,15 @@ namespace assembly {
     X(Imm, \
         int64_t value;) \
     X(Pseudo, \
-        std::string name;) \
+        Symbol name;) \
     X(PseudoAggregate, \
-        std::string name; \
+        Symbol name; \
         size_t offset;) \
     X(Memory, \
         Register reg; \
         int offset;) \
     X(Data, \
-        std::string name; \
+        Symbol name; \
         size_t offset = 0;) \
     X(Indexed, \
         Register base; \
@@ -116,36 +118,47 @@ namespace assembly {
         Operand lhs; \
         Operand rhs; \
         WordType type;) \
+    /* Created by the peephole optimizer, after the instruction fixups */ \
+    X(Test, \
+        Operand lhs; \
+        Operand rhs; \
+        WordType type;) \
     X(Jmp, \
-        std::string identifier;) \
+        Symbol identifier;) \
     X(JmpCC, \
         std::string cond_code; \
-        std::string identifier;) \
+        Symbol identifier;) \
+    /* Jumps to one of the targets through the table of their offsets */ \
+    /* from the table; the table is emitted with the instruction */ \
+    X(JmpIndirect, \
+        Operand target; \
+        Symbol table; \
+        std::vector<Symbol> targets;) \
     X(SetCC, \
         std::string cond_code; \
         Operand op;) \
     X(Label, \
-        std::string identifier;) \
+        Symbol identifier;) \
     X(Push, \
         Operand op;) \
     X(Pop, \
         Register reg;) \
     X(Call, \
-        std::string identifier;)
+        Symbol identifier;)
 
 #define ASM_TOP_LEVEL_LIST(X) \
     X(Function, \
-        std::list<CFGBlock> blocks; \
-        std::string name; \
+        CFG blocks; \
+        Symbol name; \
         bool global; \
         int stack_size;) \
     X(StaticVariable, \
-        std::string name; \
+        Symbol name; \
         bool global; \
         std::vector<ConstantValue> list; \
         size_t alignment;) \
     X(StaticConstant, \
-        std::string name; \
+        Symbol name; \
         ConstantValue init; \
         size_t alignment;)
 
@@ -155,19 +168,14 @@ enum Register {
 #undef ADD_REG_TO_ENUM
 };
 
-class CFGBlock;
-
 DEFINE_NODES_WITH_COMMON_VARIANT(Operand, ASM_OPERAND_LIST);
 DEFINE_NODES_WITH_COMMON_VARIANT(Instruction, ASM_INSTRUCTION_LIST);
-DEFINE_NODES_WITH_COMMON_VARIANT(TopLevel, ASM_TOP_LEVEL_LIST);
 
-class CFGBlock {
-public:
-    std::list<Instruction> instructions = {};
-    std::set<CFGBlock *> predecessors = {};
-    std::set<CFGBlock *> successors = {};
-    size_t id;
-};
+using InstructionList = PooledList<Instruction>;
+using CFGBlock = BasicBlock<Instruction>;
+using CFG = ControlFlowGraph<Instruction>;
+
+DEFINE_NODES_WITH_COMMON_VARIANT(TopLevel, ASM_TOP_LEVEL_LIST);
 
 inline bool operator==(const Register &reg, const Operand &op)
 {
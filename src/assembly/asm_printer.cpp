@@ -22,7 +22,7 @@ static std::string escapeString(std::string_view in)
     return out;
 }
 
-static std::string formatLabel(std::string_view name)
+static std::string formatLabel(const std::string &name)
 {
 #ifdef __APPLE__
     return std::format("_{}", name);
@@ -31,6 +31,11 @@ static std::string formatLabel(std::string_view name)
 #endif
 }
 
+static std::string formatLabel(Symbol name)
+{
+    return formatLabel(name.str());
+}
+
 std::string ASMPrinter::BuildInitializer(const ConstantValue &init)
 {
     // Custom types
@@ -252,6 +257,15 @@ void ASMPrinter::operator()(const Cmp &c)
     m_codeStream << std::endl;
 }
 
+void ASMPrinter::operator()(const Test &t)
+{
+    m_codeStream << "    " << AddSuffix("test", t.type) << " ";
+    std::visit(*this, t.lhs);
+    m_codeStream << ", ";
+    std::visit(*this, t.rhs);
+    m_codeStream << std::endl;
+}
+
 void ASMPrinter::operator()(const Jmp &j)
 {
     m_codeStream << "    jmp L" << j.identifier << std::endl;
@@ -262,6 +276,32 @@ void ASMPrinter::operator()(const JmpCC &j)
     m_codeStream << "    j" << j.cond_code << " L" << j.identifier << std::endl;
 }
 
+void ASMPrinter::operator()(const JmpIndirect &j)
+{
+    m_codeStream << "    jmp *";
+    std::visit(*this, j.target);
+    m_codeStream << std::endl;
+
+    // Offsets of the targets from the table
+#ifdef __APPLE__
+    // Mach-O keeps the jump tables in the code
+    m_codeStream << "    .p2align 2" << std::endl;
+    m_codeStream << formatLabel(j.table) << ":" << std::endl;
+    m_codeStream << "    .data_region jt32" << std::endl;
+#else
+    m_codeStream << "    .section .rodata" << std::endl;
+    m_codeStream << "    .balign 4" << std::endl;
+    m_codeStream << formatLabel(j.table) << ":" << std::endl;
+#endif
+    for (Symbol target : j.targets)
+        m_codeStream << "    .long L" << target << "-" << formatLabel(j.table) << std::endl;
+#ifdef __APPLE__
+    m_codeStream << "    .end_data_region" << std::endl;
+#else
+    m_codeStream << "    .text" << std::endl;
+#endif
+}
+
 void ASMPrinter::operator()(const SetCC &s)
 {
     m_codeStream << "    set" << s.cond_code << " ";
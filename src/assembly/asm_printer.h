@@ -32,8 +32,10 @@ struct ASMPrinter : public IASMVisitor<void> {
     void operator()(const Div &) override;
     void operator()(const Cdq &) override;
     void operator()(const Cmp &) override;
+    void operator()(const Test &) override;
     void operator()(const Jmp &) override;
     void operator()(const JmpCC &) override;
+    void operator()(const JmpIndirect &) override;
     void operator()(const SetCC &) override;
     void operator()(const Label &) override;
     void operator()(const Push &) override;
@@ -60,7 +60,7 @@ void ASMSymbolTable::InsertConstants(std::shared_ptr<ConstantMap> constants)
     }
 }
 
-bool ASMSymbolTable::Contains(const std::string &name)
+bool ASMSymbolTable::Contains(Symbol name) const
 {
     return m_table.contains(name);
 }
@@ -20,7 +20,7 @@ struct FunEntry {
     std::vector<Register> arg_registers = {};
     std::vector<Register> ret_registers = {};
     std::set<Register> callee_saved_registers = {};
-    std::set<std::string> aliased_vars = {};
+    std::set<Symbol> aliased_vars = {};
 };
 
 using ASMSymbolEntry = std::variant<ObjEntry, FunEntry>;
@@ -29,9 +29,9 @@ class ASMSymbolTable {
 public:
     void InsertSymbols(Context *context);
     void InsertConstants(std::shared_ptr<ConstantMap> constants);
-    bool Contains(const std::string &name);
+    bool Contains(Symbol name) const;
 
-    template<typename T> ASMSymbolEntry &Insert(const std::string &name, T &&entry)
+    template<typename T> ASMSymbolEntry &Insert(Symbol name, T &&entry)
     {
         auto [it, inserted] = m_table.emplace(name, std::forward<T>(entry));
         if (!inserted)
@@ -39,15 +39,18 @@ public:
         return it->second;
     }
 
-    template <typename T> T *getAs(const std::string &name)
+    // Doesn't modify the table, functions look up their
+    // entries in parallel during register allocation
+    template <typename T> T *getAs(Symbol name)
     {
-        if (m_table.contains(name))
-            return std::get_if<T>(&m_table[name]);
+        auto it = m_table.find(name);
+        if (it != m_table.end())
+            return std::get_if<T>(&it->second);
         return nullptr;
     }
 
 private:
-    std::unordered_map<std::string, ASMSymbolEntry> m_table;
+    std::unordered_map<Symbol, ASMSymbolEntry> m_table;
 };
 
 };
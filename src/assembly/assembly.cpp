@@ -1,5 +1,6 @@
 #include "assembly.h"
 #include "asm_builder.h"
+#include "asm_encoder.h"
 #include "asm_printer.h"
 #include "asm_printer_utils.h"
 #include "common/context.h"
@@ -9,9 +10,10 @@ namespace assembly {
 
 // register_allocator.cpp
 void allocateRegisters(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     FunEntry *function_entry,
-    ASMSymbolTable *asm_symbol_table);
+    ASMSymbolTable *asm_symbol_table,
+    PassTimer *timer);
 
 // postprocess.cpp
 void postprocessPseudoRegisters(
@@ -20,46 +22,106 @@ void postprocessPseudoRegisters(
 void postprocessInvalidInstructions(
     std::list<TopLevel> &asm_list);
 
-std::string from_tac(
+// peephole.cpp
+void peepholeOptimization(
+    std::list<TopLevel> &asm_list,
+    Context *context);
+
+static size_t countInstructions(const std::list<TopLevel> &asm_list)
+{
+    size_t ret = 0;
+    for (auto &top_level_obj : asm_list) {
+        if (const Function *f = std::get_if<Function>(&top_level_obj)) {
+            for (auto &block : f->blocks)
+                ret += block.instructions.size();
+        }
+    }
+    return ret;
+}
+
+std::list<TopLevel> from_tac(
     const std::list<tac::TopLevel> &tac_list,
     Context *context)
 {
     // Use one constant dictionary across all ASMBuilders
     std::shared_ptr<ConstantMap> constants = std::make_shared<ConstantMap>();
 
+    PassTimer *timer = context->passTimer.get();
     std::list<TopLevel> asm_list;
-    ASMBuilder tac_to_asm(context, constants);
-    tac_to_asm.ConvertTopLevel(tac_list, asm_list);
+    auto count = [&]() { return countInstructions(asm_list); };
+    {
+        auto t = timer->Time("Instruction selection");
+        ASMBuilder tac_to_asm(context, constants);
+        tac_to_asm.ConvertTopLevel(tac_list, asm_list);
+        t.Count("instructions", count);
 
-    context->asmSymbolTable->InsertSymbols(context);
-    context->asmSymbolTable->InsertConstants(constants);
+        context->asmSymbolTable->InsertSymbols(context);
+        context->asmSymbolTable->InsertConstants(constants);
+    }
 
 #if 1
-    // Intraprocedural optimization: we work on separate functions
-    for (auto &top_level_obj : asm_list) {
-        std::visit([&](auto &obj) {
-            using T = std::decay_t<decltype(obj)>;
-            if constexpr (std::is_same_v<T, Function>) {
-                ASMSymbolTable *asm_symbol_table = context->asmSymbolTable.get();
-                FunEntry *entry = asm_symbol_table->getAs<FunEntry>(obj.name);
-                assert(entry);
-                if (!entry->defined)
-                    return;
-                // Determined during register allocation, used in the postprocess step
-                entry->callee_saved_registers.clear();
-                allocateRegisters(obj.blocks, entry, asm_symbol_table);
-            }
-        }, top_level_obj);
+    {
+        auto t = timer->Time("Register allocation");
+        ASMSymbolTable *asm_symbol_table = context->asmSymbolTable.get();
+        std::vector<Function *> functions;
+        for (auto &top_level_obj : asm_list) {
+            if (Function *f = std::get_if<Function>(&top_level_obj))
+                functions.push_back(f);
+        }
+        // Intraprocedural optimization: we work on separate functions,
+        // so they can be processed in parallel
+        PassTimer::Stack timer_stack = timer->CurrentStack();
+        RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+            Function &obj = *functions[i];
+            PassTimer::Attach attach(timer, timer_stack);
+            FunEntry *entry = asm_symbol_table->getAs<FunEntry>(obj.name);
+            assert(entry);
+            if (!entry->defined)
+                return;
+            // Determined during register allocation, used in the postprocess step
+            entry->callee_saved_registers.clear();
+            allocateRegisters(obj.blocks, entry, asm_symbol_table, timer);
+        });
+        t.Count("instructions", count);
     }
 #endif
 
-    // TODO: Rename it or try to merge into replacePseudoRegisters()
-    postprocessPseudoRegisters(asm_list, context->asmSymbolTable);
+    {
+        auto t = timer->Time("Postprocessing");
+        t.Count("instructions", count);
+        // TODO: Rename it or try to merge into replacePseudoRegisters()
+        postprocessPseudoRegisters(asm_list, context->asmSymbolTable);
+
+        postprocessInvalidInstructions(asm_list);
+    }
 
-    postprocessInvalidInstructions(asm_list);
+    if (context->peephole) {
+        auto t = timer->Time("Peephole optimization");
+        peepholeOptimization(asm_list, context);
+        t.Count("instructions", count);
+    }
 
+    return asm_list;
+}
+
+std::string to_text(
+    const std::list<TopLevel> &asm_list,
+    Context *context)
+{
+    auto t = context->passTimer->Time("Assembly printing");
+    t.Count("instructions", [&]() { return countInstructions(asm_list); });
     ASMPrinter asm_printer(context);
     return asm_printer.ToText(asm_list);
 }
 
+std::vector<char> to_object(
+    const std::list<TopLevel> &asm_list,
+    Context *context)
+{
+    auto t = context->passTimer->Time("Object encoding");
+    t.Count("instructions", [&]() { return countInstructions(asm_list); });
+    ASMEncoder encoder;
+    return writeELF(encoder.ToObject(asm_list));
+}
+
 }; // assembly
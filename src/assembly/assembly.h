@@ -1,13 +1,25 @@
 #pragma once
 
+#include "asm_nodes.h"
 #include "tac/tac_nodes.h"
 
 class Context;
 
 namespace assembly {
 
-std::string from_tac(
+// Instruction selection, register allocation and fixing up the instructions
+std::list<TopLevel> from_tac(
     const std::list<tac::TopLevel> &tac_list,
     Context *context);
 
+// Assembly source for an external assembler
+std::string to_text(
+    const std::list<TopLevel> &asm_list,
+    Context *context);
+
+// Relocatable ELF object file
+std::vector<char> to_object(
+    const std::list<TopLevel> &asm_list,
+    Context *context);
+
 }; // assembly
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "common/symbol.h"
 #include "common/system.h"
 #include "common/values.h"
 #include <cstring>
@@ -28,4 +29,4 @@ DIAG_IGNORE("-Wconversion")
 DIAG_POP
 };
 
-using ConstantMap = std::map<ConstantValue, std::string, ConstantValueComparator>;
+using ConstantMap = std::map<ConstantValue, Symbol, ConstantValueComparator>;
@@ -0,0 +1,268 @@
+#include "object_file.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace assembly {
+
+// ELF constants
+static constexpr uint16_t ET_REL = 1;
+static constexpr uint16_t EM_X86_64 = 62;
+static constexpr uint32_t SHT_PROGBITS = 1;
+static constexpr uint32_t SHT_SYMTAB = 2;
+static constexpr uint32_t SHT_STRTAB = 3;
+static constexpr uint32_t SHT_RELA = 4;
+static constexpr uint32_t SHT_NOBITS = 8;
+static constexpr uint64_t SHF_WRITE = 0x1;
+static constexpr uint64_t SHF_ALLOC = 0x2;
+static constexpr uint64_t SHF_EXECINSTR = 0x4;
+static constexpr uint64_t SHF_INFO_LINK = 0x40;
+static constexpr uint8_t STB_LOCAL = 0;
+static constexpr uint8_t STB_GLOBAL = 1;
+static constexpr uint8_t STT_NOTYPE = 0;
+static constexpr uint8_t STT_OBJECT = 1;
+static constexpr uint8_t STT_FUNC = 2;
+
+class ByteWriter {
+public:
+    template <typename T>
+    void Write(T value)
+    {
+        // Little endian host (x86-64)
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(T));
+    }
+
+    void Write(const std::vector<uint8_t> &bytes)
+    {
+        m_bytes.insert(m_bytes.end(), bytes.begin(), bytes.end());
+    }
+
+    void Align(size_t alignment)
+    {
+        while (m_bytes.size() % alignment)
+            m_bytes.push_back(0);
+    }
+
+    size_t Size() const { return m_bytes.size(); }
+    std::vector<char> &Bytes() { return m_bytes; }
+
+private:
+    std::vector<char> m_bytes;
+};
+
+class StringTable {
+public:
+    uint32_t Add(const std::string &str)
+    {
+        if (str.empty())
+            return 0;
+        auto it = m_offsets.find(str);
+        if (it != m_offsets.end())
+            return it->second;
+        uint32_t offset = static_cast<uint32_t>(m_bytes.size());
+        m_bytes.insert(m_bytes.end(), str.begin(), str.end());
+        m_bytes.push_back(0);
+        m_offsets.emplace(str, offset);
+        return offset;
+    }
+
+    const std::vector<uint8_t> &Bytes() const { return m_bytes; }
+
+private:
+    std::vector<uint8_t> m_bytes = { 0 };
+    std::unordered_map<std::string, uint32_t> m_offsets;
+};
+
+struct SectionHeader {
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint64_t flags = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t link = 0;
+    uint32_t info = 0;
+    uint64_t alignment = 1;
+    uint64_t entry_size = 0;
+};
+
+std::vector<char> writeELF(const ObjectFile &object)
+{
+    // Section indices in the file
+    enum : uint16_t {
+        NullIndex,
+        TextIndex,
+        RelaTextIndex,
+        DataIndex,
+        RelaDataIndex,
+        BssIndex,
+        RODataIndex,
+        RelaRODataIndex,
+        NoteIndex,
+        SymtabIndex,
+        StrtabIndex,
+        ShstrtabIndex,
+        SectionHeaderCount,
+    };
+    auto fileIndex = [](ObjectFile::SectionId section) -> uint16_t {
+        switch (section) {
+        case ObjectFile::Text: return TextIndex;
+        case ObjectFile::Data: return DataIndex;
+        case ObjectFile::Bss: return BssIndex;
+        case ObjectFile::ROData: return RODataIndex;
+        case ObjectFile::Undefined: return 0;
+        }
+        return 0;
+    };
+
+    // Symbol table: the local symbols have to precede the global ones
+    StringTable strtab;
+    ByteWriter symtab;
+    std::unordered_map<std::string, uint32_t> symbol_index;
+    symtab.Write(std::vector<uint8_t>(24, 0));
+    uint32_t first_global = 1;
+    uint32_t next_index = 1;
+    for (bool global : { false, true }) {
+        if (global)
+            first_global = next_index;
+        for (const ObjectFile::Symbol &symbol : object.symbols) {
+            if (symbol.global != global)
+                continue;
+            uint8_t type = symbol.section == ObjectFile::Undefined
+                ? STT_NOTYPE
+                : (symbol.function ? STT_FUNC : STT_OBJECT);
+            symtab.Write<uint32_t>(strtab.Add(symbol.name));
+            symtab.Write<uint8_t>(static_cast<uint8_t>(((global ? STB_GLOBAL : STB_LOCAL) << 4) | type));
+            symtab.Write<uint8_t>(0);
+            symtab.Write<uint16_t>(fileIndex(symbol.section));
+            symtab.Write<uint64_t>(symbol.value);
+            symtab.Write<uint64_t>(symbol.size);
+            symbol_index[symbol.name] = next_index++;
+        }
+    }
+
+    // By section: .text, .data and .rodata (jump tables)
+    ByteWriter rela[3];
+    for (const ObjectFile::Relocation &relocation : object.relocations) {
+        auto it = symbol_index.find(relocation.symbol);
+        if (it == symbol_index.end())
+            throw std::runtime_error("Relocation against unknown symbol: " + relocation.symbol);
+        size_t rela_index = 0;
+        switch (relocation.section) {
+        case ObjectFile::Text: rela_index = 0; break;
+        case ObjectFile::Data: rela_index = 1; break;
+        case ObjectFile::ROData: rela_index = 2; break;
+        case ObjectFile::Bss:
+        case ObjectFile::Undefined:
+            throw std::runtime_error("Relocations are only supported in .text, .data and .rodata");
+        }
+        ByteWriter &out = rela[rela_index];
+        out.Write<uint64_t>(relocation.offset);
+        out.Write<uint64_t>((static_cast<uint64_t>(it->second) << 32) | relocation.type);
+        out.Write<int64_t>(relocation.addend);
+    }
+
+    StringTable shstrtab;
+    SectionHeader headers[SectionHeaderCount];
+    auto setHeader = [&](uint16_t index, const std::string &name, uint32_t type, uint64_t flags) {
+        headers[index].name = shstrtab.Add(name);
+        headers[index].type = type;
+        headers[index].flags = flags;
+    };
+    setHeader(TextIndex, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR);
+    setHeader(RelaTextIndex, ".rela.text", SHT_RELA, SHF_INFO_LINK);
+    setHeader(DataIndex, ".data", SHT_PROGBITS, SHF_WRITE | SHF_ALLOC);
+    setHeader(RelaDataIndex, ".rela.data", SHT_RELA, SHF_INFO_LINK);
+    setHeader(BssIndex, ".bss", SHT_NOBITS, SHF_WRITE | SHF_ALLOC);
+    setHeader(RODataIndex, ".rodata", SHT_PROGBITS, SHF_ALLOC);
+    setHeader(RelaRODataIndex, ".rela.rodata", SHT_RELA, SHF_INFO_LINK);
+    // Non-executable stack
+    setHeader(NoteIndex, ".note.GNU-stack", SHT_PROGBITS, 0);
+    setHeader(SymtabIndex, ".symtab", SHT_SYMTAB, 0);
+    setHeader(StrtabIndex, ".strtab", SHT_STRTAB, 0);
+    setHeader(ShstrtabIndex, ".shstrtab", SHT_STRTAB, 0);
+
+    for (uint16_t index : { RelaTextIndex, RelaDataIndex, RelaRODataIndex }) {
+        headers[index].link = SymtabIndex;
+        // The relocation sections follow the sections they relocate
+        headers[index].info = index - 1u;
+        headers[index].alignment = 8;
+        headers[index].entry_size = 24;
+    }
+    headers[SymtabIndex].link = StrtabIndex;
+    headers[SymtabIndex].info = first_global;
+    headers[SymtabIndex].alignment = 8;
+    headers[SymtabIndex].entry_size = 24;
+
+    // Section contents follow the ELF header
+    ByteWriter out;
+    out.Write(std::vector<uint8_t>(64, 0));
+    auto place = [&](uint16_t index, const std::vector<uint8_t> &bytes, size_t alignment) {
+        out.Align(alignment);
+        headers[index].offset = out.Size();
+        headers[index].size = bytes.size();
+        headers[index].alignment = alignment;
+        out.Write(bytes);
+    };
+    auto toBytes = [](ByteWriter &writer) {
+        return std::vector<uint8_t>(writer.Bytes().begin(), writer.Bytes().end());
+    };
+    place(TextIndex, object.sections[ObjectFile::Text].bytes, object.sections[ObjectFile::Text].alignment);
+    place(RelaTextIndex, toBytes(rela[0]), 8);
+    place(DataIndex, object.sections[ObjectFile::Data].bytes, object.sections[ObjectFile::Data].alignment);
+    place(RelaDataIndex, toBytes(rela[1]), 8);
+    place(RODataIndex, object.sections[ObjectFile::ROData].bytes, object.sections[ObjectFile::ROData].alignment);
+    place(RelaRODataIndex, toBytes(rela[2]), 8);
+    place(NoteIndex, {}, 1);
+    place(SymtabIndex, toBytes(symtab), 8);
+    place(StrtabIndex, strtab.Bytes(), 1);
+    place(ShstrtabIndex, shstrtab.Bytes(), 1);
+    headers[BssIndex].offset = out.Size();
+    headers[BssIndex].size = object.sections[ObjectFile::Bss].size;
+    headers[BssIndex].alignment = object.sections[ObjectFile::Bss].alignment;
+
+    out.Align(8);
+    uint64_t section_headers_offset = out.Size();
+    for (const SectionHeader &header : headers) {
+        out.Write<uint32_t>(header.name);
+        out.Write<uint32_t>(header.type);
+        out.Write<uint64_t>(header.flags);
+        out.Write<uint64_t>(0); // address
+        out.Write<uint64_t>(header.offset);
+        out.Write<uint64_t>(header.size);
+        out.Write<uint32_t>(header.link);
+        out.Write<uint32_t>(header.info);
+        out.Write<uint64_t>(header.alignment);
+        out.Write<uint64_t>(header.entry_size);
+    }
+
+    // ELF header
+    ByteWriter header;
+    header.Write(std::vector<uint8_t>{ 0x7f, 'E', 'L', 'F',
+        2, // 64-bit
+        1, // little endian
+        1, // version
+        0, // System V ABI
+        0, 0, 0, 0, 0, 0, 0, 0 });
+    header.Write<uint16_t>(ET_REL);
+    header.Write<uint16_t>(EM_X86_64);
+    header.Write<uint32_t>(1); // version
+    header.Write<uint64_t>(0); // entry
+    header.Write<uint64_t>(0); // program headers
+    header.Write<uint64_t>(section_headers_offset);
+    header.Write<uint32_t>(0); // flags
+    header.Write<uint16_t>(64); // ELF header size
+    header.Write<uint16_t>(0); // program header entry size
+    header.Write<uint16_t>(0); // program header count
+    header.Write<uint16_t>(64); // section header entry size
+    header.Write<uint16_t>(SectionHeaderCount);
+    header.Write<uint16_t>(ShstrtabIndex);
+
+    std::vector<char> &bytes = out.Bytes();
+    std::copy(header.Bytes().begin(), header.Bytes().end(), bytes.begin());
+    return std::move(bytes);
+}
+
+}; // assembly
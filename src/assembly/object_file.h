@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace assembly {
+
+// Machine code and data of a translation unit with its symbols
+// and relocations, before it's written in an object file format
+struct ObjectFile {
+    enum SectionId {
+        Text,
+        Data,
+        Bss,
+        ROData,
+        SectionCount,
+        Undefined = SectionCount,
+    };
+
+    struct Section {
+        std::vector<uint8_t> bytes;
+        // Only the size is tracked for .bss
+        size_t size = 0;
+        size_t alignment = 1;
+    };
+
+    struct Symbol {
+        std::string name;
+        SectionId section = Undefined;
+        uint64_t value = 0;
+        uint64_t size = 0;
+        bool global = false;
+        bool function = false;
+    };
+
+    // x86-64 relocation types
+    enum RelocationType : uint32_t {
+        Absolute64 = 1, // R_X86_64_64
+        PCRelative32 = 2, // R_X86_64_PC32
+        PLT32 = 4, // R_X86_64_PLT32
+    };
+
+    struct Relocation {
+        SectionId section = Text;
+        uint64_t offset = 0;
+        std::string symbol;
+        RelocationType type = PCRelative32;
+        int64_t addend = 0;
+    };
+
+    Section sections[SectionCount];
+    std::vector<Symbol> symbols;
+    std::vector<Relocation> relocations;
+};
+
+// Relocatable ELF64 object file for x86-64 (elf_writer.cpp)
+std::vector<char> writeELF(const ObjectFile &object);
+
+}; // assembly
@@ -0,0 +1,676 @@
+#include "asm_nodes.h"
+#include "asm_symbol_table.h"
+#include "common/context.h"
+#include <cassert>
+#include <limits>
+#include <map>
+
+namespace assembly {
+
+// register_allocator.cpp
+void addControlFlowEdges(CFG &blocks);
+
+// A bit for each register (by its value), and one for the flags
+using RegisterSet = uint64_t;
+static constexpr RegisterSet s_flags = RegisterSet(1) << (XMM15 + 1);
+
+static constexpr RegisterSet bit(Register reg)
+{
+    return RegisterSet(1) << reg;
+}
+
+static constexpr RegisterSet s_callerSavedRegisters =
+    bit(AX) | bit(CX) | bit(DX) | bit(SI) | bit(DI) | bit(R8) | bit(R9) | bit(R10) | bit(R11)
+    | bit(XMM0) | bit(XMM1) | bit(XMM2) | bit(XMM3) | bit(XMM4) | bit(XMM5) | bit(XMM6) | bit(XMM7)
+    | bit(XMM8) | bit(XMM9) | bit(XMM10) | bit(XMM11) | bit(XMM12) | bit(XMM13) | bit(XMM14) | bit(XMM15);
+
+// Restored before returning
+static constexpr RegisterSet s_calleeSavedRegisters =
+    bit(BX) | bit(R12) | bit(R13) | bit(R14) | bit(R15) | bit(SP) | bit(BP);
+
+static bool isMemoryAddress(const Operand &op)
+{
+    return std::holds_alternative<Memory>(op)
+        || std::holds_alternative<Data>(op)
+        || std::holds_alternative<Indexed>(op);
+}
+
+// Reserved for the instruction fixups, they don't hold values between them
+static bool isScratchRegister(Register reg)
+{
+    return reg == R10 || reg == R11 || reg == XMM14 || reg == XMM15;
+}
+
+static bool isXMMRegister(Register reg)
+{
+    return reg >= XMM0 && reg <= XMM15;
+}
+
+static bool fitsInt32(const Operand &op)
+{
+    if (const Imm *imm = std::get_if<Imm>(&op)) {
+        return imm->value >= std::numeric_limits<int32_t>::lowest()
+            && imm->value <= std::numeric_limits<int32_t>::max();
+    }
+    return true;
+}
+
+static bool isImm(const Operand &op, int64_t value)
+{
+    const Imm *imm = std::get_if<Imm>(&op);
+    return imm && imm->value == value;
+}
+
+static bool sameRegister(const Operand &a, const Operand &b)
+{
+    const Reg *ra = std::get_if<Reg>(&a);
+    const Reg *rb = std::get_if<Reg>(&b);
+    return ra && rb && ra->reg == rb->reg;
+}
+
+static bool sameMemory(const Operand &a, const Operand &b)
+{
+    if (const Memory *ma = std::get_if<Memory>(&a)) {
+        const Memory *mb = std::get_if<Memory>(&b);
+        return mb && ma->reg == mb->reg && ma->offset == mb->offset;
+    }
+    if (const Data *da = std::get_if<Data>(&a)) {
+        const Data *db = std::get_if<Data>(&b);
+        return db && da->name == db->name && da->offset == db->offset;
+    }
+    return false;
+}
+
+// Compares the register with zero: cmp $0, reg or test reg, reg
+static bool isZeroTest(const Instruction &instr, const Operand &reg, WordType type)
+{
+    if (const Cmp *cmp = std::get_if<Cmp>(&instr))
+        return cmp->type == type && isImm(cmp->lhs, 0) && sameRegister(cmp->rhs, reg);
+    if (const Test *test = std::get_if<Test>(&instr))
+        return test->type == type && sameRegister(test->lhs, reg) && sameRegister(test->rhs, reg);
+    return false;
+}
+
+// The condition code which holds exactly when the given one doesn't,
+// empty if it's unknown
+static std::string invertConditionCode(const std::string &cond_code)
+{
+    static const std::map<std::string, std::string> s_inverse = {
+        { "e", "ne" }, { "ne", "e" },
+        { "l", "ge" }, { "ge", "l" }, { "le", "g" }, { "g", "le" },
+        { "b", "ae" }, { "ae", "b" }, { "be", "a" }, { "a", "be" },
+        { "p", "np" }, { "np", "p" }, { "s", "ns" }, { "ns", "s" },
+    };
+    auto it = s_inverse.find(cond_code);
+    return it == s_inverse.end() ? std::string() : it->second;
+}
+
+static void addReads(const Operand &op, RegisterSet &uses)
+{
+    if (const Reg *r = std::get_if<Reg>(&op))
+        uses |= bit(r->reg);
+    else if (const Memory *m = std::get_if<Memory>(&op))
+        uses |= bit(m->reg);
+    else if (const Indexed *i = std::get_if<Indexed>(&op))
+        uses |= bit(i->base) | bit(i->index);
+}
+
+static void addWrites(const Operand &op, WordType type, RegisterSet &uses, RegisterSet &defs)
+{
+    if (const Reg *r = std::get_if<Reg>(&op)) {
+        defs |= bit(r->reg);
+        // Writing the lowest byte keeps the rest of the register
+        if (type == Byte)
+            uses |= bit(r->reg);
+    } else
+        addReads(op, uses);
+}
+
+namespace {
+
+struct Effects {
+    RegisterSet uses = 0;
+    RegisterSet defs = 0;
+};
+
+} // namespace
+
+static Effects effectsOf(const Instruction &instr, ASMSymbolTable *asm_symbol_table)
+{
+    Effects e;
+    std::visit([&](const auto &i) {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, Mov>) {
+            addReads(i.src, e.uses);
+            addWrites(i.dst, i.type, e.uses, e.defs);
+        } else if constexpr (std::is_same_v<T, Movsx> || std::is_same_v<T, MovZeroExtend>) {
+            addReads(i.src, e.uses);
+            addWrites(i.dst, i.dst_type, e.uses, e.defs);
+        } else if constexpr (std::is_same_v<T, Lea>) {
+            addReads(i.src, e.uses);
+            addWrites(i.dst, Quadword, e.uses, e.defs);
+        } else if constexpr (std::is_same_v<T, Cvttsd2si> || std::is_same_v<T, Cvtsi2sd>) {
+            addReads(i.src, e.uses);
+            addWrites(i.dst, i.type, e.uses, e.defs);
+        } else if constexpr (std::is_same_v<T, Unary>) {
+            addReads(i.src, e.uses);
+            addWrites(i.src, i.type, e.uses, e.defs);
+            if (i.op != Not_AU)
+                e.defs |= s_flags;
+        } else if constexpr (std::is_same_v<T, Binary>) {
+            // xor reg, reg doesn't depend on the register
+            if (i.op != BWXor_AB || !sameRegister(i.src, i.dst)) {
+                addReads(i.src, e.uses);
+                addReads(i.dst, e.uses);
+            }
+            addWrites(i.dst, i.type, e.uses, e.defs);
+            bool shift = i.op == ShiftL_AB || i.op == ShiftRU_AB || i.op == ShiftRS_AB;
+            // Shifting by zero (or by CL, which may be zero) keeps the flags
+            if (i.type != Doubleword && (!shift || (std::holds_alternative<Imm>(i.src) && !isImm(i.src, 0))))
+                e.defs |= s_flags;
+        } else if constexpr (std::is_same_v<T, Idiv> || std::is_same_v<T, Div>) {
+            addReads(i.src, e.uses);
+            e.uses |= bit(AX) | bit(DX);
+            e.defs |= bit(AX) | bit(DX) | s_flags;
+        } else if constexpr (std::is_same_v<T, Cdq>) {
+            e.uses |= bit(AX);
+            e.defs |= bit(DX);
+        } else if constexpr (std::is_same_v<T, Cmp> || std::is_same_v<T, Test>) {
+            addReads(i.lhs, e.uses);
+            addReads(i.rhs, e.uses);
+            e.defs |= s_flags;
+        } else if constexpr (std::is_same_v<T, JmpCC>) {
+            e.uses |= s_flags;
+        } else if constexpr (std::is_same_v<T, JmpIndirect>) {
+            addReads(i.target, e.uses);
+        } else if constexpr (std::is_same_v<T, SetCC>) {
+            e.uses |= s_flags;
+            addWrites(i.op, Byte, e.uses, e.defs);
+        } else if constexpr (std::is_same_v<T, Push>) {
+            addReads(i.op, e.uses);
+        } else if constexpr (std::is_same_v<T, Pop>) {
+            e.defs |= bit(i.reg);
+        } else if constexpr (std::is_same_v<T, Call>) {
+            const FunEntry *entry = asm_symbol_table->getAs<FunEntry>(i.identifier);
+            assert(entry);
+            for (Register reg : entry->arg_registers)
+                e.uses |= bit(reg);
+            e.defs |= s_callerSavedRegisters | s_flags;
+        }
+    }, instr);
+    return e;
+}
+
+// The instruction after the given one, skipping the comments
+static InstructionList::iterator nextInstruction(InstructionList &instructions, InstructionList::iterator it)
+{
+    do {
+        ++it;
+    } while (it != instructions.end() && std::holds_alternative<Comment>(*it));
+    return it;
+}
+
+// The instruction before the given one skipping the comments, end() if there's none
+static InstructionList::iterator previousInstruction(InstructionList &instructions, InstructionList::iterator it)
+{
+    while (it != instructions.begin()) {
+        --it;
+        if (!std::holds_alternative<Comment>(*it))
+            return it;
+    }
+    return instructions.end();
+}
+
+// The instruction reading the scratch register, with the scratch register
+// replaced by the operand it was loaded from; nullopt if that's not valid
+static std::optional<Instruction> forwardOperand(
+    const Instruction &instr,
+    Register scratch,
+    const Operand &src,
+    WordType type)
+{
+    if (const Mov *mov = std::get_if<Mov>(&instr)) {
+        if (mov->type != type || !(scratch == mov->src) || scratch == mov->dst)
+            return std::nullopt;
+        if (isMemoryAddress(src) && isMemoryAddress(mov->dst))
+            return std::nullopt;
+        if (type == Quadword && std::holds_alternative<Imm>(src) && isMemoryAddress(mov->dst))
+            return std::nullopt;
+        return Mov{ src, mov->dst, type };
+    }
+    if (const Cmp *cmp = std::get_if<Cmp>(&instr)) {
+        if (cmp->type != type || (scratch == cmp->lhs) == (scratch == cmp->rhs))
+            return std::nullopt;
+        Cmp ret{ scratch == cmp->lhs ? src : cmp->lhs, scratch == cmp->rhs ? src : cmp->rhs, type };
+        if ((isMemoryAddress(ret.lhs) && isMemoryAddress(ret.rhs)) || std::holds_alternative<Imm>(ret.rhs))
+            return std::nullopt;
+        // comisd compares to a register
+        if (type == Doubleword && (std::holds_alternative<Imm>(ret.lhs) || !std::holds_alternative<Reg>(ret.rhs)))
+            return std::nullopt;
+        if (type == Quadword && !fitsInt32(ret.lhs))
+            return std::nullopt;
+        return ret;
+    }
+    if (const Binary *binary = std::get_if<Binary>(&instr)) {
+        if (binary->type != type || !(scratch == binary->src) || scratch == binary->dst)
+            return std::nullopt;
+        // The packed AND, OR and XOR of doubles need aligned memory operands
+        bool valid_op = type == Doubleword
+            ? binary->op == Add_AB || binary->op == Sub_AB || binary->op == Mult_AB || binary->op == DivDouble_AB
+            : binary->op == Add_AB || binary->op == Sub_AB || binary->op == Mult_AB
+                || binary->op == BWAnd_AB || binary->op == BWOr_AB || binary->op == BWXor_AB;
+        if (!valid_op || (isMemoryAddress(src) && isMemoryAddress(binary->dst)))
+            return std::nullopt;
+        // These can only compute into a register
+        if ((type == Doubleword || binary->op == Mult_AB) && !std::holds_alternative<Reg>(binary->dst))
+            return std::nullopt;
+        if (std::holds_alternative<Imm>(src) && (type == Doubleword || (type == Quadword && !fitsInt32(src))))
+            return std::nullopt;
+        return Binary{ binary->op, src, binary->dst, type };
+    }
+    return std::nullopt;
+}
+
+namespace {
+
+class Peephole {
+public:
+    // A rewrite of the instructions starting at the given one, returning
+    // whether it applied. The iterator is left at the instruction to
+    // continue matching from.
+    struct Rule {
+        const char *name;
+        bool (Peephole::*apply)(size_t block, InstructionList::iterator &it);
+    };
+    static const std::vector<Rule> s_rules;
+
+    Peephole(
+        CFG &blocks,
+        const FunEntry *function_entry,
+        ASMSymbolTable *asm_symbol_table,
+        std::vector<size_t> &hits);
+
+    void Run();
+
+private:
+    struct Position {
+        size_t block;
+        InstructionList::iterator it;
+    };
+
+    void SolveLiveness();
+    // Registers and flags read after the instruction, before being written
+    RegisterSet LiveAfter(size_t block, InstructionList::iterator pos) const;
+    // The next instruction in the layout, in the same or in a later block
+    std::optional<Position> Following(size_t block, InstructionList::iterator it);
+
+    bool RemoveSelfMove(size_t block, InstructionList::iterator &it);
+    bool ForwardScratchRegister(size_t block, InstructionList::iterator &it);
+    bool ReuseStoredRegister(size_t block, InstructionList::iterator &it);
+    bool RemoveRedundantCompare(size_t block, InstructionList::iterator &it);
+    bool FuseSetCCBranch(size_t block, InstructionList::iterator &it);
+    bool TestInsteadOfCompare(size_t block, InstructionList::iterator &it);
+    bool XorInsteadOfMove(size_t block, InstructionList::iterator &it);
+    bool RemoveJumpToNext(size_t block, InstructionList::iterator &it);
+    bool InvertBranchOverJump(size_t block, InstructionList::iterator &it);
+
+    CFG &m_blocks;
+    ASMSymbolTable *m_asmSymbolTable;
+    std::vector<size_t> &m_hits;
+    // Live at the end of the function
+    RegisterSet m_exitLive;
+    // By block index
+    std::vector<RegisterSet> m_liveIn;
+    std::vector<RegisterSet> m_liveOut;
+};
+
+const std::vector<Peephole::Rule> Peephole::s_rules = {
+    { "Move to itself", &Peephole::RemoveSelfMove },
+    { "Scratch register forwarding", &Peephole::ForwardScratchRegister },
+    { "Reload after store", &Peephole::ReuseStoredRegister },
+    { "Compare after arithmetic", &Peephole::RemoveRedundantCompare },
+    { "SetCC and branch fusion", &Peephole::FuseSetCCBranch },
+    { "Compare with zero", &Peephole::TestInsteadOfCompare },
+    { "Zeroing move", &Peephole::XorInsteadOfMove },
+    { "Jump to next label", &Peephole::RemoveJumpToNext },
+    { "Branch over jump", &Peephole::InvertBranchOverJump },
+};
+
+Peephole::Peephole(
+    CFG &blocks,
+    const FunEntry *function_entry,
+    ASMSymbolTable *asm_symbol_table,
+    std::vector<size_t> &hits)
+    : m_blocks(blocks)
+    , m_asmSymbolTable(asm_symbol_table)
+    , m_hits(hits)
+    , m_exitLive(s_calleeSavedRegisters)
+{
+    for (Register reg : function_entry->ret_registers)
+        m_exitLive |= bit(reg);
+}
+
+void Peephole::SolveLiveness()
+{
+    size_t count = m_blocks.size();
+    size_t exit = count - 1;
+    m_liveIn.assign(count, 0);
+    m_liveOut.assign(count, 0);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t index = exit; index-- > 0;) {
+            const CFGBlock &block = m_blocks[index];
+            RegisterSet live = 0;
+            for (uint32_t succ : block.successors)
+                live |= succ == exit ? m_exitLive : m_liveIn[succ];
+            m_liveOut[index] = live;
+            for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+                Effects e = effectsOf(*it, m_asmSymbolTable);
+                live = (live & ~e.defs) | e.uses;
+            }
+            if (live != m_liveIn[index]) {
+                m_liveIn[index] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+RegisterSet Peephole::LiveAfter(size_t block, InstructionList::iterator pos) const
+{
+    RegisterSet live = m_liveOut[block];
+    auto it = m_blocks[block].instructions.end();
+    while (--it != pos) {
+        Effects e = effectsOf(*it, m_asmSymbolTable);
+        live = (live & ~e.defs) | e.uses;
+    }
+    return live;
+}
+
+std::optional<Peephole::Position> Peephole::Following(size_t block, InstructionList::iterator it)
+{
+    it = nextInstruction(m_blocks[block].instructions, it);
+    while (it == m_blocks[block].instructions.end()) {
+        if (++block == m_blocks.size())
+            return std::nullopt;
+        InstructionList &instructions = m_blocks[block].instructions;
+        it = instructions.begin();
+        if (it != instructions.end() && std::holds_alternative<Comment>(*it))
+            it = nextInstruction(instructions, it);
+    }
+    return Position{ block, it };
+}
+
+// mov %rax, %rax
+bool Peephole::RemoveSelfMove(size_t block, InstructionList::iterator &it)
+{
+    const Mov *mov = std::get_if<Mov>(&*it);
+    // movl clears the upper half of the register
+    if (!mov || mov->type == Longword || !sameRegister(mov->src, mov->dst))
+        return false;
+    it = m_blocks[block].instructions.erase(it);
+    return true;
+}
+
+// mov -8(%rbp), %r10; cmpq %r10, %rax -> cmpq -8(%rbp), %rax
+// The fixups load operands into the scratch registers more often than needed,
+// e.g. the left operand of every 8-byte comparison.
+bool Peephole::ForwardScratchRegister(size_t block, InstructionList::iterator &it)
+{
+    const Mov *mov = std::get_if<Mov>(&*it);
+    const Reg *scratch = mov ? std::get_if<Reg>(&mov->dst) : nullptr;
+    if (!scratch || !isScratchRegister(scratch->reg))
+        return false;
+    InstructionList &instructions = m_blocks[block].instructions;
+    RegisterSet src_regs = 0;
+    addReads(mov->src, src_regs);
+
+    // Only loads into other registers may come before the instruction reading it
+    auto user = nextInstruction(instructions, it);
+    while (user != instructions.end()) {
+        Effects e = effectsOf(*user, m_asmSymbolTable);
+        if ((e.uses | e.defs) & bit(scratch->reg))
+            break;
+        const Mov *between = std::get_if<Mov>(&*user);
+        if (!between || !std::holds_alternative<Reg>(between->dst) || (e.defs & src_regs))
+            return false;
+        user = nextInstruction(instructions, user);
+    }
+    if (user == instructions.end())
+        return false;
+    std::optional<Instruction> forwarded = forwardOperand(*user, scratch->reg, mov->src, mov->type);
+    if (!forwarded || (LiveAfter(block, user) & bit(scratch->reg)))
+        return false;
+    *user = std::move(*forwarded);
+    it = instructions.erase(it);
+    return true;
+}
+
+// movl %eax, -4(%rbp); movl -4(%rbp), %ecx -> movl %eax, -4(%rbp); movl %eax, %ecx
+bool Peephole::ReuseStoredRegister(size_t block, InstructionList::iterator &it)
+{
+    const Mov *store = std::get_if<Mov>(&*it);
+    const Reg *src = store ? std::get_if<Reg>(&store->src) : nullptr;
+    if (!src || !(std::holds_alternative<Memory>(store->dst) || std::holds_alternative<Data>(store->dst)))
+        return false;
+    InstructionList &instructions = m_blocks[block].instructions;
+    auto next = nextInstruction(instructions, it);
+    Mov *load = next != instructions.end() ? std::get_if<Mov>(&*next) : nullptr;
+    const Reg *dst = load ? std::get_if<Reg>(&load->dst) : nullptr;
+    if (!dst || load->type != store->type || !sameMemory(load->src, store->dst)
+        || isXMMRegister(src->reg) != isXMMRegister(dst->reg))
+        return false;
+    // movl clears the upper half of the register, so it is kept as a self move
+    if (dst->reg == src->reg && load->type != Longword)
+        instructions.erase(next);
+    else
+        load->src = *src;
+    return true;
+}
+
+// subl $1, %ecx; cmpl $0, %ecx; je L -> subl $1, %ecx; je L
+// Arithmetic sets the zero flag by its result
+bool Peephole::RemoveRedundantCompare(size_t block, InstructionList::iterator &it)
+{
+    const Binary *binary = std::get_if<Binary>(&*it);
+    if (!binary || binary->type == Doubleword || !std::holds_alternative<Reg>(binary->dst)
+        || !(binary->op == Add_AB || binary->op == Sub_AB
+            || binary->op == BWAnd_AB || binary->op == BWOr_AB || binary->op == BWXor_AB))
+        return false;
+    InstructionList &instructions = m_blocks[block].instructions;
+    auto compare = nextInstruction(instructions, it);
+    if (compare == instructions.end() || !isZeroTest(*compare, binary->dst, binary->type))
+        return false;
+    auto jump = nextInstruction(instructions, compare);
+    const JmpCC *jcc = jump != instructions.end() ? std::get_if<JmpCC>(&*jump) : nullptr;
+    // The other flags are set differently
+    if (!jcc || (jcc->cond_code != "e" && jcc->cond_code != "ne") || (LiveAfter(block, jump) & s_flags))
+        return false;
+    instructions.erase(compare);
+    return true;
+}
+
+// movl $0, %eax; setl %al; cmpl $0, %eax; je L -> jge L
+// Conditional jumps on the result of a comparison are lowered this way
+bool Peephole::FuseSetCCBranch(size_t block, InstructionList::iterator &it)
+{
+    SetCC *setcc = std::get_if<SetCC>(&*it);
+    if (!setcc || !std::holds_alternative<Reg>(setcc->op))
+        return false;
+    InstructionList &instructions = m_blocks[block].instructions;
+    auto compare = nextInstruction(instructions, it);
+    if (compare == instructions.end())
+        return false;
+    WordType type = std::holds_alternative<Cmp>(*compare)
+        ? std::get<Cmp>(*compare).type
+        : (std::holds_alternative<Test>(*compare) ? std::get<Test>(*compare).type : Byte);
+    if (!isZeroTest(*compare, setcc->op, type))
+        return false;
+    auto jump = nextInstruction(instructions, compare);
+    JmpCC *jcc = jump != instructions.end() ? std::get_if<JmpCC>(&*jump) : nullptr;
+    if (!jcc || (jcc->cond_code != "e" && jcc->cond_code != "ne"))
+        return false;
+    std::string cond_code = jcc->cond_code == "ne" ? setcc->cond_code : invertConditionCode(setcc->cond_code);
+    if (cond_code.empty())
+        return false;
+    // The rest of the register is compared too, it has to be cleared before
+    auto clear = previousInstruction(instructions, it);
+    const Mov *mov = clear != instructions.end() ? std::get_if<Mov>(&*clear) : nullptr;
+    bool cleared = mov && mov->type != Byte && isImm(mov->src, 0) && sameRegister(mov->dst, setcc->op);
+    if (!cleared && type != Byte)
+        return false;
+    const Reg &reg = std::get<Reg>(setcc->op);
+    if (LiveAfter(block, jump) & (bit(reg.reg) | s_flags))
+        return false;
+
+    jcc->cond_code = cond_code;
+    if (cleared)
+        instructions.erase(clear);
+    instructions.erase(compare);
+    it = instructions.erase(it);
+    return true;
+}
+
+// cmpl $0, %eax -> testl %eax, %eax
+// Sets the flags the same way, without an immediate operand
+bool Peephole::TestInsteadOfCompare(size_t, InstructionList::iterator &it)
+{
+    const Cmp *cmp = std::get_if<Cmp>(&*it);
+    if (!cmp || cmp->type == Doubleword || !isImm(cmp->lhs, 0) || !std::holds_alternative<Reg>(cmp->rhs))
+        return false;
+    *it = Test{ cmp->rhs, cmp->rhs, cmp->type };
+    return true;
+}
+
+// movq $0, %rax -> xorl %eax, %eax
+bool Peephole::XorInsteadOfMove(size_t block, InstructionList::iterator &it)
+{
+    const Mov *mov = std::get_if<Mov>(&*it);
+    const Reg *dst = mov ? std::get_if<Reg>(&mov->dst) : nullptr;
+    if (!dst || isXMMRegister(dst->reg) || !isImm(mov->src, 0))
+        return false;
+    // XOR overwrites the flags
+    if (LiveAfter(block, it) & s_flags)
+        return false;
+    // Writing the lower half clears the upper one
+    WordType type = mov->type == Byte ? Byte : Longword;
+    Reg reg{ dst->reg, GetBytesOfWordType(type) };
+    *it = Binary{ BWXor_AB, reg, reg, type };
+    return true;
+}
+
+// jmp L; L: -> L:
+bool Peephole::RemoveJumpToNext(size_t block, InstructionList::iterator &it)
+{
+    Symbol target;
+    if (const Jmp *jmp = std::get_if<Jmp>(&*it))
+        target = jmp->identifier;
+    else if (const JmpCC *jcc = std::get_if<JmpCC>(&*it))
+        target = jcc->identifier;
+    else
+        return false;
+    std::optional<Position> next = Following(block, it);
+    if (!next)
+        return false;
+    const Label *label = std::get_if<Label>(&*next->it);
+    if (!label || label->identifier != target)
+        return false;
+    it = m_blocks[block].instructions.erase(it);
+    return true;
+}
+
+// je L1; jmp L2; L1: -> jne L2; L1:
+bool Peephole::InvertBranchOverJump(size_t block, InstructionList::iterator &it)
+{
+    JmpCC *jcc = std::get_if<JmpCC>(&*it);
+    if (!jcc)
+        return false;
+    std::optional<Position> next = Following(block, it);
+    const Jmp *jmp = next ? std::get_if<Jmp>(&*next->it) : nullptr;
+    if (!jmp)
+        return false;
+    std::optional<Position> after = Following(next->block, next->it);
+    const Label *label = after ? std::get_if<Label>(&*after->it) : nullptr;
+    if (!label || label->identifier != jcc->identifier)
+        return false;
+    std::string cond_code = invertConditionCode(jcc->cond_code);
+    if (cond_code.empty())
+        return false;
+    *it = JmpCC{ cond_code, jmp->identifier };
+    m_blocks[next->block].instructions.erase(next->it);
+    return true;
+}
+
+void Peephole::Run()
+{
+    // The rules may enable each other, and the liveness is conservative
+    // only until the end of a round
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        addControlFlowEdges(m_blocks);
+        SolveLiveness();
+        for (size_t index = 0; index < m_blocks.size(); ++index) {
+            InstructionList &instructions = m_blocks[index].instructions;
+            for (auto it = instructions.begin(); it != instructions.end();) {
+                if (std::holds_alternative<Comment>(*it)) {
+                    ++it;
+                    continue;
+                }
+                bool applied = false;
+                for (size_t rule = 0; rule < s_rules.size() && !applied; ++rule) {
+                    if ((this->*s_rules[rule].apply)(index, it)) {
+                        ++m_hits[rule];
+                        applied = true;
+                    }
+                }
+                if (applied)
+                    changed = true;
+                else
+                    ++it;
+            }
+        }
+    }
+}
+
+} // namespace
+
+// Rewrites short instruction sequences of the final code (after the
+// fixups) into cheaper ones, by a table of rules tried at each instruction
+// until none of them applies. A liveness analysis of the registers and the
+// flags over the blocks tells which values are read later. The rules are
+// timed as one pass, and reported under it by their number of rewrites.
+void peepholeOptimization(std::list<TopLevel> &asm_list, Context *context)
+{
+    ASMSymbolTable *asm_symbol_table = context->asmSymbolTable.get();
+    PassTimer *timer = context->passTimer.get();
+    std::vector<Function *> functions;
+    for (auto &top_level_obj : asm_list) {
+        if (Function *f = std::get_if<Function>(&top_level_obj))
+            functions.push_back(f);
+    }
+    // By function, then by rule
+    std::vector<std::vector<size_t>> hits(functions.size(), std::vector<size_t>(Peephole::s_rules.size(), 0));
+    RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+        Function &obj = *functions[i];
+        const FunEntry *entry = asm_symbol_table->getAs<FunEntry>(obj.name);
+        assert(entry);
+        if (!entry->defined)
+            return;
+        Peephole peephole(obj.blocks, entry, asm_symbol_table, hits[i]);
+        peephole.Run();
+    });
+
+    for (size_t rule = 0; rule < Peephole::s_rules.size(); ++rule) {
+        auto t = timer->Time(Peephole::s_rules[rule].name);
+        t.Count("rewrites", [&]() {
+            size_t ret = 0;
+            for (const std::vector<size_t> &function_hits : hits)
+                ret += function_hits[rule];
+            return ret;
+        });
+    }
+}
+
+}; // namespace assembly
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <limits>
 #include <map>
+#include <unordered_map>
 #include <list>
 
 namespace assembly {
@@ -11,15 +12,15 @@ namespace assembly {
 // Replace each pseudo-register with proper stack offsets or static variables;
 // calculates the overall stack size needed to store all local variables.
 static int postprocessPseudoRegisters(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     int stack_start,
     std::shared_ptr<ASMSymbolTable> asm_symbol_table)
 {
-    std::map<std::string, int> pseudo_offset;
+    std::unordered_map<Symbol, int> pseudo_offset;
     int current_offset = stack_start;
 
     auto resolvePseudo = [&](Operand &op) {
-        std::string name;
+        Symbol name;
         size_t extra_offset = 0; // The offset inside the array
         if (auto pseudo = std::get_if<Pseudo>(&op))
             name = pseudo->name;
@@ -85,6 +86,8 @@ static int postprocessPseudoRegisters(
                 } else if constexpr (std::is_same_v<T, Cmp>) {
                     resolvePseudo(obj.lhs);
                     resolvePseudo(obj.rhs);
+                } else if constexpr (std::is_same_v<T, JmpIndirect>) {
+                    resolvePseudo(obj.target);
                 } else if constexpr (std::is_same_v<T, SetCC>) {
                     resolvePseudo(obj.op);
                 } else if constexpr (std::is_same_v<T, Push>) {
@@ -165,7 +168,7 @@ static bool isXMMRegister(const Operand &op)
     return false;
 }
 
-static std::list<Instruction>::iterator postprocessMov(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessMov(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Mov>(*it);
     // MOV instruction can't have memory addresses both in source and destination
@@ -192,7 +195,7 @@ static std::list<Instruction>::iterator postprocessMov(std::list<Instruction> &a
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessMovsx(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessMovsx(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Movsx>(*it);
 
@@ -216,7 +219,7 @@ static std::list<Instruction>::iterator postprocessMovsx(std::list<Instruction>
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessMovZeroExtend(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessMovZeroExtend(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<MovZeroExtend>(*it);
 
@@ -245,7 +248,7 @@ static std::list<Instruction>::iterator postprocessMovZeroExtend(std::list<Instr
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessLea(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessLea(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Lea>(*it);
     // The source can't be a constant or a register - currently it's guaranteed.
@@ -253,13 +256,13 @@ static std::list<Instruction>::iterator postprocessLea(std::list<Instruction> &a
     if (!std::holds_alternative<Reg>(obj.dst)) {
         auto current = obj;
         it = asm_list.erase(it);
-        it = asm_list.emplace(it, Lea{ current.src, Reg{ AX, 8 } });
-        it = asm_list.emplace(std::next(it), Mov{ Reg{ AX, 8 }, current.dst, Quadword });
+        it = asm_list.emplace(it, Lea{ current.src, Reg{ R11, 8 } });
+        it = asm_list.emplace(std::next(it), Mov{ Reg{ R11, 8 }, current.dst, Quadword });
     }
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessCvttsd2si(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessCvttsd2si(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Cvttsd2si>(*it);
     // The destination of cvttsd2si must be a general purpose register
@@ -267,13 +270,13 @@ static std::list<Instruction>::iterator postprocessCvttsd2si(std::list<Instructi
         auto current = obj;
         uint8_t bytes = GetBytesOfWordType(current.type);
         it = asm_list.erase(it);
-        it = asm_list.emplace(it, Cvttsd2si{ current.src, Reg{ AX, bytes }, current.type });
-        it = asm_list.emplace(std::next(it), Mov{ Reg{ AX, bytes }, current.dst, current.type });
+        it = asm_list.emplace(it, Cvttsd2si{ current.src, Reg{ R11, bytes }, current.type });
+        it = asm_list.emplace(std::next(it), Mov{ Reg{ R11, bytes }, current.dst, current.type });
     }
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessCvtsi2sd(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessCvtsi2sd(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Cvtsi2sd>(*it);
     // The source of cvtsi2sdcan’t be a constant, and the destination must be a register
@@ -288,7 +291,7 @@ static std::list<Instruction>::iterator postprocessCvtsi2sd(std::list<Instructio
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessCmp(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessCmp(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Cmp>(*it);
     if (obj.type == Doubleword && !std::holds_alternative<Reg>(obj.rhs)) {
@@ -325,7 +328,7 @@ static std::list<Instruction>::iterator postprocessCmp(std::list<Instruction> &a
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessSetCC(std::list<Instruction> &, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessSetCC(InstructionList &, InstructionList::iterator it)
 {
     auto &obj = std::get<SetCC>(*it);
     // SetCC always uses the 1-byte version of the registers
@@ -334,7 +337,7 @@ static std::list<Instruction>::iterator postprocessSetCC(std::list<Instruction>
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessPush(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessPush(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Push>(*it);
     if (immLongerThanFourByte(obj.op)) {
@@ -356,7 +359,7 @@ static std::list<Instruction>::iterator postprocessPush(std::list<Instruction> &
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessBinary(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessBinary(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Binary>(*it);
     if (obj.type == Doubleword && (obj.op == Add_AB || obj.op == Sub_AB || obj.op == Mult_AB || obj.op == DivDouble_AB || obj.op == BWXor_AB)) {
@@ -432,7 +435,7 @@ static std::list<Instruction>::iterator postprocessBinary(std::list<Instruction>
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessIdiv(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessIdiv(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Idiv>(*it);
     // IDIV can't have constant operand
@@ -446,7 +449,7 @@ static std::list<Instruction>::iterator postprocessIdiv(std::list<Instruction> &
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator postprocessDiv(std::list<Instruction> &asm_list, std::list<Instruction>::iterator it)
+static InstructionList::iterator postprocessDiv(InstructionList &asm_list, InstructionList::iterator it)
 {
     auto &obj = std::get<Div>(*it);
     // DIV can't have constant operand
@@ -460,7 +463,7 @@ static std::list<Instruction>::iterator postprocessDiv(std::list<Instruction> &a
     return std::next(it);
 }
 
-static void postprocessInvalidInstructions(std::list<Instruction> &asm_list)
+static void postprocessInvalidInstructions(InstructionList &asm_list)
 {
     for (auto it = asm_list.begin(); it != asm_list.end();) {
         it = std::visit([&](auto &obj) {
@@ -2,10 +2,12 @@
 #include "asm_symbol_table.h"
 #include "asm_printer_utils.h"
 #include "register_allocator_util.h"
+#include "common/pass_timer.h"
 #include <algorithm>
 #include <cassert>
 #include <limits>
 #include <map>
+#include <unordered_map>
 #include <numeric>
 #include <ranges>
 
@@ -15,7 +17,7 @@ namespace assembly {
 
 static inline bool replacePseudo(
     Operand &op,
-    const std::map<std::string, Register> &register_map,
+    const std::map<Symbol, Register> &register_map,
     WordType type)
 {
     return std::visit([&](auto &obj) {
@@ -31,8 +33,8 @@ static inline bool replacePseudo(
 }
 
 void replacePseudoRegisters(
-    std::list<CFGBlock> &blocks,
-    const std::map<std::string, Register> &reg_map,
+    CFG &blocks,
+    const std::map<Symbol, Register> &reg_map,
     const std::set<Register> &callee_saved_registers)
 {
     // TODO: Find a better place for adding Pushes/Pops
@@ -73,7 +75,7 @@ static const std::vector<Register> s_floatingPointRegisters = {
 };
 
 // Registers and PseudoRegisters
-using GraphKey = std::variant<Register, std::string>;
+using GraphKey = std::variant<Register, Symbol>;
 
 struct GraphData {
     std::set<GraphKey> neighbors = {};
@@ -82,9 +84,9 @@ struct GraphData {
     bool pruned = false;
 };
 
-static std::map<const Instruction *, std::set<GraphKey>> s_instructionAnnotations;
-static std::map<const CFGBlock *, std::set<GraphKey>> s_blockAnnotations;
-static size_t s_exitId = 0;
+thread_local static std::map<const Instruction *, std::set<GraphKey>> s_instructionAnnotations;
+thread_local static std::map<const CFGBlock *, std::set<GraphKey>> s_blockAnnotations;
+thread_local static size_t s_exitId = 0;
 
 static const std::set<Register> s_allCalleeSavedRegisters = {
     BX, BP, R12, R13, R14, R15
@@ -130,6 +132,8 @@ static void ForEachOperand(Instruction &instr, Fn &&fn)
             fn(i.rhs);
         } else if constexpr (std::is_same_v<T, Jmp>) {
         } else if constexpr (std::is_same_v<T, JmpCC>) {
+        } else if constexpr (std::is_same_v<T, JmpIndirect>) {
+            fn(i.target);
         } else if constexpr (std::is_same_v<T, SetCC>) {
             fn(i.op);
         } else if constexpr (std::is_same_v<T, Label>) {
@@ -158,7 +162,7 @@ static Operand keyToOperand(const GraphKey &key, WordType type = Longword)
         using T = std::decay_t<decltype(v)>;
         if constexpr (std::is_same_v<T, Register>) {
             return Reg{ v, GetBytesOfWordType(type) };
-        } else if constexpr (std::is_same_v<T, std::string>) {
+        } else if constexpr (std::is_same_v<T, Symbol>) {
             return Pseudo{ v };
         }
     }, key);
@@ -258,7 +262,7 @@ static inline void unionCoalesced(
 }
 
 static std::map<GraphKey, GraphKey> coalesce(
-    const std::list<CFGBlock> &blocks,
+    const CFG &blocks,
     std::map<GraphKey, GraphData> &interference_graph,
     uint8_t k)
 {
@@ -304,7 +308,7 @@ static std::map<GraphKey, GraphKey> coalesce(
 }
 
 static void rewriteCoalesced(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     const std::map<GraphKey, GraphKey> &coalesced_registers)
 {
     replaceOperandsInFunction(blocks, [&coalesced_registers](Operand &op, WordType type) -> bool {
@@ -344,10 +348,10 @@ static std::map<GraphKey, GraphData> buildBaseGraph(const std::vector<Register>
 }
 
 static inline void addPseudoRegisters(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     std::map<GraphKey, GraphData> &graph,
     bool processing_floating_points,
-    const std::set<std::string> &aliased_vars,
+    const std::set<Symbol> &aliased_vars,
     ASMSymbolTable *asm_symbol_table)
 {
     for (auto &block : blocks) {
@@ -370,7 +374,7 @@ static inline void addPseudoRegisters(
 }
 
 static inline void addSpillCosts(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     std::map<GraphKey, GraphData> &graph,
     bool processing_floating_points,
     ASMSymbolTable *asm_symbol_table)
@@ -393,48 +397,47 @@ static inline void addSpillCosts(
     }
 }
 
-static inline void connect(CFGBlock *from, CFGBlock *to)
-{
-    from->successors.insert(to);
-    to->predecessors.insert(from);
-}
-
-static void addControlFlowEdges(std::list<CFGBlock> &blocks)
+// Connects the blocks by their jumps and fall-throughs; the blocks
+// returning are connected to the last (exit) block
+void addControlFlowEdges(CFG &blocks)
 {
     // Map labels to their blocks
-    std::map<std::string, CFGBlock *> blockLabels;
-    for (auto &block : blocks) {
-        block.predecessors.clear();
-        block.successors.clear();
+    std::unordered_map<Symbol, size_t> blockLabels;
+    blocks.clearEdges();
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const CFGBlock &block = blocks[i];
         if (block.instructions.empty())
             continue;
         if (const Label *label = std::get_if<Label>(&block.instructions.front()))
-            blockLabels[label->identifier] = &block;
+            blockLabels[label->identifier] = i;
     }
+    auto connect_label = [&](size_t from, Symbol label) {
+        if (auto it = blockLabels.find(label); it != blockLabels.end())
+            blocks.connect(from, it->second);
+    };
 
     // Connect blocks
-    CFGBlock *entry_block = &blocks.front();
-    CFGBlock *exit_block = &blocks.back();
-    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-        CFGBlock *block = &*it;
-        CFGBlock *next_block = (block == exit_block)
-            ? exit_block : &*std::next(it);
-        if (block == entry_block || block->instructions.empty()) {
-            connect(block, next_block);
+    size_t exit_block = blocks.size() - 1;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const CFGBlock &block = blocks[i];
+        size_t next_block = (i == exit_block) ? exit_block : i + 1;
+        if (i == 0 || block.instructions.empty()) {
+            blocks.connect(i, next_block);
             continue;
         }
-        Instruction &last = block->instructions.back();
+        const Instruction &last = block.instructions.back();
         if (std::holds_alternative<Ret>(last))
-            connect(block, exit_block);
-        else if (const Jmp *j = std::get_if<Jmp>(&last)) {
-            if (CFGBlock *target = blockLabels[j->identifier])
-                connect(block, target);
-        } else if (const JmpCC *jcc = std::get_if<JmpCC>(&last)) {
-            if (CFGBlock *target = blockLabels[jcc->identifier])
-                connect(block, target);
-            connect(block, next_block);
+            blocks.connect(i, exit_block);
+        else if (const Jmp *j = std::get_if<Jmp>(&last))
+            connect_label(i, j->identifier);
+        else if (const JmpCC *jcc = std::get_if<JmpCC>(&last)) {
+            connect_label(i, jcc->identifier);
+            blocks.connect(i, next_block);
+        } else if (const JmpIndirect *ji = std::get_if<JmpIndirect>(&last)) {
+            for (Symbol target : ji->targets)
+                connect_label(i, target);
         } else
-            connect(block, next_block);
+            blocks.connect(i, next_block);
     }
 }
 
@@ -504,6 +507,8 @@ static std::pair<std::vector<Operand>, std::vector<Operand>> findUsedAndUpdated(
             return { { i.lhs, i.rhs }, { } };
         } else if constexpr (std::is_same_v<T, Jmp>) {
         } else if constexpr (std::is_same_v<T, JmpCC>) {
+        } else if constexpr (std::is_same_v<T, JmpIndirect>) {
+            return { { i.target }, { } };
         } else if constexpr (std::is_same_v<T, SetCC>) {
             return { { }, { i.op } };
         } else if constexpr (std::is_same_v<T, Label>) {
@@ -564,11 +569,13 @@ static void transfer(
 // Meet operator: propagates information about live registers
 // from one block to another.
 static std::set<GraphKey> meet(
+    const CFG &blocks,
     const CFGBlock *block,
     FunEntry *function_entry)
 {
     std::set<GraphKey> live_registers;
-    for (auto &succ : block->successors) {
+    for (uint32_t succ_index : block->successors) {
+        const CFGBlock *succ = &blocks[succ_index];
         if (succ->id == 0)
             assert(false);
         else if (succ->id == s_exitId) {
@@ -584,7 +591,7 @@ static std::set<GraphKey> meet(
 
 // Iterative algorithm: implements a backward (liveness) analysis
 static void findLiveRegisters(
-    const std::list<CFGBlock> &blocks,
+    const CFG &blocks,
     FunEntry *function_entry,
     ASMSymbolTable *asm_symbol_table)
 {
@@ -601,10 +608,11 @@ static void findLiveRegisters(
         const CFGBlock *block = worklist.front();
         worklist.pop_front();
         std::set<GraphKey> old_annotations = s_blockAnnotations[block];
-        std::set<GraphKey> end_live = meet(block, function_entry);
+        std::set<GraphKey> end_live = meet(blocks, block, function_entry);
         transfer(block, end_live, asm_symbol_table);
         if (old_annotations != s_blockAnnotations[block]) {
-            for (auto pred : block->predecessors) {
+            for (uint32_t pred_index : block->predecessors) {
+                const CFGBlock *pred = &blocks[pred_index];
                 if (pred->id == 0 || pred->id == s_exitId)
                     continue;
                 if (std::find(worklist.begin(), worklist.end(), pred) == worklist.end())
@@ -615,7 +623,7 @@ static void findLiveRegisters(
 }
 
 static void addInterferenceEdges(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     std::map<GraphKey, GraphData> &interference_graph,
     ASMSymbolTable *asm_symbol_table)
 {
@@ -725,30 +733,42 @@ static void colorGraph(std::map<GraphKey, GraphData> &graph, uint8_t k)
 }
 
 static std::map<GraphKey, GraphData> buildInterferenceGraph(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     FunEntry *function_entry,
     ASMSymbolTable *asm_symbol_table,
-    const std::vector<Register> &registers)
+    const std::vector<Register> &registers,
+    PassTimer *timer)
 {
     uint8_t k = static_cast<uint8_t>(registers.size());
     bool processing_floating_points = registers[0] >= XMM0;
     std::map<GraphKey, GraphData> interference_graph;
 
+    auto count = [&]() { return blocks.instructionCount(); };
     while (true) {
-        interference_graph = buildBaseGraph(registers);
-        addPseudoRegisters(
-            blocks, interference_graph,
-            processing_floating_points,
-            function_entry->aliased_vars,
-            asm_symbol_table);
-        addControlFlowEdges(blocks);
-        s_instructionAnnotations.clear();
-        s_blockAnnotations.clear();
-        s_exitId = blocks.back().id;
-        findLiveRegisters(blocks, function_entry, asm_symbol_table);
-        addInterferenceEdges(blocks, interference_graph, asm_symbol_table);
+        {
+            auto t = timer->Time("Liveness analysis");
+            t.Count("instructions", count);
+            interference_graph = buildBaseGraph(registers);
+            addPseudoRegisters(
+                blocks, interference_graph,
+                processing_floating_points,
+                function_entry->aliased_vars,
+                asm_symbol_table);
+            addControlFlowEdges(blocks);
+            s_instructionAnnotations.clear();
+            s_blockAnnotations.clear();
+            s_exitId = blocks.back().id;
+            findLiveRegisters(blocks, function_entry, asm_symbol_table);
+        }
+        {
+            auto t = timer->Time("Interference graph");
+            t.Count("nodes", [&]() { return interference_graph.size(); });
+            addInterferenceEdges(blocks, interference_graph, asm_symbol_table);
+        }
 
 #if REGISTER_COALESCATION
+        auto t = timer->Time("Coalescing");
+        t.Count("instructions", count);
         auto coalesced = coalesce(blocks, interference_graph, k);
         if (coalesced.empty())
             break;
@@ -758,6 +778,8 @@ static std::map<GraphKey, GraphData> buildInterferenceGraph(
 #endif
     }
 
+    auto t = timer->Time("Graph coloring");
+    t.Count("nodes", [&]() { return interference_graph.size(); });
     addSpillCosts(blocks, interference_graph, processing_floating_points, asm_symbol_table);
 
     colorGraph(interference_graph, k);
@@ -766,7 +788,7 @@ static std::map<GraphKey, GraphData> buildInterferenceGraph(
 
 void addToRegisterMap(
     std::map<GraphKey, GraphData> &graph,
-    std::map<std::string, Register> &register_map,
+    std::map<Symbol, Register> &register_map,
     FunEntry *function_entry)
 {
     std::map<size_t, Register> color_map;
@@ -776,7 +798,7 @@ void addToRegisterMap(
     }
 
     for (auto &[key, data] : graph) {
-        if (const std::string *name = std::get_if<std::string>(&key)) {
+        if (const Symbol *name = std::get_if<Symbol>(&key)) {
             if (data.color == 0)
                 continue;
             Register reg = color_map[data.color];
@@ -788,21 +810,24 @@ void addToRegisterMap(
 }
 
 void allocateRegisters(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     FunEntry *function_entry,
-    ASMSymbolTable *asm_symbol_table)
+    ASMSymbolTable *asm_symbol_table,
+    PassTimer *timer)
 {
     // Mapping pseudo registers to physical registers
-    std::map<std::string, Register> register_map;
+    std::map<Symbol, Register> register_map;
 
     std::map<GraphKey, GraphData> int_graph
-        = buildInterferenceGraph(blocks, function_entry, asm_symbol_table, s_integerRegisters);
+        = buildInterferenceGraph(blocks, function_entry, asm_symbol_table, s_integerRegisters, timer);
     addToRegisterMap(int_graph, register_map, function_entry);
 
     std::map<GraphKey, GraphData> xmm_graph
-        = buildInterferenceGraph(blocks, function_entry, asm_symbol_table, s_floatingPointRegisters);
+        = buildInterferenceGraph(blocks, function_entry, asm_symbol_table, s_floatingPointRegisters, timer);
     addToRegisterMap(xmm_graph, register_map, function_entry);
 
+    auto t = timer->Time("Register replacement");
+    t.Count("instructions", [&]() { return blocks.instructionCount(); });
     replacePseudoRegisters(blocks, register_map, function_entry->callee_saved_registers);
 }
 
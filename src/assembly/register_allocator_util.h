@@ -2,9 +2,9 @@
 
 namespace assembly {
 
-static inline std::list<Instruction>::iterator removeIfNeeded(
-    std::list<Instruction> &instructions,
-    std::list<Instruction>::iterator it,
+static inline InstructionList::iterator removeIfNeeded(
+    InstructionList &instructions,
+    InstructionList::iterator it,
     const Operand &a,
     const Operand &b,
     bool changed)
@@ -20,7 +20,7 @@ static inline std::list<Instruction>::iterator removeIfNeeded(
 
 template <typename ReplaceFn>
 void replaceOperandsInFunction(
-    std::list<CFGBlock> &blocks,
+    CFG &blocks,
     ReplaceFn &&replaceFn)
 {
     for (auto &block : blocks) {
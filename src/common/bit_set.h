@@ -0,0 +1,89 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed size set of dense indices (e.g. variable or copy ids of a function),
+// stored as 64-bit words. Set operations work a word at a time.
+class BitSet {
+public:
+    BitSet() = default;
+    explicit BitSet(size_t size) : m_size(size), m_words((size + 63) / 64, 0) {}
+
+    size_t size() const { return m_size; }
+
+    bool test(size_t i) const { return m_words[i / 64] >> (i % 64) & 1; }
+    void set(size_t i) { m_words[i / 64] |= uint64_t(1) << (i % 64); }
+    void reset(size_t i) { m_words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+    void setAll()
+    {
+        for (auto &word : m_words)
+            word = ~uint64_t(0);
+        if (m_size % 64 && !m_words.empty())
+            m_words.back() = (uint64_t(1) << (m_size % 64)) - 1;
+    }
+
+    void clear()
+    {
+        for (auto &word : m_words)
+            word = 0;
+    }
+
+    bool any() const
+    {
+        for (auto word : m_words) {
+            if (word)
+                return true;
+        }
+        return false;
+    }
+
+    size_t count() const
+    {
+        size_t ret = 0;
+        for (auto word : m_words)
+            ret += static_cast<size_t>(std::popcount(word));
+        return ret;
+    }
+
+    BitSet &operator|=(const BitSet &other)
+    {
+        for (size_t i = 0; i < m_words.size(); ++i)
+            m_words[i] |= other.m_words[i];
+        return *this;
+    }
+
+    BitSet &operator&=(const BitSet &other)
+    {
+        for (size_t i = 0; i < m_words.size(); ++i)
+            m_words[i] &= other.m_words[i];
+        return *this;
+    }
+
+    // Removes the elements of the other set
+    BitSet &subtract(const BitSet &other)
+    {
+        for (size_t i = 0; i < m_words.size(); ++i)
+            m_words[i] &= ~other.m_words[i];
+        return *this;
+    }
+
+    friend bool operator==(const BitSet &a, const BitSet &b) = default;
+
+    // Calls fn with the index of each element in increasing order
+    template <typename Fn>
+    void forEach(Fn &&fn) const
+    {
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            for (uint64_t word = m_words[i]; word; word &= word - 1)
+                fn(i * 64 + static_cast<size_t>(std::countr_zero(word)));
+        }
+    }
+
+private:
+    size_t m_size = 0;
+    std::vector<uint64_t> m_words;
+};
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// Control flow graph storage shared by the TAC and the assembly layers.
+// The blocks of a function are stored in a vector and refer to each other
+// by their index in it. The instructions of all the blocks are allocated from
+// one pool per function and linked into per-block lists.
+
+static constexpr uint32_t NoNode = UINT32_MAX;
+
+// Instruction nodes of a function, allocated in fixed size chunks so the
+// instructions never move. Freed nodes are reused.
+template <typename T>
+class NodePool {
+public:
+    struct Node {
+        std::optional<T> value;
+        uint32_t prev = NoNode;
+        uint32_t next = NoNode;
+    };
+
+    NodePool() = default;
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    Node &at(uint32_t index) { return m_chunks[index / ChunkSize][index % ChunkSize]; }
+
+    template <typename... Args>
+    uint32_t allocate(Args &&...args)
+    {
+        uint32_t index;
+        if (m_free != NoNode) {
+            index = m_free;
+            m_free = at(index).next;
+        } else {
+            index = m_count++;
+            if (index % ChunkSize == 0)
+                m_chunks.push_back(std::make_unique<Node[]>(ChunkSize));
+        }
+        at(index).value.emplace(std::forward<Args>(args)...);
+        return index;
+    }
+
+    void free(uint32_t index)
+    {
+        Node &node = at(index);
+        node.value.reset();
+        node.next = m_free;
+        m_free = index;
+    }
+
+private:
+    static constexpr uint32_t ChunkSize = 256;
+
+    std::vector<std::unique_ptr<Node[]>> m_chunks;
+    uint32_t m_count = 0;
+    uint32_t m_free = NoNode;
+};
+
+// Doubly linked list of instructions living in a NodePool, with the
+// interface of std::list. Insertion and removal are O(1) and don't
+// invalidate iterators to other elements.
+template <typename T>
+class PooledList {
+    using Pool = NodePool<T>;
+
+public:
+    template <bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T *, T *>;
+        using reference = std::conditional_t<Const, const T &, T &>;
+
+        Iterator() = default;
+        Iterator(const PooledList *list, uint32_t index) : m_list(list), m_index(index) {}
+        operator Iterator<true>() const { return Iterator<true>(m_list, m_index); }
+
+        reference operator*() const { return *m_list->m_pool->at(m_index).value; }
+        pointer operator->() const { return &**this; }
+
+        Iterator &operator++()
+        {
+            m_index = m_list->m_pool->at(m_index).next;
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator &operator--()
+        {
+            m_index = (m_index == NoNode) ? m_list->m_tail : m_list->m_pool->at(m_index).prev;
+            return *this;
+        }
+        Iterator operator--(int)
+        {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        template <bool OtherConst>
+        bool operator==(const Iterator<OtherConst> &other) const { return m_index == other.index(); }
+
+        uint32_t index() const { return m_index; }
+
+    private:
+        const PooledList *m_list = nullptr;
+        uint32_t m_index = NoNode;
+    };
+
+    using value_type = T;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    PooledList() = default;
+    explicit PooledList(Pool *pool) : m_pool(pool) {}
+    PooledList(const PooledList &) = delete;
+    PooledList &operator=(const PooledList &) = delete;
+
+    // The moved-from list stays empty, attached to the same pool
+    PooledList(PooledList &&other) noexcept
+        : m_pool(other.m_pool)
+        , m_head(other.m_head)
+        , m_tail(other.m_tail)
+        , m_size(other.m_size)
+    {
+        other.release();
+    }
+
+    PooledList &operator=(PooledList &&other) noexcept
+    {
+        if (this != &other) {
+            clear();
+            m_pool = other.m_pool;
+            m_head = other.m_head;
+            m_tail = other.m_tail;
+            m_size = other.m_size;
+            other.release();
+        }
+        return *this;
+    }
+
+    ~PooledList() { clear(); }
+
+    Pool *pool() const { return m_pool; }
+
+    iterator begin() { return iterator(this, m_head); }
+    iterator end() { return iterator(this, NoNode); }
+    const_iterator begin() const { return const_iterator(this, m_head); }
+    const_iterator end() const { return const_iterator(this, NoNode); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    T &front() { return *begin(); }
+    T &back() { return *std::prev(end()); }
+    const T &front() const { return *begin(); }
+    const T &back() const { return *std::prev(end()); }
+
+    template <typename... Args>
+    iterator emplace(const_iterator pos, Args &&...args)
+    {
+        assert(m_pool);
+        uint32_t index = m_pool->allocate(std::forward<Args>(args)...);
+        uint32_t next = pos.index();
+        uint32_t prev = (next == NoNode) ? m_tail : node(next).prev;
+        node(index).prev = prev;
+        node(index).next = next;
+        (prev == NoNode ? m_head : node(prev).next) = index;
+        (next == NoNode ? m_tail : node(next).prev) = index;
+        ++m_size;
+        return iterator(this, index);
+    }
+
+    iterator insert(const_iterator pos, const T &value) { return emplace(pos, value); }
+    iterator insert(const_iterator pos, T &&value) { return emplace(pos, std::move(value)); }
+
+    template <typename... Args>
+    T &emplace_back(Args &&...args) { return *emplace(end(), std::forward<Args>(args)...); }
+    template <typename... Args>
+    T &emplace_front(Args &&...args) { return *emplace(begin(), std::forward<Args>(args)...); }
+    void push_back(const T &value) { emplace(end(), value); }
+    void push_back(T &&value) { emplace(end(), std::move(value)); }
+    void push_front(const T &value) { emplace(begin(), value); }
+    void push_front(T &&value) { emplace(begin(), std::move(value)); }
+
+    iterator erase(const_iterator pos)
+    {
+        uint32_t index = pos.index();
+        uint32_t prev = node(index).prev;
+        uint32_t next = node(index).next;
+        (prev == NoNode ? m_head : node(prev).next) = next;
+        (next == NoNode ? m_tail : node(next).prev) = prev;
+        m_pool->free(index);
+        --m_size;
+        return iterator(this, next);
+    }
+
+    void pop_back() { erase(std::prev(end())); }
+    void pop_front() { erase(begin()); }
+
+    void clear()
+    {
+        for (uint32_t index = m_head; index != NoNode;) {
+            uint32_t next = node(index).next;
+            m_pool->free(index);
+            index = next;
+        }
+        release();
+    }
+
+private:
+    typename Pool::Node &node(uint32_t index) const { return m_pool->at(index); }
+
+    void release()
+    {
+        m_head = NoNode;
+        m_tail = NoNode;
+        m_size = 0;
+    }
+
+    Pool *m_pool = nullptr;
+    uint32_t m_head = NoNode;
+    uint32_t m_tail = NoNode;
+    size_t m_size = 0;
+};
+
+// Indices of the predecessor or successor blocks of a block, without
+// duplicates. Most blocks have at most two, those are stored inline.
+class EdgeList {
+public:
+    const uint32_t *begin() const { return data(); }
+    const uint32_t *end() const { return data() + m_size; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    uint32_t front() const { return *begin(); }
+
+    bool contains(uint32_t block) const
+    {
+        for (uint32_t b : *this) {
+            if (b == block)
+                return true;
+        }
+        return false;
+    }
+
+    bool insert(uint32_t block)
+    {
+        if (contains(block))
+            return false;
+        if (m_size < InlineCapacity)
+            m_inline[m_size] = block;
+        else {
+            if (m_size == InlineCapacity)
+                m_spill.assign(m_inline.begin(), m_inline.end());
+            m_spill.push_back(block);
+        }
+        ++m_size;
+        return true;
+    }
+
+    bool erase(uint32_t block)
+    {
+        uint32_t *first = data();
+        uint32_t *last = first + m_size;
+        uint32_t *it = std::find(first, last, block);
+        if (it == last)
+            return false;
+        std::copy(it + 1, last, it);
+        if (--m_size > InlineCapacity)
+            m_spill.pop_back();
+        else if (m_size == InlineCapacity) {
+            std::copy(m_spill.begin(), m_spill.begin() + InlineCapacity, m_inline.begin());
+            m_spill.clear();
+        }
+        return true;
+    }
+
+    void clear()
+    {
+        m_size = 0;
+        m_spill.clear();
+    }
+
+    // Replaces each index with fn(index); fn returns NoNode to drop it
+    template <typename Fn>
+    void remap(Fn &&fn)
+    {
+        uint32_t *first = data();
+        uint32_t *out = first;
+        for (uint32_t *it = first; it != first + m_size; ++it) {
+            uint32_t mapped = fn(*it);
+            if (mapped != NoNode)
+                *out++ = mapped;
+        }
+        size_t new_size = static_cast<size_t>(out - first);
+        if (m_size > InlineCapacity && new_size <= InlineCapacity) {
+            std::copy(m_spill.begin(), m_spill.begin() + static_cast<std::ptrdiff_t>(new_size), m_inline.begin());
+            m_spill.clear();
+        } else if (new_size > InlineCapacity)
+            m_spill.resize(new_size);
+        m_size = static_cast<uint32_t>(new_size);
+    }
+
+private:
+    static constexpr uint32_t InlineCapacity = 2;
+
+    uint32_t *data() { return m_size <= InlineCapacity ? m_inline.data() : m_spill.data(); }
+    const uint32_t *data() const { return m_size <= InlineCapacity ? m_inline.data() : m_spill.data(); }
+
+    uint32_t m_size = 0;
+    std::array<uint32_t, InlineCapacity> m_inline = {};
+    std::vector<uint32_t> m_spill;
+};
+
+template <typename T>
+class BasicBlock {
+public:
+    PooledList<T> instructions = {};
+    EdgeList predecessors = {};
+    EdgeList successors = {};
+    // Stays the same when other blocks are removed
+    size_t id;
+};
+
+// The blocks of a function. Blocks are added before connecting them,
+// removing blocks keeps the order and the edges of the remaining ones.
+template <typename T>
+class ControlFlowGraph {
+public:
+    using Block = BasicBlock<T>;
+
+    ControlFlowGraph() : m_pool(std::make_unique<NodePool<T>>()) {}
+    ControlFlowGraph(ControlFlowGraph &&) = default;
+    ControlFlowGraph &operator=(ControlFlowGraph &&) = default;
+
+    // An empty instruction list which can be moved into a block later
+    PooledList<T> newList() const { return PooledList<T>(m_pool.get()); }
+
+    auto begin() { return m_blocks.begin(); }
+    auto end() { return m_blocks.end(); }
+    auto begin() const { return m_blocks.begin(); }
+    auto end() const { return m_blocks.end(); }
+    auto rbegin() { return m_blocks.rbegin(); }
+    auto rend() { return m_blocks.rend(); }
+    auto rbegin() const { return m_blocks.rbegin(); }
+    auto rend() const { return m_blocks.rend(); }
+
+    size_t size() const { return m_blocks.size(); }
+    bool empty() const { return m_blocks.empty(); }
+    Block &front() { return m_blocks.front(); }
+    Block &back() { return m_blocks.back(); }
+    const Block &front() const { return m_blocks.front(); }
+    const Block &back() const { return m_blocks.back(); }
+    Block &operator[](size_t index) { return m_blocks[index]; }
+    const Block &operator[](size_t index) const { return m_blocks[index]; }
+
+    size_t indexOf(const Block &block) const { return static_cast<size_t>(&block - m_blocks.data()); }
+
+    // Summed over the blocks
+    size_t instructionCount() const
+    {
+        size_t ret = 0;
+        for (auto &block : m_blocks)
+            ret += block.instructions.size();
+        return ret;
+    }
+
+    Block &emplace_back(Block &&block)
+    {
+        adopt(block);
+        return m_blocks.emplace_back(std::move(block));
+    }
+
+    Block &emplace_front(Block &&block)
+    {
+        adopt(block);
+        for (auto &b : m_blocks) {
+            b.predecessors.remap([](uint32_t i) { return i + 1; });
+            b.successors.remap([](uint32_t i) { return i + 1; });
+        }
+        return *m_blocks.emplace(m_blocks.begin(), std::move(block));
+    }
+
+    // Inserts the blocks before the one at index, keeping the edges
+    void insert(size_t index, std::vector<Block> &&blocks)
+    {
+        uint32_t count = static_cast<uint32_t>(blocks.size());
+        for (auto &block : blocks)
+            adopt(block);
+        for (auto &b : m_blocks) {
+            auto shift = [&](uint32_t i) { return i >= index ? i + count : i; };
+            b.predecessors.remap(shift);
+            b.successors.remap(shift);
+        }
+        m_blocks.insert(
+            m_blocks.begin() + static_cast<std::ptrdiff_t>(index),
+            std::make_move_iterator(blocks.begin()),
+            std::make_move_iterator(blocks.end()));
+    }
+
+    void connect(size_t from, size_t to)
+    {
+        m_blocks[from].successors.insert(static_cast<uint32_t>(to));
+        m_blocks[to].predecessors.insert(static_cast<uint32_t>(from));
+    }
+
+    void disconnect(size_t from, size_t to)
+    {
+        m_blocks[from].successors.erase(static_cast<uint32_t>(to));
+        m_blocks[to].predecessors.erase(static_cast<uint32_t>(from));
+    }
+
+    void clearEdges()
+    {
+        for (auto &block : m_blocks) {
+            block.predecessors.clear();
+            block.successors.clear();
+        }
+    }
+
+    // Removes the blocks marked by their index; the edges to them are dropped
+    void removeBlocks(const std::vector<bool> &removed)
+    {
+        std::vector<uint32_t> new_index(m_blocks.size(), NoNode);
+        uint32_t count = 0;
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            if (!removed[i])
+                new_index[i] = count++;
+        }
+        auto remap = [&](uint32_t i) { return new_index[i]; };
+        size_t out = 0;
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            if (removed[i])
+                continue;
+            m_blocks[i].predecessors.remap(remap);
+            m_blocks[i].successors.remap(remap);
+            if (out != i)
+                m_blocks[out] = std::move(m_blocks[i]);
+            ++out;
+        }
+        m_blocks.erase(m_blocks.begin() + static_cast<std::ptrdiff_t>(out), m_blocks.end());
+    }
+
+private:
+    void adopt(Block &block)
+    {
+        assert(!block.instructions.pool() || block.instructions.pool() == m_pool.get());
+        if (!block.instructions.pool())
+            block.instructions = newList();
+    }
+
+    // Declared first, so it's destroyed after the blocks
+    std::unique_ptr<NodePool<T>> m_pool;
+    std::vector<Block> m_blocks;
+};
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "assembly/asm_symbol_table.h"
+#include "pass_timer.h"
+#include "preprocessor/header_cache.h"
+#include "thread_pool.h"
 #include "type_table.h"
 #include "symbol_table.h"
+#include <atomic>
 
 class Context {
 public:
@@ -12,9 +16,31 @@ public:
         std::make_shared<SymbolTable>(typeTable.get());
     std::shared_ptr<assembly::ASMSymbolTable> asmSymbolTable =
         std::make_shared<assembly::ASMSymbolTable>();
+    std::shared_ptr<PassTimer> passTimer =
+        std::make_shared<PassTimer>();
+    // Tokenized headers, shared by the translation units
+    std::shared_ptr<preprocessor::HeaderCache> headerCache =
+        std::make_shared<preprocessor::HeaderCache>();
+    // Functions are optimized and allocated in parallel on it (if set)
+    std::shared_ptr<ThreadPool> threadPool;
+    // Suffix of the generated names (see labeling.h); atomic, because the
+    // functions of the translation unit may be processed in parallel
+    std::atomic<size_t> labelCounter = 0;
 
     bool constant_folding = false;
     bool copy_propagation = false;
     bool unreachable_code_elimination = false;
     bool dead_store_elimination = false;
+    // Loop invariant instructions are hoisted into the loop preheaders
+    bool loop_invariant_code_motion = false;
+    // Redundant computations are replaced with copies (in SSA form, enables ssa)
+    bool common_subexpression_elimination = false;
+    // Array accesses indexed by induction variables become pointer increments
+    bool induction_variables = false;
+    // Calls to small functions of the translation unit are inlined
+    bool inlining = false;
+    // Sparse optimizations in SSA form before the iterative passes
+    bool ssa = false;
+    // Instruction sequences of the final assembly are simplified
+    bool peephole = false;
 };
@@ -7,4 +7,5 @@ enum Error {
     PARSER_ERROR = 3,
     SEMANTIC_ERROR = 4,
     TYPE_ERROR = 5,
+    PREPROCESSOR_ERROR = 6,
 };
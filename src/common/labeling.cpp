@@ -1,14 +1,13 @@
 #include "labeling.h"
+#include "context.h"
 #include <format>
 
-static size_t s_counter = 0;
-
-std::string MakeNameUnique(std::string_view name)
+std::string MakeNameUnique(Context *context, std::string_view name)
 {
-    return std::format("{}.{}", name, s_counter++);
+    return std::format("{}.{}", name, context->labelCounter++);
 }
 
-std::string GenerateTempVariableName()
+std::string GenerateTempVariableName(Context *context)
 {
-    return std::format("tmp.{}", s_counter++);
+    return std::format("tmp.{}", context->labelCounter++);
 }
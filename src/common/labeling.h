@@ -2,8 +2,10 @@
 
 #include <string>
 
+class Context;
+
 // Generate string identifiers on multiple levels of the compilation
-// and ensure that they are not colliding
+// and ensure that they are not colliding within the translation unit
 
-std::string MakeNameUnique(std::string_view name);
-std::string GenerateTempVariableName();
+std::string MakeNameUnique(Context *context, std::string_view name);
+std::string GenerateTempVariableName(Context *context);
@@ -0,0 +1,187 @@
+#include "pass_timer.h"
+#include <format>
+#include <sys/resource.h>
+
+// Peak resident set size of the process in kilobytes
+static long peakRss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // bytes
+#else
+    return usage.ru_maxrss; // kilobytes
+#endif
+}
+
+static std::string escapeJSON(std::string_view str)
+{
+    std::string ret;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            ret += '\\';
+        ret += c;
+    }
+    return ret;
+}
+
+PassTimer::Scope::Scope(PassTimer *timer, std::string_view name)
+    : m_timer(timer && timer->enabled ? timer : nullptr)
+{
+    if (!m_timer)
+        return;
+    m_record = m_timer->Enter(name);
+    m_startPeakRss = peakRss();
+    m_start = std::chrono::steady_clock::now();
+}
+
+PassTimer::Scope::~Scope()
+{
+    if (!m_timer)
+        return;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+    m_timer->Leave(m_record, elapsed.count(), peakRss() - m_startPeakRss);
+}
+
+PassTimer::Scope PassTimer::Time(std::string_view name)
+{
+    return Scope(this, name);
+}
+
+PassTimer::Stack PassTimer::CurrentStack()
+{
+    if (!enabled)
+        return {};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_stacks.find(std::this_thread::get_id());
+    return it == m_stacks.end() ? Stack{} : it->second;
+}
+
+PassTimer::Attach::Attach(PassTimer *timer, const Stack &stack)
+{
+    if (!timer || !timer->enabled)
+        return;
+    std::lock_guard<std::mutex> lock(timer->m_mutex);
+    // Nothing to do when the task runs on the thread which started it
+    auto [it, inserted] = timer->m_stacks.try_emplace(std::this_thread::get_id(), stack);
+    if (inserted)
+        m_timer = timer;
+}
+
+PassTimer::Attach::~Attach()
+{
+    if (!m_timer)
+        return;
+    std::lock_guard<std::mutex> lock(m_timer->m_mutex);
+    m_timer->m_stacks.erase(std::this_thread::get_id());
+}
+
+size_t PassTimer::Enter(std::string_view name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stack &stack = m_stacks[std::this_thread::get_id()];
+
+    // Records are keyed by their parent, so the same pass name
+    // can appear under different phases
+    std::string key = stack.empty()
+        ? std::string(name)
+        : std::format("{}/{}", stack.back(), name);
+    auto it = m_index.find(key);
+    size_t index;
+    if (it == m_index.end()) {
+        index = m_records.size();
+        Record record;
+        record.name = name;
+        record.depth = stack.size();
+        if (!stack.empty())
+            record.parent = stack.back();
+        m_records.push_back(record);
+        m_index.emplace(key, index);
+    } else
+        index = it->second;
+    stack.push_back(index);
+    return index;
+}
+
+void PassTimer::Leave(size_t record, double seconds, long peak_rss_delta_kb)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Record &r = m_records[record];
+    r.calls++;
+    r.seconds += seconds;
+    r.peak_rss_delta_kb += peak_rss_delta_kb;
+
+    auto it = m_stacks.find(std::this_thread::get_id());
+    it->second.pop_back();
+    if (it->second.empty())
+        m_stacks.erase(it);
+}
+
+void PassTimer::AddObjects(size_t record, std::string_view unit, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Record &r = m_records[record];
+    r.unit = unit;
+    r.objects += count;
+}
+
+std::vector<size_t> PassTimer::TreeOrder() const
+{
+    std::vector<std::vector<size_t>> children(m_records.size() + 1);
+    for (size_t i = 0; i < m_records.size(); i++) {
+        size_t parent = m_records[i].parent;
+        children[parent == std::string::npos ? m_records.size() : parent].push_back(i);
+    }
+    std::vector<size_t> ret;
+    std::vector<size_t> worklist(children.back().rbegin(), children.back().rend());
+    while (!worklist.empty()) {
+        size_t current = worklist.back();
+        worklist.pop_back();
+        ret.push_back(current);
+        worklist.insert(worklist.end(), children[current].rbegin(), children[current].rend());
+    }
+    return ret;
+}
+
+void PassTimer::PrintText(std::ostream &out, std::string_view input) const
+{
+    out << "===== Pass timing report: " << input << " =====" << std::endl;
+    out << std::format("{:>10} {:>8} {:>12} {:>14}  {}",
+        "Wall (ms)", "Calls", "Peak RSS +KB", "Objects", "Pass") << std::endl;
+    for (size_t i : TreeOrder()) {
+        const Record &r = m_records[i];
+        std::string objects = r.unit.empty()
+            ? std::string("-")
+            : std::format("{} {}", r.objects, r.unit);
+        out << std::format("{:>10.3f} {:>8} {:>12} {:>14}  {}{}",
+            r.seconds * 1000.0,
+            r.calls,
+            r.peak_rss_delta_kb,
+            objects,
+            std::string(r.depth * 2, ' '),
+            r.name) << std::endl;
+    }
+}
+
+void PassTimer::PrintJSON(std::ostream &out, std::string_view input) const
+{
+    out << std::format("{{\"input\": \"{}\", \"passes\": [", escapeJSON(input));
+    bool first = true;
+    for (size_t i : TreeOrder()) {
+        const Record &r = m_records[i];
+        out << (first ? "\n  " : ",\n  ");
+        first = false;
+        out << std::format(
+            "{{\"name\": \"{}\", \"depth\": {}, \"calls\": {}, \"wall_ms\": {:.3f}, "
+            "\"peak_rss_delta_kb\": {}, \"objects\": {}, \"unit\": \"{}\"}}",
+            escapeJSON(r.name),
+            r.depth,
+            r.calls,
+            r.seconds * 1000.0,
+            r.peak_rss_delta_kb,
+            r.objects,
+            escapeJSON(r.unit));
+    }
+    out << "\n]}";
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Collects wall time, peak RSS growth and object counts of the
+// compilation phases (--time-passes). Phases can be nested and
+// entered multiple times (e.g. optimization passes running per function
+// and per round), those measurements are accumulated under one record.
+// Scopes of parallel tasks can be attached to the scopes of the thread
+// which started them, their wall times are summed up.
+class PassTimer {
+public:
+    struct Record {
+        std::string name;
+        size_t depth = 0;
+        // Enclosing record, npos for the driver phases
+        size_t parent = std::string::npos;
+        size_t calls = 0;
+        double seconds = 0.0;
+        // Process wide, so it's shared by translation units compiled in parallel
+        long peak_rss_delta_kb = 0;
+        // Objects produced or processed by the phase, summed over the calls
+        size_t objects = 0;
+        std::string unit;
+    };
+
+    class Scope {
+    public:
+        Scope(PassTimer *timer, std::string_view name);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        // The counter is only evaluated when the timer is enabled, and the
+        // clock is stopped meanwhile (e.g. counting walks the whole AST)
+        template <typename Fn>
+        void Count(std::string_view unit, Fn &&counter)
+        {
+            if (!m_timer)
+                return;
+            auto start = std::chrono::steady_clock::now();
+            size_t count = counter();
+            m_start += std::chrono::steady_clock::now() - start;
+            m_timer->AddObjects(m_record, unit, count);
+        }
+
+    private:
+        PassTimer *m_timer;
+        size_t m_record = 0;
+        std::chrono::steady_clock::time_point m_start;
+        long m_startPeakRss = 0;
+    };
+
+    // Returns an inactive scope when the timer is disabled
+    Scope Time(std::string_view name);
+
+    // Open scopes of the calling thread
+    using Stack = std::vector<size_t>;
+    Stack CurrentStack();
+
+    // Nests the scopes opened by the calling thread (e.g. in a parallel task)
+    // into the given scopes of another thread
+    class Attach {
+    public:
+        Attach(PassTimer *timer, const Stack &stack);
+        ~Attach();
+        Attach(const Attach &) = delete;
+        Attach &operator=(const Attach &) = delete;
+
+    private:
+        PassTimer *m_timer = nullptr;
+    };
+
+    // The reports are labeled with the name of the translation unit; the
+    // JSON one is a single object so the caller can collect them in an array
+    void PrintText(std::ostream &out, std::string_view input) const;
+    void PrintJSON(std::ostream &out, std::string_view input) const;
+
+    bool enabled = false;
+
+private:
+    size_t Enter(std::string_view name);
+    void Leave(size_t record, double seconds, long peak_rss_delta_kb);
+    void AddObjects(size_t record, std::string_view unit, size_t count);
+    // Records with the children following their parents
+    std::vector<size_t> TreeOrder() const;
+
+    std::vector<Record> m_records;
+    // "<parent index>/<name>" to record index
+    std::map<std::string, size_t> m_index;
+    std::map<std::thread::id, Stack> m_stacks;
+    std::mutex m_mutex;
+};
@@ -0,0 +1,73 @@
+#include "symbol.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// The names are stored in chunks which never move, chunk k has room for
+// FirstChunkSize * 2^k of them. They are read by id without locking.
+static constexpr size_t FirstChunkSize = 256;
+static constexpr size_t MaxChunks = 32;
+
+class SymbolStorage
+{
+public:
+    static SymbolStorage &Instance()
+    {
+        static SymbolStorage s_instance;
+        return s_instance;
+    }
+
+    uint32_t Intern(std::string_view name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_ids.find(name);
+        if (it != m_ids.end())
+            return it->second;
+        auto [chunk, offset] = Locate(m_count);
+        if (!m_chunks[chunk].load(std::memory_order_relaxed)) {
+            m_owned[chunk] = std::make_unique<std::string[]>(FirstChunkSize << chunk);
+            m_chunks[chunk].store(m_owned[chunk].get(), std::memory_order_release);
+        }
+        std::string &stored = m_chunks[chunk].load(std::memory_order_relaxed)[offset];
+        stored = name;
+        uint32_t id = static_cast<uint32_t>(m_count++);
+        m_ids.emplace(stored, id);
+        return id;
+    }
+
+    const std::string &Name(uint32_t id) const
+    {
+        auto [chunk, offset] = Locate(id);
+        return m_chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+private:
+    SymbolStorage() { Intern(""); }
+
+    static std::pair<size_t, size_t> Locate(size_t id)
+    {
+        size_t chunk = static_cast<size_t>(std::bit_width(id / FirstChunkSize + 1)) - 1;
+        assert(chunk < MaxChunks);
+        return { chunk, id - FirstChunkSize * ((size_t(1) << chunk) - 1) };
+    }
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string_view, uint32_t> m_ids;
+    size_t m_count = 0;
+    std::array<std::unique_ptr<std::string[]>, MaxChunks> m_owned;
+    std::array<std::atomic<std::string *>, MaxChunks> m_chunks{};
+};
+
+Symbol::Symbol(std::string_view name)
+    : m_id(name.empty() ? 0 : SymbolStorage::Instance().Intern(name))
+{
+}
+
+const std::string &Symbol::str() const
+{
+    return SymbolStorage::Instance().Name(m_id);
+}
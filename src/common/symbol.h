@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Interned name of a variable, function, label or temporary. Every distinct
+// name is stored once for the whole compilation, so a symbol is a 32-bit id,
+// copied, compared and hashed as an integer.
+class Symbol
+{
+public:
+    // The empty name
+    Symbol() = default;
+    Symbol(std::string_view name);
+    Symbol(const std::string &name) : Symbol(std::string_view(name)) {}
+    Symbol(const char *name) : Symbol(std::string_view(name)) {}
+
+    const std::string &str() const;
+    uint32_t id() const { return m_id; }
+    bool empty() const { return m_id == 0; }
+
+    friend bool operator==(Symbol a, Symbol b) { return a.m_id == b.m_id; }
+    // Ordered by the names, so ordered containers don't depend on
+    // the order in which the threads interned them
+    friend bool operator<(Symbol a, Symbol b) { return a.m_id != b.m_id && a.str() < b.str(); }
+
+    friend std::ostream &operator<<(std::ostream &os, Symbol symbol) { return os << symbol.str(); }
+
+private:
+    uint32_t m_id = 0;
+};
+
+template <>
+struct std::hash<Symbol> {
+    size_t operator()(Symbol symbol) const { return symbol.id(); }
+};
@@ -1,12 +1,13 @@
 #include "symbol_table.h"
+#include <algorithm>
 #include <iostream>
 
-bool SymbolTable::contains(const std::string &name)
+bool SymbolTable::contains(Symbol name) const
 {
     return m_table.contains(name);
 }
 
-const SymbolEntry *SymbolTable::get(const std::string &name)
+const SymbolEntry *SymbolTable::get(Symbol name) const
 {
     auto it = m_table.find(name);
     if (it != m_table.end())
@@ -14,7 +15,7 @@ const SymbolEntry *SymbolTable::get(const std::string &name)
     return nullptr;
 }
 
-int SymbolTable::getByteSize(const std::string &name)
+int SymbolTable::getByteSize(Symbol name) const
 {
     auto it = m_table.find(name);
     if (it != m_table.end())
@@ -22,16 +23,16 @@ int SymbolTable::getByteSize(const std::string &name)
     return 0;
 }
 
-const Type &SymbolTable::getType(const std::string &name)
+const Type &SymbolTable::getType(Symbol name) const
 {
     auto it = m_table.find(name);
     if (it != m_table.end())
         return it->second.type;
-    static Type empty;
+    static const Type empty;
     return empty;
 }
 
-WordType SymbolTable::getWordType(const std::string &name)
+WordType SymbolTable::getWordType(Symbol name) const
 {
     auto it = m_table.find(name);
     if (it != m_table.end())
@@ -39,14 +40,27 @@ WordType SymbolTable::getWordType(const std::string &name)
     return Longword;
 }
 
-void SymbolTable::insert(const std::string &name, const Type &type, const IdentifierAttributes &attr)
+void SymbolTable::insert(Symbol name, const Type &type, const IdentifierAttributes &attr)
 {
     m_table[name] = SymbolEntry{ type , attr };
 }
 
+std::vector<std::pair<Symbol, const SymbolEntry *>> SymbolTable::sortedEntries() const
+{
+    std::vector<std::pair<Symbol, const SymbolEntry *>> entries;
+    entries.reserve(m_table.size());
+    for (const auto &[name, entry] : m_table)
+        entries.emplace_back(name, &entry);
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
+    return entries;
+}
+
 void SymbolTable::print()
 {
-    for (const auto &[name, entry] : m_table) {
+    for (const auto &[name, entry_ptr] : sortedEntries()) {
+        const SymbolEntry &entry = *entry_ptr;
         std::cout << name << " ";
         std::cout << "[" << entry.type << "] ";
         std::cout << (entry.attrs.defined ? "defined" : "undefined") << " ";
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "symbol.h"
 #include "types.h"
 #include "values.h"
 #include <unordered_map>
+#include <vector>
 
 class TypeTable;
 
@@ -35,28 +37,34 @@ struct SymbolEntry {
     IdentifierAttributes attrs;
 };
 
+// The table is filled by the type checker and TAC generation, later stages
+// only look up symbols. Lookups don't modify it, so they are safe to do
+// concurrently (e.g. optimizing functions in parallel) without insertions.
 struct SymbolTable {
 public:
     SymbolTable(TypeTable *typeTable) : m_typeTable(typeTable) {}
 
-    bool contains(const std::string &name);
-    const SymbolEntry *get(const std::string &name);
-    template <typename T> const T *getTypeAs(const std::string &name) {
+    bool contains(Symbol name) const;
+    const SymbolEntry *get(Symbol name) const;
+    template <typename T> const T *getTypeAs(Symbol name) const {
         auto it = m_table.find(name);
         if (it != m_table.end()) {
             return it->second.type.getAs<T>();
         }
         return nullptr;
     }
-    int getByteSize(const std::string &name);
-    const Type &getType(const std::string &name);
-    WordType getWordType(const std::string &name);
+    int getByteSize(Symbol name) const;
+    const Type &getType(Symbol name) const;
+    WordType getWordType(Symbol name) const;
     void insert(
-        const std::string &name,
+        Symbol name,
         const Type &type,
         const IdentifierAttributes &attr);
+    // Entries ordered by name, for output which must not depend on
+    // the order in which the symbols were interned
+    std::vector<std::pair<Symbol, const SymbolEntry *>> sortedEntries() const;
     void print();
 
-    std::unordered_map<std::string, SymbolEntry> m_table;
+    std::unordered_map<Symbol, SymbolEntry> m_table;
     TypeTable *m_typeTable;
 };
@@ -0,0 +1,162 @@
+#include "thread_pool.h"
+
+// The pool and queue of the current worker thread
+thread_local static const ThreadPool *s_currentPool = nullptr;
+thread_local static size_t s_currentIndex = 0;
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = 1;
+    for (size_t i = 0; i < thread_count; i++)
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    m_workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++)
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskAvailable.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    Push(std::move(task));
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_allDone.wait(lock, [this]() { return m_pending == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+    if (count == 1) {
+        fn(0);
+        return;
+    }
+
+    struct Batch {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->remaining = count;
+    for (size_t i = 0; i < count; i++) {
+        Push([batch, &fn, i]() {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                if (!batch->error)
+                    batch->error = std::current_exception();
+            }
+            if (--batch->remaining == 0) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->done.notify_all();
+            }
+        });
+    }
+
+    size_t index = s_currentPool == this ? s_currentIndex : 0;
+    while (batch->remaining > 0) {
+        std::function<void()> task;
+        if (TryPop(index, task)) {
+            Run(task);
+            continue;
+        }
+        // Every remaining task of the batch is running on another thread
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait(lock, [&]() { return batch->remaining == 0; });
+    }
+
+    if (batch->error)
+        std::rethrow_exception(batch->error);
+}
+
+size_t ThreadPool::DefaultThreadCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    s_currentPool = this;
+    s_currentIndex = index;
+    while (true) {
+        std::function<void()> task;
+        if (TryPop(index, task)) {
+            Run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_taskAvailable.wait(lock, [this]() {
+            return m_stopping || m_queued > 0;
+        });
+        if (m_stopping && m_queued == 0)
+            return;
+    }
+}
+
+void ThreadPool::Push(std::function<void()> task)
+{
+    // Tasks submitted by a worker go to its own queue
+    size_t index = s_currentPool == this
+        ? s_currentIndex
+        : m_nextQueue++ % m_queues.size();
+    // Counted before another thread can pop it: a task finishing before its
+    // submission is counted would bring m_pending to zero while the task
+    // that submitted it is still running, and Wait would return early
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued++;
+        m_pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_taskAvailable.notify_one();
+}
+
+bool ThreadPool::TryPop(size_t index, std::function<void()> &task)
+{
+    for (size_t i = 0; i < m_queues.size(); i++) {
+        WorkerQueue &queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        break;
+    }
+    if (!task)
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued--;
+    return true;
+}
+
+void ThreadPool::Run(std::function<void()> &task)
+{
+    task();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0)
+        m_allDone.notify_all();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool of worker threads. Every worker has its own task queue,
+// idle workers steal from the others.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void Submit(std::function<void()> task);
+    // Blocks until every submitted task is finished
+    void Wait();
+
+    // Runs fn(0) ... fn(count - 1) on the pool and waits for them.
+    // The calling thread executes tasks too while waiting, so it can be
+    // used from inside of a task (e.g. functions of a translation unit).
+    void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+    size_t Size() const { return m_workers.size(); }
+
+    // Number of threads used when it's not specified by the user
+    static size_t DefaultThreadCount();
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    void Push(std::function<void()> task);
+    // Own queue first (LIFO), then stealing from the others (FIFO)
+    bool TryPop(size_t index, std::function<void()> &task);
+    void Run(std::function<void()> &task);
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::atomic<size_t> m_nextQueue = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_allDone;
+    size_t m_queued = 0;
+    size_t m_pending = 0;
+    bool m_stopping = false;
+};
+
+// ParallelFor on the pool, or a simple loop without one
+inline void RunParallel(ThreadPool *pool, size_t count, const std::function<void(size_t)> &fn)
+{
+    if (pool) {
+        pool->ParallelFor(count, fn);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+        fn(i);
+}
@@ -1,24 +1,26 @@
 #include "types.h"
 #include "common/type_table.h"
 #include <cassert>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 
-static const std::unordered_set<std::string> s_typeSpecifiers {
+static const std::unordered_set<std::string_view> s_typeSpecifiers {
 #define ADD_TYPE_TO_SET(stringname) stringname,
     TYPE_SPECIFIER_LIST(ADD_TYPE_TO_SET)
 #undef ADD_TYPE_TO_SET
 };
 
-static const std::unordered_map<std::string, StorageClass> s_storageClasses {
+static const std::unordered_map<std::string_view, StorageClass> s_storageClasses {
 #define ADD_CLASS_TO_MAP(enumname, stringname) {stringname, enumname},
     STORAGE_CLASS_LIST(ADD_CLASS_TO_MAP)
 #undef ADD_CLASS_TO_MAP
 };
 
-static const std::unordered_set<std::string> s_specifiers {
+static const std::unordered_set<std::string_view> s_specifiers {
 #define ADD_TYPE_TO_SET(stringname) stringname,
     TYPE_SPECIFIER_LIST(ADD_TYPE_TO_SET)
 #undef ADD_TYPE_TO_SET
@@ -51,12 +53,12 @@ static std::string toString(BasicType type)
     }
 }
 
-bool IsTypeSpecifier(const std::string &type)
+bool IsTypeSpecifier(std::string_view type)
 {
     return s_typeSpecifiers.contains(type);
 }
 
-std::optional<StorageClass> GetStorageClass(const std::string &storage)
+std::optional<StorageClass> GetStorageClass(std::string_view storage)
 {
     auto it = s_storageClasses.find(storage);
     if (it != s_storageClasses.end())
@@ -64,7 +66,7 @@ std::optional<StorageClass> GetStorageClass(const std::string &storage)
     return std::nullopt;
 }
 
-bool IsStorageOrTypeSpecifier(const std::string &type)
+bool IsStorageOrTypeSpecifier(std::string_view type)
 {
     return s_specifiers.contains(type);
 }
@@ -110,21 +112,21 @@ std::optional<Type> DetermineType(const std::set<std::string> &type_specifiers)
 
 bool AssemblyType::isWord(WordType type) const
 {
-    if (auto w = std::get_if<WordType>(&t))
+    if (auto w = getAs<WordType>())
         return *w == type;
     return false;
 }
 
 bool AssemblyType::isByteArray() const
 {
-    return std::holds_alternative<ByteArray>(t);
+    return getAs<ByteArray>() != nullptr;
 }
 
 size_t AssemblyType::size() const
 {
-    if (auto b = std::get_if<ByteArray>(&t))
+    if (auto b = getAs<ByteArray>())
         return b->size;
-    auto w = std::get_if<WordType>(&t);
+    auto w = getAs<WordType>();
     assert(w);
     switch (*w) {
     case WordType::Byte:
@@ -142,30 +144,25 @@ size_t AssemblyType::size() const
 
 size_t AssemblyType::alignment() const
 {
-    if (auto b = std::get_if<ByteArray>(&t))
+    if (auto b = getAs<ByteArray>())
         return b->alignment;
     return size();
 }
 
+// The components are interned, so they are compared by their addresses
 bool FunctionType::operator==(const FunctionType &other) const
 {
-    if (params.size() != other.params.size())
-        return false;
-    for (size_t i = 0; i < params.size(); i++) {
-        if (*params[i] != *other.params[i])
-            return false;
-    }
-    return *ret == *other.ret;
+    return params == other.params && ret == other.ret;
 }
 
 bool PointerType::operator==(const PointerType &other) const
 {
-    return *referenced == *other.referenced;
+    return referenced == other.referenced && decayed == other.decayed;
 }
 
 bool ArrayType::operator==(const ArrayType &other) const
 {
-    return *element == *other.element && count == other.count;
+    return element == other.element && count == other.count;
 }
 
 bool VoidType::operator==(const VoidType &) const
@@ -178,48 +175,137 @@ bool AggregateType::operator==(const AggregateType &other) const
     return tag == other.tag && is_union == other.is_union;
 }
 
+namespace {
+
+struct TypeInfoHash {
+    using is_transparent = void;
+
+    size_t operator()(const TypeNode *node) const { return (*this)(node->info); }
+    size_t operator()(const TypeInfo &info) const
+    {
+        size_t hash = info.index();
+        auto combine = [&hash](size_t value) {
+            hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+        };
+        std::visit([&](const auto &obj) {
+            using T = std::decay_t<decltype(obj)>;
+            if constexpr (std::is_same_v<T, BasicType>)
+                combine(static_cast<size_t>(obj));
+            else if constexpr (std::is_same_v<T, FunctionType>) {
+                for (const Type *param : obj.params)
+                    combine(std::hash<const Type *>{}(param));
+                combine(std::hash<const Type *>{}(obj.ret));
+            } else if constexpr (std::is_same_v<T, PointerType>) {
+                combine(std::hash<const Type *>{}(obj.referenced));
+                combine(obj.decayed);
+            } else if constexpr (std::is_same_v<T, ArrayType>) {
+                combine(std::hash<const Type *>{}(obj.element));
+                combine(obj.count);
+            } else if constexpr (std::is_same_v<T, AggregateType>) {
+                combine(std::hash<std::string>{}(obj.tag));
+                combine(obj.is_union);
+            }
+        }, info);
+        return hash;
+    }
+};
+
+struct TypeInfoEqual {
+    using is_transparent = void;
+
+    static const TypeInfo &info(const TypeInfo &info) { return info; }
+    static const TypeInfo &info(const TypeNode *node) { return node->info; }
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const { return info(a) == info(b); }
+};
+
+}; // namespace
+
+const TypeNode *Type::Intern(TypeInfo info)
+{
+    // Shared by the translation units compiled in parallel
+    static std::mutex s_mutex;
+    static std::unordered_set<const TypeNode *, TypeInfoHash, TypeInfoEqual> s_nodes;
+    // The elements of a deque don't move when it grows
+    static std::deque<TypeNode> s_storage;
+
+    // Equality ignores the decayed marks, so every type is interned with
+    // the one it's equal to, which has none of them
+    auto without_decay = [](const Type *type) { return &type->m_node->identity->type; };
+    TypeInfo identity_info = info;
+    if (FunctionType *function_type = std::get_if<FunctionType>(&identity_info)) {
+        for (const Type *&param : function_type->params)
+            param = without_decay(param);
+        function_type->ret = without_decay(function_type->ret);
+    } else if (PointerType *pointer_type = std::get_if<PointerType>(&identity_info)) {
+        pointer_type->referenced = without_decay(pointer_type->referenced);
+        pointer_type->decayed = false;
+    } else if (ArrayType *array_type = std::get_if<ArrayType>(&identity_info))
+        array_type->element = without_decay(array_type->element);
+    const TypeNode *identity = identity_info == info ? nullptr : Intern(std::move(identity_info));
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_nodes.find(info);
+    if (it != s_nodes.end())
+        return *it;
+    TypeNode &node = s_storage.emplace_back();
+    node.info = std::move(info);
+    node.type.m_node = &node;
+    node.identity = identity ? identity : &node;
+    s_nodes.insert(&node);
+    return &node;
+}
+
+Type::Type(BasicType type) : m_node(Intern(type)) {}
+Type::Type(FunctionType type) : m_node(Intern(std::move(type))) {}
+Type::Type(PointerType type) : m_node(Intern(type)) {}
+Type::Type(ArrayType type) : m_node(Intern(type)) {}
+Type::Type(VoidType type) : m_node(Intern(type)) {}
+Type::Type(AggregateType type) : m_node(Intern(std::move(type))) {}
+
 bool Type::isBasic(BasicType type) const
 {
-    if (auto p = std::get_if<BasicType>(&t))
+    if (auto p = getAs<BasicType>())
         return *p == type;
     return false;
 }
 
 bool Type::isFunction() const
 {
-    return std::holds_alternative<FunctionType>(t);
+    return getAs<FunctionType>() != nullptr;
 }
 
 bool Type::isPointer() const
 {
-    return std::holds_alternative<PointerType>(t);
+    return getAs<PointerType>() != nullptr;
 }
 
 bool Type::isVoid() const
 {
-    return std::holds_alternative<VoidType>(t);
+    return getAs<VoidType>() != nullptr;
 }
 
 bool Type::isVoidPointer() const
 {
-    if (auto pointer_type = std::get_if<PointerType>(&t))
+    if (auto pointer_type = getAs<PointerType>())
         return pointer_type->referenced->isVoid();
     return false;
 }
 
 bool Type::isArray() const
 {
-    return std::holds_alternative<ArrayType>(t);
+    return getAs<ArrayType>() != nullptr;
 }
 
 bool Type::isAggregate() const
 {
-    return std::holds_alternative<AggregateType>(t);
+    return getAs<AggregateType>() != nullptr;
 }
 
 bool Type::isInteger() const
 {
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     if (!basic_type)
         return false;
     switch (*basic_type) {
@@ -248,7 +334,7 @@ bool Type::isComplete(const TypeTable *table) const
 
 bool Type::isCompletePointer(const TypeTable *table) const
 {
-    if (auto pointer_type = std::get_if<PointerType>(&t))
+    if (auto pointer_type = getAs<PointerType>())
         return pointer_type->referenced->isComplete(table);
     return false;
 }
@@ -260,7 +346,7 @@ bool Type::isScalar() const
 
 bool Type::isSigned() const
 {
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     if (!basic_type)
         return false;
     switch (*basic_type) {
@@ -280,7 +366,7 @@ bool Type::isSigned() const
 
 bool Type::isArithmetic() const
 {
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     if (!basic_type)
         return false;
     switch (*basic_type) {
@@ -300,7 +386,7 @@ bool Type::isArithmetic() const
 
 bool Type::isCharacter() const
 {
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     if (!basic_type)
         return false;
     switch (*basic_type) {
@@ -320,22 +406,22 @@ bool Type::isCharacter() const
 
 bool Type::isInitialized() const
 {
-    return !std::holds_alternative<std::monostate>(t);
+    return m_node != nullptr;
 }
 
 size_t Type::size(TypeTable *table) const
 {
     if (isPointer())
         return 8;
-    if (const ArrayType *arr = std::get_if<ArrayType>(&t))
+    if (const ArrayType *arr = getAs<ArrayType>())
         return arr->element->size(table) * arr->count;
-    if (const AggregateType *aggr_type = std::get_if<AggregateType>(&t)) {
+    if (const AggregateType *aggr_type = getAs<AggregateType>()) {
         auto entry = table->get(aggr_type->tag);
         // Handle tentative aggregates on higher levels
         assert(entry);
         return entry->size;
     }
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     assert(basic_type);
     switch (*basic_type) {
     case BasicType::Char:
@@ -356,9 +442,9 @@ size_t Type::size(TypeTable *table) const
 
 size_t Type::alignment(TypeTable *table) const
 {
-    if (auto array_type = std::get_if<ArrayType>(&t))
+    if (auto array_type = getAs<ArrayType>())
         return array_type->element->alignment(table);
-    if (auto aggr_type = std::get_if<AggregateType>(&t)) {
+    if (auto aggr_type = getAs<AggregateType>()) {
         auto entry = table->get(aggr_type->tag);
         assert(entry); // Incomplete aggregate type
         return entry->alignment;
@@ -368,13 +454,13 @@ size_t Type::alignment(TypeTable *table) const
 
 WordType Type::wordType() const
 {
-    if (std::holds_alternative<PointerType>(t))
+    if (getAs<PointerType>() != nullptr)
         return Quadword;
-    if (const ArrayType *array_type = std::get_if<ArrayType>(&t)) {
+    if (const ArrayType *array_type = getAs<ArrayType>()) {
         assert(array_type->element->isCharacter());
         return Byte;
     }
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     assert(basic_type);
     switch (*basic_type) {
     case BasicType::Char:
@@ -397,7 +483,7 @@ WordType Type::wordType() const
 
 Type Type::storedType() const
 {
-    if (auto a = std::get_if<ArrayType>(&t))
+    if (auto a = getAs<ArrayType>())
         return a->element->storedType();
     else
         return *this;
@@ -407,7 +493,7 @@ Type Type::promotedType() const
 {
     if (isPointer())
         return *this;
-    const BasicType *basic_type = std::get_if<BasicType>(&t);
+    const BasicType *basic_type = getAs<BasicType>();
     assert(basic_type);
     switch (*basic_type) {
     case BasicType::Int:
@@ -451,7 +537,7 @@ std::ostream &operator<<(std::ostream &os, const Type &type)
                 os << "Struct(" << obj.tag << ")";
         } else
             os << "typeless";
-    }, type.t);
+    }, type.info());
     return os;
 }
 
@@ -31,9 +31,9 @@ enum StorageClass {
     StorageExtern
 };
 
-bool IsTypeSpecifier(const std::string &type);
-std::optional<StorageClass> GetStorageClass(const std::string &storage);
-bool IsStorageOrTypeSpecifier(const std::string &type);
+bool IsTypeSpecifier(std::string_view type);
+std::optional<StorageClass> GetStorageClass(std::string_view storage);
+bool IsStorageOrTypeSpecifier(std::string_view type);
 // ---
 
 // Assembly types
@@ -71,7 +71,10 @@ struct AssemblyType {
 uint8_t GetBytesOfWordType(WordType type);
 //---
 
-// Recursive type structure which represents higher level type information
+// Recursive type structure which represents higher level type information.
+// Every distinct type is interned once for the whole compilation and Type
+// is a handle to it, so types are cheap to copy and compared in O(1).
+// The derived types refer to the interned instances of their components.
 struct Type;
 
 enum BasicType {
@@ -86,19 +89,19 @@ enum BasicType {
 };
 
 struct FunctionType {
-    std::vector<std::shared_ptr<Type>> params;
-    std::shared_ptr<Type> ret;
+    std::vector<const Type *> params;
+    const Type *ret;
     bool operator==(const FunctionType &other) const;
 };
 
 struct PointerType {
-    std::shared_ptr<Type> referenced;
+    const Type *referenced;
     bool decayed = false;
     bool operator==(const PointerType &other) const;
 };
 
 struct ArrayType {
-    std::shared_ptr<Type> element;
+    const Type *element;
     uint64_t count;
     bool operator==(const ArrayType &other) const;
 };
@@ -123,14 +126,24 @@ using TypeInfo = std::variant<
     AggregateType
 >;
 
+struct TypeNode;
+
 struct Type {
-    TypeInfo t; // std::monostate until initialized
+    // Not initialized until it's assigned
+    Type() = default;
+    explicit Type(BasicType type);
+    explicit Type(FunctionType type);
+    explicit Type(PointerType type);
+    explicit Type(ArrayType type);
+    explicit Type(VoidType type);
+    explicit Type(AggregateType type);
 
     template <typename T>
-    T *getAs() { return std::get_if<T>(&t); }
+    const T *getAs() const;
 
-    template <typename T>
-    const T *getAs() const { return std::get_if<T>(&t); }
+    const TypeInfo &info() const;
+    // Lives as long as the program, the derived types point to it
+    const Type *interned() const;
 
     bool isBasic(BasicType type) const;
     bool isFunction() const;
@@ -153,9 +166,7 @@ struct Type {
     Type storedType() const;
     Type promotedType() const;
 
-    friend bool operator==(const Type &a, const Type &b) {
-        return a.t == b.t;
-    }
+    friend bool operator==(const Type &a, const Type &b);
 
     friend bool operator!=(const Type &a, const Type &b) {
         return !(a == b);
@@ -163,6 +174,43 @@ struct Type {
 
     friend std::ostream &operator<<(std::ostream &os, const Type &t);
     std::string toString() const;
+
+private:
+    static const TypeNode *Intern(TypeInfo info);
+
+    const TypeNode *m_node = nullptr;
 };
 
+struct TypeNode {
+    TypeInfo info;
+    // Handle of this node
+    Type type;
+    // The same type without the decayed marks on its pointers,
+    // decayed pointers are equal to the plain ones
+    const TypeNode *identity;
+};
+
+template <typename T>
+const T *Type::getAs() const
+{
+    return m_node ? std::get_if<T>(&m_node->info) : nullptr;
+}
+
+inline const TypeInfo &Type::info() const
+{
+    static const TypeInfo s_uninitialized;
+    return m_node ? m_node->info : s_uninitialized;
+}
+
+inline const Type *Type::interned() const
+{
+    return m_node ? &m_node->type : nullptr;
+}
+
+inline bool operator==(const Type &a, const Type &b)
+{
+    return a.m_node == b.m_node
+        || (a.m_node && b.m_node && a.m_node->identity == b.m_node->identity);
+}
+
 std::optional<Type> DetermineType(const std::set<std::string> &type_specifiers);
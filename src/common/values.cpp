@@ -49,8 +49,7 @@ std::string toLabel(const ConstantValue &v)
 
 Type getType(const ConstantValue &v)
 {
-    Type ret;
-    ret.t = std::visit([](auto x) -> BasicType {
+    return Type{ std::visit([](auto x) -> BasicType {
         using T = std::decay_t<decltype(x)>;
         if constexpr (std::is_same_v<T, int>) return BasicType::Int;
         if constexpr (std::is_same_v<T, long>) return BasicType::Long;
@@ -60,8 +59,7 @@ Type getType(const ConstantValue &v)
         if constexpr (std::is_same_v<T, char>) return BasicType::Char;
         if constexpr (std::is_same_v<T, unsigned char>) return BasicType::UChar;
         else assert(false);
-    }, v);
-    return ret;
+    }, v) };
 }
 
 bool isPositiveZero(const ConstantValue &v)
@@ -4,11 +4,15 @@
 
 namespace lexer {
 
-Result tokenize(std::string_view source_code)
+Result tokenize(std::string source_code)
 {
     Result res;
+    res.source = std::make_unique<Source>(std::move(source_code));
 
-    Tokenizer tokenizer(source_code);
+    Tokenizer tokenizer(*res.source);
+    // Typical token density of C sources, so the tokens are
+    // usually stored with one allocation
+    res.tokens.reserve(res.source->text().size() / 2);
     while (auto token = tokenizer.NextToken())
         res.tokens.push_back(*token);
 
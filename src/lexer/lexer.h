@@ -1,7 +1,9 @@
 #pragma once
 
-#include <list>
+#include "source.h"
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace lexer {
 
@@ -9,11 +11,13 @@ class Token;
 
 struct Result
 {
-    std::list<Token> tokens;
+    // The tokens point into the source
+    std::unique_ptr<Source> source;
+    std::vector<Token> tokens;
     std::string error_message;
     int return_code = 0;
 };
 
-Result tokenize(std::string_view code);
+Result tokenize(std::string code);
 
 }; // lexer
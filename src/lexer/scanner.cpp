@@ -0,0 +1,114 @@
+#include "scanner.h"
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lexer {
+
+static bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static bool is_identifier_char(char c)
+{
+    char lower = static_cast<char>(c | 0x20);
+    return (lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_string_end(char c)
+{
+    return c == '"' || c == '\\' || c == '\n';
+}
+
+#ifdef __SSE2__
+// Scans blocks of 16 characters while every character matches, the mask
+// function marks the matching ones. The remaining tail is left to the caller.
+template <typename Mask>
+static size_t scan_blocks(std::string_view text, size_t pos, Mask mask)
+{
+    while (pos + 16 <= text.length()) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + pos));
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(mask(block)));
+        if (bits != 0xFFFF)
+            return pos + static_cast<size_t>(__builtin_ctz(~bits));
+        pos += 16;
+    }
+    return pos;
+}
+
+static __m128i in_range(__m128i block, char low, char high)
+{
+    // Signed comparisons, the characters above 127 are never in range
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(block, _mm_set1_epi8(static_cast<char>(low - 1))),
+        _mm_cmplt_epi8(block, _mm_set1_epi8(static_cast<char>(high + 1))));
+}
+#endif
+
+size_t skip_whitespace(std::string_view text, size_t pos)
+{
+    // Most runs are a single space or a newline and indentation
+    if (pos < text.length() && !is_whitespace(text[pos]))
+        return pos;
+#ifdef __SSE2__
+    pos = scan_blocks(text, pos, [](__m128i block) {
+        return _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+    });
+#endif
+    while (pos < text.length() && is_whitespace(text[pos]))
+        pos++;
+    return pos;
+}
+
+size_t find_identifier_end(std::string_view text, size_t pos)
+{
+#ifdef __SSE2__
+    pos = scan_blocks(text, pos, [](__m128i block) {
+        // Lowercase letters are the uppercase ones with 0x20 set
+        __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        return _mm_or_si128(
+            _mm_or_si128(in_range(lower, 'a', 'z'), in_range(block, '0', '9')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('_')));
+    });
+#endif
+    while (pos < text.length() && is_identifier_char(text[pos]))
+        pos++;
+    return pos;
+}
+
+size_t find_string_end(std::string_view text, size_t pos)
+{
+#ifdef __SSE2__
+    pos = scan_blocks(text, pos, [](__m128i block) {
+        __m128i end = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+        return _mm_andnot_si128(end, _mm_set1_epi8(-1));
+    });
+#endif
+    while (pos < text.length() && !is_string_end(text[pos]))
+        pos++;
+    return pos;
+}
+
+size_t find_char(std::string_view text, size_t pos, char c)
+{
+    // memchr is vectorized by the C library
+    if (pos >= text.length())
+        return text.length();
+    const void *found = std::memchr(text.data() + pos, c, text.length() - pos);
+    if (!found)
+        return text.length();
+    return static_cast<size_t>(static_cast<const char *>(found) - text.data());
+}
+
+}; // namespace lexer
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace lexer {
+
+// Scanning runs of characters 16 bytes at a time with SSE2 (a scalar loop
+// on other targets). They return the position of the first character which
+// stops the scan starting at pos, or the length of the text.
+
+// First character which is not ' ', '\t' or '\n'
+size_t skip_whitespace(std::string_view text, size_t pos);
+// First character which is not a letter, a digit or '_'
+size_t find_identifier_end(std::string_view text, size_t pos);
+// First '"', '\\' or '\n'
+size_t find_string_end(std::string_view text, size_t pos);
+// First occurrence of c
+size_t find_char(std::string_view text, size_t pos, char c);
+
+}; // namespace lexer
@@ -0,0 +1,33 @@
+#include "source.h"
+#include "scanner.h"
+#include <algorithm>
+
+namespace lexer {
+
+Source::Source(std::string text)
+    : m_text(std::move(text))
+{
+}
+
+std::string_view Source::Store(std::string text)
+{
+    return m_stored.emplace_back(std::move(text));
+}
+
+Source::Location Source::Locate(size_t offset) const
+{
+    if (!m_newlinesIndexed) {
+        for (size_t pos = find_char(m_text, 0, '\n'); pos < m_text.length(); pos = find_char(m_text, pos + 1, '\n'))
+            m_newlines.push_back(pos);
+        m_newlinesIndexed = true;
+    }
+    // Newlines before the offset
+    auto it = std::lower_bound(m_newlines.begin(), m_newlines.end(), offset);
+    size_t line_start = it == m_newlines.begin() ? 0 : *std::prev(it) + 1;
+    Location location;
+    location.line = static_cast<size_t>(it - m_newlines.begin()) + 1;
+    location.col = offset - line_start + 1;
+    return location;
+}
+
+}; // namespace lexer
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lexer {
+
+// Text of a translation unit, the tokens refer to it without copying.
+// It has to outlive the tokens, so it's kept for the whole compilation.
+class Source
+{
+public:
+    explicit Source(std::string text);
+    ~Source() = default;
+
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+
+    std::string_view text() const { return m_text; }
+
+    struct Location {
+        size_t line;
+        size_t col;
+    };
+    // Line and column of a position in the text. They are only needed for
+    // diagnostics, so the newlines are indexed on the first call.
+    Location Locate(size_t offset) const;
+
+    // Keeps text which is not part of the source (decoded string literals)
+    std::string_view Store(std::string text);
+
+private:
+    std::string m_text;
+    // The elements of a deque don't move when it grows
+    std::deque<std::string> m_stored;
+    mutable std::vector<size_t> m_newlines;
+    mutable bool m_newlinesIndexed = false;
+};
+
+}; // namespace lexer
@@ -1,4 +1,5 @@
 #include "token.h"
+#include "source.h"
 #include <iostream>
 
 namespace lexer {
@@ -34,20 +35,30 @@ std::string Token::ToString(Type type)
 
 Token::Token()
     : m_type(Type::Undefined)
-    , m_line(0)
-    , m_col(0)
-    , m_value("")
+    , m_offset(0)
+    , m_source(nullptr)
+    , m_value()
 {
 }
 
-Token::Token(Type type, std::string_view value, size_t line, size_t col)
+Token::Token(Type type, std::string_view value, const Source *source, size_t offset)
     : m_type(type)
-    , m_line(line)
-    , m_col(col)
+    , m_offset(static_cast<uint32_t>(offset))
+    , m_source(source)
     , m_value(value)
 {
 }
 
+size_t Token::line() const
+{
+    return m_source ? m_source->Locate(m_offset).line : 0;
+}
+
+size_t Token::col() const
+{
+    return m_source ? m_source->Locate(m_offset).col : 0;
+}
+
 std::ostream &operator<<(std::ostream &os, const Token &t)
 {
     os << "<" << toString(t.type());
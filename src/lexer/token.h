@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace lexer {
 
+class Source;
+
 class Token
 {
 public:
@@ -21,14 +25,16 @@ public:
     static std::string ToString(Type type);
 
     Token();
-    Token(Type type, std::string_view value, size_t line, size_t col);
+    Token(Type type, std::string_view value, const Source *source, size_t offset);
     ~Token() = default;
 
     Type type() const { return m_type; }
-    size_t line() const { return m_line; }
-    size_t col() const { return m_col; }
-    std::string value() const { return m_value; }
-    void setValue(const std::string &value) { m_value = value; }
+    // Computed from the position in the source, where the tokenizer
+    // stood after reading the token
+    size_t line() const;
+    size_t col() const;
+    // Points into the lexer::Source of the translation unit
+    std::string_view value() const { return m_value; }
 
     bool isIdentifier() const { return m_type == Identifier; }
     bool isKeyword() const { return m_type == Keyword; }
@@ -42,9 +48,9 @@ public:
 
 private:
     Type m_type;
-    size_t m_line;
-    size_t m_col;
-    std::string m_value;
+    uint32_t m_offset;
+    const Source *m_source;
+    std::string_view m_value;
 };
 
 }; // namespace lexer
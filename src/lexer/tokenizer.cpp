@@ -1,57 +1,123 @@
 #include "tokenizer.h"
+#include "scanner.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <cctype>
+#include <cstdint>
 #include <format>
-#include <unordered_set>
+
+static constexpr std::string_view s_keywords[] = {
+    "alignas", "alignof", "auto", "bool", "break", "case", "char", "const",
+    "constexpr", "continue", "default", "do", "double", "else", "enum", "extern",
+    "false", "float", "for", "goto", "if", "inline", "int", "long", "nullptr",
+    "register", "restrict", "return", "short", "signed", "sizeof", "static",
+    "static_assert", "struct", "switch", "thread_local", "true", "typedef", "typeof",
+    "typeof_unqual", "union", "unsigned", "void", "volatile", "while", "_Alignas",
+    "_Alignof", "_Atomic", "_BitInt", "_Bool", "_Complex", "_Decimal128", "_Decimal32",
+    "_Decimal64", "_Generic", "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local"
+};
+
+// Hashes the length and the first and last two characters (FNV-1a style),
+// every keyword has at least two characters
+static constexpr uint32_t keyword_hash(std::string_view word, uint32_t seed)
+{
+    uint32_t hash = seed;
+    for (size_t c : { word.size(), size_t(uint8_t(word[0])), size_t(uint8_t(word[1])),
+            size_t(uint8_t(word[word.size() - 1])), size_t(uint8_t(word[word.size() - 2])) })
+        hash = (hash ^ static_cast<uint32_t>(c)) * 16777619u;
+    return hash;
+}
+
+// Perfect hash table of the keywords: the seed is searched at compile time,
+// so every keyword has its own slot and a lookup is one string comparison
+struct KeywordTable {
+    static constexpr size_t size = 256;
+    uint32_t seed = 0;
+    std::array<std::string_view, size> slots = {};
+};
+
+static constexpr KeywordTable s_keywordTable = []() {
+    for (uint32_t seed = 1; ; ++seed) {
+        KeywordTable table;
+        table.seed = seed;
+        bool collision = false;
+        for (std::string_view keyword : s_keywords) {
+            std::string_view &slot = table.slots[keyword_hash(keyword, seed) % KeywordTable::size];
+            collision |= !slot.empty();
+            slot = keyword;
+        }
+        if (!collision)
+            return table;
+    }
+}();
 
 static bool is_keyword(std::string_view word)
 {
-    static const std::unordered_set<std::string> keywords = {
-        "alignas", "alignof", "auto", "bool", "break", "case", "char", "const",
-        "constexpr", "continue", "default", "do", "double", "else", "enum", "extern",
-        "false", "float", "for", "goto", "if", "inline", "int", "long", "nullptr",
-        "register", "restrict", "return", "short", "signed", "sizeof", "static",
-        "static_assert", "struct", "switch", "thread_local", "true", "typedef", "typeof",
-        "typeof_unqual", "union", "unsigned", "void", "volatile", "while", "_Alignas",
-        "_Alignof", "_Atomic", "_BitInt", "_Bool", "_Complex", "_Decimal128", "_Decimal32",
-        "_Decimal64", "_Generic", "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local"
+    if (word.size() < 2)
+        return false;
+    return s_keywordTable.slots[keyword_hash(word, s_keywordTable.seed) % KeywordTable::size] == word;
+}
+
+// Character classes used by the tokenizer
+enum CharClass : uint8_t {
+    Whitespace = 1 << 0,
+    Operator = 1 << 1,
+    Punctator = 1 << 2,
+    Digit = 1 << 3,
+    // Letters and '_'
+    IdentifierStart = 1 << 4,
+    NumericSuffix = 1 << 5,
+};
+
+static constexpr std::array<uint8_t, 256> s_charClasses = []() {
+    std::array<uint8_t, 256> classes = {};
+    auto add = [&](std::string_view chars, CharClass c) {
+        for (char ch : chars)
+            classes[static_cast<uint8_t>(ch)] |= c;
     };
-    return keywords.contains(std::string(word));
+    add(" \t\n", Whitespace);
+    add("+-*/<>^?%!=~|&,.:", Operator);
+    add("([{)]};", Punctator);
+    add("0123456789", Digit);
+    add("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_", IdentifierStart);
+    add("lLuU", NumericSuffix);
+    return classes;
+}();
+
+static bool has_class(char c, uint8_t classes)
+{
+    return s_charClasses[static_cast<uint8_t>(c)] & classes;
 }
 
 static bool is_operator(char c)
 {
-    switch (c) {
-    case '+': case '-': case '*': case '/':
-    case '<': case '>': case '^': case '?':
-    case '%': case '!': case '=': case '~':
-    case '|': case '&': case ',': case '.':
-    case ':':
-        return true;
-    default:
-        return false;
-    }
+    return has_class(c, Operator);
 }
 
 static bool is_punctator(char c)
 {
-    switch (c) {
-    case '(': case '[': case '{': case ')':
-    case ']': case '}': case ';':
-        return true;
-    default:
-        return false;
-    }
+    return has_class(c, Punctator);
 }
 
 static bool is_whitespace(char c)
 {
-    return std::isblank(c) || c == '\n';
+    return has_class(c, Whitespace);
+}
+
+static bool is_digit(char c)
+{
+    return has_class(c, Digit);
 }
 
 static bool is_numeric_suffix(char c)
 {
-    return c == 'l' || c == 'L' || c == 'u' || c == 'U';
+    return has_class(c, NumericSuffix);
+}
+
+// Ends a numeric literal
+static bool is_separator(char c)
+{
+    return has_class(c, Whitespace | Operator | Punctator);
 }
 
 static bool decode_escape(char esc, char &out)
@@ -74,13 +140,24 @@ static bool decode_escape(char esc, char &out)
     return true;
 }
 
+// Views of single characters for the char literals
+static std::string_view char_view(char c)
+{
+    static const std::array<char, 256> chars = []() {
+        std::array<char, 256> ret;
+        for (size_t i = 0; i < ret.size(); ++i)
+            ret[i] = static_cast<char>(i);
+        return ret;
+    }();
+    return std::string_view(&chars[static_cast<unsigned char>(c)], 1);
+}
+
 namespace lexer {
 
-Tokenizer::Tokenizer(std::string_view s)
-    : m_string(s)
+Tokenizer::Tokenizer(Source &source)
+    : m_source(source)
+    , m_string(source.text())
     , m_pos(0)
-    , m_line(1)
-    , m_col(1)
     , m_error(ALL_OK)
     , m_message("")
 {
@@ -110,13 +187,7 @@ char Tokenizer::Step()
 {
     if (m_string.length() == m_pos - 1)
         return 0;
-    char ret = m_string[m_pos++];
-    if (ret == '\n') {
-        m_line++;
-        m_col = 1;
-    } else
-        m_col++;
-    return ret;
+    return m_string[m_pos++];
 }
 
 char Tokenizer::PeekNextChar(size_t i)
@@ -136,12 +207,13 @@ char Tokenizer::PreviousChar()
 void Tokenizer::AbortAtPosition(std::string_view message)
 {
     m_error = LEXER_ERROR;
-    m_message = std::format("{} (line: {}, column: {})", message, m_line, m_col);
+    Source::Location location = m_source.Locate(m_pos);
+    m_message = std::format("{} (line: {}, column: {})", message, location.line, location.col);
 }
 
 Token Tokenizer::CreateToken(Token::Type type, std::string_view content)
 {
-    return Token(type, content, m_line, m_col);
+    return Token(type, content, &m_source, m_pos);
 }
 
 Token Tokenizer::MakeNumericLiteral()
@@ -153,17 +225,14 @@ Token Tokenizer::MakeNumericLiteral()
 
     // Parse the integer or fractional part of the number
     char next = PeekNextChar();
-    assert(std::isdigit(next) || next == '.');
-
-    std::string literal;
-    literal.reserve(20);
+    assert(is_digit(next) || next == '.');
 
+    size_t start = m_pos;
     size_t dot_count = next == '.' ? 1 : 0;
     while (true) {
         Step();
-        literal += next;
         next = PeekNextChar();
-        if (std::isdigit(next))
+        if (is_digit(next))
             continue;
         if (next == '.') {
             if (++dot_count > 1)
@@ -172,14 +241,14 @@ Token Tokenizer::MakeNumericLiteral()
         }
         // Optional exponent part of floating point numbers
         if (next =='e' || next == 'E') {
-            literal += ParseExponent();
+            ParseExponent();
             next = PeekNextChar();
             if (is_numeric_suffix(next))
-                literal += ParseNumericSuffixes(dot_count, /* after_exponent */ true);
+                ParseNumericSuffixes(dot_count, /* after_exponent */ true);
             break;
         }
         if (is_numeric_suffix(next)) {
-            literal += ParseNumericSuffixes(dot_count, /* after_exponent */ false);
+            ParseNumericSuffixes(dot_count, /* after_exponent */ false);
             break;
         }
         break;
@@ -187,18 +256,17 @@ Token Tokenizer::MakeNumericLiteral()
 
     next = PeekNextChar();
     // We started to process an identifier starting with a number, it's invalid.
-    if (!is_whitespace(next) && !is_operator(next) && !is_punctator(next))
+    if (!is_separator(next))
         AbortAtPosition("Identifiers can't start with numbers.");
 
-    return CreateToken(Token::NumericLiteral, literal);
+    return CreateToken(Token::NumericLiteral, m_string.substr(start, m_pos - start));
 }
 
-std::string Tokenizer::ParseNumericSuffixes(bool is_fractional, bool after_exponent)
+void Tokenizer::ParseNumericSuffixes(bool is_fractional, bool after_exponent)
 {
     char next = PeekNextChar();
     assert(is_numeric_suffix(next));
 
-    std::string suffixes;
     size_t l_count = 0;
     size_t u_count = 0;
     while (true) {
@@ -208,7 +276,6 @@ std::string Tokenizer::ParseNumericSuffixes(bool is_fractional, bool after_expon
                 AbortAtPosition("Fractional numeric literals can't have a L suffix.");
             if (++l_count > 1)
                 AbortAtPosition("This implementation supports only one L suffix in numeric literals.");
-            suffixes += next;
             Step();
             continue;
         }
@@ -219,7 +286,6 @@ std::string Tokenizer::ParseNumericSuffixes(bool is_fractional, bool after_expon
                 AbortAtPosition("Numeric literals can have only one U suffix.");
             if (after_exponent)
                 AbortAtPosition("Floating point numbers are always signed.");
-            suffixes += next;
             Step();
             continue;
         }
@@ -227,73 +293,74 @@ std::string Tokenizer::ParseNumericSuffixes(bool is_fractional, bool after_expon
     }
 
     next = PeekNextChar();
-    if ((!is_whitespace(next) && !is_operator(next) && !is_punctator(next))
+    if ((!is_separator(next))
         || (after_exponent && (next == 'e' || next == 'E')))
         AbortAtPosition(std::format("Unsupported '{}' suffix after numeric literal.", next));
-
-    return suffixes;
 }
 
-std::string Tokenizer::ParseExponent()
+void Tokenizer::ParseExponent()
 {
     char next = PeekNextChar();
     assert(next == 'e' || next == 'E');
-    std::string exponent;
-    exponent += next;
     Step();
 
     next = PeekNextChar();
     // + or - is optional
-    if (next == '+' || next == '-') {
-        exponent += next;
+    if (next == '+' || next == '-')
         Step();
-    }
 
     // The numeric part is mandatory here
     bool has_numeric_part = false;
-    while (std::isdigit(next = PeekNextChar())) {
+    while (is_digit(next = PeekNextChar())) {
         has_numeric_part = true;
-        exponent += next;
         Step();
     }
     if (!has_numeric_part)
         AbortAtPosition("Exponential parts of numeric literals must have a numeric part.");
     if (next == '.')
         AbortAtPosition("Exponential parts of numeric literals can't contain a '.'.");
-
-    return exponent;
 }
 
 Token Tokenizer::MakeStringLiteral()
 {
-    std::string literal;
-    literal.reserve(10);
-
     // We won't include the trailing ""
     char next = Step();
     assert(next == '"');
-    do {
-        next = Step();
-        if (next == '"')
-            break;
+
+    // Literals without escape sequences are taken from the source as they are,
+    // the decoded ones are stored separately
+    size_t start = m_pos;
+    size_t end = start;
+    std::optional<std::string> decoded;
+    while (true) {
+        end = find_string_end(m_string, m_pos);
+        if (decoded)
+            decoded->append(m_string.substr(m_pos, end - m_pos));
+        m_pos = end;
         if (ReachedEOF()) {
             AbortAtPosition("Unclosed string literal");
             break;
         }
+        next = Step();
+        if (next == '"')
+            break;
         if (next == '\n') {
             AbortAtPosition("Newlines are not allowed in string literals");
             break;
         }
-        if (next == '\\') {
-            if (!decode_escape(Step(), next)) {
-                AbortAtPosition("Invalid escape sequence");
-                break;
-            }
+        // Escape sequence
+        if (!decoded)
+            decoded = std::string(m_string.substr(start, end - start));
+        if (ReachedEOF() || !decode_escape(Step(), next)) {
+            AbortAtPosition("Invalid escape sequence");
+            break;
         }
-        literal += next;
-    } while (true);
+        *decoded += next;
+    }
 
-    return CreateToken(Token::StringLiteral, literal);
+    if (decoded)
+        return CreateToken(Token::StringLiteral, m_source.Store(std::move(*decoded)));
+    return CreateToken(Token::StringLiteral, m_string.substr(start, end - start));
 }
 
 Token Tokenizer::MakeCharLiteral()
@@ -320,30 +387,23 @@ Token Tokenizer::MakeCharLiteral()
     if (Step() != '\'')
         AbortAtPosition("Invalid char literal");
 
-    return CreateToken(Token::CharLiteral, std::string(1, value));
+    return CreateToken(Token::CharLiteral, char_view(value));
 }
 
 void Tokenizer::SkipWhitespace()
 {
     assert(is_whitespace(PeekNextChar()));
-    while (is_whitespace(PeekNextChar()))
-        Step();
+    m_pos = skip_whitespace(m_string, m_pos);
 }
 
 Token Tokenizer::MakeIdentifierOrKeyword()
 {
-    std::string word;
-    word.reserve(10);
-
-    char next = PeekNextChar();
+    size_t start = m_pos;
     // They can't start with numbers
-    assert(next == '_' || std::isalpha(next));
-    do {
-        Step();
-        word += next;
-        next = PeekNextChar();
-    } while (next == '_' || std::isalnum(next));
+    assert(has_class(PeekNextChar(), IdentifierStart));
+    m_pos = find_identifier_end(m_string, m_pos + 1);
 
+    std::string_view word = m_string.substr(start, m_pos - start);
     return CreateToken(is_keyword(word) ? Token::Keyword :  Token::Identifier, word);
 }
 
@@ -403,34 +463,33 @@ Token Tokenizer::MakeOperator(char first)
             if (next == '=') { Step(); return CreateToken(Token::Operator, "^="); }
             break;
     }
-    return CreateToken(Token::Operator, std::string(1, first));
+    return CreateToken(Token::Operator, m_string.substr(m_pos - 1, 1));
 }
 
 void Tokenizer::SkipComment()
 {
-    bool oneliner = true;
     char next = Step();
     // We already jumped over the initial /
     assert(next == '/' || next == '*');
-    oneliner = (next == '/');
 
-    do {
-        next = PeekNextChar();
-        if (oneliner && next == '\n') {
-            Step();
-            break;
+    if (next == '/') {
+        // Including the newline
+        m_pos = std::min(find_char(m_string, m_pos, '\n') + 1, m_string.length());
+        return;
+    }
+
+    while (true) {
+        m_pos = find_char(m_string, m_pos, '*');
+        if (m_pos + 1 >= m_string.length()) {
+            m_pos = m_string.length();
+            AbortAtPosition("Unclosed comment block");
+            return;
         }
-        if (!oneliner && next == '*') {
-            Step();
-            if (PeekNextChar() == '/') {
-                Step();
-                break;
-            }
+        if (m_string[++m_pos] == '/') {
+            m_pos++;
+            return;
         }
-        Step();
-        if (!oneliner && ReachedEOF())
-            AbortAtPosition("Unclosed comment block");
-    } while (IsRunning());
+    }
 }
 
 std::optional<Token> Tokenizer::NextToken()
@@ -443,9 +502,9 @@ std::optional<Token> Tokenizer::NextToken()
             continue;
         }
 
-        if (std::isdigit(c))
+        if (is_digit(c))
             return MakeNumericLiteral();
-        if (c == '.' && std::isdigit(PeekNextChar(1)))
+        if (c == '.' && is_digit(PeekNextChar(1)))
             return MakeNumericLiteral();
 
         if (c == '"')
@@ -454,7 +513,7 @@ std::optional<Token> Tokenizer::NextToken()
         if (c == '\'')
             return MakeCharLiteral();
 
-        if (c == '_' || std::isalpha(c))
+        if (has_class(c, IdentifierStart))
             return MakeIdentifierOrKeyword();
 
         if (is_operator(c)) {
@@ -469,8 +528,10 @@ std::optional<Token> Tokenizer::NextToken()
             return MakeOperator(op);
         }
 
-        if (is_punctator(c))
-            return CreateToken(Token::Punctator, std::string(1, Step()));
+        if (is_punctator(c)) {
+            Step();
+            return CreateToken(Token::Punctator, m_string.substr(m_pos - 1, 1));
+        }
 
         AbortAtPosition(std::format("Can't recognize the character '{}'.", c));
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common/error.h"
+#include "source.h"
 #include "token.h"
 #include <optional>
 #include <string_view>
@@ -10,7 +11,7 @@ namespace lexer {
 class Tokenizer
 {
 public:
-    Tokenizer(std::string_view s);
+    Tokenizer(Source &source);
     ~Tokenizer() = default;
 
     bool IsRunning();
@@ -30,17 +31,16 @@ private:
     void SkipWhitespace();
     void SkipComment();
     Token MakeNumericLiteral();
-    std::string ParseNumericSuffixes(bool is_fractional, bool after_exponent);
-    std::string ParseExponent();
+    void ParseNumericSuffixes(bool is_fractional, bool after_exponent);
+    void ParseExponent();
     Token MakeStringLiteral();
     Token MakeCharLiteral();
     Token MakeIdentifierOrKeyword();
     Token MakeOperator(char first);
 
+    Source &m_source;
     std::string_view m_string;
     size_t m_pos;
-    size_t m_line;
-    size_t m_col;
     Error m_error;
     std::string m_message;
 };
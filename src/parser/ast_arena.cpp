@@ -0,0 +1,28 @@
+#include "ast_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace parser {
+
+void *ASTArena::Allocate(size_t size, size_t alignment)
+{
+    auto aligned = [alignment](std::byte *ptr) {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        return reinterpret_cast<std::byte *>((address + alignment - 1) & ~(alignment - 1));
+    };
+
+    std::byte *ptr = m_current ? aligned(m_current) : nullptr;
+    if (!ptr || ptr + size > m_end) {
+        // Oversized nodes get a chunk of their own
+        size_t chunk_size = std::max(ChunkSize, size + alignment);
+        m_chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(chunk_size));
+        m_current = m_chunks.back().get();
+        m_end = m_current + chunk_size;
+        ptr = aligned(m_current);
+    }
+    m_current = ptr + size;
+    m_used += size;
+    return ptr;
+}
+
+}; // namespace parser
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace parser {
+
+// Bump allocator of the AST nodes of a translation unit. The nodes are laid
+// out in the order they are parsed and their memory is released at once,
+// when the arena is destroyed.
+class ASTArena
+{
+public:
+    ASTArena() = default;
+    ~ASTArena() = default;
+
+    ASTArena(const ASTArena &) = delete;
+    ASTArena &operator=(const ASTArena &) = delete;
+
+    void *Allocate(size_t size, size_t alignment);
+    size_t BytesUsed() const { return m_used; }
+
+    template <typename T, typename... Args>
+    T *New(Args &&...args)
+    {
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+private:
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> m_chunks;
+    std::byte *m_current = nullptr;
+    std::byte *m_end = nullptr;
+    size_t m_used = 0;
+};
+
+// Owner of a child node in the arena. It destroys the node like
+// std::unique_ptr, but its memory is given back with the whole arena.
+template <typename T>
+class NodePtr
+{
+public:
+    NodePtr() = default;
+    NodePtr(std::nullptr_t) {}
+    explicit NodePtr(T *node) : m_node(node) {}
+    ~NodePtr() { reset(); }
+
+    NodePtr(const NodePtr &) = delete;
+    NodePtr &operator=(const NodePtr &) = delete;
+
+    NodePtr(NodePtr &&other) noexcept : m_node(std::exchange(other.m_node, nullptr)) {}
+    NodePtr &operator=(NodePtr &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            m_node = std::exchange(other.m_node, nullptr);
+        }
+        return *this;
+    }
+
+    void reset()
+    {
+        if (m_node)
+            std::exchange(m_node, nullptr)->~T();
+    }
+
+    T *get() const { return m_node; }
+    T *operator->() const { return m_node; }
+    T &operator*() const { return *m_node; }
+    explicit operator bool() const { return m_node; }
+
+private:
+    T *m_node = nullptr;
+};
+
+}; // namespace parser
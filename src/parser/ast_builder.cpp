@@ -43,9 +43,10 @@ struct ASTBuilder::AbstractArrayDeclarator {
     std::unique_ptr<AbstractDeclarator> inner_declarator;
 };
 
-ASTBuilder::ASTBuilder(const std::list<lexer::Token> &tokens)
+ASTBuilder::ASTBuilder(const std::vector<lexer::Token> &tokens, ASTArena &arena)
     : m_tokens(tokens)
-    , m_pos(tokens.begin())
+    , m_arena(arena)
+    , m_pos(0)
     , m_error(ALL_OK)
     , m_message("")
 {
@@ -61,33 +62,38 @@ std::string ASTBuilder::ErrorMessage()
     return m_message;
 }
 
-std::string ASTBuilder::Consume(TokenType e_type, std::string_view e_value)
+std::string_view ASTBuilder::Consume(TokenType e_type, std::string_view e_value)
 {
-    if (m_pos == m_tokens.end()) {
+    if (m_pos == m_tokens.size()) {
         Abort("ASTBuilder reached the end of tokens.");
         return "";
     }
 
-    if (m_pos->type() != e_type) {
+    const lexer::Token &token = m_tokens[m_pos];
+    if (token.type() != e_type) {
         Abort(std::format("Expected {}, but found {}",
             lexer::Token::ToString(e_type),
-            lexer::Token::ToString(m_pos->type())
-        ), m_pos->line());
+            lexer::Token::ToString(token.type())
+        ), token.line());
         return "";
     }
-    if (e_value.length() > 0 && m_pos->value() != e_value) {
-        Abort(std::format("Expected {}, but {} found", e_value, m_pos->value()), m_pos->line());
+    if (e_value.length() > 0 && token.value() != e_value) {
+        Abort(std::format("Expected {}, but {} found", e_value, token.value()), token.line());
         return "";
     }
-    LOG("Consumed " << (m_pos)->value());
-    return (m_pos++)->value();
+    LOG("Consumed " << token.value());
+    m_pos++;
+    return token.value();
 }
 
-std::optional<lexer::Token> ASTBuilder::Peek(long n)
+const lexer::Token ASTBuilder::TokenRef::s_end;
+
+ASTBuilder::TokenRef ASTBuilder::Peek(long n)
 {
-    if (std::distance(m_pos, m_tokens.end()) <= n)
-        return std::nullopt;
-    return *std::next(m_pos, n);
+    long index = static_cast<long>(m_pos) + n;
+    if (index < 0 || static_cast<size_t>(index) >= m_tokens.size())
+        return {};
+    return &m_tokens[static_cast<size_t>(index)];
 }
 
 Expression ASTBuilder::ParseExpression(int min_precedence)
@@ -162,13 +168,13 @@ Expression ASTBuilder::ParseUnaryExpression()
                 };
             } else {
                 ret = SizeOfExpression{
-                    .expr = unique_expression(ParseExpression(0))
+                    .expr = unique_expression(m_arena, ParseExpression(0))
                 };
             }
             Consume(TokenType::Punctator, ")");
         } else {
             ret = SizeOfExpression{
-                .expr = unique_expression(ParseUnaryExpression())
+                .expr = unique_expression(m_arena, ParseUnaryExpression())
             };
         }
         return ret;
@@ -183,7 +189,7 @@ Expression ASTBuilder::ParseUnaryExpression()
         AbstractDeclarator declarator = ParseAbstractDeclarator();
         ret.type = ProcessAbstractDeclarator(declarator, base_type);
         Consume(TokenType::Punctator, ")");
-        ret.expr = unique_expression(ParseUnaryExpression());
+        ret.expr = unique_expression(m_arena, ParseUnaryExpression());
         return ret;
     }
 
@@ -204,17 +210,17 @@ Expression ASTBuilder::ParsePostfixExpression()
         } else if (next->isOperator() && next->value() == ".") {
             LOG("DotExpression");
             Consume(TokenType::Operator);
-            expr = DotExpression{ UE(expr), Consume(TokenType::Identifier) };
+            expr = DotExpression{ UE(expr), std::string(Consume(TokenType::Identifier)) };
         } else if (next->isOperator() && next->value() == "->") {
             LOG("ArrowExpression");
             Consume(TokenType::Operator);
-            expr = ArrowExpression{ UE(expr), Consume(TokenType::Identifier) };
+            expr = ArrowExpression{ UE(expr), std::string(Consume(TokenType::Identifier)) };
         } else if (next->isPunctator() && next->value() == "[") {
             LOG("SubscriptExpression");
             Consume(TokenType::Punctator, "[");
             expr = SubscriptExpression{
                 .pointer = UE(expr),
-                .index = unique_expression(ParseExpression(0))
+                .index = unique_expression(m_arena, ParseExpression(0))
             };
             Consume(TokenType::Punctator, "]");
         } else
@@ -233,7 +239,7 @@ Expression ASTBuilder::ParsePrimaryExpression()
         if (next->isPunctator() && next->value() == "(")
             return ParseFunctionCall();
         LOG("VariableExpression");
-        return VariableExpression{ Consume(TokenType::Identifier) };
+        return VariableExpression{ std::string(Consume(TokenType::Identifier)) };
     }
 
     if (next->isPunctator() && next->value() == "(") {
@@ -247,6 +253,8 @@ Expression ASTBuilder::ParsePrimaryExpression()
     if (next->isStringLiteral())
         return ParseStringExpression();
 
+    if (!next)
+        Abort("ASTBuilder reached the end of tokens.");
     assert(next->isNumericLiteral() || next->isCharLiteral());
     return ParseConstantExpression();
 }
@@ -261,7 +269,7 @@ Expression ASTBuilder::ParseFunctionCall()
     while (next->value() != ")") {
         if (next->value() == ",")
             Consume(TokenType::Operator, ",");
-        ret.args.push_back(unique_expression(ParseExpression(0)));
+        ret.args.push_back(unique_expression(m_arena, ParseExpression(0)));
         next = Peek();
     }
     Consume(TokenType::Punctator, ")");
@@ -271,7 +279,7 @@ Expression ASTBuilder::ParseFunctionCall()
 Expression ASTBuilder::ParseStringExpression()
 {
     LOG("ParseStringExpression");
-    std::string literal = Consume(TokenType::StringLiteral);
+    std::string literal = std::string(Consume(TokenType::StringLiteral));
     // Merge consecutive string literals ("foo" "bar" -> "foobar")
     while (Peek()->isStringLiteral())
         literal += Consume(TokenType::StringLiteral);
@@ -285,7 +293,7 @@ Expression ASTBuilder::ParseConstantExpression()
     if (next->isCharLiteral())
         return ConstantExpression{ (int)(Consume(TokenType::CharLiteral)[0]), Type{ BasicType::Int } };
 
-    std::string literal = Consume(TokenType::NumericLiteral);
+    std::string literal = std::string(Consume(TokenType::NumericLiteral));
     // Parse suffixes
     // TODO: Maybe make different token types for different literals to skip this part here
     bool hasL = false;
@@ -346,7 +354,7 @@ uint64_t ASTBuilder::ParseArrayDimension()
         return static_cast<uint64_t>(Consume(TokenType::CharLiteral)[0]);
 
     // Expect a positive integer for array sizes
-    std::string l = Consume(TokenType::NumericLiteral);
+    std::string l = std::string(Consume(TokenType::NumericLiteral));
     if (l.contains('E') || l.contains('e') || l.contains('.'))
         Abort("Expected a positive integer, but a floating point literal found.");
 
@@ -368,7 +376,7 @@ Statement ASTBuilder::ParseReturn()
     auto ret = ReturnStatement{};
     auto next = Peek();
     if (next->type() != TokenType::Punctator || next->value() != ";")
-        ret.expr = unique_expression(ParseExpression(0));
+        ret.expr = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ";");
     return ret;
 }
@@ -379,14 +387,14 @@ Statement ASTBuilder::ParseIf()
     Consume(TokenType::Keyword, "if");
     auto ret = IfStatement{};
     Consume(TokenType::Punctator, "(");
-    ret.condition = unique_expression(ParseExpression(0));
+    ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ")");
-    ret.trueBranch = unique_statement(ParseStatement());
+    ret.trueBranch = unique_statement(m_arena, ParseStatement());
 
     auto next = Peek();
     if (next->isKeyword() && next->value() == "else") {
         Consume(TokenType::Keyword, "else");
-        ret.falseBranch = unique_statement(ParseStatement());
+        ret.falseBranch = unique_statement(m_arena, ParseStatement());
     }
     return ret;
 }
@@ -395,7 +403,7 @@ Statement ASTBuilder::ParseGoto()
 {
     LOG("ParseGoto");
     Consume(TokenType::Keyword, "goto");
-    auto ret = GotoStatement{ Consume(TokenType::Identifier) };
+    auto ret = GotoStatement{ std::string(Consume(TokenType::Identifier)) };
     Consume(TokenType::Punctator, ";");
     return ret;
 }
@@ -405,11 +413,11 @@ Statement ASTBuilder::ParseLabeledStatement()
     // In C17, labels are allowed only before statements and they
     // make a labeled statement together.
     LOG("ParseLabeledStatement");
-    std::string label = Consume(TokenType::Identifier);
+    std::string label = std::string(Consume(TokenType::Identifier));
     Consume(TokenType::Operator, ":");
     return LabeledStatement{
         label,
-        unique_statement(ParseStatement())
+        unique_statement(m_arena, ParseStatement())
     };
 }
 
@@ -435,9 +443,9 @@ Statement ASTBuilder::ParseWhile()
     auto ret = WhileStatement{};
     Consume(TokenType::Keyword, "while");
     Consume(TokenType::Punctator, "(");
-    ret.condition = unique_expression(ParseExpression(0));
+    ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ")");
-    ret.body = unique_statement(ParseStatement());
+    ret.body = unique_statement(m_arena, ParseStatement());
     return ret;
 }
 
@@ -446,10 +454,10 @@ Statement ASTBuilder::ParseDoWhile()
     LOG("ParseDoWhile");
     auto ret = DoWhileStatement{};
     Consume(TokenType::Keyword, "do");
-    ret.body = unique_statement(ParseStatement());
+    ret.body = unique_statement(m_arena, ParseStatement());
     Consume(TokenType::Keyword, "while");
     Consume(TokenType::Punctator, "(");
-    ret.condition = unique_expression(ParseExpression(0));
+    ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ")");
     Consume(TokenType::Punctator, ";");
     return ret;
@@ -467,28 +475,28 @@ Statement ASTBuilder::ParseFor()
     if (next->isPunctator() && next->value() == ";") {
         Consume(TokenType::Punctator, ";");
     } else if (next->isKeyword()) {
-        ret.init = std::make_unique<ForInit>(
-            to_for_init(ParseDeclaration(/* only_variable */ true)));
+        ret.init = NodePtr<ForInit>(m_arena.New<ForInit>(
+            to_for_init(ParseDeclaration(/* only_variable */ true))));
     } else {
-        ret.init = std::make_unique<ForInit>(
-            to_for_init(ParseExpression(0)));
+        ret.init = NodePtr<ForInit>(m_arena.New<ForInit>(
+            to_for_init(ParseExpression(0))));
         Consume(TokenType::Punctator, ";");
     }
 
     // Condition
     next = Peek();
     if (next->value() != ";")
-        ret.condition = unique_expression(ParseExpression(0));
+        ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ";");
 
     // Update
     next = Peek();
     if (next->value() != ")")
-        ret.update = unique_expression(ParseExpression(0));
+        ret.update = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ")");
 
     // Body
-    ret.body = unique_statement(ParseStatement());
+    ret.body = unique_statement(m_arena, ParseStatement());
     return ret;
 }
 
@@ -498,9 +506,9 @@ Statement ASTBuilder::ParseSwitch()
     auto ret = SwitchStatement{};
     Consume(TokenType::Keyword, "switch");
     Consume(TokenType::Punctator, "(");
-    ret.condition = unique_expression(ParseExpression(0));
+    ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Punctator, ")");
-    ret.body = unique_statement(ParseStatement());
+    ret.body = unique_statement(m_arena, ParseStatement());
     return ret;
 }
 
@@ -509,9 +517,9 @@ Statement ASTBuilder::ParseCase()
     LOG("ParseCase");
     auto ret = CaseStatement{};
     Consume(TokenType::Keyword, "case");
-    ret.condition = unique_expression(ParseExpression(0));
+    ret.condition = unique_expression(m_arena, ParseExpression(0));
     Consume(TokenType::Operator, ":");
-    ret.statement = unique_statement(ParseStatement());
+    ret.statement = unique_statement(m_arena, ParseStatement());
     return ret;
 }
 
@@ -521,7 +529,7 @@ Statement ASTBuilder::ParseDefault()
     Consume(TokenType::Keyword, "default");
     Consume(TokenType::Operator, ":");
     return DefaultStatement{
-        unique_statement(ParseStatement()),
+        unique_statement(m_arena, ParseStatement()),
         ""
     };
 }
@@ -612,7 +620,7 @@ Declaration ASTBuilder::ParseDeclaration(bool only_variable)
         bool is_union_declaration = next->value() == "union";
         Consume(TokenType::Keyword, is_union_declaration ? "union" : "struct");
         auto decl = AggregateTypeDeclaration{
-            .tag = Consume(TokenType::Identifier),
+            .tag = std::string(Consume(TokenType::Identifier)),
             .members = {},
             .is_union = is_union_declaration
         };
@@ -664,7 +672,7 @@ Declaration ASTBuilder::ParseDeclaration(bool only_variable)
         func.name = std::move(identifier);
         func.params = param_names;
         if (next->isPunctator() && next->value() == "{")
-            func.body = unique_statement(ParseBlock());
+            func.body = unique_statement(m_arena, ParseBlock());
         else
             Consume(TokenType::Punctator, ";");
         return func;
@@ -679,7 +687,7 @@ Declaration ASTBuilder::ParseDeclaration(bool only_variable)
             return decl;
         }
         Consume(TokenType::Operator, "=");
-        decl.init = std::make_unique<Initializer>(ParseInitializer());
+        decl.init = NodePtr<Initializer>(m_arena.New<Initializer>(ParseInitializer()));
         Consume(TokenType::Punctator, ";");
         return decl;
     }
@@ -697,7 +705,7 @@ Initializer ASTBuilder::ParseInitializer()
         CompoundInit init;
         Consume(TokenType::Punctator, "{");
         while (next->value() != "}") {
-            init.list.push_back(std::make_unique<Initializer>(ParseInitializer()));
+            init.list.push_back(NodePtr<Initializer>(m_arena.New<Initializer>(ParseInitializer())));
             next = Peek();
             if (next->isOperator() && next->value() == ",")
                 Consume(TokenType::Operator, ",");
@@ -708,7 +716,7 @@ Initializer ASTBuilder::ParseInitializer()
     } else {
         LOG("SingleInit");
         SingleInit init{
-            .expr = unique_expression(ParseExpression(0))
+            .expr = unique_expression(m_arena, ParseExpression(0))
         };
         ret.emplace<SingleInit>(std::move(init));
     }
@@ -743,7 +751,7 @@ ASTBuilder::Declarator ASTBuilder::ParseDeclarator()
             simple_declarator = ParseDeclarator();
             Consume(TokenType::Punctator, ")");
         } else {
-            std::string identifier = Consume(TokenType::Identifier);
+            std::string identifier = std::string(Consume(TokenType::Identifier));
             simple_declarator = IdentifierDeclarator{ identifier };
         }
         next = Peek();
@@ -795,16 +803,16 @@ ASTBuilder::ProcessDeclarator(const Declarator &declarator, const Type &base_typ
     if (auto id = std::get_if<IdentifierDeclarator>(&declarator))
         return std::make_tuple(id->identifier, base_type, std::vector<std::string>{});
     else if (auto ptr = std::get_if<PointerDeclarator>(&declarator)) {
-        Type derived_type = Type{ PointerType{ std::make_shared<Type>(base_type) } };
+        Type derived_type = Type{ PointerType{ base_type.interned() } };
         return ProcessDeclarator(*ptr->inner_declarator, derived_type);
     } else if (auto arr = std::get_if<ArrayDeclarator>(&declarator)) {
-        Type derived_type = Type{ ArrayType{ std::make_shared<Type>(base_type), arr->size } };
+        Type derived_type = Type{ ArrayType{ base_type.interned(), arr->size } };
         return ProcessDeclarator(*arr->inner_declarator, derived_type);
     } else if (auto func = std::get_if<FunctionDeclarator>(&declarator)) {
         if (auto func_id = std::get_if<IdentifierDeclarator>(func->inner_declarator.get())) {
             FunctionType func_type = FunctionType{
                 .params = {},
-                .ret = std::make_shared<Type>(base_type)
+                .ret = base_type.interned()
             };
             std::vector<std::string> param_names;
             for (auto &param : func->params) {
@@ -812,7 +820,7 @@ ASTBuilder::ProcessDeclarator(const Declarator &declarator, const Type &base_typ
                 if (param_type.isFunction())
                     Abort("Function pointers are not supported yet.");
                 param_names.push_back(param_name);
-                func_type.params.push_back(std::make_shared<Type>(param_type));
+                func_type.params.push_back(param_type.interned());
             }
             return std::make_tuple(func_id->identifier, Type{ func_type }, param_names);
         } else
@@ -881,10 +889,10 @@ Type ASTBuilder::ProcessAbstractDeclarator(const AbstractDeclarator &decl, const
     if (std::holds_alternative<parser::ASTBuilder::AbstractBaseDeclarator>(decl)) {
         return base_type;
     } else if (auto ptr = std::get_if<AbstractPointerDeclarator>(&decl)) {
-        Type derived_type = Type{ PointerType{ std::make_shared<Type>(base_type) } };
+        Type derived_type = Type{ PointerType{ base_type.interned() } };
         return ProcessAbstractDeclarator(*ptr->inner_declarator, derived_type);
     } else if (auto arr = std::get_if<AbstractArrayDeclarator>(&decl)) {
-        Type derived_type = Type{ ArrayType{ std::make_shared<Type>(base_type), arr->size } };
+        Type derived_type = Type{ ArrayType{ base_type.interned(), arr->size } };
         return ProcessAbstractDeclarator(*arr->inner_declarator, derived_type);
     } else
         assert(false);
@@ -897,7 +905,7 @@ std::pair<StorageClass, Type> ASTBuilder::ParseTypeSpecifierList()
     std::optional<Type> type;
     std::set<std::string> type_specifiers;
     std::vector<StorageClass> storage_classes;
-    std::optional<lexer::Token> next;
+    TokenRef next;
     bool afterStructKeyword = false;
     bool afterUnionKeyword = false;
     while ((next = Peek())) {
@@ -924,7 +932,7 @@ std::pair<StorageClass, Type> ASTBuilder::ParseTypeSpecifierList()
                 afterUnionKeyword = true;
                 continue;
             }
-            auto [it, inserted] = type_specifiers.insert(Consume(TokenType::Keyword));
+            auto [it, inserted] = type_specifiers.insert(std::string(Consume(TokenType::Keyword)));
             if (!inserted)
                 Abort(std::format("Duplicated type specifier '{}'", next->value()));
             continue;
@@ -932,11 +940,11 @@ std::pair<StorageClass, Type> ASTBuilder::ParseTypeSpecifierList()
         if (next->isIdentifier() && afterStructKeyword) {
             if (!type_specifiers.empty())
                 Abort("Can't use 'struct' with other type specifiers.");
-            type = Type{ AggregateType{ Consume(TokenType::Identifier), false } };
+            type = Type{ AggregateType{ std::string(Consume(TokenType::Identifier)), false } };
         } else if (next->isIdentifier() && afterUnionKeyword) {
             if (!type_specifiers.empty())
                 Abort("Can't use 'union' with other type specifiers.");
-            type = Type{ AggregateType{ Consume(TokenType::Identifier), true } };
+            type = Type{ AggregateType{ std::string(Consume(TokenType::Identifier)), true } };
         }
         break;
     }
@@ -957,7 +965,7 @@ Type ASTBuilder::ParseTypes()
 {
     LOG("ParseTypes");
     std::set<std::string> type_specifiers;
-    std::optional<lexer::Token> next;
+    TokenRef next;
     bool afterStructKeyword = false;
     bool afterUnionKeyword = false;
     while ((next = Peek())) {
@@ -975,7 +983,7 @@ Type ASTBuilder::ParseTypes()
                 afterUnionKeyword = true;
                 continue;
             }
-            auto [it, inserted] = type_specifiers.insert(Consume(TokenType::Keyword));
+            auto [it, inserted] = type_specifiers.insert(std::string(Consume(TokenType::Keyword)));
             if (!inserted)
                 Abort(std::format("Duplicated type specifier '{}'", next->value()));
             continue;
@@ -983,11 +991,11 @@ Type ASTBuilder::ParseTypes()
         if (next->isIdentifier() && afterStructKeyword) {
             if (!type_specifiers.empty())
                 Abort("Can't use 'struct' with other type specifiers.");
-            return Type{ AggregateType{ Consume(TokenType::Identifier), false } };
+            return Type{ AggregateType{ std::string(Consume(TokenType::Identifier)), false } };
         } else if (next->isIdentifier() && afterUnionKeyword) {
             if (!type_specifiers.empty())
                 Abort("Can't use 'union' with other type specifiers.");
-            return Type{ AggregateType{ Consume(TokenType::Identifier), true } };
+            return Type{ AggregateType{ std::string(Consume(TokenType::Identifier)), true } };
         }
         break;
     }
@@ -1015,12 +1023,12 @@ std::vector<Declaration> ASTBuilder::Build()
         while (Peek())
             root.push_back(ParseDeclaration());
 
-        if (m_pos != m_tokens.end()) {
-            std::cerr << "Asserting on " << m_pos->value() << std::endl;
-            assert(m_pos == m_tokens.end());
+        if (m_pos != m_tokens.size()) {
+            std::cerr << "Asserting on " << m_tokens[m_pos].value() << std::endl;
+            assert(m_pos == m_tokens.size());
         }
-    } catch (const SyntaxError &e) {
-        std::cerr << e.what() << std::endl;
+    } catch (const SyntaxError &) {
+        // Reported by the caller through ErrorMessage()
     }
     return root;
 }
@@ -3,7 +3,7 @@
 #include "ast_nodes.h"
 #include "common/error.h"
 #include "lexer/token.h"
-#include <list>
+#include <vector>
 
 namespace parser {
 
@@ -12,7 +12,7 @@ class ASTBuilder
 public:
     using TokenType = lexer::Token::Type;
 
-    ASTBuilder(const std::list<lexer::Token> &token_list);
+    ASTBuilder(const std::vector<lexer::Token> &token_list, ASTArena &arena);
     ~ASTBuilder() = default;
 
     void Abort(std::string_view, size_t line = 0);
@@ -22,8 +22,24 @@ public:
     std::string ErrorMessage();
 
 private:
-    std::string Consume(TokenType type, std::string_view value = "");
-    std::optional<lexer::Token> Peek(long n = 0);
+    // Result of a lookahead: false after the last token, where it reads as
+    // an Undefined token with an empty value
+    class TokenRef
+    {
+    public:
+        TokenRef(const lexer::Token *token = nullptr) : m_token(token) {}
+
+        explicit operator bool() const { return m_token; }
+        const lexer::Token *operator->() const { return m_token ? m_token : &s_end; }
+        const lexer::Token &operator*() const { return *operator->(); }
+
+    private:
+        static const lexer::Token s_end;
+        const lexer::Token *m_token;
+    };
+
+    std::string_view Consume(TokenType type, std::string_view value = "");
+    TokenRef Peek(long n = 0);
 
     Expression ParseExpression(int min_precedence);
     Expression ParseUnaryExpression();
@@ -86,8 +102,10 @@ private:
     // Parse type names only
     Type ParseTypes();
 
-    const std::list<lexer::Token> &m_tokens;
-    std::list<lexer::Token>::const_iterator m_pos;
+    const std::vector<lexer::Token> &m_tokens;
+    ASTArena &m_arena;
+    // Index of the next token
+    size_t m_pos;
     Error m_error;
     std::string m_message;
 };
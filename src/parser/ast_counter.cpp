@@ -0,0 +1,251 @@
+#include "ast_counter.h"
+
+namespace parser {
+
+void ASTCounter::operator()(const ConstantExpression &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const StringExpression &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const VariableExpression &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const CastExpression &c)
+{
+    count++;
+    std::visit(*this, *c.expr);
+}
+
+void ASTCounter::operator()(const UnaryExpression &u)
+{
+    count++;
+    std::visit(*this, *u.expr);
+}
+
+void ASTCounter::operator()(const BinaryExpression &b)
+{
+    count++;
+    std::visit(*this, *b.lhs);
+    std::visit(*this, *b.rhs);
+}
+
+void ASTCounter::operator()(const AssignmentExpression &a)
+{
+    count++;
+    std::visit(*this, *a.lhs);
+    std::visit(*this, *a.rhs);
+}
+
+void ASTCounter::operator()(const CompoundAssignmentExpression &c)
+{
+    count++;
+    std::visit(*this, *c.lhs);
+    std::visit(*this, *c.rhs);
+}
+
+void ASTCounter::operator()(const ConditionalExpression &c)
+{
+    count++;
+    std::visit(*this, *c.condition);
+    std::visit(*this, *c.trueBranch);
+    std::visit(*this, *c.falseBranch);
+}
+
+void ASTCounter::operator()(const FunctionCallExpression &f)
+{
+    count++;
+    for (auto &a : f.args)
+        std::visit(*this, *a);
+}
+
+void ASTCounter::operator()(const DereferenceExpression &d)
+{
+    count++;
+    std::visit(*this, *d.expr);
+}
+
+void ASTCounter::operator()(const AddressOfExpression &a)
+{
+    count++;
+    std::visit(*this, *a.expr);
+}
+
+void ASTCounter::operator()(const SubscriptExpression &s)
+{
+    count++;
+    std::visit(*this, *s.pointer);
+    std::visit(*this, *s.index);
+}
+
+void ASTCounter::operator()(const SizeOfExpression &s)
+{
+    count++;
+    std::visit(*this, *s.expr);
+}
+
+void ASTCounter::operator()(const SizeOfTypeExpression &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const DotExpression &d)
+{
+    count++;
+    std::visit(*this, *d.expr);
+}
+
+void ASTCounter::operator()(const ArrowExpression &a)
+{
+    count++;
+    std::visit(*this, *a.expr);
+}
+
+void ASTCounter::operator()(const ReturnStatement &r)
+{
+    count++;
+    if (r.expr)
+        std::visit(*this, *r.expr);
+}
+
+void ASTCounter::operator()(const IfStatement &i)
+{
+    count++;
+    std::visit(*this, *i.condition);
+    std::visit(*this, *i.trueBranch);
+    if (i.falseBranch)
+        std::visit(*this, *i.falseBranch);
+}
+
+void ASTCounter::operator()(const GotoStatement &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const LabeledStatement &l)
+{
+    count++;
+    std::visit(*this, *l.statement);
+}
+
+void ASTCounter::operator()(const BlockStatement &s)
+{
+    count++;
+    for (auto &item : s.items)
+        std::visit(*this, item);
+}
+
+void ASTCounter::operator()(const ExpressionStatement &e)
+{
+    count++;
+    std::visit(*this, *e.expr);
+}
+
+void ASTCounter::operator()(const NullStatement &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const BreakStatement &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const ContinueStatement &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const WhileStatement &w)
+{
+    count++;
+    std::visit(*this, *w.condition);
+    std::visit(*this, *w.body);
+}
+
+void ASTCounter::operator()(const DoWhileStatement &d)
+{
+    count++;
+    std::visit(*this, *d.body);
+    std::visit(*this, *d.condition);
+}
+
+void ASTCounter::operator()(const ForStatement &f)
+{
+    count++;
+    if (f.init)
+        std::visit(*this, *f.init);
+    if (f.condition)
+        std::visit(*this, *f.condition);
+    if (f.update)
+        std::visit(*this, *f.update);
+    std::visit(*this, *f.body);
+}
+
+void ASTCounter::operator()(const SwitchStatement &s)
+{
+    count++;
+    std::visit(*this, *s.condition);
+    std::visit(*this, *s.body);
+}
+
+void ASTCounter::operator()(const CaseStatement &c)
+{
+    count++;
+    std::visit(*this, *c.condition);
+    std::visit(*this, *c.statement);
+}
+
+void ASTCounter::operator()(const DefaultStatement &d)
+{
+    count++;
+    std::visit(*this, *d.statement);
+}
+
+void ASTCounter::operator()(const FunctionDeclaration &f)
+{
+    count++;
+    if (f.body)
+        std::visit(*this, *f.body);
+}
+
+void ASTCounter::operator()(const VariableDeclaration &v)
+{
+    count++;
+    if (v.init)
+        std::visit(*this, *v.init);
+}
+
+void ASTCounter::operator()(const AggregateTypeDeclaration &)
+{
+    count++;
+}
+
+void ASTCounter::operator()(const SingleInit &s)
+{
+    count++;
+    std::visit(*this, *s.expr);
+}
+
+void ASTCounter::operator()(const CompoundInit &c)
+{
+    count++;
+    for (auto &i : c.list)
+        std::visit(*this, *i);
+}
+
+size_t ASTCounter::Count(const std::vector<Declaration> &root)
+{
+    ASTCounter counter;
+    for (auto &i : root)
+        std::visit(counter, i);
+    return counter.count;
+}
+
+} // namespace parser
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ast_visitor.h"
+
+namespace parser {
+
+// Counts the nodes of the AST (used by --time-passes)
+struct ASTCounter : public IASTVisitor<void> {
+    size_t count = 0;
+
+    void operator()(const ConstantExpression &e) override;
+    void operator()(const StringExpression &s) override;
+    void operator()(const VariableExpression &v) override;
+    void operator()(const CastExpression &c) override;
+    void operator()(const UnaryExpression &e) override;
+    void operator()(const BinaryExpression &e) override;
+    void operator()(const AssignmentExpression &a) override;
+    void operator()(const CompoundAssignmentExpression &c) override;
+    void operator()(const ConditionalExpression &c) override;
+    void operator()(const FunctionCallExpression &f) override;
+    void operator()(const DereferenceExpression &d) override;
+    void operator()(const AddressOfExpression &a) override;
+    void operator()(const SubscriptExpression &s) override;
+    void operator()(const SizeOfExpression &s) override;
+    void operator()(const SizeOfTypeExpression &s) override;
+    void operator()(const DotExpression &d) override;
+    void operator()(const ArrowExpression &a) override;
+    void operator()(const ReturnStatement &s) override;
+    void operator()(const IfStatement &i) override;
+    void operator()(const GotoStatement &g) override;
+    void operator()(const LabeledStatement &l) override;
+    void operator()(const BlockStatement &s) override;
+    void operator()(const ExpressionStatement &e) override;
+    void operator()(const NullStatement &) override;
+    void operator()(const BreakStatement &b) override;
+    void operator()(const ContinueStatement &c) override;
+    void operator()(const WhileStatement &w) override;
+    void operator()(const DoWhileStatement &d) override;
+    void operator()(const ForStatement &f) override;
+    void operator()(const SwitchStatement &s) override;
+    void operator()(const CaseStatement &c) override;
+    void operator()(const DefaultStatement &d) override;
+    void operator()(const FunctionDeclaration &f) override;
+    void operator()(const VariableDeclaration &v) override;
+    void operator()(const AggregateTypeDeclaration &a) override;
+    void operator()(const SingleInit &s) override;
+    void operator()(const CompoundInit &c) override;
+    void operator()(std::monostate) override {}
+
+    static size_t Count(const std::vector<Declaration> &root);
+};
+
+}; // namespace parser
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ast_arena.h"
 #include "common/macro.h"
 #include "common/operator.h"
 #include "common/types.h"
@@ -16,12 +17,12 @@ namespace parser {
         Type type; \
         std::string name; \
         std::vector<std::string> params; \
-        std::unique_ptr<Statement> body;) \
+        NodePtr<Statement> body;) \
     X(VariableDeclaration, \
         StorageClass storage; \
         Type type; \
         std::string identifier; \
-        std::unique_ptr<Initializer> init;) \
+        NodePtr<Initializer> init;) \
     X(AggregateTypeDeclaration, \
         std::string tag; \
         std::vector<MemberDeclaration> members; \
@@ -34,52 +35,52 @@ struct MemberDeclaration {
 
 #define AST_STATEMENT_LIST(X) \
     X(ReturnStatement, \
-        std::unique_ptr<Expression> expr;) \
+        NodePtr<Expression> expr;) \
     X(IfStatement, \
-        std::unique_ptr<Expression> condition; \
-        std::unique_ptr<Statement> trueBranch; \
-        std::unique_ptr<Statement> falseBranch;) \
+        NodePtr<Expression> condition; \
+        NodePtr<Statement> trueBranch; \
+        NodePtr<Statement> falseBranch;) \
     X(GotoStatement, \
         std::string label;) \
     X(LabeledStatement, \
         std::string label; \
-        std::unique_ptr<Statement> statement;) \
+        NodePtr<Statement> statement;) \
     X(BlockStatement, \
         std::vector<BlockItem> items;) \
     X(ExpressionStatement, \
-        std::unique_ptr<Expression> expr;) \
+        NodePtr<Expression> expr;) \
     X(NullStatement, /* no op */) \
     X(BreakStatement, \
         std::string label;) \
     X(ContinueStatement, \
         std::string label;) \
     X(WhileStatement, \
-        std::unique_ptr<Expression> condition; \
-        std::unique_ptr<Statement> body; \
+        NodePtr<Expression> condition; \
+        NodePtr<Statement> body; \
         std::string label;) \
     X(DoWhileStatement, \
-        std::unique_ptr<Statement> body; \
-        std::unique_ptr<Expression> condition; \
+        NodePtr<Statement> body; \
+        NodePtr<Expression> condition; \
         std::string label;) \
     X(ForStatement, \
-        std::unique_ptr<ForInit> init; \
-        std::unique_ptr<Expression> condition; \
-        std::unique_ptr<Expression> update; \
-        std::unique_ptr<Statement> body; \
+        NodePtr<ForInit> init; \
+        NodePtr<Expression> condition; \
+        NodePtr<Expression> update; \
+        NodePtr<Statement> body; \
         std::string label;) \
     X(SwitchStatement, \
-        std::unique_ptr<Expression> condition; \
+        NodePtr<Expression> condition; \
         Type type = Type{}; \
-        std::unique_ptr<Statement> body; \
+        NodePtr<Statement> body; \
         std::set<ConstantValue> cases; \
         bool hasDefault; \
         std::string label;) \
     X(CaseStatement, \
-        std::unique_ptr<Expression> condition; \
-        std::unique_ptr<Statement> statement; \
+        NodePtr<Expression> condition; \
+        NodePtr<Statement> statement; \
         std::string label;) \
     X(DefaultStatement, \
-        std::unique_ptr<Statement> statement; \
+        NodePtr<Statement> statement; \
         std::string label;) \
 
 #define AST_EXPRESSION_LIST(X) \
@@ -93,70 +94,70 @@ struct MemberDeclaration {
         std::string identifier; \
         Type type = Type{};) \
     X(CastExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         Type inner_type = Type{}; \
         Type type;) \
     X(UnaryExpression, \
         UnaryOperator op; \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         bool postfix = false; \
         Type type = Type{};) \
     X(BinaryExpression, \
         BinaryOperator op; \
-        std::unique_ptr<Expression> lhs; \
-        std::unique_ptr<Expression> rhs; \
+        NodePtr<Expression> lhs; \
+        NodePtr<Expression> rhs; \
         Type type = Type{};) \
     X(AssignmentExpression, \
-        std::unique_ptr<Expression> lhs; \
-        std::unique_ptr<Expression> rhs; \
+        NodePtr<Expression> lhs; \
+        NodePtr<Expression> rhs; \
         Type type = Type{};) \
     X(CompoundAssignmentExpression, \
         BinaryOperator op; \
-        std::unique_ptr<Expression> lhs; \
-        std::unique_ptr<Expression> rhs; \
+        NodePtr<Expression> lhs; \
+        NodePtr<Expression> rhs; \
         Type inner_type = Type{}; \
         Type type = Type{};) \
     X(ConditionalExpression, \
-        std::unique_ptr<Expression> condition; \
-        std::unique_ptr<Expression> trueBranch; \
-        std::unique_ptr<Expression> falseBranch; \
+        NodePtr<Expression> condition; \
+        NodePtr<Expression> trueBranch; \
+        NodePtr<Expression> falseBranch; \
         Type type = Type{};) \
     X(FunctionCallExpression, \
         std::string identifier; \
-        std::vector<std::unique_ptr<Expression>> args; \
+        std::vector<NodePtr<Expression>> args; \
         Type type;) \
     X(DereferenceExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         Type type = Type{};) \
     X(AddressOfExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         Type type = Type{};) \
     X(SubscriptExpression, \
-        std::unique_ptr<Expression> pointer; \
-        std::unique_ptr<Expression> index; \
+        NodePtr<Expression> pointer; \
+        NodePtr<Expression> index; \
         Type type = Type{};) \
     X(SizeOfExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         Type inner_type = Type{}; \
         Type type = Type{};) \
     X(SizeOfTypeExpression, \
         Type operand; \
         Type type = Type{};) \
     X(DotExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         std::string identifier; \
         Type type = Type{};) \
     X(ArrowExpression, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         std::string identifier; \
         Type type = Type{};)
 
 #define AST_INITIALIZER_LIST(X) \
     X(SingleInit, \
-        std::unique_ptr<Expression> expr; \
+        NodePtr<Expression> expr; \
         Type type = Type{};) \
     X(CompoundInit, \
-        std::vector<std::unique_ptr<Initializer>> list; \
+        std::vector<NodePtr<Initializer>> list; \
         Type type = Type{};)
 
 AST_DECLARATION_LIST(FORWARD_DECL_NODE)
@@ -184,16 +185,17 @@ AST_STATEMENT_LIST(DEFINE_NODE)
 AST_EXPRESSION_LIST(DEFINE_NODE)
 
 template <typename T>
-std::unique_ptr<Expression> unique_expression(T &&item) {
-    return std::make_unique<Expression>(std::forward<T>(item));
+NodePtr<Expression> unique_expression(ASTArena &arena, T &&item) {
+    return NodePtr<Expression>(arena.New<Expression>(std::forward<T>(item)));
 }
-#define UE(x) unique_expression(std::move(x))
+// Used by the classes which build the AST into their m_arena
+#define UE(x) unique_expression(m_arena, std::move(x))
 
 template <typename T>
-std::unique_ptr<Statement> unique_statement(T &&item) {
-    return std::make_unique<Statement>(std::forward<T>(item));
+NodePtr<Statement> unique_statement(ASTArena &arena, T &&item) {
+    return NodePtr<Statement>(arena.New<Statement>(std::forward<T>(item)));
 }
-#define US(x) unique_statement(std::move(x))
+#define US(x) unique_statement(m_arena, std::move(x))
 
 template <typename T>
 inline BlockItem to_block_item(T &&stmt) {
@@ -3,11 +3,12 @@
 
 namespace parser {
 
-Result parse(const std::list<lexer::Token> &tokens)
+Result parse(const std::vector<lexer::Token> &tokens)
 {
     Result res;
+    res.arena = std::make_unique<ASTArena>();
 
-    ASTBuilder builder(tokens);
+    ASTBuilder builder(tokens, *res.arena);
     res.root = builder.Build();
     res.return_code = builder.ErrorCode();
     res.error_message = builder.ErrorMessage();
@@ -2,18 +2,21 @@
 
 #include "ast_nodes.h"
 #include "lexer/token.h"
-#include <list>
+#include <memory>
+#include <vector>
 
 namespace parser {
 
 struct Result
 {
+    // Owns the nodes, so it's declared before (and destroyed after) the root
+    std::unique_ptr<ASTArena> arena;
     std::vector<Declaration> root;
     std::string error_message;
     int return_code = 0;
 };
 
-Result parse(const std::list<lexer::Token> &token_list);
+Result parse(const std::vector<lexer::Token> &token_list);
 
 }; // parser
 
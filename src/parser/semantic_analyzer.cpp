@@ -14,6 +14,12 @@ struct SemanticError : public std::runtime_error
     }
 };
 
+SemanticAnalyzer::SemanticAnalyzer(Context *context)
+    : m_context(context)
+{
+    assert(m_context);
+}
+
 void SemanticAnalyzer::enterScope()
 {
     m_variableFunctionScopes.emplace_back();
@@ -59,20 +65,28 @@ SemanticAnalyzer::AggregateInfo *SemanticAnalyzer::lookupAggregateTag(const std:
 // Call it only in the IDENTIFIER_RESOLUTION stage
 void SemanticAnalyzer::ValidateTypeSpecifier(Type &type)
 {
+    // Types are immutable, the resolved one is built from the components
+    auto validate = [this](const Type *component) {
+        Type resolved = *component;
+        ValidateTypeSpecifier(resolved);
+        return resolved.interned();
+    };
     if (auto aggr_type = type.getAs<AggregateType>()) {
         auto aggregate_info = lookupAggregateTag(aggr_type->tag);
         if (aggregate_info && aggregate_info->is_union == aggr_type->is_union)
-            aggr_type->tag = aggregate_info->unique_name;
+            type = Type{ AggregateType{ aggregate_info->unique_name, aggr_type->is_union } };
         else
             Abort(std::format("Undeclared aggregate type '{}'", aggr_type->tag));
     } else if (auto pointer_type = type.getAs<PointerType>())
-        ValidateTypeSpecifier(*pointer_type->referenced);
+        type = Type{ PointerType{ validate(pointer_type->referenced), pointer_type->decayed } };
     else if (auto array_type = type.getAs<ArrayType>())
-        ValidateTypeSpecifier(*array_type->element);
+        type = Type{ ArrayType{ validate(array_type->element), array_type->count } };
     else if (auto function_type = type.getAs<FunctionType>()) {
-        for (auto &p : function_type->params)
-            ValidateTypeSpecifier(*p);
-        ValidateTypeSpecifier(*function_type->ret);
+        FunctionType resolved;
+        for (const Type *p : function_type->params)
+            resolved.params.push_back(validate(p));
+        resolved.ret = validate(function_type->ret);
+        type = Type{ std::move(resolved) };
     }
 }
 
@@ -241,7 +255,7 @@ void SemanticAnalyzer::operator()(LabeledStatement &l)
 {
     if (m_currentStage == IDENTIFIER_RESOLUTION) {
         // Collect labels for the later stages, catch duplications here
-        std::string unique_name = MakeNameUnique(l.label);
+        std::string unique_name = MakeNameUnique(m_context, l.label);
         auto &s = m_labels[m_currentFunction];
         if (s.contains(l.label))
             Abort(std::format("Label '{}' declared multiple times inside function '{}'", l.label, m_currentFunction));
@@ -303,7 +317,7 @@ void SemanticAnalyzer::operator()(ContinueStatement &c)
 void SemanticAnalyzer::operator()(WhileStatement &w)
 {
     if (m_currentStage == LOOP_LABELING) {
-        w.label = MakeNameUnique("while");
+        w.label = MakeNameUnique(m_context, "while");
         m_controlFlowLabels.push_back(make_pair(w.label, Loop));
     }
 
@@ -317,7 +331,7 @@ void SemanticAnalyzer::operator()(WhileStatement &w)
 void SemanticAnalyzer::operator()(DoWhileStatement &d)
 {
     if (m_currentStage == LOOP_LABELING) {
-        d.label = MakeNameUnique("do");
+        d.label = MakeNameUnique(m_context, "do");
         m_controlFlowLabels.push_back(make_pair(d.label, Loop));
     }
 
@@ -335,7 +349,7 @@ void SemanticAnalyzer::operator()(ForStatement &f)
         enterScope();
 
     if (m_currentStage == LOOP_LABELING) {
-        f.label = MakeNameUnique("for");
+        f.label = MakeNameUnique(m_context, "for");
         m_controlFlowLabels.push_back(make_pair(f.label, Loop));
     }
 
@@ -358,7 +372,7 @@ void SemanticAnalyzer::operator()(SwitchStatement &s)
 {
     if (m_currentStage == LOOP_LABELING) {
         m_switches.push_back(&s);
-        s.label = MakeNameUnique("switch");
+        s.label = MakeNameUnique(m_context, "switch");
         m_controlFlowLabels.push_back(make_pair(s.label, Switch));
     }
 
@@ -434,7 +448,7 @@ void SemanticAnalyzer::operator()(FunctionDeclaration &f)
         for (auto &p : f.params) {
             if (currentScope().contains(p))
                 Abort(std::format("Duplicate function parameter ({})", p));
-            std::string unique_name = MakeNameUnique(p);
+            std::string unique_name = MakeNameUnique(m_context, p);
             currentScope()[p] = IdentifierInfo {
                 .unique_name = unique_name,
                 .has_linkage = false
@@ -486,7 +500,7 @@ void SemanticAnalyzer::operator()(VariableDeclaration &v)
             } else {
                 // Give variables globally unique names; different variables
                 // can have the same names in different scopes
-                std::string unique_name = MakeNameUnique(v.identifier);
+                std::string unique_name = MakeNameUnique(m_context, v.identifier);
                 currentScope()[v.identifier] = IdentifierInfo{
                     .unique_name = unique_name,
                     .has_linkage = false
@@ -505,7 +519,7 @@ void SemanticAnalyzer::operator()(AggregateTypeDeclaration &a)
     if (m_currentStage == IDENTIFIER_RESOLUTION) {
         auto aggregate_info = lookupAggregateTag(a.tag);
         if (!aggregate_info || currentAggregateTagScope().find(a.tag) == currentAggregateTagScope().end()) {
-            std::string unique_tag = MakeNameUnique(a.tag);
+            std::string unique_tag = MakeNameUnique(m_context, a.tag);
             currentAggregateTagScope()[a.tag] = AggregateInfo{
                 .unique_name = unique_tag,
                 .is_union = a.is_union
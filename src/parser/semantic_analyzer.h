@@ -5,6 +5,8 @@
 #include <unordered_map>
 #include <unordered_set>
 
+class Context;
+
 namespace parser {
 
 struct SemanticAnalyzer : public IASTMutatingVisitor<void> {
@@ -19,6 +21,8 @@ struct SemanticAnalyzer : public IASTMutatingVisitor<void> {
         LOOP_LABELING = 2,
     };
 
+    SemanticAnalyzer(Context *context);
+
     void operator()(ConstantExpression &n) override;
     void operator()(StringExpression &s) override;
     void operator()(VariableExpression &v) override;
@@ -62,6 +66,7 @@ struct SemanticAnalyzer : public IASTMutatingVisitor<void> {
     void Abort(std::string_view);
 
 private:
+    Context *m_context;
     Stage m_currentStage = IDENTIFIER_RESOLUTION;
 
     void enterScope();
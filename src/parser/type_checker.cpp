@@ -38,23 +38,25 @@ static bool isNullPointerExpression(const Expression &expr)
     return false;
 }
 
-static std::unique_ptr<Expression> explicitCast(
-    std::unique_ptr<Expression> expr,
+static NodePtr<Expression> explicitCast(
+    ASTArena &arena,
+    NodePtr<Expression> expr,
     const Type &from_type,
     const Type &to_type)
 {
     assert(from_type.isInitialized() && to_type.isInitialized());
     if (from_type == to_type)
         return expr;
-    return std::make_unique<Expression>(CastExpression{
+    return unique_expression(arena, CastExpression{
         .expr = std::move(expr),
         .inner_type = from_type,
         .type = to_type
     });
 }
 
-static std::unique_ptr<Expression> convertByAssignment(
-    std::unique_ptr<Expression> expr,
+static NodePtr<Expression> convertByAssignment(
+    ASTArena &arena,
+    NodePtr<Expression> expr,
     const Type &from_type,
     const Type &to_type)
 {
@@ -62,13 +64,13 @@ static std::unique_ptr<Expression> convertByAssignment(
     if (from_type == to_type)
         return expr;
     if (from_type.isArithmetic() && to_type.isArithmetic())
-        return explicitCast(std::move(expr), from_type, to_type);
+        return explicitCast(arena, std::move(expr), from_type, to_type);
     if (isNullPointerExpression(*expr) && to_type.isPointer())
-        return explicitCast(std::move(expr), from_type, to_type);
+        return explicitCast(arena, std::move(expr), from_type, to_type);
     if (from_type.isPointer() && to_type.isVoidPointer())
-        return explicitCast(std::move(expr), from_type, to_type);
+        return explicitCast(arena, std::move(expr), from_type, to_type);
     if (from_type.isVoidPointer() && to_type.isPointer())
-        return explicitCast(std::move(expr), from_type, to_type);
+        return explicitCast(arena, std::move(expr), from_type, to_type);
     return nullptr;
 }
 
@@ -115,9 +117,10 @@ static size_t byteSizeOf(const std::vector<ConstantValue> &v)
     return sum;
 }
 
-TypeChecker::TypeChecker(Context *context)
+TypeChecker::TypeChecker(Context *context, ASTArena &arena)
     : m_context(context)
     , m_typeTable(context->typeTable.get())
+    , m_arena(arena)
 {
     assert(m_context);
 }
@@ -260,7 +263,7 @@ TypeChecker::ToConstantValueList(const Initializer *init, const Type &type)
     return ret;
 }
 
-Type TypeChecker::VisitAndConvert(std::unique_ptr<Expression> &expr)
+Type TypeChecker::VisitAndConvert(NodePtr<Expression> &expr)
 {
     Type type = std::visit(*this, *expr);
     if (type.isArray()) {
@@ -273,7 +276,7 @@ Type TypeChecker::VisitAndConvert(std::unique_ptr<Expression> &expr)
             .expr = std::move(old_expr),
             .type = new_type
         };
-        expr = std::make_unique<Expression>(std::move(addr));
+        expr = UE(addr);
         return new_type;
     }
     if (const AggregateType *aggr_type = type.getAs<AggregateType>()) {
@@ -308,7 +311,7 @@ Type TypeChecker::operator()(ConstantExpression &c)
 Type TypeChecker::operator()(StringExpression &s)
 {
     s.type = Type{ ArrayType{
-        .element = std::make_shared<Type>(BasicType::Char),
+        .element = Type{ BasicType::Char }.interned(),
         .count = s.value.size() + 1
     } };
     return s.type;
@@ -350,7 +353,7 @@ Type TypeChecker::operator()(UnaryExpression &u)
     if (isMutating(u.op)) {
         if (!isLvalue(*u.expr, type))
             Abort(std::format("Invalid lvalue in {} unary expression", toString(u.op)));
-        if (PointerType *pointer_type = type.getAs<PointerType>()) {
+        if (const PointerType *pointer_type = type.getAs<PointerType>()) {
             if (!pointer_type->referenced->isComplete(m_typeTable))
                 Abort("Incomplete pointer type in unary expression");
         }
@@ -367,7 +370,7 @@ Type TypeChecker::operator()(UnaryExpression &u)
     // but we avoid that in order to keep the one byte representation.
     if (type.isCharacter() && !isMutating(u.op)) {
         Type promotedType = type.promotedType();
-        u.expr = explicitCast(std::move(u.expr), type, promotedType);
+        u.expr = explicitCast(m_arena, std::move(u.expr), type, promotedType);
         u.type = promotedType;
         return u.type;
     }
@@ -428,11 +431,11 @@ Type TypeChecker::operator()(BinaryExpression &b)
     // Pointer arithmetics
     if (b.op == Add) {
         if (left_type.isCompletePointer(m_typeTable) && right_type.isInteger()) {
-            b.rhs = explicitCast(std::move(b.rhs), right_type, Type{ BasicType::Long });
+            b.rhs = explicitCast(m_arena, std::move(b.rhs), right_type, Type{ BasicType::Long });
             b.type = left_type;
             return b.type;
         } else if (left_type.isInteger() && right_type.isCompletePointer(m_typeTable)) {
-            b.lhs = explicitCast(std::move(b.lhs), left_type, Type{ BasicType::Long });
+            b.lhs = explicitCast(m_arena, std::move(b.lhs), left_type, Type{ BasicType::Long });
             b.type = right_type;
             return b.type;
         } else if (!left_type.isArithmetic() && !right_type.isArithmetic())
@@ -440,7 +443,7 @@ Type TypeChecker::operator()(BinaryExpression &b)
     }
     if (b.op == Subtract) {
         if (left_type.isCompletePointer(m_typeTable) && right_type.isInteger()) {
-            b.rhs = explicitCast(std::move(b.rhs), right_type, Type{ BasicType::Long });
+            b.rhs = explicitCast(m_arena, std::move(b.rhs), right_type, Type{ BasicType::Long });
             b.type = left_type;
             return b.type;
         } else if (left_type.isCompletePointer(m_typeTable) && left_type == right_type) {
@@ -466,8 +469,8 @@ Type TypeChecker::operator()(BinaryExpression &b)
         if (left_type.isPointer() || right_type.isPointer()) {
             if (auto cpt = getCommonPointerType(*b.lhs, left_type, *b.rhs, right_type)) {
                 common_type = *cpt;
-                b.lhs = explicitCast(std::move(b.lhs), left_type, common_type);
-                b.rhs = explicitCast(std::move(b.rhs), right_type, common_type);
+                b.lhs = explicitCast(m_arena, std::move(b.lhs), left_type, common_type);
+                b.rhs = explicitCast(m_arena, std::move(b.rhs), right_type, common_type);
                 b.type = Type{ BasicType::Int };
                 return b.type;
             } else
@@ -485,15 +488,15 @@ Type TypeChecker::operator()(BinaryExpression &b)
         if (left_type.isPointer() || right_type.isPointer())
             Abort("Operand of bitshifts can't be pointers.");
         Type promoted_left = left_type.promotedType();
-        b.lhs = explicitCast(std::move(b.lhs), left_type, promoted_left);
-        b.rhs = explicitCast(std::move(b.rhs), right_type, right_type.promotedType());
+        b.lhs = explicitCast(m_arena, std::move(b.lhs), left_type, promoted_left);
+        b.rhs = explicitCast(m_arena, std::move(b.rhs), right_type, right_type.promotedType());
         b.type = promoted_left;
         return b.type;
     }
 
     common_type = GetCommonType(left_type, right_type);
-    b.lhs = explicitCast(std::move(b.lhs), left_type, common_type);
-    b.rhs = explicitCast(std::move(b.rhs), right_type, common_type);
+    b.lhs = explicitCast(m_arena, std::move(b.lhs), left_type, common_type);
+    b.rhs = explicitCast(m_arena, std::move(b.rhs), right_type, common_type);
     if (isRelationOperator(b.op)) {
         // Represented as integer, but they needed a common type before
         b.type = Type{ BasicType::Int };
@@ -511,7 +514,7 @@ Type TypeChecker::operator()(AssignmentExpression &a)
     if (!isLvalue(*a.lhs, left_type))
         Abort("The left side of an assignment should be an lvalue.");
     Type right_type = VisitAndConvert(a.rhs);
-    if (!(a.rhs = convertByAssignment(std::move(a.rhs), right_type, left_type)))
+    if (!(a.rhs = convertByAssignment(m_arena, std::move(a.rhs), right_type, left_type)))
         Abort("Can't convert type for assignment");
     a.type = left_type;
     return a.type;
@@ -556,7 +559,7 @@ Type TypeChecker::operator()(CompoundAssignmentExpression &c)
             Abort("The right side of += and -= must be integer if left is a pointer.");
 
         // += and -=
-        c.rhs = explicitCast(std::move(c.rhs), right_type, Type{ BasicType::ULong });
+        c.rhs = explicitCast(m_arena, std::move(c.rhs), right_type, Type{ BasicType::ULong });
         c.inner_type = left_type;
         c.type = left_type;
         return c.type;
@@ -566,15 +569,15 @@ Type TypeChecker::operator()(CompoundAssignmentExpression &c)
 
     if (c.op == BinaryOperator::AssignLShift || c.op == BinaryOperator::AssignRShift) {
         // The right operand of shift operators needs an integer promotion
-        c.rhs = explicitCast(std::move(c.rhs), right_type, right_type.promotedType());
+        c.rhs = explicitCast(m_arena, std::move(c.rhs), right_type, right_type.promotedType());
         c.inner_type = left_type;
         c.type = left_type;
         return c.type;
     }
 
     Type common_type = GetCommonType(left_type, right_type);
-    c.lhs = explicitCast(std::move(c.lhs), left_type, common_type);
-    c.rhs = explicitCast(std::move(c.rhs), right_type, common_type);
+    c.lhs = explicitCast(m_arena, std::move(c.lhs), left_type, common_type);
+    c.rhs = explicitCast(m_arena, std::move(c.rhs), right_type, common_type);
     c.inner_type = common_type;
     c.type = left_type;
     return c.type;
@@ -607,8 +610,8 @@ Type TypeChecker::operator()(ConditionalExpression &c)
     } else
         common_type = GetCommonType(true_type, false_type);
 
-    c.trueBranch = explicitCast(std::move(c.trueBranch), true_type, common_type);
-    c.falseBranch = explicitCast(std::move(c.falseBranch), false_type, common_type);
+    c.trueBranch = explicitCast(m_arena, std::move(c.trueBranch), true_type, common_type);
+    c.falseBranch = explicitCast(m_arena, std::move(c.falseBranch), false_type, common_type);
     c.type = common_type;
     return c.type;
 }
@@ -621,7 +624,7 @@ Type TypeChecker::operator()(FunctionCallExpression &f)
 
         for (size_t i = 0; i < f.args.size(); i++) {
             Type arg_type = VisitAndConvert(f.args[i]);
-            if (!(f.args[i] = convertByAssignment(std::move(f.args[i]), arg_type, *type->params[i])))
+            if (!(f.args[i] = convertByAssignment(m_arena, std::move(f.args[i]), arg_type, *type->params[i])))
                 Abort("Can't convert argument type for function call");
         }
         f.type = *type->ret;
@@ -630,13 +633,13 @@ Type TypeChecker::operator()(FunctionCallExpression &f)
         // The symbol name exists, we verified it during the semantic analysis.
         Abort(std::format("'{}' is not a function name", f.identifier));
     }
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(DereferenceExpression &d)
 {
     Type type = VisitAndConvert(d.expr);
-    if (PointerType *pointer_type = type.getAs<PointerType>()) {
+    if (const PointerType *pointer_type = type.getAs<PointerType>()) {
         if (pointer_type->referenced->isVoid())
             Abort("Can't dereference a void pointer");
         d.type = *pointer_type->referenced;
@@ -650,7 +653,7 @@ Type TypeChecker::operator()(AddressOfExpression &a)
     Type type = std::visit(*this, *a.expr);
     if (!isLvalue(*a.expr, type))
         Abort("Can't take the address of a non-lvalue");
-    a.type = Type{ PointerType{ .referenced = std::make_shared<Type>(type) } };
+    a.type = Type{ PointerType{ .referenced = type.interned() } };
     return a.type;
 }
 
@@ -662,11 +665,11 @@ Type TypeChecker::operator()(SubscriptExpression &s)
     if (base_type.isCompletePointer(m_typeTable) && index_type.isInteger()) {
         // array_name[index]
         result_type = base_type;
-        s.index = explicitCast(std::move(s.index), index_type, Type{ BasicType::Long });
+        s.index = explicitCast(m_arena, std::move(s.index), index_type, Type{ BasicType::Long });
     } else if (base_type.isInteger() && index_type.isCompletePointer(m_typeTable)) {
         // index[array_name]
         result_type = index_type;
-        s.pointer = explicitCast(std::move(s.pointer), base_type, Type{ BasicType::Long });
+        s.pointer = explicitCast(m_arena, std::move(s.pointer), base_type, Type{ BasicType::Long });
     } else
         Abort("Subscript expressions must have a (complete) pointer and integer operands.");
     s.type = *result_type.getAs<PointerType>()->referenced;
@@ -724,18 +727,18 @@ Type TypeChecker::operator()(ArrowExpression &a)
 
 Type TypeChecker::operator()(ReturnStatement &r)
 {
-    Type function_return_type = *std::get<FunctionType>(m_functionTypeStack.back().t).ret;
+    Type function_return_type = *m_functionTypeStack.back().getAs<FunctionType>()->ret;
     if (r.expr) {
         if (function_return_type.isVoid())
             Abort("Void function can't return a value");
         Type ret_type = VisitAndConvert(r.expr);
-        if (!(r.expr = convertByAssignment(std::move(r.expr), ret_type, function_return_type)))
+        if (!(r.expr = convertByAssignment(m_arena, std::move(r.expr), ret_type, function_return_type)))
             Abort("Can't convert return type");
     } else {
         if (!function_return_type.isVoid())
             Abort("Function must return a value");
     }
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(IfStatement &i)
@@ -746,46 +749,46 @@ Type TypeChecker::operator()(IfStatement &i)
     std::visit(*this, *i.trueBranch);
     if (i.falseBranch)
         std::visit(*this, *i.falseBranch);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(GotoStatement &)
 {
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(LabeledStatement &l)
 {
     std::visit(*this, *l.statement);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(BlockStatement &b)
 {
     for (auto &i : b.items)
         std::visit(*this, i);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(ExpressionStatement &e)
 {
     VisitAndConvert(e.expr);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(NullStatement &)
 {
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(BreakStatement &)
 {
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(ContinueStatement &)
 {
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(WhileStatement &w)
@@ -794,7 +797,7 @@ Type TypeChecker::operator()(WhileStatement &w)
     if (!condition_type.isScalar())
         Abort("While loop should have a scalar condition type");
     std::visit(*this, *w.body);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(DoWhileStatement &d)
@@ -803,7 +806,7 @@ Type TypeChecker::operator()(DoWhileStatement &d)
     Type condition_type = VisitAndConvert(d.condition);
     if (!condition_type.isScalar())
         Abort("Do-while loop should have a scalar condition type");
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(ForStatement &f)
@@ -825,7 +828,7 @@ Type TypeChecker::operator()(ForStatement &f)
     if (f.update)
         VisitAndConvert(f.update);
     std::visit(*this, *f.body);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(SwitchStatement &s)
@@ -836,13 +839,13 @@ Type TypeChecker::operator()(SwitchStatement &s)
 
     // Integer promotion of the controlling expression
     Type promotedType = type.promotedType();
-    s.condition = explicitCast(std::move(s.condition), type, promotedType);
+    s.condition = explicitCast(m_arena, std::move(s.condition), type, promotedType);
     s.type = promotedType;
 
     m_switches.push_back(&s);
     std::visit(*this, *s.body);
     m_switches.pop_back();
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(CaseStatement &c)
@@ -861,13 +864,13 @@ Type TypeChecker::operator()(CaseStatement &c)
             Abort("Duplicate case in switch");
     }
     std::visit(*this, *c.statement);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(DefaultStatement &d)
 {
     std::visit(*this, *d.statement);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(FunctionDeclaration &f)
@@ -875,7 +878,7 @@ Type TypeChecker::operator()(FunctionDeclaration &f)
     // f.type was already determined during the AST build
     ValidateTypeSpecifier(f.type);
 
-    FunctionType *function_type = f.type.getAs<FunctionType>();
+    const FunctionType *function_type = f.type.getAs<FunctionType>();
     if (!function_type->ret->isVoid() && !function_type->ret->isComplete(m_typeTable) && f.body)
         Abort(std::format("Defined function '{}' can't return an incomplete type", f.name));
     if (function_type->ret->isArray())
@@ -887,19 +890,20 @@ Type TypeChecker::operator()(FunctionDeclaration &f)
     bool is_global = f.storage != StorageStatic;
 
     // Adjust the parameter list to accept arrays as pointers
-    auto param_types = function_type->params;
-    std::vector<std::shared_ptr<Type>> adjusted_param_types;
+    FunctionType adjusted_function_type = *function_type;
     for (size_t i = 0; i < f.params.size(); i++) {
         Type adjusted_type;
-        if (param_types[i]->isVoid())
+        const Type *param_type = function_type->params[i];
+        if (param_type->isVoid())
             Abort(std::format("Can't declare a parameter of type void in function '{}'", f.name));
-        else if (ArrayType *arr = param_types[i]->getAs<ArrayType>())
+        else if (const ArrayType *arr = param_type->getAs<ArrayType>())
             adjusted_type = Type{ PointerType{ .referenced = arr->element, .decayed = true } };
         else
-            adjusted_type = *param_types[i];
-        adjusted_param_types.push_back(std::make_shared<Type>(adjusted_type));
+            adjusted_type = *param_type;
+        adjusted_function_type.params[i] = adjusted_type.interned();
     }
-    function_type->params = std::move(adjusted_param_types);
+    f.type = Type{ std::move(adjusted_function_type) };
+    function_type = f.type.getAs<FunctionType>();
 
     if (const SymbolEntry *entry = m_context->symbolTable->get(f.name)) {
         if (entry->type != f.type)
@@ -937,7 +941,7 @@ Type TypeChecker::operator()(FunctionDeclaration &f)
         m_functionTypeStack.pop_back();
     }
 
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(VariableDeclaration &v)
@@ -1050,14 +1054,14 @@ Type TypeChecker::operator()(VariableDeclaration &v)
             }
         }
     }
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(AggregateTypeDeclaration &a)
 {
     // Don't process incomplete aggregates
     if (a.members.empty())
-        return Type{ std::monostate() };
+        return Type{};
 
     if (m_typeTable->get(a.tag))
         Abort(std::format("Redeclaration of aggregate type '{}'", a.tag));
@@ -1097,7 +1101,7 @@ Type TypeChecker::operator()(AggregateTypeDeclaration &a)
 
     // Insert it into the type table
     m_typeTable->insert(a.tag, entry);
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Type TypeChecker::operator()(SingleInit &s)
@@ -1123,7 +1127,7 @@ Type TypeChecker::operator()(SingleInit &s)
     Type type = VisitAndConvert(s.expr);
     m_targetTypeForInitializer = targetType;
 
-    if (!(s.expr = convertByAssignment(std::move(s.expr), type, m_targetTypeForInitializer)))
+    if (!(s.expr = convertByAssignment(m_arena, std::move(s.expr), type, m_targetTypeForInitializer)))
         Abort(std::format("Can't convert initializer from {} to {}.",
             type.toString(), m_targetTypeForInitializer.toString()));
     s.type = m_targetTypeForInitializer;
@@ -1170,7 +1174,7 @@ Type TypeChecker::operator()(CompoundInit &c)
 
 Type TypeChecker::operator()(std::monostate)
 {
-    return Type{ std::monostate() };
+    return Type{};
 }
 
 Error TypeChecker::CheckAndMutate(std::vector<parser::Declaration> &astVector)
@@ -1221,7 +1225,7 @@ InitialValue TypeChecker::InitializeStaticPointer(
             Abort("String literal initialization expect char pointer type");
         // Put the string constant into the symbol table and later initialize
         // the pointer from the address of this.
-        std::string constant_name = MakeNameUnique("string");
+        std::string constant_name = MakeNameUnique(m_context, "string");
         Type expr_type = std::visit(*this, *single_init->expr);
         m_context->symbolTable->insert(constant_name, expr_type, IdentifierAttributes{
             .type = IdentifierAttributes::Constant,
@@ -10,7 +10,7 @@ namespace parser {
 
 class TypeChecker : public IASTMutatingVisitor<Type> {
 public:
-    TypeChecker(Context *context);
+    TypeChecker(Context *context, ASTArena &arena);
 
     Type operator()(ConstantExpression &c) override;
     Type operator()(StringExpression &s) override;
@@ -55,7 +55,7 @@ public:
     void Abort(std::string_view);
 
 private:
-    Type VisitAndConvert(std::unique_ptr<Expression> &expr);
+    Type VisitAndConvert(NodePtr<Expression> &expr);
     void ValidateTypeSpecifier(const Type &type);
     Type GetCommonType(const Type &first, const Type &second);
     std::vector<ConstantValue> ToConstantValueList(const Initializer *init, const Type &type);
@@ -69,6 +69,8 @@ private:
 
     Context *m_context;
     TypeTable *m_typeTable;
+    // Implicit conversions are inserted into the AST
+    ASTArena &m_arena;
 };
 
 }; // namespace parser
@@ -0,0 +1,286 @@
+#include "expression.h"
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace preprocessor {
+
+struct ExpressionError : public std::runtime_error
+{
+    explicit ExpressionError(const std::string &message) : std::runtime_error(message) {}
+};
+
+// Preprocessor arithmetic is done in intmax_t or uintmax_t
+struct Value {
+    long long value = 0;
+    bool is_unsigned = false;
+
+    unsigned long long u() const { return static_cast<unsigned long long>(value); }
+};
+
+static Value makeValue(long long value, bool is_unsigned = false)
+{
+    return Value{ value, is_unsigned };
+}
+
+static Value makeUnsigned(unsigned long long value)
+{
+    return Value{ static_cast<long long>(value), true };
+}
+
+static Value parseNumber(const std::string &text)
+{
+    size_t end = text.size();
+    bool is_unsigned = false;
+    while (end > 0) {
+        char c = text[end - 1];
+        if (c == 'u' || c == 'U')
+            is_unsigned = true;
+        else if (c != 'l' && c != 'L')
+            break;
+        end--;
+    }
+    std::string digits = text.substr(0, end);
+    int base = 10;
+    size_t start = 0;
+    if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        base = 16;
+        start = 2;
+    } else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B')) {
+        base = 2;
+        start = 2;
+    } else if (digits.size() > 1 && digits[0] == '0')
+        base = 8;
+
+    unsigned long long value = 0;
+    for (size_t i = start; i < digits.size(); i++) {
+        char c = digits[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            digit = base;
+        if (digit >= base)
+            throw ExpressionError(std::format("Invalid integer constant in preprocessor expression: {}", text));
+        value = value * static_cast<unsigned long long>(base) + static_cast<unsigned long long>(digit);
+    }
+    // Too big for intmax_t
+    if (value > static_cast<unsigned long long>(std::numeric_limits<long long>::max()))
+        is_unsigned = true;
+    return Value{ static_cast<long long>(value), is_unsigned };
+}
+
+static Value parseChar(const std::string &text)
+{
+    size_t quote = text.find('\'');
+    std::string_view body(text.data() + quote + 1, text.size() - quote - 2);
+    if (body.empty())
+        throw ExpressionError("Empty char literal in preprocessor expression");
+    if (body[0] != '\\')
+        return makeValue(static_cast<signed char>(body[0]));
+    if (body.size() < 2)
+        throw ExpressionError("Invalid escape sequence in preprocessor expression");
+    switch (body[1]) {
+    case 'n': return makeValue('\n');
+    case 't': return makeValue('\t');
+    case 'r': return makeValue('\r');
+    case 'a': return makeValue('\a');
+    case 'b': return makeValue('\b');
+    case 'f': return makeValue('\f');
+    case 'v': return makeValue('\v');
+    case 'x':
+        return makeValue(static_cast<signed char>(std::stoi(std::string(body.substr(2)), nullptr, 16)));
+    default:
+        if (body[1] >= '0' && body[1] <= '7')
+            return makeValue(static_cast<signed char>(std::stoi(std::string(body.substr(1)), nullptr, 8)));
+        return makeValue(body[1]);
+    }
+}
+
+class ExpressionParser {
+public:
+    explicit ExpressionParser(const std::vector<PPToken> &tokens)
+        : m_tokens(tokens)
+    {
+    }
+
+    Value Parse()
+    {
+        Value value = ParseConditional();
+        if (m_pos != m_tokens.size())
+            throw ExpressionError(std::format("Unexpected '{}' in preprocessor expression", m_tokens[m_pos].text));
+        return value;
+    }
+
+private:
+    bool Accept(std::string_view punctuator)
+    {
+        if (m_pos < m_tokens.size() && m_tokens[m_pos].isPunctuator(punctuator)) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(std::string_view punctuator)
+    {
+        if (!Accept(punctuator))
+            throw ExpressionError(std::format("Missing '{}' in preprocessor expression", punctuator));
+    }
+
+    Value ParseConditional()
+    {
+        Value condition = ParseBinary(0);
+        if (!Accept("?"))
+            return condition;
+        Value then_value = ParseConditional();
+        Expect(":");
+        Value else_value = ParseConditional();
+        Value ret = condition.value ? then_value : else_value;
+        ret.is_unsigned = then_value.is_unsigned || else_value.is_unsigned;
+        return ret;
+    }
+
+    static int Precedence(std::string_view op)
+    {
+        static constexpr std::pair<std::string_view, int> s_precedences[] = {
+            { "||", 1 }, { "&&", 2 }, { "|", 3 }, { "^", 4 }, { "&", 5 },
+            { "==", 6 }, { "!=", 6 },
+            { "<", 7 }, { ">", 7 }, { "<=", 7 }, { ">=", 7 },
+            { "<<", 8 }, { ">>", 8 },
+            { "+", 9 }, { "-", 9 },
+            { "*", 10 }, { "/", 10 }, { "%", 10 },
+        };
+        for (auto &[name, precedence] : s_precedences) {
+            if (name == op)
+                return precedence;
+        }
+        return -1;
+    }
+
+    // Precedence climbing
+    Value ParseBinary(int min_precedence)
+    {
+        Value lhs = ParseUnary();
+        while (m_pos < m_tokens.size() && m_tokens[m_pos].kind == PPToken::Punctuator) {
+            std::string op = m_tokens[m_pos].text;
+            int precedence = Precedence(op);
+            if (precedence < 0 || precedence <= min_precedence)
+                break;
+            m_pos++;
+            Value rhs = ParseBinary(precedence);
+            lhs = Apply(op, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    static Value Apply(const std::string &op, Value lhs, Value rhs)
+    {
+        if (op == "||")
+            return makeValue(lhs.value || rhs.value);
+        if (op == "&&")
+            return makeValue(lhs.value && rhs.value);
+        if (op == "<<")
+            return Value{ static_cast<long long>(lhs.u() << (rhs.value & 63)), lhs.is_unsigned };
+        if (op == ">>") {
+            return lhs.is_unsigned
+                ? makeUnsigned(lhs.u() >> (rhs.value & 63))
+                : makeValue(lhs.value >> (rhs.value & 63));
+        }
+
+        // Usual arithmetic conversions
+        bool is_unsigned = lhs.is_unsigned || rhs.is_unsigned;
+        if (op == "==")
+            return makeValue(lhs.value == rhs.value);
+        if (op == "!=")
+            return makeValue(lhs.value != rhs.value);
+        if (op == "<")
+            return makeValue(is_unsigned ? lhs.u() < rhs.u() : lhs.value < rhs.value);
+        if (op == ">")
+            return makeValue(is_unsigned ? lhs.u() > rhs.u() : lhs.value > rhs.value);
+        if (op == "<=")
+            return makeValue(is_unsigned ? lhs.u() <= rhs.u() : lhs.value <= rhs.value);
+        if (op == ">=")
+            return makeValue(is_unsigned ? lhs.u() >= rhs.u() : lhs.value >= rhs.value);
+        if (op == "|")
+            return Value{ lhs.value | rhs.value, is_unsigned };
+        if (op == "^")
+            return Value{ lhs.value ^ rhs.value, is_unsigned };
+        if (op == "&")
+            return Value{ lhs.value & rhs.value, is_unsigned };
+        // Wrapping arithmetic
+        if (op == "+")
+            return Value{ static_cast<long long>(lhs.u() + rhs.u()), is_unsigned };
+        if (op == "-")
+            return Value{ static_cast<long long>(lhs.u() - rhs.u()), is_unsigned };
+        if (op == "*")
+            return Value{ static_cast<long long>(lhs.u() * rhs.u()), is_unsigned };
+        if (rhs.value == 0)
+            throw ExpressionError("Division by zero in preprocessor expression");
+        if (is_unsigned)
+            return makeUnsigned(op == "/" ? lhs.u() / rhs.u() : lhs.u() % rhs.u());
+        if (lhs.value == std::numeric_limits<long long>::min() && rhs.value == -1)
+            return makeValue(op == "/" ? lhs.value : 0);
+        return makeValue(op == "/" ? lhs.value / rhs.value : lhs.value % rhs.value);
+    }
+
+    Value ParseUnary()
+    {
+        if (Accept("+"))
+            return ParseUnary();
+        if (Accept("-")) {
+            Value value = ParseUnary();
+            return Value{ static_cast<long long>(0 - value.u()), value.is_unsigned };
+        }
+        if (Accept("~")) {
+            Value value = ParseUnary();
+            return Value{ ~value.value, value.is_unsigned };
+        }
+        if (Accept("!"))
+            return makeValue(!ParseUnary().value);
+        return ParsePrimary();
+    }
+
+    Value ParsePrimary()
+    {
+        if (Accept("(")) {
+            Value value = ParseConditional();
+            Expect(")");
+            return value;
+        }
+        if (m_pos >= m_tokens.size())
+            throw ExpressionError("Missing operand in preprocessor expression");
+        const PPToken &token = m_tokens[m_pos++];
+        if (token.kind == PPToken::Number)
+            return parseNumber(token.text);
+        if (token.kind == PPToken::CharLiteral)
+            return parseChar(token.text);
+        // C23 keywords, the other identifiers are not macros
+        if (token.kind == PPToken::Identifier)
+            return makeValue(token.text == "true");
+        throw ExpressionError(std::format("Unexpected '{}' in preprocessor expression", token.text));
+    }
+
+    const std::vector<PPToken> &m_tokens;
+    size_t m_pos = 0;
+};
+
+bool evaluate(const std::vector<PPToken> &tokens, bool &result, std::string &error)
+{
+    try {
+        result = ExpressionParser(tokens).Parse().value != 0;
+        return true;
+    } catch (const ExpressionError &e) {
+        error = e.what();
+    } catch (const std::exception &) {
+        // Out of range escape sequences
+        error = "Invalid preprocessor expression";
+    }
+    return false;
+}
+
+}; // namespace preprocessor
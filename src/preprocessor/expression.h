@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pp_token.h"
+#include <string>
+#include <vector>
+
+namespace preprocessor {
+
+// Evaluates the controlling expression of an #if or #elif directive.
+// Macros and "defined" operators have to be replaced already,
+// the remaining identifiers are evaluated as 0.
+// Returns false and sets the error message if the expression is invalid.
+bool evaluate(const std::vector<PPToken> &tokens, bool &result, std::string &error);
+
+}; // namespace preprocessor
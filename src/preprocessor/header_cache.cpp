@@ -0,0 +1,85 @@
+#include "header_cache.h"
+#include "pp_tokenizer.h"
+#include <fstream>
+#include <iterator>
+
+namespace preprocessor {
+
+// Index of the first token of the next line
+static size_t nextLine(const std::vector<PPToken> &tokens, size_t i)
+{
+    for (i++; i < tokens.size() && !tokens[i].line_start; i++)
+        ;
+    return i;
+}
+
+static bool isDirective(const std::vector<PPToken> &tokens, size_t i, std::string_view name)
+{
+    return i + 1 < tokens.size()
+        && tokens[i].line_start
+        && tokens[i].isPunctuator("#")
+        && !tokens[i + 1].line_start
+        && tokens[i + 1].isIdentifier(name);
+}
+
+// An include guard is an #ifndef at the beginning of the file,
+// followed by the #define of the same macro, and closed at the end
+static std::optional<std::string> findIncludeGuard(const std::vector<PPToken> &tokens)
+{
+    if (!isDirective(tokens, 0, "ifndef") || tokens.size() < 3 || tokens[2].line_start)
+        return std::nullopt;
+    std::string guard = tokens[2].text;
+    size_t define = nextLine(tokens, 0);
+    if (!isDirective(tokens, define, "define")
+        || define + 2 >= tokens.size()
+        || !tokens[define + 2].isIdentifier(guard)) {
+        return std::nullopt;
+    }
+
+    size_t depth = 0;
+    for (size_t i = 0; i < tokens.size(); i = nextLine(tokens, i)) {
+        if (isDirective(tokens, i, "if") || isDirective(tokens, i, "ifdef") || isDirective(tokens, i, "ifndef"))
+            depth++;
+        else if (isDirective(tokens, i, "endif")) {
+            if (--depth == 0)
+                return nextLine(tokens, i) == tokens.size() ? std::optional(guard) : std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+static std::shared_ptr<const HeaderCache::File> load(const std::filesystem::path &path)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec))
+        return nullptr;
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+        return nullptr;
+    std::string content(std::istreambuf_iterator<char>(stream), {});
+
+    auto file = std::make_shared<HeaderCache::File>();
+    file->path = path.string();
+    if (!tokenize(content, file->tokens, file->error))
+        return file;
+    file->guard = findIncludeGuard(file->tokens);
+    return file;
+}
+
+std::shared_ptr<const HeaderCache::File> HeaderCache::Get(const std::filesystem::path &path)
+{
+    std::string key = path.lexically_normal().string();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(key);
+        if (it != m_files.end())
+            return it->second;
+    }
+    // Loaded without holding the lock, if another thread was faster,
+    // its result is used
+    std::shared_ptr<const File> file = load(key);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.try_emplace(key, file).first->second;
+}
+
+}; // namespace preprocessor
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "pp_token.h"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace preprocessor {
+
+// Tokenized source files, shared by the translation units of
+// an invocation, so a header is read and tokenized only once.
+class HeaderCache {
+public:
+    struct File {
+        std::string path;
+        std::vector<PPToken> tokens;
+        // Set when tokenization failed
+        std::string error;
+        // Macro of the "#ifndef X #define X ... #endif" include guard
+        // wrapping the whole file
+        std::optional<std::string> guard;
+    };
+
+    // Returns nullptr if the file can't be read. Thread-safe.
+    std::shared_ptr<const File> Get(const std::filesystem::path &path);
+
+private:
+    std::mutex m_mutex;
+    // Missing files are cached as nullptr too (include path lookups)
+    std::unordered_map<std::string, std::shared_ptr<const File>> m_files;
+};
+
+}; // namespace preprocessor
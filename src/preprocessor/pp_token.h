@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace preprocessor {
+
+// Names of the macros which must not be expanded again from a token
+using HideSet = std::set<std::string>;
+
+// Preprocessing token
+struct PPToken {
+    enum Kind {
+        Identifier,
+        Number,
+        CharLiteral,
+        StringLiteral,
+        Punctuator,
+        Other,
+        EndOfFile,
+    };
+
+    Kind kind = EndOfFile;
+    std::string text;
+    size_t line = 0;
+    // First token of a line, directives start with these
+    bool line_start = false;
+    bool space_before = false;
+    // Null when it's empty
+    std::shared_ptr<const HideSet> hide_set;
+
+    bool isPunctuator(std::string_view s) const { return kind == Punctuator && text == s; }
+    bool isIdentifier(std::string_view s) const { return kind == Identifier && text == s; }
+    bool isHidden(const std::string &name) const { return hide_set && hide_set->contains(name); }
+};
+
+}; // namespace preprocessor
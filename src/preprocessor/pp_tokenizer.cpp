@@ -0,0 +1,210 @@
+#include "pp_tokenizer.h"
+#include <cctype>
+#include <format>
+
+namespace preprocessor {
+
+// Longest ones first
+static constexpr std::string_view s_punctuators[] = {
+    "...", "<<=", ">>=",
+    "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+    "*=", "/=", "%=", "+=", "-=", "&=", "^=", "|=", "##",
+};
+
+static bool isIdentifierStart(char c)
+{
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+static bool isIdentifierChar(char c)
+{
+    return isIdentifierStart(c) || std::isdigit(static_cast<unsigned char>(c));
+}
+
+static bool isDigit(char c)
+{
+    return std::isdigit(static_cast<unsigned char>(c));
+}
+
+// Removes the backslash-newline sequences. The removed newlines are
+// appended to the end of the logical line, so the line numbers of
+// the following lines don't change.
+static std::string spliceLines(std::string_view source)
+{
+    std::string ret;
+    ret.reserve(source.size());
+    size_t pending_newlines = 0;
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] == '\\') {
+            size_t next = i + 1;
+            if (next < source.size() && source[next] == '\r')
+                next++;
+            if (next < source.size() && source[next] == '\n') {
+                pending_newlines++;
+                i = next;
+                continue;
+            }
+        }
+        ret += source[i];
+        if (source[i] == '\n') {
+            ret.append(pending_newlines, '\n');
+            pending_newlines = 0;
+        }
+    }
+    ret.append(pending_newlines, '\n');
+    return ret;
+}
+
+bool needsSpace(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.empty() || rhs.empty())
+        return false;
+    char l = lhs.back();
+    char r = rhs.front();
+    if (isIdentifierChar(l) && isIdentifierChar(r))
+        return true;
+    // pp-numbers continue with dots and signed exponents
+    bool number = isDigit(lhs.front()) || (lhs.size() > 1 && lhs[0] == '.' && isDigit(lhs[1]));
+    if (number && (r == '.' || ((r == '+' || r == '-') && (l == 'e' || l == 'E' || l == 'p' || l == 'P'))))
+        return true;
+    if (l == '.' && isDigit(r))
+        return true;
+    if (l == '/' && (r == '/' || r == '*'))
+        return true;
+    std::string joined = std::string(lhs) + r;
+    for (std::string_view punctuator : s_punctuators) {
+        if (punctuator.starts_with(joined))
+            return true;
+    }
+    return false;
+}
+
+bool tokenize(std::string_view source, std::vector<PPToken> &tokens, std::string &error)
+{
+    std::string code = spliceLines(source);
+    size_t pos = 0;
+    size_t line = 1;
+    bool line_start = true;
+    bool space_before = false;
+
+    auto peek = [&](size_t n = 0) -> char {
+        return pos + n < code.size() ? code[pos + n] : '\0';
+    };
+    auto add = [&](PPToken::Kind kind, size_t start) {
+        PPToken token;
+        token.kind = kind;
+        token.text = code.substr(start, pos - start);
+        token.line = line;
+        token.line_start = line_start;
+        token.space_before = space_before;
+        tokens.push_back(std::move(token));
+        line_start = false;
+        space_before = false;
+    };
+
+    while (pos < code.size()) {
+        char c = code[pos];
+        if (c == '\n') {
+            line++;
+            pos++;
+            line_start = true;
+            space_before = false;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f') {
+            pos++;
+            space_before = true;
+            continue;
+        }
+
+        // Comments are replaced by a space
+        if (c == '/' && peek(1) == '/') {
+            while (pos < code.size() && code[pos] != '\n')
+                pos++;
+            space_before = true;
+            continue;
+        }
+        if (c == '/' && peek(1) == '*') {
+            size_t start_line = line;
+            pos += 2;
+            while (pos < code.size() && !(code[pos] == '*' && peek(1) == '/')) {
+                if (code[pos] == '\n')
+                    line++;
+                pos++;
+            }
+            if (pos >= code.size()) {
+                error = std::format("Unclosed comment block (line: {})", start_line);
+                return false;
+            }
+            pos += 2;
+            space_before = true;
+            continue;
+        }
+
+        size_t start = pos;
+        if (isIdentifierStart(c)) {
+            // Prefixed literals (e.g. L"...") are one token
+            bool prefix = (c == 'L' || c == 'u' || c == 'U') && (peek(1) == '"' || peek(1) == '\'');
+            if (!prefix) {
+                while (isIdentifierChar(peek()))
+                    pos++;
+                add(PPToken::Identifier, start);
+                continue;
+            }
+            pos++;
+            c = code[pos];
+        }
+
+        if (isDigit(c) || (c == '.' && isDigit(peek(1)))) {
+            // pp-number
+            pos++;
+            while (true) {
+                char next = peek();
+                if ((next == '+' || next == '-')
+                    && (code[pos - 1] == 'e' || code[pos - 1] == 'E'
+                        || code[pos - 1] == 'p' || code[pos - 1] == 'P')) {
+                    pos++;
+                } else if (isIdentifierChar(next) || next == '.')
+                    pos++;
+                else
+                    break;
+            }
+            add(PPToken::Number, start);
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            size_t end = pos + 1;
+            while (end < code.size() && code[end] != c && code[end] != '\n') {
+                if (code[end] == '\\')
+                    end++;
+                end++;
+            }
+            if (end < code.size() && code[end] == c) {
+                pos = end + 1;
+                add(c == '"' ? PPToken::StringLiteral : PPToken::CharLiteral, start);
+            } else {
+                // A lone quote (e.g. an apostrophe in a skipped block),
+                // it's only an error if the lexer gets it
+                pos++;
+                add(PPToken::Other, start);
+            }
+            continue;
+        }
+
+        bool found = false;
+        for (std::string_view punctuator : s_punctuators) {
+            if (std::string_view(code).substr(pos, punctuator.size()) == punctuator) {
+                pos += punctuator.size();
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            pos++;
+        add(found || std::ispunct(static_cast<unsigned char>(c)) ? PPToken::Punctuator : PPToken::Other, start);
+    }
+    return true;
+}
+
+}; // namespace preprocessor
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "pp_token.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace preprocessor {
+
+// Splits a source file into preprocessing tokens. Line continuations
+// and comments are removed, the line numbers of the tokens are kept.
+// Returns false and sets the error message on malformed input.
+bool tokenize(std::string_view source, std::vector<PPToken> &tokens, std::string &error);
+
+// Whether the two tokens would be lexed differently when written
+// next to each other without whitespace (e.g. "-" and "-", or "x" and "1")
+bool needsSpace(std::string_view lhs, std::string_view rhs);
+
+}; // namespace preprocessor
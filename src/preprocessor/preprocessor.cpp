@@ -0,0 +1,804 @@
+#include "preprocessor.h"
+#include "common/error.h"
+#include "expression.h"
+#include "header_cache.h"
+#include "pp_tokenizer.h"
+#include <cctype>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace preprocessor {
+
+struct PreprocessorError : public std::runtime_error
+{
+    explicit PreprocessorError(const std::string &message) : std::runtime_error(message) {}
+};
+
+struct Macro {
+    std::vector<PPToken> body;
+    std::vector<std::string> params;
+    bool function_like = false;
+    // The last parameter collects the remaining arguments
+    bool variadic = false;
+};
+
+// The leading numeric components of a version like "12" or "4.9.2"
+static std::vector<unsigned long> parseVersion(const std::string &name)
+{
+    std::vector<unsigned long> version;
+    size_t pos = 0;
+    while (pos < name.size() && std::isdigit(static_cast<unsigned char>(name[pos]))) {
+        size_t end = pos;
+        while (end < name.size() && std::isdigit(static_cast<unsigned char>(name[end])))
+            end++;
+        version.push_back(std::stoul(name.substr(pos, end - pos)));
+        if (end == name.size() || name[end] != '.')
+            break;
+        pos = end + 1;
+    }
+    return version;
+}
+
+// Include directories of the system, in the order of gcc
+static const std::vector<std::filesystem::path> &systemIncludeDirs()
+{
+    static const std::vector<std::filesystem::path> s_dirs = []() {
+        std::vector<std::filesystem::path> dirs;
+        std::error_code ec;
+        // Headers of the newest gcc (stddef.h, stdarg.h...)
+        std::filesystem::path gcc_dir;
+        std::vector<unsigned long> gcc_version;
+        for (const auto &entry : std::filesystem::directory_iterator("/usr/lib/gcc/x86_64-linux-gnu", ec)) {
+            if (!std::filesystem::is_directory(entry.path() / "include", ec))
+                continue;
+            std::vector<unsigned long> version = parseVersion(entry.path().filename().string());
+            if (gcc_dir.empty() || version > gcc_version) {
+                gcc_dir = entry.path();
+                gcc_version = std::move(version);
+            }
+        }
+        if (!gcc_dir.empty())
+            dirs.push_back(gcc_dir / "include");
+        dirs.push_back("/usr/local/include");
+        dirs.push_back("/usr/include/x86_64-linux-gnu");
+        dirs.push_back("/usr/include");
+#if defined(__APPLE__)
+        dirs.push_back("/Library/Developer/CommandLineTools/SDKs/MacOSX.sdk/usr/include");
+#endif
+        return dirs;
+    }();
+    return s_dirs;
+}
+
+// Source of the predefined macros and the command line definitions
+static std::string builtinSource(const Options &options)
+{
+    std::string source =
+        "#define __STDC__ 1\n"
+        "#define __STDC_VERSION__ 201710L\n"
+        "#define __STDC_HOSTED__ 1\n"
+        "#define __x86_64__ 1\n"
+        "#define __x86_64 1\n"
+        "#define __amd64__ 1\n"
+        "#define __LP64__ 1\n"
+        "#define _LP64 1\n"
+        "#define __CHAR_BIT__ 8\n"
+        "#define __SIZEOF_SHORT__ 2\n"
+        "#define __SIZEOF_INT__ 4\n"
+        "#define __SIZEOF_LONG__ 8\n"
+        "#define __SIZEOF_LONG_LONG__ 8\n"
+        "#define __SIZEOF_POINTER__ 8\n"
+        "#define __SIZEOF_DOUBLE__ 8\n"
+        "#define __SCHAR_MAX__ 127\n"
+        "#define __SHRT_MAX__ 32767\n"
+        "#define __INT_MAX__ 2147483647\n"
+        "#define __LONG_MAX__ 9223372036854775807L\n"
+        "#define __LONG_LONG_MAX__ 9223372036854775807LL\n"
+        "#define __SIZE_TYPE__ unsigned long\n"
+        "#define __PTRDIFF_TYPE__ long\n"
+        "#define __WCHAR_TYPE__ int\n"
+        "#define __WINT_TYPE__ unsigned int\n"
+        "#define __INTMAX_TYPE__ long\n"
+        "#define __UINTMAX_TYPE__ unsigned long\n"
+        "#define __ORDER_LITTLE_ENDIAN__ 1234\n"
+        "#define __ORDER_BIG_ENDIAN__ 4321\n"
+        "#define __BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__\n"
+#if defined(__APPLE__)
+        "#define __APPLE__ 1\n"
+        "#define __MACH__ 1\n"
+#else
+        "#define __linux__ 1\n"
+        "#define __linux 1\n"
+        "#define __unix__ 1\n"
+        "#define __unix 1\n"
+        "#define __ELF__ 1\n"
+#endif
+        ;
+    for (const std::string &definition : options.definitions) {
+        if (definition.starts_with("-")) {
+            source += std::format("#undef {}\n", definition.substr(1));
+            continue;
+        }
+        size_t eq = definition.find('=');
+        if (eq == std::string::npos)
+            source += std::format("#define {} 1\n", definition);
+        else
+            source += std::format("#define {} {}\n", definition.substr(0, eq), definition.substr(eq + 1));
+    }
+    return source;
+}
+
+static std::shared_ptr<const HideSet> merge(
+    const std::shared_ptr<const HideSet> &a,
+    const std::shared_ptr<const HideSet> &b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    auto ret = std::make_shared<HideSet>(*a);
+    ret->insert(b->begin(), b->end());
+    return ret;
+}
+
+static std::shared_ptr<const HideSet> intersect(
+    const std::shared_ptr<const HideSet> &a,
+    const std::shared_ptr<const HideSet> &b)
+{
+    if (!a || !b)
+        return nullptr;
+    auto ret = std::make_shared<HideSet>();
+    for (const std::string &name : *a) {
+        if (b->contains(name))
+            ret->insert(name);
+    }
+    return ret;
+}
+
+static PPToken stringize(const std::vector<PPToken> &tokens)
+{
+    PPToken ret;
+    ret.kind = PPToken::StringLiteral;
+    ret.text = "\"";
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const PPToken &token = tokens[i];
+        if (i > 0 && (token.space_before || token.line_start))
+            ret.text += ' ';
+        bool literal = token.kind == PPToken::StringLiteral || token.kind == PPToken::CharLiteral;
+        for (char c : token.text) {
+            if (literal && (c == '"' || c == '\\'))
+                ret.text += '\\';
+            ret.text += c;
+        }
+    }
+    ret.text += '"';
+    return ret;
+}
+
+// Expands the macros and executes the directives. Macro expansion follows
+// Prosser's algorithm: every token carries the names of the macros it was
+// produced by (hide set), these are not expanded again from it.
+class Preprocessor {
+public:
+    Preprocessor(const Options &options, HeaderCache *cache)
+        : m_options(options)
+        , m_cache(cache)
+    {
+    }
+
+    std::string Run(const std::string &file_path);
+
+private:
+    struct Source {
+        std::shared_ptr<const HeaderCache::File> file;
+        size_t pos = 0;
+        // Conditionals opened before the file
+        size_t conditional_depth = 0;
+        // Position in the include path where the file was found (#include_next)
+        size_t search_index = std::string::npos;
+    };
+
+    struct Conditional {
+        bool parent_active = true;
+        bool active = false;
+        // One of the branches is already chosen
+        bool taken = false;
+        bool seen_else = false;
+    };
+
+    // Tokens to read before the source files. Macro arguments are expanded
+    // on an isolated stream, which ends with its tokens.
+    struct Stream {
+        std::deque<PPToken> tokens;
+        bool isolated = false;
+    };
+
+    [[noreturn]] void Abort(std::string_view message, size_t line = 0);
+
+    PPToken Next();
+    void PushFront(std::vector<PPToken> tokens);
+    bool Active() const;
+    void PushSource(std::shared_ptr<const HeaderCache::File> file, size_t search_index);
+
+    // Directives
+    std::vector<PPToken> ReadLine();
+    void ProcessDirective(const PPToken &hash);
+    void Define(const std::vector<PPToken> &line);
+    void Include(std::vector<PPToken> line, bool next, size_t line_number);
+    bool EvaluateCondition(const std::vector<PPToken> &line, size_t line_number);
+    bool IsDefined(const std::vector<PPToken> &line, size_t line_number);
+
+    // Macro expansion
+    bool Expand(const PPToken &token);
+    std::vector<std::vector<PPToken>> ReadArguments(const PPToken &name, const Macro &macro, PPToken &rparen);
+    std::vector<PPToken> Substitute(const Macro &macro, const std::vector<std::vector<PPToken>> &args);
+    std::vector<PPToken> ExpandTokens(const std::vector<PPToken> &tokens, bool condition = false);
+    PPToken Paste(const PPToken &lhs, const PPToken &rhs);
+
+    void Emit(const PPToken &token);
+
+    const Options &m_options;
+    HeaderCache *m_cache;
+    std::unordered_map<std::string, Macro> m_macros;
+    std::vector<Source> m_sources;
+    std::vector<Conditional> m_conditionals;
+    std::vector<Stream> m_streams = { Stream() };
+    // Files which executed #pragma once
+    std::set<std::string> m_onceFiles;
+    std::string m_mainPath;
+
+    std::string m_output;
+    size_t m_lastTokenStart = 0;
+};
+
+void Preprocessor::Abort(std::string_view message, size_t line)
+{
+    const std::string &path = m_sources.empty() ? m_mainPath : m_sources.back().file->path;
+    if (line)
+        throw PreprocessorError(std::format("Preprocessor error at {}:{}: {}", path, line, message));
+    throw PreprocessorError(std::format("Preprocessor error in {}: {}", path, message));
+}
+
+std::string Preprocessor::Run(const std::string &file_path)
+{
+    m_mainPath = file_path;
+    auto main_file = m_cache->Get(file_path);
+    if (!main_file)
+        throw PreprocessorError(std::format("Could not open the file: {}", file_path));
+    PushSource(main_file, std::string::npos);
+
+    auto builtin = std::make_shared<HeaderCache::File>();
+    builtin->path = "<built-in>";
+    tokenize(builtinSource(m_options), builtin->tokens, builtin->error);
+    PushSource(builtin, std::string::npos);
+
+    while (true) {
+        PPToken token = Next();
+        if (token.kind == PPToken::EndOfFile)
+            break;
+        if (!Expand(token))
+            Emit(token);
+    }
+    m_output += '\n';
+    return std::move(m_output);
+}
+
+void Preprocessor::PushSource(std::shared_ptr<const HeaderCache::File> file, size_t search_index)
+{
+    if (!file->error.empty())
+        throw PreprocessorError(std::format("Preprocessor error in {}: {}", file->path, file->error));
+    if (m_sources.size() > 200)
+        Abort("#include nested too deeply");
+    Source source;
+    source.file = std::move(file);
+    source.conditional_depth = m_conditionals.size();
+    source.search_index = search_index;
+    m_sources.push_back(std::move(source));
+}
+
+bool Preprocessor::Active() const
+{
+    return m_conditionals.empty() || m_conditionals.back().active;
+}
+
+PPToken Preprocessor::Next()
+{
+    while (true) {
+        Stream &stream = m_streams.back();
+        if (!stream.tokens.empty()) {
+            PPToken token = std::move(stream.tokens.front());
+            stream.tokens.pop_front();
+            return token;
+        }
+        if (stream.isolated || m_sources.empty())
+            return PPToken();
+
+        Source &source = m_sources.back();
+        if (source.pos == source.file->tokens.size()) {
+            if (m_conditionals.size() > source.conditional_depth)
+                Abort("Unterminated conditional directive");
+            m_sources.pop_back();
+            continue;
+        }
+        const PPToken &token = source.file->tokens[source.pos++];
+        if (token.line_start && token.isPunctuator("#")) {
+            ProcessDirective(token);
+            continue;
+        }
+        if (Active())
+            return token;
+    }
+}
+
+void Preprocessor::PushFront(std::vector<PPToken> tokens)
+{
+    std::deque<PPToken> &stream = m_streams.back().tokens;
+    stream.insert(stream.begin(), std::make_move_iterator(tokens.begin()), std::make_move_iterator(tokens.end()));
+}
+
+std::vector<PPToken> Preprocessor::ReadLine()
+{
+    Source &source = m_sources.back();
+    const std::vector<PPToken> &tokens = source.file->tokens;
+    std::vector<PPToken> ret;
+    while (source.pos < tokens.size() && !tokens[source.pos].line_start)
+        ret.push_back(tokens[source.pos++]);
+    return ret;
+}
+
+void Preprocessor::ProcessDirective(const PPToken &hash)
+{
+    std::vector<PPToken> line = ReadLine();
+    // Null directive
+    if (line.empty())
+        return;
+    std::string name = line.front().kind == PPToken::Identifier ? line.front().text : std::string();
+    line.erase(line.begin());
+
+    // Conditionals are tracked in skipped blocks too
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+        Conditional conditional;
+        conditional.parent_active = Active();
+        if (conditional.parent_active) {
+            if (name == "if")
+                conditional.active = EvaluateCondition(line, hash.line);
+            else
+                conditional.active = IsDefined(line, hash.line) == (name == "ifdef");
+        }
+        conditional.taken = conditional.active;
+        m_conditionals.push_back(conditional);
+        return;
+    }
+    if (name == "elif" || name == "elifdef" || name == "elifndef" || name == "else" || name == "endif") {
+        if (m_conditionals.size() <= m_sources.back().conditional_depth)
+            Abort(std::format("#{} without #if", name), hash.line);
+        Conditional &conditional = m_conditionals.back();
+        if (name == "endif") {
+            m_conditionals.pop_back();
+            return;
+        }
+        if (conditional.seen_else)
+            Abort(std::format("#{} after #else", name), hash.line);
+        if (name == "else") {
+            conditional.seen_else = true;
+            conditional.active = conditional.parent_active && !conditional.taken;
+        } else if (!conditional.parent_active || conditional.taken)
+            conditional.active = false;
+        else if (name == "elif")
+            conditional.active = EvaluateCondition(line, hash.line);
+        else
+            conditional.active = IsDefined(line, hash.line) == (name == "elifdef");
+        conditional.taken = conditional.taken || conditional.active;
+        return;
+    }
+
+    if (!Active())
+        return;
+
+    if (name == "define")
+        Define(line);
+    else if (name == "undef") {
+        if (line.empty() || line.front().kind != PPToken::Identifier)
+            Abort("Macro names must be identifiers", hash.line);
+        m_macros.erase(line.front().text);
+    } else if (name == "include" || name == "include_next")
+        Include(std::move(line), name == "include_next", hash.line);
+    else if (name == "error") {
+        PPToken message = stringize(line);
+        Abort(std::format("#error {}", message.text.substr(1, message.text.size() - 2)), hash.line);
+    } else if (name == "pragma" && !line.empty() && line.front().isIdentifier("once"))
+        m_onceFiles.insert(m_sources.back().file->path);
+    else if (name == "warning" || name == "pragma" || name == "line" || name == "ident") {
+        // Other pragmas and line control are ignored
+    } else
+        Abort("Invalid preprocessing directive", hash.line);
+}
+
+void Preprocessor::Define(const std::vector<PPToken> &line)
+{
+    if (line.empty() || line.front().kind != PPToken::Identifier)
+        Abort("Macro names must be identifiers");
+    size_t line_number = line.front().line;
+    Macro macro;
+    size_t i = 1;
+    // No whitespace is allowed between the name and the parameter list
+    if (i < line.size() && line[i].isPunctuator("(") && !line[i].space_before) {
+        macro.function_like = true;
+        i++;
+        if (i < line.size() && line[i].isPunctuator(")"))
+            i++;
+        else {
+            while (true) {
+                if (i < line.size() && line[i].isPunctuator("...")) {
+                    macro.params.push_back("__VA_ARGS__");
+                    macro.variadic = true;
+                    i++;
+                } else if (i < line.size() && line[i].kind == PPToken::Identifier) {
+                    macro.params.push_back(line[i++].text);
+                    // GNU named variadic parameter: "args..."
+                    if (i < line.size() && line[i].isPunctuator("...")) {
+                        macro.variadic = true;
+                        i++;
+                    }
+                } else
+                    Abort("Invalid macro parameter list", line_number);
+
+                if (i < line.size() && line[i].isPunctuator(")") ) {
+                    i++;
+                    break;
+                }
+                if (macro.variadic || i >= line.size() || !line[i].isPunctuator(","))
+                    Abort("Invalid macro parameter list", line_number);
+                i++;
+            }
+        }
+    }
+    macro.body.assign(line.begin() + static_cast<long>(i), line.end());
+    if (!macro.body.empty())
+        macro.body.front().space_before = false;
+    m_macros[line.front().text] = std::move(macro);
+}
+
+void Preprocessor::Include(std::vector<PPToken> line, bool next, size_t line_number)
+{
+    // Computed includes are macro expanded first
+    if (!line.empty() && line.front().kind == PPToken::Identifier)
+        line = ExpandTokens(line);
+    if (line.empty())
+        Abort("#include expects \"FILENAME\" or <FILENAME>", line_number);
+
+    std::string name;
+    bool quoted = false;
+    if (line.front().kind == PPToken::StringLiteral) {
+        name = line.front().text.substr(1, line.front().text.size() - 2);
+        quoted = true;
+    } else if (line.front().isPunctuator("<")) {
+        size_t i = 1;
+        for (; i < line.size() && !line[i].isPunctuator(">"); i++) {
+            if (line[i].space_before && i > 1)
+                name += ' ';
+            name += line[i].text;
+        }
+        if (i == line.size())
+            Abort("Missing '>' in #include", line_number);
+    } else
+        Abort("#include expects \"FILENAME\" or <FILENAME>", line_number);
+
+    const Source &current = m_sources.back();
+    std::vector<std::filesystem::path> search_path;
+    for (const std::string &dir : m_options.include_dirs)
+        search_path.push_back(dir);
+    for (const std::filesystem::path &dir : systemIncludeDirs())
+        search_path.push_back(dir);
+
+    std::shared_ptr<const HeaderCache::File> file;
+    size_t search_index = std::string::npos;
+    if (std::filesystem::path(name).is_absolute())
+        file = m_cache->Get(name);
+    else {
+        // "file" is looked up next to the including file first
+        if (quoted && !next)
+            file = m_cache->Get(std::filesystem::path(current.file->path).parent_path() / name);
+        size_t start = next && current.search_index != std::string::npos ? current.search_index + 1 : 0;
+        for (size_t i = start; !file && i < search_path.size(); i++) {
+            file = m_cache->Get(search_path[i] / name);
+            search_index = i;
+        }
+    }
+    if (!file)
+        Abort(std::format("Can't find include file: {}", name), line_number);
+
+    // Include guards and #pragma once are checked without reading the file again
+    if (file->guard && m_macros.contains(*file->guard))
+        return;
+    if (m_onceFiles.contains(file->path))
+        return;
+    PushSource(file, search_index);
+}
+
+bool Preprocessor::EvaluateCondition(const std::vector<PPToken> &line, size_t line_number)
+{
+    std::vector<PPToken> tokens = ExpandTokens(line, true);
+    bool result = false;
+    std::string error;
+    if (!evaluate(tokens, result, error))
+        Abort(error, line_number);
+    return result;
+}
+
+bool Preprocessor::IsDefined(const std::vector<PPToken> &line, size_t line_number)
+{
+    if (line.empty() || line.front().kind != PPToken::Identifier)
+        Abort("Macro names must be identifiers", line_number);
+    return m_macros.contains(line.front().text);
+}
+
+bool Preprocessor::Expand(const PPToken &token)
+{
+    if (token.kind != PPToken::Identifier || token.isHidden(token.text))
+        return false;
+
+    auto it = m_macros.find(token.text);
+    if (it == m_macros.end()) {
+        // Dynamic predefined macros
+        PPToken replacement = token;
+        if (token.text == "__LINE__") {
+            replacement.kind = PPToken::Number;
+            replacement.text = std::to_string(token.line);
+        } else if (token.text == "__FILE__" && !m_sources.empty()) {
+            PPToken path;
+            path.kind = PPToken::Identifier;
+            path.text = m_sources.back().file->path;
+            replacement.kind = PPToken::StringLiteral;
+            replacement.text = stringize({ path }).text;
+        } else
+            return false;
+        PushFront({ replacement });
+        return true;
+    }
+    const Macro macro = it->second;
+
+    std::vector<PPToken> result;
+    auto hide_set = std::make_shared<HideSet>();
+    hide_set->insert(token.text);
+    std::shared_ptr<const HideSet> hidden;
+    if (!macro.function_like) {
+        result = macro.body;
+        hidden = merge(token.hide_set, hide_set);
+    } else {
+        // A function-like macro name without arguments is not expanded
+        PPToken next = Next();
+        if (!next.isPunctuator("(")) {
+            if (next.kind != PPToken::EndOfFile)
+                PushFront({ next });
+            return false;
+        }
+        PPToken rparen;
+        std::vector<std::vector<PPToken>> args = ReadArguments(token, macro, rparen);
+        result = Substitute(macro, args);
+        hidden = merge(intersect(token.hide_set, rparen.hide_set), hide_set);
+    }
+
+    for (PPToken &t : result) {
+        t.hide_set = merge(t.hide_set, hidden);
+        t.line = token.line;
+    }
+    if (!result.empty()) {
+        result.front().space_before = token.space_before;
+        result.front().line_start = token.line_start;
+    }
+    PushFront(std::move(result));
+    return true;
+}
+
+std::vector<std::vector<PPToken>> Preprocessor::ReadArguments(
+    const PPToken &name,
+    const Macro &macro,
+    PPToken &rparen)
+{
+    std::vector<std::vector<PPToken>> args(1);
+    size_t depth = 0;
+    while (true) {
+        PPToken token = Next();
+        if (token.kind == PPToken::EndOfFile)
+            Abort(std::format("Unterminated argument list invoking macro \"{}\"", name.text), name.line);
+        if (depth == 0 && token.isPunctuator(")")) {
+            rparen = std::move(token);
+            break;
+        }
+        // The variadic parameter collects the commas too
+        if (depth == 0 && token.isPunctuator(",") && !(macro.variadic && args.size() == macro.params.size())) {
+            args.emplace_back();
+            continue;
+        }
+        if (token.isPunctuator("("))
+            depth++;
+        else if (token.isPunctuator(")"))
+            depth--;
+        args.back().push_back(std::move(token));
+    }
+
+    if (macro.params.empty() && args.size() == 1 && args.front().empty())
+        args.clear();
+    // The variadic arguments can be omitted
+    if (macro.variadic && args.size() + 1 == macro.params.size())
+        args.emplace_back();
+    if (args.size() != macro.params.size()) {
+        Abort(std::format("Macro \"{}\" requires {} arguments, but {} given",
+            name.text, macro.params.size(), args.size()), name.line);
+    }
+    return args;
+}
+
+std::vector<PPToken> Preprocessor::Substitute(const Macro &macro, const std::vector<std::vector<PPToken>> &args)
+{
+    auto param = [&](const PPToken &token) -> std::optional<size_t> {
+        if (token.kind != PPToken::Identifier)
+            return std::nullopt;
+        for (size_t i = 0; i < macro.params.size(); i++) {
+            if (macro.params[i] == token.text)
+                return i;
+        }
+        return std::nullopt;
+    };
+    auto append = [](std::vector<PPToken> &ret, const std::vector<PPToken> &tokens, bool space_before) {
+        size_t start = ret.size();
+        ret.insert(ret.end(), tokens.begin(), tokens.end());
+        if (start < ret.size())
+            ret[start].space_before = space_before;
+    };
+
+    // Arguments are expanded once, when they are used without # or ##
+    std::vector<std::optional<std::vector<PPToken>>> expanded_args(args.size());
+    const std::vector<PPToken> &body = macro.body;
+    std::vector<PPToken> ret;
+    // The left operand of ## was an empty argument
+    bool placemarker = false;
+    for (size_t i = 0; i < body.size(); i++) {
+        const PPToken &token = body[i];
+        std::optional<size_t> next_param = i + 1 < body.size() ? param(body[i + 1]) : std::nullopt;
+
+        if (token.isPunctuator("#") && next_param) {
+            PPToken str = stringize(args[*next_param]);
+            str.space_before = token.space_before;
+            ret.push_back(std::move(str));
+            i++;
+            continue;
+        }
+
+        if (token.isPunctuator("##") && i + 1 < body.size()) {
+            const PPToken &rhs = body[++i];
+            bool lhs_empty = placemarker || ret.empty();
+            placemarker = false;
+            if (next_param) {
+                const std::vector<PPToken> &arg = args[*next_param];
+                // GNU extension: ", ## __VA_ARGS__" drops the comma without variadic arguments
+                if (macro.variadic && *next_param + 1 == macro.params.size()
+                    && !lhs_empty && ret.back().isPunctuator(",")) {
+                    if (arg.empty())
+                        ret.pop_back();
+                    else
+                        append(ret, arg, arg.front().space_before);
+                    continue;
+                }
+                if (arg.empty()) {
+                    placemarker = lhs_empty;
+                    continue;
+                }
+                if (lhs_empty)
+                    append(ret, arg, rhs.space_before);
+                else {
+                    ret.back() = Paste(ret.back(), arg.front());
+                    ret.insert(ret.end(), arg.begin() + 1, arg.end());
+                }
+            } else if (lhs_empty)
+                ret.push_back(rhs);
+            else
+                ret.back() = Paste(ret.back(), rhs);
+            continue;
+        }
+
+        if (std::optional<size_t> index = param(token)) {
+            // Operands of ## are not expanded
+            if (i + 1 < body.size() && body[i + 1].isPunctuator("##")) {
+                append(ret, args[*index], token.space_before);
+                placemarker = args[*index].empty();
+                continue;
+            }
+            if (!expanded_args[*index])
+                expanded_args[*index] = ExpandTokens(args[*index]);
+            append(ret, *expanded_args[*index], token.space_before);
+            continue;
+        }
+
+        ret.push_back(token);
+    }
+    return ret;
+}
+
+std::vector<PPToken> Preprocessor::ExpandTokens(const std::vector<PPToken> &tokens, bool condition)
+{
+    Stream stream;
+    stream.tokens.assign(tokens.begin(), tokens.end());
+    stream.isolated = true;
+    m_streams.push_back(std::move(stream));
+
+    std::vector<PPToken> ret;
+    while (true) {
+        PPToken token = Next();
+        if (token.kind == PPToken::EndOfFile)
+            break;
+        // "defined X" or "defined(X)" in #if, the name is not expanded
+        if (condition && token.isIdentifier("defined")) {
+            PPToken name = Next();
+            bool paren = name.isPunctuator("(");
+            if (paren)
+                name = Next();
+            if (name.kind != PPToken::Identifier)
+                Abort("Macro names must be identifiers", token.line);
+            if (paren && !Next().isPunctuator(")"))
+                Abort("Missing ')' after \"defined\"", token.line);
+            token.kind = PPToken::Number;
+            token.text = m_macros.contains(name.text) ? "1" : "0";
+            ret.push_back(std::move(token));
+            continue;
+        }
+        if (!Expand(token))
+            ret.push_back(std::move(token));
+    }
+
+    m_streams.pop_back();
+    return ret;
+}
+
+PPToken Preprocessor::Paste(const PPToken &lhs, const PPToken &rhs)
+{
+    std::string text = lhs.text + rhs.text;
+    std::vector<PPToken> tokens;
+    std::string error;
+    if (!tokenize(text, tokens, error) || tokens.size() != 1) {
+        Abort(std::format("Pasting \"{}\" and \"{}\" does not give a valid preprocessing token",
+            lhs.text, rhs.text), lhs.line);
+    }
+    PPToken ret = lhs;
+    ret.kind = tokens.front().kind;
+    ret.text = std::move(text);
+    return ret;
+}
+
+void Preprocessor::Emit(const PPToken &token)
+{
+    // The line structure is kept, the lexer only needs whitespace
+    // where the tokens would merge
+    if (!m_output.empty()) {
+        if (token.line_start)
+            m_output += '\n';
+        else if (token.space_before
+            || needsSpace(std::string_view(m_output).substr(m_lastTokenStart), token.text)) {
+            m_output += ' ';
+        }
+    }
+    m_lastTokenStart = m_output.size();
+    m_output += token.text;
+}
+
+Result preprocess(const std::string &file_path, const Options &options, HeaderCache *cache)
+{
+    Result res;
+    HeaderCache local_cache;
+    Preprocessor preprocessor(options, cache ? cache : &local_cache);
+    try {
+        res.output = preprocessor.Run(file_path);
+    } catch (const PreprocessorError &e) {
+        res.error_message = e.what();
+        res.return_code = Error::PREPROCESSOR_ERROR;
+    }
+    return res;
+}
+
+}; // namespace preprocessor
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace preprocessor {
+
+class HeaderCache;
+
+struct Options
+{
+    // -I directories, searched before the system ones
+    std::vector<std::string> include_dirs;
+    // -D and -U arguments: "NAME", "NAME=VALUE" or "-NAME" to undefine
+    std::vector<std::string> definitions;
+};
+
+struct Result
+{
+    std::string output;
+    std::string error_message;
+    int return_code = 0;
+};
+
+// Preprocesses a source file in memory. The included headers are taken
+// from the cache (if given), which can be shared by the translation units.
+Result preprocess(const std::string &file_path, const Options &options, HeaderCache *cache = nullptr);
+
+}; // namespace preprocessor
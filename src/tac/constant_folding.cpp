@@ -1,5 +1,6 @@
 #include "common/context.h"
 #include "common/system.h"
+#include "pass_manager.h"
 #include "tac_nodes.h"
 
 namespace tac {
@@ -9,7 +10,7 @@ DIAG_IGNORE("-Wconversion")
 DIAG_IGNORE("-Wsign-conversion")
 DIAG_IGNORE("-Wswitch")
 DIAG_IGNORE("-Wswitch-enum")
-static std::optional<ConstantValue> evaluate(
+std::optional<ConstantValue> evaluate(
     BinaryOperator op,
     const ConstantValue &a,
     const ConstantValue &b)
@@ -73,7 +74,7 @@ static std::optional<ConstantValue> evaluate(
     }, a, b);
 }
 
-static std::optional<ConstantValue> evaluate(UnaryOperator op, const ConstantValue &a)
+std::optional<ConstantValue> evaluate(UnaryOperator op, const ConstantValue &a)
 {
     return std::visit([&](auto l) -> std::optional<ConstantValue> {
         using L = std::decay_t<decltype(l)>;
@@ -96,8 +97,8 @@ static std::optional<ConstantValue> evaluate(UnaryOperator op, const ConstantVal
 }
 DIAG_POP
 
-static std::list<Instruction>::iterator foldUnary(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldUnary(
+    InstructionList::iterator it,
     bool &changed)
 {
     auto &obj = std::get<Unary>(*it);
@@ -111,8 +112,8 @@ static std::list<Instruction>::iterator foldUnary(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldBinary(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldBinary(
+    InstructionList::iterator it,
     bool &changed)
 {
     auto &obj = std::get<Binary>(*it);
@@ -127,42 +128,55 @@ static std::list<Instruction>::iterator foldBinary(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldJumpIfZero(
-    std::list<Instruction> &i,
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldJumpIfZero(
+    InstructionList &i,
+    InstructionList::iterator it,
     bool &changed)
 {
     auto &obj = std::get<JumpIfZero>(*it);
     const Constant *condition = std::get_if<Constant>(&obj.condition);
     if (!condition)
         return std::next(it);
-    if (isZero(condition->value))
-        *it = Jump{ obj.target };
-    else
-        it = i.erase(it);
     changed = true;
+    if (!isZero(condition->value))
+        return i.erase(it);
+    *it = Jump{ obj.target };
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldJumpIfNotZero(
-    std::list<Instruction> &i,
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldJumpIfNotZero(
+    InstructionList &i,
+    InstructionList::iterator it,
     bool &changed)
 {
     auto &obj = std::get<JumpIfNotZero>(*it);
     const Constant *condition = std::get_if<Constant>(&obj.condition);
     if (!condition)
         return std::next(it);
-    if (!isPositiveZero(condition->value))
-        *it = Jump{ obj.target };
-    else
-        it = i.erase(it);
     changed = true;
+    if (isPositiveZero(condition->value))
+        return i.erase(it);
+    *it = Jump{ obj.target };
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldSignExtend(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldJumpTable(
+    InstructionList::iterator it,
+    bool &changed)
+{
+    auto &obj = std::get<JumpTable>(*it);
+    const Constant *index = std::get_if<Constant>(&obj.index);
+    // An index out of the table can only be in unreachable code,
+    // after the bounds check of the switch.
+    if (!index || castTo<uint64_t>(index->value) >= obj.targets.size())
+        return std::next(it);
+    changed = true;
+    *it = Jump{ obj.targets[castTo<size_t>(index->value)] };
+    return std::next(it);
+}
+
+static InstructionList::iterator foldSignExtend(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -179,8 +193,8 @@ static std::list<Instruction>::iterator foldSignExtend(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldTruncate(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldTruncate(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -197,8 +211,8 @@ static std::list<Instruction>::iterator foldTruncate(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldZeroExtend(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldZeroExtend(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -215,8 +229,8 @@ static std::list<Instruction>::iterator foldZeroExtend(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldDoubleToInt(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldDoubleToInt(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -232,8 +246,8 @@ static std::list<Instruction>::iterator foldDoubleToInt(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldDoubleToUInt(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldDoubleToUInt(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -249,8 +263,8 @@ static std::list<Instruction>::iterator foldDoubleToUInt(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldIntToDouble(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldIntToDouble(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -266,8 +280,8 @@ static std::list<Instruction>::iterator foldIntToDouble(
     return std::next(it);
 }
 
-static std::list<Instruction>::iterator foldUIntToDouble(
-    std::list<Instruction>::iterator it,
+static InstructionList::iterator foldUIntToDouble(
+    InstructionList::iterator it,
     Context *context,
     bool &changed)
 {
@@ -283,39 +297,45 @@ static std::list<Instruction>::iterator foldUIntToDouble(
     return std::next(it);
 }
 
-void constantFolding(std::list<CFGBlock> &blocks, Context *context, bool &changed)
+void constantFolding(CFGBlock &block, Context *context, Changes &changes)
 {
-    for (auto &block : blocks) {
-        for (auto it = block.instructions.begin(); it != block.instructions.end();) {
-            it = std::visit([&](auto &obj) {
-                using T = std::decay_t<decltype(obj)>;
-                if constexpr (std::is_same_v<T, Unary>)
-                    return foldUnary(it, changed);
-                else if constexpr (std::is_same_v<T, Binary>)
-                    return foldBinary(it, changed);
-                else if constexpr (std::is_same_v<T, JumpIfZero>)
-                    return foldJumpIfZero(block.instructions, it, changed);
-                else if constexpr (std::is_same_v<T, JumpIfNotZero>)
-                    return foldJumpIfNotZero(block.instructions, it, changed);
-                else if constexpr (std::is_same_v<T, SignExtend>)
-                    return foldSignExtend(it, context, changed);
-                else if constexpr (std::is_same_v<T, Truncate>)
-                    return foldTruncate(it, context, changed);
-                else if constexpr (std::is_same_v<T, ZeroExtend>)
-                    return foldZeroExtend(it, context, changed);
-                else if constexpr (std::is_same_v<T, DoubleToInt>)
-                    return foldDoubleToInt(it, context, changed);
-                else if constexpr (std::is_same_v<T, DoubleToUInt>)
-                    return foldDoubleToUInt(it, context, changed);
-                else if constexpr (std::is_same_v<T, IntToDouble>)
-                    return foldIntToDouble(it, context, changed);
-                else if constexpr (std::is_same_v<T, UIntToDouble>)
-                    return foldUIntToDouble(it, context, changed);
-                else
-                    return std::next(it);
-            }, *it);
-        }
+    bool changed = false;
+    bool jump_changed = false;
+    for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+        it = std::visit([&](auto &obj) {
+            using T = std::decay_t<decltype(obj)>;
+            if constexpr (std::is_same_v<T, Unary>)
+                return foldUnary(it, changed);
+            else if constexpr (std::is_same_v<T, Binary>)
+                return foldBinary(it, changed);
+            else if constexpr (std::is_same_v<T, JumpIfZero>)
+                return foldJumpIfZero(block.instructions, it, jump_changed);
+            else if constexpr (std::is_same_v<T, JumpIfNotZero>)
+                return foldJumpIfNotZero(block.instructions, it, jump_changed);
+            else if constexpr (std::is_same_v<T, JumpTable>)
+                return foldJumpTable(it, jump_changed);
+            else if constexpr (std::is_same_v<T, SignExtend>)
+                return foldSignExtend(it, context, changed);
+            else if constexpr (std::is_same_v<T, Truncate>)
+                return foldTruncate(it, context, changed);
+            else if constexpr (std::is_same_v<T, ZeroExtend>)
+                return foldZeroExtend(it, context, changed);
+            else if constexpr (std::is_same_v<T, DoubleToInt>)
+                return foldDoubleToInt(it, context, changed);
+            else if constexpr (std::is_same_v<T, DoubleToUInt>)
+                return foldDoubleToUInt(it, context, changed);
+            else if constexpr (std::is_same_v<T, IntToDouble>)
+                return foldIntToDouble(it, context, changed);
+            else if constexpr (std::is_same_v<T, UIntToDouble>)
+                return foldUIntToDouble(it, context, changed);
+            else
+                return std::next(it);
+        }, *it);
     }
+    if (changed || jump_changed)
+        changes.MarkBlock(block);
+    if (jump_changed)
+        changes.MarkControlFlow();
 }
 
 }; // tac
@@ -1,226 +1,187 @@
-#include "tac_nodes.h"
+#include "data_flow.h"
+#include "pass_manager.h"
 #include "common/context.h"
-#include <algorithm>
 #include <map>
+#include <optional>
 
 namespace tac {
 
-static std::map<const Instruction *, std::set<Copy>> s_instructionAnnotations;
-static std::map<const CFGBlock *, std::set<Copy>> s_blockAnnotations;
+// The Copy instructions of the function are numbered densely, so the sets
+// of reaching copies are bit sets indexed by these ids.
+struct CopyIndex {
+    std::vector<Copy> copies;
+    std::map<Copy, uint32_t> ids;
+    // By variable id: the copies which read or write the variable
+    std::vector<std::vector<uint32_t>> using_variable;
+    // By variable id: the copies which write the variable
+    std::vector<std::vector<uint32_t>> to_variable;
+    // Copies involving aliased or static variables, memory writes kill them
+    BitSet using_memory;
+};
 
-static Type getType(const Value &value, SymbolTable *symbol_table)
-{
-    if (auto c = std::get_if<Constant>(&value))
-        return getType(c->value);
-    auto v = std::get_if<Variant>(&value);
-    const SymbolEntry *entry = symbol_table->get(v->name);
-    assert(entry);
-    return entry->type;
-}
+thread_local static CopyIndex s_copyIndex;
+// By variable id
+thread_local static std::vector<Type> s_variableTypes;
 
-static bool isNullConstant(const Value &value)
+static const Type &getType(const Value &value, Type &constant_type)
 {
     if (auto c = std::get_if<Constant>(&value)) {
-        return std::visit([](const auto &v) -> bool {
-            using T = std::decay_t<decltype(v)>;
-            if constexpr (std::is_integral_v<T>)
-                return v == 0;
-            return false;
-        }, c->value);
+        constant_type = getType(c->value);
+        return constant_type;
     }
-    return false;
+    return s_variableTypes[std::get<Variant>(value).id];
 }
 
-static void killCopiesUsing(std::set<Copy> &copies, const Value &v)
+static std::optional<uint32_t> findCopy(const Copy &copy)
 {
-    for (auto it = copies.begin(); it != copies.end();) {
-        if (it->src == v || it->dst == v)
-            it = copies.erase(it);
-        else
-            ++it;
-    }
+    auto it = s_copyIndex.ids.find(copy);
+    if (it == s_copyIndex.ids.end())
+        return std::nullopt;
+    return it->second;
 }
 
-// Transfer function: takes all the Copy instructions that reach the begin-
-// ning of a basic block and calculates which copies reach each individual
-// instruction within the block. It also calculates which copies reach the
-// end of the block, just after the final instruction.
-static void transfer(
-    const CFGBlock *block,
-    const std::set<Copy> &initial_reaching_copies,
-    const std::set<Value> &aliased_vars,
-    const std::set<Value> &static_vars,
-    SymbolTable *symbol_table)
+static void buildCopyIndex(
+    const CFG &blocks,
+    size_t variable_count,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars)
 {
-    std::set<Copy> current_reaching_copies = initial_reaching_copies;
-    for (const auto &instruction : block->instructions) {
-        s_instructionAnnotations[&instruction] = current_reaching_copies;
-        if (const Copy *copy = std::get_if<Copy>(&instruction)) {
-            // Check for reversed copy
-            if (current_reaching_copies.contains(Copy{ copy->dst, copy->src }))
+    CopyIndex &index = s_copyIndex;
+    index = CopyIndex{};
+    index.using_variable.resize(variable_count);
+    index.to_variable.resize(variable_count);
+    for (auto &block : blocks) {
+        for (auto &instr : block.instructions) {
+            const Copy *copy = std::get_if<Copy>(&instr);
+            if (!copy)
                 continue;
-            killCopiesUsing(current_reaching_copies, copy->dst);
-            Type src_type = getType(copy->src, symbol_table);
-            Type dst_type = getType(copy->dst, symbol_table);
-            if (std::holds_alternative<Constant>(copy->src)
-                || src_type == dst_type
-                || (src_type.isCharacter() && dst_type.isCharacter())
-                || (isNullConstant(copy->src) && dst_type.isPointer()))
-                current_reaching_copies.insert(*copy);
-        } else if (const FunctionCall *func_call = std::get_if<FunctionCall>(&instruction)) {
-            for (auto reaching_copy = current_reaching_copies.begin();
-                reaching_copy != current_reaching_copies.end();) {
-                if (aliased_vars.contains(reaching_copy->src) || aliased_vars.contains(reaching_copy->dst)) {
-                    reaching_copy = current_reaching_copies.erase(reaching_copy);
-                    continue;
-                }
-                if (static_vars.contains(reaching_copy->src) || static_vars.contains(reaching_copy->dst)) {
-                    reaching_copy = current_reaching_copies.erase(reaching_copy);
-                    continue;
-                }
-                if (func_call->dst && (reaching_copy->src == func_call->dst || reaching_copy->dst == func_call->dst)) {
-                    reaching_copy = current_reaching_copies.erase(reaching_copy);
-                    continue;
-                }
-                ++reaching_copy;
-            }
-        } else if (std::holds_alternative<Store>(instruction)) {
-            for (auto reaching_copy = current_reaching_copies.begin();
-                reaching_copy != current_reaching_copies.end();) {
-                if (aliased_vars.contains(reaching_copy->src) || aliased_vars.contains(reaching_copy->dst)) {
-                    reaching_copy = current_reaching_copies.erase(reaching_copy);
-                    continue;
-                }
-                if (static_vars.contains(reaching_copy->src) || static_vars.contains(reaching_copy->dst)) {
-                    reaching_copy = current_reaching_copies.erase(reaching_copy);
-                    continue;
-                }
-                ++reaching_copy;
+            auto [it, inserted] = index.ids.try_emplace(
+                *copy,
+                static_cast<uint32_t>(index.copies.size()));
+            if (!inserted)
+                continue;
+            index.copies.push_back(*copy);
+            if (const Variant *src = std::get_if<Variant>(&copy->src))
+                index.using_variable[src->id].push_back(it->second);
+            if (const Variant *dst = std::get_if<Variant>(&copy->dst)) {
+                index.using_variable[dst->id].push_back(it->second);
+                index.to_variable[dst->id].push_back(it->second);
             }
-        } else if (const Unary *unary = std::get_if<Unary>(&instruction))
-            killCopiesUsing(current_reaching_copies, unary->dst);
-        else if (const Binary *binary = std::get_if<Binary>(&instruction))
-            killCopiesUsing(current_reaching_copies, binary->dst);
-        else if (const SignExtend *se = std::get_if<SignExtend>(&instruction))
-            killCopiesUsing(current_reaching_copies, se->dst);
-        else if (const Truncate *tr = std::get_if<Truncate>(&instruction))
-            killCopiesUsing(current_reaching_copies, tr->dst);
-        else if (const ZeroExtend *ze = std::get_if<ZeroExtend>(&instruction))
-            killCopiesUsing(current_reaching_copies, ze->dst);
-        else if (const DoubleToInt *dti = std::get_if<DoubleToInt>(&instruction))
-            killCopiesUsing(current_reaching_copies, dti->dst);
-        else if (const DoubleToUInt *dtu = std::get_if<DoubleToUInt>(&instruction))
-            killCopiesUsing(current_reaching_copies, dtu->dst);
-        else if (const IntToDouble *itd = std::get_if<IntToDouble>(&instruction))
-            killCopiesUsing(current_reaching_copies, itd->dst);
-        else if (const UIntToDouble *utd = std::get_if<UIntToDouble>(&instruction))
-            killCopiesUsing(current_reaching_copies, utd->dst);
-        else if (const AddPtr *add = std::get_if<AddPtr>(&instruction))
-            killCopiesUsing(current_reaching_copies, add->dst);
-        else if (const CopyToOffset *cto = std::get_if<CopyToOffset>(&instruction))
-            killCopiesUsing(current_reaching_copies, Value{ Variant{ cto->dst_identifier } });
-        else if (const CopyFromOffset *cfo = std::get_if<CopyFromOffset>(&instruction))
-            killCopiesUsing(current_reaching_copies, cfo->dst);
+        }
     }
-    s_blockAnnotations[block] = std::move(current_reaching_copies);
-}
 
-// Meet operator: propagates information about reaching copies
-// from one block to another.
-static std::set<Copy> meet(
-    const CFGBlock *block,
-    const std::set<Copy> &all_copies)
-{
-    std::set<Copy> incoming_copies = all_copies;
-    const std::set<CFGBlock *> &preds = block->predecessors;
-    for (auto pred = preds.begin(); pred != preds.end(); ++pred) {
-        if ((*pred)->id == 0) // Entry
-            return {};
-        const std::set<Copy> &pred_out_copies = s_blockAnnotations[*pred];
-        // Intersection of incoming_copies and pred_out_copies
-        for (auto it = incoming_copies.begin(); it != incoming_copies.end();) {
-            if (!pred_out_copies.contains(*it))
-                it = incoming_copies.erase(it);
-            else
-                ++it;
-        }
+    index.using_memory = BitSet(index.copies.size());
+    auto is_memory = [&](const Value &v) {
+        const Variant *var = std::get_if<Variant>(&v);
+        return var && (aliased_vars.test(var->id) || static_vars.test(var->id));
+    };
+    for (size_t i = 0; i < index.copies.size(); ++i) {
+        if (is_memory(index.copies[i].src) || is_memory(index.copies[i].dst))
+            index.using_memory.set(i);
     }
-    return incoming_copies;
 }
 
-// Iterative algorithm: implements a forward data flow analysis using
-// the transfer function and meet operator defined above.
-static void findReachingCopies(
-    const std::list<CFGBlock> &blocks,
-    const std::set<Value> &aliased_vars,
-    const std::set<Value> &static_vars,
-    SymbolTable *symbol_table)
+static bool isNullConstant(const Value &value)
 {
-    size_t exit_id = blocks.back().id;
-
-    std::set<Copy> all_copies;
-    for (auto &block : blocks) {
-        for (auto &instr : block.instructions) {
-            if (const Copy *copy = std::get_if<Copy>(&instr))
-                all_copies.insert(*copy);
-        }
+    if (auto c = std::get_if<Constant>(&value)) {
+        return std::visit([](const auto &v) -> bool {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_integral_v<T>)
+                return v == 0;
+            return false;
+        }, c->value);
     }
+    return false;
+}
 
-    std::list<const CFGBlock *> worklist;
-    // TODO: Can be optimized by reverse postordering
-    for (auto &block : blocks) {
-        if (block.id == 0 || block.id == exit_id)
-            continue;
-        worklist.push_back(&block);
-        s_blockAnnotations[&block] = all_copies;
+static void killCopiesUsing(BitSet &copies, const Value &v)
+{
+    if (const Variant *var = std::get_if<Variant>(&v)) {
+        for (uint32_t id : s_copyIndex.using_variable[var->id])
+            copies.reset(id);
     }
+}
 
-    while (!worklist.empty()) {
-        const CFGBlock *block = worklist.front();
-        worklist.pop_front();
-        std::set<Copy> old_annotations = s_blockAnnotations[block];
-        std::set<Copy> incoming_copies = meet(block, all_copies);
-        transfer(block, incoming_copies, aliased_vars, static_vars, symbol_table);
-        if (old_annotations != s_blockAnnotations[block]) {
-            for (auto succ : block->successors) {
-                if (succ->id == 0)
-                    assert(false);
-                if (succ->id == exit_id)
-                    continue;
-                if (std::find(worklist.begin(), worklist.end(), succ) == worklist.end())
-                    worklist.push_back(succ);
-            }
-        }
-    }
+// Transfer function of a single instruction: takes the copies which reach
+// it and calculates which copies reach the next one.
+static void transfer(const Instruction &instruction, BitSet &current_reaching_copies)
+{
+    if (const Copy *copy = std::get_if<Copy>(&instruction)) {
+        // Check for reversed copy
+        std::optional<uint32_t> reversed = findCopy(Copy{ copy->dst, copy->src });
+        if (reversed && current_reaching_copies.test(*reversed))
+            return;
+        killCopiesUsing(current_reaching_copies, copy->dst);
+        Type src_constant_type, dst_constant_type;
+        const Type &src_type = getType(copy->src, src_constant_type);
+        const Type &dst_type = getType(copy->dst, dst_constant_type);
+        if (std::holds_alternative<Constant>(copy->src)
+            || src_type == dst_type
+            || (src_type.isCharacter() && dst_type.isCharacter())
+            || (isNullConstant(copy->src) && dst_type.isPointer()))
+            current_reaching_copies.set(*findCopy(*copy));
+    } else if (const FunctionCall *func_call = std::get_if<FunctionCall>(&instruction)) {
+        current_reaching_copies.subtract(s_copyIndex.using_memory);
+        if (func_call->dst)
+            killCopiesUsing(current_reaching_copies, *func_call->dst);
+    } else if (std::holds_alternative<Store>(instruction)) {
+        current_reaching_copies.subtract(s_copyIndex.using_memory);
+    } else if (const Unary *unary = std::get_if<Unary>(&instruction))
+        killCopiesUsing(current_reaching_copies, unary->dst);
+    else if (const Binary *binary = std::get_if<Binary>(&instruction))
+        killCopiesUsing(current_reaching_copies, binary->dst);
+    else if (const SignExtend *se = std::get_if<SignExtend>(&instruction))
+        killCopiesUsing(current_reaching_copies, se->dst);
+    else if (const Truncate *tr = std::get_if<Truncate>(&instruction))
+        killCopiesUsing(current_reaching_copies, tr->dst);
+    else if (const ZeroExtend *ze = std::get_if<ZeroExtend>(&instruction))
+        killCopiesUsing(current_reaching_copies, ze->dst);
+    else if (const DoubleToInt *dti = std::get_if<DoubleToInt>(&instruction))
+        killCopiesUsing(current_reaching_copies, dti->dst);
+    else if (const DoubleToUInt *dtu = std::get_if<DoubleToUInt>(&instruction))
+        killCopiesUsing(current_reaching_copies, dtu->dst);
+    else if (const IntToDouble *itd = std::get_if<IntToDouble>(&instruction))
+        killCopiesUsing(current_reaching_copies, itd->dst);
+    else if (const UIntToDouble *utd = std::get_if<UIntToDouble>(&instruction))
+        killCopiesUsing(current_reaching_copies, utd->dst);
+    else if (const AddPtr *add = std::get_if<AddPtr>(&instruction))
+        killCopiesUsing(current_reaching_copies, add->dst);
+    else if (const CopyToOffset *cto = std::get_if<CopyToOffset>(&instruction))
+        killCopiesUsing(current_reaching_copies, Value{ cto->dst_identifier });
+    else if (const CopyFromOffset *cfo = std::get_if<CopyFromOffset>(&instruction))
+        killCopiesUsing(current_reaching_copies, cfo->dst);
 }
 
 static Value newOperand(
     Value &operand,
-    std::set<Copy> &reaching_copies,
-    SymbolTable *symbol_table,
+    const BitSet &reaching_copies,
     bool &changed)
 {
-    if (std::holds_alternative<Constant>(operand))
+    const Variant *var = std::get_if<Variant>(&operand);
+    if (!var)
         return operand;
 
-    for (const Copy &rcopy : reaching_copies) {
-        if (rcopy.dst == operand) {
-            Type dst_type = getType(rcopy.dst, symbol_table);
-            Type src_type = getType(rcopy.src, symbol_table);
-            Value result = operand;
+    // At most one of the copies to a variable can reach an instruction
+    for (uint32_t id : s_copyIndex.to_variable[var->id]) {
+        if (!reaching_copies.test(id))
+            continue;
+        const Copy &rcopy = s_copyIndex.copies[id];
+        Type src_constant_type, dst_constant_type;
+        const Type &dst_type = getType(rcopy.dst, dst_constant_type);
+        const Type &src_type = getType(rcopy.src, src_constant_type);
+        Value result = operand;
 
-            if (const Constant *c = std::get_if<Constant>(&rcopy.src))
-                result = Value{ Constant{ ConvertValue(c->value, dst_type) } };
-            else if (src_type == dst_type
-                || (src_type.isCharacter() && dst_type.isCharacter()))
-                result = rcopy.src;
-            else
-                return operand;
+        if (const Constant *c = std::get_if<Constant>(&rcopy.src))
+            result = Value{ Constant{ ConvertValue(c->value, dst_type) } };
+        else if (src_type == dst_type
+            || (src_type.isCharacter() && dst_type.isCharacter()))
+            result = rcopy.src;
+        else
+            return operand;
 
-            if (result != operand)
-                changed = true;
-            return result;
-        }
+        if (result != operand)
+            changed = true;
+        return result;
     }
 
     return operand;
@@ -229,79 +190,103 @@ static Value newOperand(
 // Returns true if the instruction can be removed
 static bool rewriteInstruction(
     Instruction &instr,
-    SymbolTable *symbol_table,
+    const BitSet &reaching_copies,
     bool &changed)
 {
-    std::set<Copy> &reaching_copies = s_instructionAnnotations[&instr];
     if (Copy *copy = std::get_if<Copy>(&instr)) {
-        for (const Copy &rcopy : reaching_copies) {
-            if (rcopy == *copy || (rcopy.src == copy->dst && rcopy.dst == copy->src))
-                return true;
-        }
-        copy->src = newOperand(copy->src, reaching_copies, symbol_table, changed);
+        if (reaching_copies.test(*findCopy(*copy)))
+            return true;
+        std::optional<uint32_t> reversed = findCopy(Copy{ copy->dst, copy->src });
+        if (reversed && reaching_copies.test(*reversed))
+            return true;
+        copy->src = newOperand(copy->src, reaching_copies, changed);
     } else if (Unary *unary = std::get_if<Unary>(&instr))
-        unary->src = newOperand(unary->src, reaching_copies, symbol_table, changed);
+        unary->src = newOperand(unary->src, reaching_copies, changed);
     else if (Binary *binary = std::get_if<Binary>(&instr)) {
-        binary->src1 = newOperand(binary->src1, reaching_copies, symbol_table, changed);
-        binary->src2 = newOperand(binary->src2, reaching_copies, symbol_table, changed);
-    } else if (Return *ret = std::get_if<Return>(&instr))
-        ret->val = newOperand(*ret->val, reaching_copies, symbol_table, changed);
-    else if (Load *load = std::get_if<Load>(&instr))
-        load->src_ptr = newOperand(load->src_ptr, reaching_copies, symbol_table, changed);
+        binary->src1 = newOperand(binary->src1, reaching_copies, changed);
+        binary->src2 = newOperand(binary->src2, reaching_copies, changed);
+    } else if (Return *ret = std::get_if<Return>(&instr)) {
+        if (ret->val)
+            ret->val = newOperand(*ret->val, reaching_copies, changed);
+    } else if (Load *load = std::get_if<Load>(&instr))
+        load->src_ptr = newOperand(load->src_ptr, reaching_copies, changed);
     else if (Store *store = std::get_if<Store>(&instr))
-        store->src = newOperand(store->src, reaching_copies, symbol_table, changed);
+        store->src = newOperand(store->src, reaching_copies, changed);
     else if (FunctionCall *fc = std::get_if<FunctionCall>(&instr)) {
         for (auto &arg : fc->args)
-            arg = newOperand(arg, reaching_copies, symbol_table, changed);
+            arg = newOperand(arg, reaching_copies, changed);
     } else if (JumpIfZero *jz = std::get_if<JumpIfZero>(&instr))
-        jz->condition = newOperand(jz->condition, reaching_copies, symbol_table, changed);
+        jz->condition = newOperand(jz->condition, reaching_copies, changed);
     else if (JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&instr))
-        jnz->condition = newOperand(jnz->condition, reaching_copies, symbol_table, changed);
+        jnz->condition = newOperand(jnz->condition, reaching_copies, changed);
+    else if (JumpTable *jt = std::get_if<JumpTable>(&instr))
+        jt->index = newOperand(jt->index, reaching_copies, changed);
     else if (SignExtend *se = std::get_if<SignExtend>(&instr))
-        se->src = newOperand(se->src, reaching_copies, symbol_table, changed);
+        se->src = newOperand(se->src, reaching_copies, changed);
     else if (Truncate *tr = std::get_if<Truncate>(&instr))
-        tr->src = newOperand(tr->src, reaching_copies, symbol_table, changed);
+        tr->src = newOperand(tr->src, reaching_copies, changed);
     else if (ZeroExtend *ze = std::get_if<ZeroExtend>(&instr))
-        ze->src = newOperand(ze->src, reaching_copies, symbol_table, changed);
+        ze->src = newOperand(ze->src, reaching_copies, changed);
     else if (DoubleToInt *dti = std::get_if<DoubleToInt>(&instr))
-        dti->src = newOperand(dti->src, reaching_copies, symbol_table, changed);
+        dti->src = newOperand(dti->src, reaching_copies, changed);
     else if (DoubleToUInt *dtu = std::get_if<DoubleToUInt>(&instr))
-        dtu->src = newOperand(dtu->src, reaching_copies, symbol_table, changed);
+        dtu->src = newOperand(dtu->src, reaching_copies, changed);
     else if (IntToDouble *itd = std::get_if<IntToDouble>(&instr))
-        itd->src = newOperand(itd->src, reaching_copies, symbol_table, changed);
+        itd->src = newOperand(itd->src, reaching_copies, changed);
     else if (UIntToDouble *utd = std::get_if<UIntToDouble>(&instr))
-        utd->src = newOperand(utd->src, reaching_copies, symbol_table, changed);
+        utd->src = newOperand(utd->src, reaching_copies, changed);
     else if (AddPtr *add = std::get_if<AddPtr>(&instr)) {
-        add->ptr = newOperand(add->ptr, reaching_copies, symbol_table, changed);
-        add->index = newOperand(add->index, reaching_copies, symbol_table, changed);
+        add->ptr = newOperand(add->ptr, reaching_copies, changed);
+        add->index = newOperand(add->index, reaching_copies, changed);
     } else if (CopyToOffset *cto = std::get_if<CopyToOffset>(&instr))
-        cto->src = newOperand(cto->src, reaching_copies, symbol_table, changed);
+        cto->src = newOperand(cto->src, reaching_copies, changed);
     else if (CopyFromOffset *cfo = std::get_if<CopyFromOffset>(&instr)) {
-        Value old_src = Value{ Variant{ cfo->src_identifier } };
-        Value new_src = newOperand(old_src, reaching_copies, symbol_table, changed);
-        cfo->src_identifier = std::get_if<Variant>(&new_src)->name;
+        Value old_src = Value{ cfo->src_identifier };
+        Value new_src = newOperand(old_src, reaching_copies, changed);
+        cfo->src_identifier = std::get<Variant>(new_src);
     }
     return false;
 }
 
 void copyPropagation(
-    std::list<CFGBlock> &blocks,
-    const std::set<Value> &aliased_vars,
-    const std::set<Value> &static_vars,
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
     Context *context,
-    bool &changed)
+    Changes &changes)
 {
-    s_instructionAnnotations.clear();
-    s_blockAnnotations.clear();
-    findReachingCopies(blocks, aliased_vars, static_vars, context->symbolTable.get());
+    s_variableTypes.clear();
+    s_variableTypes.reserve(variables.size());
+    for (Symbol name : variables)
+        s_variableTypes.push_back(context->symbolTable->getType(name));
+    buildCopyIndex(blocks, variables.size(), aliased_vars, static_vars);
+
+    // Forward analysis of the copies reaching the blocks
+    size_t copy_count = s_copyIndex.copies.size();
+    DataFlow reaching_copies(blocks, DataFlow::Forward, DataFlow::Intersection, copy_count);
+    reaching_copies.Solve(BitSet(copy_count), [](const CFGBlock &block, BitSet &copies) {
+        for (const auto &instruction : block.instructions)
+            transfer(instruction, copies);
+    });
+
+    // The copies reaching the instructions are recomputed while rewriting them
+    BitSet current(copy_count);
+    BitSet before(copy_count);
     for (auto &block : blocks) {
+        bool changed = false;
+        current = reaching_copies.In(block);
         for (auto it = block.instructions.begin(); it != block.instructions.end();) {
-            if (rewriteInstruction(*it, context->symbolTable.get(), changed)) {
+            before = current;
+            transfer(*it, current);
+            if (rewriteInstruction(*it, before, changed)) {
                 changed = true;
                 it = block.instructions.erase(it);
             } else
                 ++it;
         }
+        if (changed)
+            changes.MarkBlock(block);
     }
 }
 
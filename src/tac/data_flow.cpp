@@ -0,0 +1,119 @@
+#include "data_flow.h"
+
+namespace tac {
+
+DataFlow::DataFlow(
+    const CFG &blocks,
+    Direction direction,
+    Meet meet,
+    size_t fact_count)
+    : m_blocks(blocks)
+    , m_direction(direction)
+    , m_meet(meet)
+    , m_factCount(fact_count)
+{
+    ComputeOrder();
+}
+
+void DataFlow::ComputeOrder()
+{
+    bool forward = m_direction == Forward;
+    auto next_blocks = [&](uint32_t block) -> const EdgeList & {
+        return forward ? m_blocks[block].successors : m_blocks[block].predecessors;
+    };
+
+    // Iterative depth-first search from the entry (forward)
+    // or from the exit (backward) block
+    std::vector<bool> visited(m_blocks.size(), false);
+    std::vector<uint32_t> postorder;
+    using Frame = std::pair<uint32_t, const uint32_t *>;
+    std::vector<Frame> stack;
+    uint32_t start = forward ? 0 : static_cast<uint32_t>(m_blocks.size() - 1);
+    visited[start] = true;
+    stack.emplace_back(start, next_blocks(start).begin());
+    while (!stack.empty()) {
+        auto &[block, it] = stack.back();
+        if (it == next_blocks(block).end()) {
+            postorder.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        uint32_t next = *it++;
+        if (!visited[next]) {
+            visited[next] = true;
+            stack.emplace_back(next, next_blocks(next).begin());
+        }
+    }
+
+    m_order.assign(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        uint32_t block = static_cast<uint32_t>(forward ? i : m_blocks.size() - 1 - i);
+        if (!visited[block])
+            m_order.push_back(block);
+    }
+}
+
+void DataFlow::Solve(const BitSet &boundary, const Transfer &transfer)
+{
+    bool forward = m_direction == Forward;
+    BitSet top(m_factCount);
+    if (m_meet == Intersection)
+        top.setAll();
+    m_in.assign(m_blocks.size(), top);
+    m_out.assign(m_blocks.size(), top);
+
+    uint32_t boundary_block = forward ? 0 : static_cast<uint32_t>(m_blocks.size() - 1);
+    m_in[boundary_block] = boundary;
+    m_out[boundary_block] = boundary;
+
+    // Sweeps over the blocks in reverse postorder, visiting only those
+    // whose incoming facts may have changed
+    std::vector<size_t> position(m_blocks.size());
+    for (size_t i = 0; i < m_order.size(); ++i)
+        position[m_order[i]] = i;
+    std::vector<bool> pending(m_order.size(), true);
+    pending[position[boundary_block]] = false;
+    size_t pending_count = m_order.size() - 1;
+
+    BitSet facts(m_factCount);
+    while (pending_count) {
+        for (size_t i = 0; i < m_order.size(); ++i) {
+            if (!pending[i])
+                continue;
+            pending[i] = false;
+            --pending_count;
+
+            uint32_t block = m_order[i];
+            const EdgeList &incoming = forward ? m_blocks[block].predecessors : m_blocks[block].successors;
+            const EdgeList &outgoing = forward ? m_blocks[block].successors : m_blocks[block].predecessors;
+            std::vector<BitSet> &met = forward ? m_in : m_out;
+            std::vector<BitSet> &transferred = forward ? m_out : m_in;
+
+            // Meet over no edges leaves the facts at the top
+            facts = top;
+            for (uint32_t other : incoming) {
+                if (m_meet == Union)
+                    facts |= transferred[other];
+                else
+                    facts &= transferred[other];
+            }
+            met[block] = facts;
+            transfer(m_blocks[block], facts);
+            if (facts == transferred[block])
+                continue;
+            transferred[block] = facts;
+
+            for (uint32_t other : outgoing) {
+                if (other == boundary_block)
+                    continue;
+                size_t pos = position[other];
+                if (!pending[pos]) {
+                    pending[pos] = true;
+                    ++pending_count;
+                }
+            }
+        }
+    }
+}
+
+} // namespace tac
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common/bit_set.h"
+#include "tac_nodes.h"
+#include <functional>
+#include <vector>
+
+namespace tac {
+
+// Iterative solver of data-flow problems whose facts are dense bit vectors
+// (reaching copies, live variables, ...). Only the facts at the block
+// boundaries are stored; a pass can recompute the facts of the individual
+// instructions by running its transfer function over a block again.
+class DataFlow {
+public:
+    enum Direction { Forward, Backward };
+    enum Meet { Union, Intersection };
+
+    // Applies the effect of a whole block to the facts: start to end of the
+    // block for forward problems, end to start for backward problems.
+    using Transfer = std::function<void(const CFGBlock &, BitSet &)>;
+
+    DataFlow(
+        const CFG &blocks,
+        Direction direction,
+        Meet meet,
+        size_t fact_count);
+
+    // The boundary facts hold at the end of the entry block (forward)
+    // or at the start of the exit block (backward).
+    void Solve(const BitSet &boundary, const Transfer &transfer);
+
+    // Facts at the start and at the end of a block
+    const BitSet &In(const CFGBlock &block) const { return m_in[m_blocks.indexOf(block)]; }
+    const BitSet &Out(const CFGBlock &block) const { return m_out[m_blocks.indexOf(block)]; }
+
+private:
+    void ComputeOrder();
+
+    const CFG &m_blocks;
+    Direction m_direction;
+    Meet m_meet;
+    size_t m_factCount;
+    // Reverse postorder of the blocks in the direction of the analysis,
+    // followed by the blocks it doesn't reach
+    std::vector<uint32_t> m_order;
+    // By block index
+    std::vector<BitSet> m_in;
+    std::vector<BitSet> m_out;
+};
+
+} // namespace tac
@@ -0,0 +1,61 @@
+#include "ssa.h"
+#include "tac_helper.h"
+
+namespace tac {
+
+// Mark and sweep over the SSA versions: instructions with side effects are
+// live, and so is everything they use, transitively. Unlike the dead store
+// elimination it removes dead cycles through Phi nodes (e.g. unused loop
+// counters) too.
+void deadCodeElimination(CFG &blocks, const SSAVariables &ssa)
+{
+    size_t variable_count = ssa.original.size();
+    // The instruction defining each version, if it can be removed
+    std::vector<const Instruction *> definitions(variable_count, nullptr);
+    auto removable_definition = [&](const Instruction &instr) -> const Variant * {
+        if (std::holds_alternative<FunctionCall>(instr))
+            return nullptr;
+        const Value *dst = GetDestination(instr);
+        if (!dst || !ssa.IsVersion(*dst))
+            return nullptr;
+        return &std::get<Variant>(*dst);
+    };
+
+    BitSet live(variable_count);
+    std::vector<uint32_t> worklist;
+    auto mark_uses = [&](const Instruction &instr) {
+        ForEachUse(instr, [&](const Value &value) {
+            const Variant *var = std::get_if<Variant>(&value);
+            if (var && ssa.IsVersion(*var) && !live.test(var->id)) {
+                live.set(var->id);
+                worklist.push_back(var->id);
+            }
+        });
+    };
+    for (auto &block : blocks) {
+        for (auto &instr : block.instructions) {
+            if (const Variant *dst = removable_definition(instr))
+                definitions[dst->id] = &instr;
+            else
+                mark_uses(instr);
+        }
+    }
+    while (!worklist.empty()) {
+        uint32_t id = worklist.back();
+        worklist.pop_back();
+        if (definitions[id])
+            mark_uses(*definitions[id]);
+    }
+
+    for (auto &block : blocks) {
+        for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+            const Variant *dst = removable_definition(*it);
+            if (dst && !live.test(dst->id))
+                it = block.instructions.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+} // namespace tac
@@ -0,0 +1,128 @@
+#include "dominators.h"
+
+namespace tac {
+
+DominatorTree::DominatorTree(const CFG &blocks)
+{
+    ComputeReversePostorder(blocks);
+    ComputeIdoms(blocks);
+    ComputeTreeOrder();
+    ComputeFrontiers(blocks);
+}
+
+bool DominatorTree::Dominates(size_t a, size_t b) const
+{
+    if (!Reachable(a) || !Reachable(b))
+        return false;
+    return m_treeStart[a] <= m_treeStart[b] && m_treeEnd[b] <= m_treeEnd[a];
+}
+
+void DominatorTree::ComputeReversePostorder(const CFG &blocks)
+{
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<uint32_t> postorder;
+    std::vector<std::pair<uint32_t, const uint32_t *>> stack;
+    visited[0] = true;
+    stack.emplace_back(0, blocks[0].successors.begin());
+    while (!stack.empty()) {
+        auto &[block, it] = stack.back();
+        if (it == blocks[block].successors.end()) {
+            postorder.push_back(block);
+            stack.pop_back();
+            continue;
+        }
+        uint32_t next = *it++;
+        if (!visited[next]) {
+            visited[next] = true;
+            stack.emplace_back(next, blocks[next].successors.begin());
+        }
+    }
+
+    m_rpo.assign(postorder.rbegin(), postorder.rend());
+    m_rpoNumber.assign(blocks.size(), NoNode);
+    for (size_t i = 0; i < m_rpo.size(); ++i)
+        m_rpoNumber[m_rpo[i]] = static_cast<uint32_t>(i);
+}
+
+void DominatorTree::ComputeIdoms(const CFG &blocks)
+{
+    m_idom.assign(blocks.size(), NoNode);
+    m_idom[0] = 0;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (m_rpoNumber[a] > m_rpoNumber[b])
+                a = m_idom[a];
+            while (m_rpoNumber[b] > m_rpoNumber[a])
+                b = m_idom[b];
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < m_rpo.size(); ++i) {
+            uint32_t block = m_rpo[i];
+            uint32_t new_idom = NoNode;
+            for (uint32_t pred : blocks[block].predecessors) {
+                if (m_idom[pred] == NoNode)
+                    continue;
+                new_idom = (new_idom == NoNode) ? pred : intersect(pred, new_idom);
+            }
+            if (new_idom != m_idom[block]) {
+                m_idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    m_idom[0] = NoNode;
+
+    m_children.assign(blocks.size(), {});
+    for (uint32_t block : m_rpo) {
+        if (m_idom[block] != NoNode)
+            m_children[m_idom[block]].push_back(block);
+    }
+}
+
+void DominatorTree::ComputeTreeOrder()
+{
+    m_treeStart.assign(m_idom.size(), NoNode);
+    m_treeEnd.assign(m_idom.size(), NoNode);
+    m_preorder.clear();
+    std::vector<std::pair<uint32_t, size_t>> stack = { { 0, 0 } };
+    m_treeStart[0] = 0;
+    m_preorder.push_back(0);
+    while (!stack.empty()) {
+        auto &[block, child] = stack.back();
+        if (child == m_children[block].size()) {
+            m_treeEnd[block] = static_cast<uint32_t>(m_preorder.size());
+            stack.pop_back();
+            continue;
+        }
+        uint32_t next = m_children[block][child++];
+        m_treeStart[next] = static_cast<uint32_t>(m_preorder.size());
+        m_preorder.push_back(next);
+        stack.emplace_back(next, 0);
+    }
+}
+
+void DominatorTree::ComputeFrontiers(const CFG &blocks)
+{
+    m_frontier.assign(blocks.size(), {});
+    for (uint32_t block : m_rpo) {
+        if (blocks[block].predecessors.size() < 2)
+            continue;
+        for (uint32_t pred : blocks[block].predecessors) {
+            if (!Reachable(pred))
+                continue;
+            for (uint32_t runner = pred; runner != m_idom[block]; runner = m_idom[runner]) {
+                std::vector<uint32_t> &frontier = m_frontier[runner];
+                if (!frontier.empty() && frontier.back() == block)
+                    break;
+                frontier.push_back(block);
+            }
+        }
+    }
+}
+
+} // namespace tac
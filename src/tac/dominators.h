@@ -0,0 +1,48 @@
+#pragma once
+
+#include "tac_nodes.h"
+#include <vector>
+
+namespace tac {
+
+// Dominator tree and dominance frontiers of a function's control flow graph,
+// computed with the iterative algorithm of Cooper, Harvey and Kennedy.
+// Blocks are referred to by their index; blocks not reachable from the
+// entry are not part of the tree.
+class DominatorTree {
+public:
+    explicit DominatorTree(const CFG &blocks);
+
+    bool Reachable(size_t block) const { return m_rpoNumber[block] != NoNode; }
+    // NoNode for the entry and for the unreachable blocks
+    uint32_t Idom(size_t block) const { return m_idom[block]; }
+    const std::vector<uint32_t> &Children(size_t block) const { return m_children[block]; }
+    const std::vector<uint32_t> &Frontier(size_t block) const { return m_frontier[block]; }
+    // Every block dominates itself
+    bool Dominates(size_t a, size_t b) const;
+
+    // Reachable blocks in reverse postorder of the control flow graph
+    const std::vector<uint32_t> &ReversePostorder() const { return m_rpo; }
+    // Reachable blocks in preorder of the dominator tree
+    const std::vector<uint32_t> &Preorder() const { return m_preorder; }
+
+private:
+    void ComputeReversePostorder(const CFG &blocks);
+    void ComputeIdoms(const CFG &blocks);
+    void ComputeTreeOrder();
+    void ComputeFrontiers(const CFG &blocks);
+
+    std::vector<uint32_t> m_rpo;
+    // By block index
+    std::vector<uint32_t> m_rpoNumber;
+    std::vector<uint32_t> m_idom;
+    std::vector<std::vector<uint32_t>> m_children;
+    std::vector<std::vector<uint32_t>> m_frontier;
+    std::vector<uint32_t> m_preorder;
+    // By block index: position in the preorder of the tree and the end
+    // of its subtree there
+    std::vector<uint32_t> m_treeStart;
+    std::vector<uint32_t> m_treeEnd;
+};
+
+} // namespace tac
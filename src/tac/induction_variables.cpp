@@ -0,0 +1,545 @@
+#include "common/context.h"
+#include "common/labeling.h"
+#include "data_flow.h"
+#include "loops.h"
+#include "ssa.h"
+#include "tac_helper.h"
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <unordered_map>
+
+namespace tac {
+
+static bool isComparison(BinaryOperator op)
+{
+    return op == BinaryOperator::LessThan
+        || op == BinaryOperator::LessOrEqual
+        || op == BinaryOperator::GreaterThan
+        || op == BinaryOperator::GreaterOrEqual
+        || op == BinaryOperator::Equal
+        || op == BinaryOperator::NotEqual;
+}
+
+// The offsets of AddPtr with a constant index are encoded as 32 bit
+// displacements
+static bool fitsDisplacement(int64_t index, size_t scale)
+{
+    constexpr int64_t limit = std::numeric_limits<int32_t>::max();
+    return index > -limit && index < limit
+        && std::abs(index) * static_cast<int64_t>(scale) < limit;
+}
+
+namespace {
+
+// A basic induction variable: its only definition in the loop adds a
+// constant to it, either directly or through a temporary copied into it
+struct InductionVariable {
+    int64_t step;
+    uint32_t block;
+    InstructionList::iterator update;
+    // The addition into the temporary, before the update in the same block
+    std::optional<InstructionList::iterator> next;
+    // The variable is int, its uses as an index are sign extended
+    bool narrow;
+};
+
+// A pointer kept equal to base + scale * iv through the loop
+struct PointerVariable {
+    Value base;
+    uint32_t iv;
+    size_t scale;
+    Variant var;
+    // A long variable the index was extended into, a model for the
+    // type of new ones
+    Symbol index_model;
+};
+
+// An operand which holds the value of an induction variable, sign extended
+// if the variable is int
+struct IndexValue {
+    uint32_t iv;
+    bool extended;
+};
+
+struct Location {
+    uint32_t block;
+    InstructionList::iterator instr;
+};
+
+class InductionVariableOptimization {
+public:
+    InductionVariableOptimization(
+        CFG &blocks,
+        std::vector<Symbol> &variables,
+        const BitSet &aliased_vars,
+        const BitSet &static_vars,
+        Context *context,
+        size_t &next_block_id,
+        std::vector<SplitVariable> &new_variables);
+
+    void Run();
+
+private:
+    // Rewrites the array accesses of the loop. Returns whether the function
+    // changed; the loops and the liveness are outdated then.
+    bool Optimize(const Loop &loop, const DataFlow &live);
+    void CollectDefinitions(const Loop &loop);
+    void FindInductionVariables();
+    std::optional<IndexValue> Resolve(const Value &value, uint32_t block, InstructionList::iterator pos) const;
+    bool IsInvariant(const Value &value) const;
+    bool IsOriginal(uint32_t id) const { return id < m_originalCount; }
+    Variant NewVariable(Symbol model);
+    void InsertIntoPreheader(const Loop &loop, Instruction &&instr);
+    // Linear function test replacement: when the induction variable is only
+    // used to compute its next value and to compare it with invariants, the
+    // comparisons are done on the pointer and the variable is removed
+    void ReplaceTests(const Loop &loop, const PointerVariable &pointer, const BitSet &live_out);
+
+    CFG &m_blocks;
+    std::vector<Symbol> &m_variables;
+    const BitSet &m_aliasedVars;
+    const BitSet &m_staticVars;
+    Context *m_context;
+    size_t &m_nextBlockId;
+    std::vector<SplitVariable> &m_newVariables;
+    // The variables from this id on are created by the pass
+    size_t m_originalCount;
+
+    // By variable id: the definitions in the current loop, and the place of
+    // the definition if there is one
+    std::vector<uint32_t> m_definitions;
+    std::vector<Location> m_definitionSites;
+    bool m_memoryWritten = false;
+    std::unordered_map<uint32_t, InductionVariable> m_inductionVariables;
+};
+
+InductionVariableOptimization::InductionVariableOptimization(
+    CFG &blocks,
+    std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    std::vector<SplitVariable> &new_variables)
+    : m_blocks(blocks)
+    , m_variables(variables)
+    , m_aliasedVars(aliased_vars)
+    , m_staticVars(static_vars)
+    , m_context(context)
+    , m_nextBlockId(next_block_id)
+    , m_newVariables(new_variables)
+    , m_originalCount(variables.size())
+{
+}
+
+void InductionVariableOptimization::CollectDefinitions(const Loop &loop)
+{
+    m_definitions.assign(m_variables.size(), 0);
+    m_definitionSites.assign(m_variables.size(), Location{});
+    m_memoryWritten = false;
+    for (uint32_t index : loop.blocks) {
+        InstructionList &instructions = m_blocks[index].instructions;
+        for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+            if (std::holds_alternative<Store>(*it) || std::holds_alternative<FunctionCall>(*it))
+                m_memoryWritten = true;
+            const Variant *var = nullptr;
+            if (const CopyToOffset *cto = std::get_if<CopyToOffset>(&*it))
+                var = &cto->dst_identifier;
+            else if (const Value *dst = GetDestination(*it))
+                var = std::get_if<Variant>(dst);
+            if (var) {
+                ++m_definitions[var->id];
+                m_definitionSites[var->id] = Location{ index, it };
+            }
+        }
+    }
+}
+
+bool InductionVariableOptimization::IsInvariant(const Value &value) const
+{
+    const Variant *var = std::get_if<Variant>(&value);
+    if (!var)
+        return true;
+    if (m_definitions[var->id] != 0 || !IsOriginal(var->id))
+        return false;
+    return !m_memoryWritten
+        || (!m_aliasedVars.test(var->id) && !m_staticVars.test(var->id));
+}
+
+void InductionVariableOptimization::FindInductionVariables()
+{
+    m_inductionVariables.clear();
+    // Whether the binary instruction computes var + constant
+    auto step_of = [](const Instruction &instr, uint32_t var, const Value &dst) -> std::optional<int64_t> {
+        const Binary *binary = std::get_if<Binary>(&instr);
+        if (!binary || binary->dst != dst)
+            return std::nullopt;
+        auto is_var = [&](const Value &v) {
+            const Variant *operand = std::get_if<Variant>(&v);
+            return operand && operand->id == var;
+        };
+        const Constant *c = nullptr;
+        if (is_var(binary->src1))
+            c = std::get_if<Constant>(&binary->src2);
+        else if (is_var(binary->src2) && binary->op == BinaryOperator::Add)
+            c = std::get_if<Constant>(&binary->src1);
+        if (!c)
+            return std::nullopt;
+        int64_t step = castTo<int64_t>(c->value);
+        if (binary->op == BinaryOperator::Add)
+            return step;
+        if (binary->op == BinaryOperator::Subtract)
+            return -step;
+        return std::nullopt;
+    };
+
+    for (uint32_t id = 0; id < m_originalCount; ++id) {
+        if (m_definitions[id] != 1 || m_aliasedVars.test(id) || m_staticVars.test(id))
+            continue;
+        const BasicType *type = m_context->symbolTable->getType(m_variables[id]).getAs<BasicType>();
+        if (!type || (*type != BasicType::Int && *type != BasicType::Long && *type != BasicType::ULong))
+            continue;
+        Location site = m_definitionSites[id];
+        Value var = Variant{ m_variables[id], id };
+        InductionVariable iv{
+            .step = 0,
+            .block = site.block,
+            .update = site.instr,
+            .next = std::nullopt,
+            .narrow = *type == BasicType::Int
+        };
+        if (std::optional<int64_t> step = step_of(*site.instr, id, var))
+            iv.step = *step;
+        else if (const Copy *copy = std::get_if<Copy>(&*site.instr)) {
+            const Variant *temp = std::get_if<Variant>(&copy->src);
+            if (!temp || m_definitions[temp->id] != 1
+                || m_definitionSites[temp->id].block != site.block)
+                continue;
+            // The addition precedes the copy, the variable doesn't change between them
+            InstructionList &instructions = m_blocks[site.block].instructions;
+            auto next = m_definitionSites[temp->id].instr;
+            bool before = false;
+            for (auto it = instructions.begin(); it != site.instr; ++it)
+                before = before || it == next;
+            std::optional<int64_t> next_step = step_of(*next, id, copy->src);
+            if (!before || !next_step)
+                continue;
+            iv.step = *next_step;
+            iv.next = next;
+        } else
+            continue;
+        if (iv.step != 0)
+            m_inductionVariables.emplace(id, iv);
+    }
+}
+
+std::optional<IndexValue> InductionVariableOptimization::Resolve(
+    const Value &value,
+    uint32_t block,
+    InstructionList::iterator pos) const
+{
+    const Variant *var = std::get_if<Variant>(&value);
+    if (!var)
+        return std::nullopt;
+    if (auto it = m_inductionVariables.find(var->id); it != m_inductionVariables.end())
+        return IndexValue{ var->id, false };
+
+    // A sign extension of an int induction variable earlier in the block,
+    // the variable doesn't change until pos
+    if (!IsOriginal(var->id) || m_definitions[var->id] != 1)
+        return std::nullopt;
+    Location site = m_definitionSites[var->id];
+    if (site.block != block)
+        return std::nullopt;
+    const SignExtend *extend = std::get_if<SignExtend>(&*site.instr);
+    const Variant *src = extend ? std::get_if<Variant>(&extend->src) : nullptr;
+    if (!src)
+        return std::nullopt;
+    auto it = m_inductionVariables.find(src->id);
+    if (it == m_inductionVariables.end() || !it->second.narrow)
+        return std::nullopt;
+    InstructionList &instructions = m_blocks[block].instructions;
+    bool defined = false;
+    for (auto i = instructions.begin(); i != pos; ++i) {
+        if (i == site.instr)
+            defined = true;
+        else if (i == it->second.update)
+            defined = false;
+    }
+    if (!defined)
+        return std::nullopt;
+    return IndexValue{ src->id, true };
+}
+
+Variant InductionVariableOptimization::NewVariable(Symbol model)
+{
+    Symbol name = Symbol(GenerateTempVariableName(m_context));
+    m_newVariables.push_back(SplitVariable{ name, model });
+    uint32_t id = static_cast<uint32_t>(m_variables.size());
+    m_variables.push_back(name);
+    m_definitions.push_back(0);
+    m_definitionSites.push_back(Location{});
+    return Variant{ name, id };
+}
+
+void InductionVariableOptimization::InsertIntoPreheader(const Loop &loop, Instruction &&instr)
+{
+    InstructionList &instructions = m_blocks[loop.preheader].instructions;
+    auto pos = instructions.end();
+    if (!instructions.empty() && std::holds_alternative<Jump>(instructions.back()))
+        pos = std::prev(pos);
+    instructions.insert(pos, std::move(instr));
+}
+
+void InductionVariableOptimization::ReplaceTests(
+    const Loop &loop,
+    const PointerVariable &pointer,
+    const BitSet &live_out)
+{
+    const InductionVariable &iv = m_inductionVariables.at(pointer.iv);
+    std::vector<uint32_t> uses(m_variables.size(), 0);
+    for (uint32_t index : loop.blocks) {
+        for (const Instruction &instr : m_blocks[index].instructions) {
+            ForEachUse(instr, [&](const Value &value) {
+                if (const Variant *var = std::get_if<Variant>(&value))
+                    ++uses[var->id];
+            });
+        }
+    }
+
+    // The uses of the variable which go away
+    std::vector<Location> comparisons;
+    std::vector<Location> extensions;
+    // The computation of the next value reads the variable once
+    size_t removed = 1;
+    if (iv.next) {
+        const Variant &temp = std::get<Variant>(std::get<Copy>(*iv.update).src);
+        if (uses[temp.id] != 1 || live_out.test(temp.id))
+            return;
+    }
+    std::vector<uint32_t> extension_uses(m_variables.size(), 0);
+    for (uint32_t index : loop.blocks) {
+        InstructionList &instructions = m_blocks[index].instructions;
+        for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+            if (const SignExtend *extend = std::get_if<SignExtend>(&*it)) {
+                const Variant *src = std::get_if<Variant>(&extend->src);
+                if (src && src->id == pointer.iv) {
+                    extensions.push_back(Location{ index, it });
+                    ++removed;
+                }
+                continue;
+            }
+            const Binary *binary = std::get_if<Binary>(&*it);
+            if (!binary || !isComparison(binary->op))
+                continue;
+            std::optional<IndexValue> left = Resolve(binary->src1, index, it);
+            std::optional<IndexValue> right = Resolve(binary->src2, index, it);
+            const Value &operand = left ? binary->src1 : binary->src2;
+            std::optional<IndexValue> resolved = left ? left : right;
+            const Value &bound = left ? binary->src2 : binary->src1;
+            if (!resolved || resolved->iv != pointer.iv || (left && right) || !IsInvariant(bound))
+                continue;
+            // The pointer to the bound must not overflow: it's either a
+            // small constant, or an int compared to the int variable
+            if (const Constant *c = std::get_if<Constant>(&bound)) {
+                if (!fitsDisplacement(castTo<int64_t>(c->value), pointer.scale))
+                    continue;
+            } else if (!iv.narrow || std::get<Variant>(operand).id != pointer.iv)
+                continue;
+            comparisons.push_back(Location{ index, it });
+            const Variant &var = std::get<Variant>(operand);
+            if (resolved->extended)
+                ++extension_uses[var.id];
+            else
+                ++removed;
+        }
+    }
+    // Every sign extension of the variable must be left without uses
+    for (const Location &extension : extensions) {
+        const Variant &dst = std::get<Variant>(std::get<SignExtend>(*extension.instr).dst);
+        if (uses[dst.id] != extension_uses[dst.id] || live_out.test(dst.id))
+            return;
+    }
+    if (comparisons.empty() || uses[pointer.iv] != removed || live_out.test(pointer.iv))
+        return;
+
+    // The bound as a pointer, computed before the loop
+    std::map<Value, Variant> bounds;
+    for (const Location &comparison : comparisons) {
+        Binary &binary = std::get<Binary>(*comparison.instr);
+        bool left = Resolve(binary.src1, comparison.block, comparison.instr).has_value();
+        Value &bound = left ? binary.src2 : binary.src1;
+        Value &operand = left ? binary.src1 : binary.src2;
+        auto [it, inserted] = bounds.try_emplace(bound);
+        if (inserted) {
+            it->second = NewVariable(pointer.var.name);
+            Value index = bound;
+            if (const Constant *c = std::get_if<Constant>(&bound))
+                index = Constant{ castTo<long>(c->value) };
+            else if (iv.narrow && std::get<Variant>(operand).id == pointer.iv) {
+                // The bound is an int too
+                index = NewVariable(pointer.index_model);
+                InsertIntoPreheader(loop, SignExtend{ bound, index });
+            }
+            InsertIntoPreheader(loop, AddPtr{ pointer.base, index, pointer.scale, it->second });
+        }
+        operand = pointer.var;
+        bound = it->second;
+    }
+
+    for (const Location &extension : extensions)
+        m_blocks[extension.block].instructions.erase(extension.instr);
+    InstructionList &instructions = m_blocks[iv.block].instructions;
+    if (iv.next)
+        instructions.erase(*iv.next);
+    instructions.erase(iv.update);
+    m_inductionVariables.erase(pointer.iv);
+}
+
+bool InductionVariableOptimization::Optimize(const Loop &loop, const DataFlow &live)
+{
+    CollectDefinitions(loop);
+    FindInductionVariables();
+    if (m_inductionVariables.empty())
+        return false;
+
+    // Pointer arithmetic indexed by an induction variable
+    std::vector<Location> accesses;
+    for (uint32_t index : loop.blocks) {
+        InstructionList &instructions = m_blocks[index].instructions;
+        for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+            const AddPtr *add = std::get_if<AddPtr>(&*it);
+            if (!add || !IsInvariant(add->ptr))
+                continue;
+            std::optional<IndexValue> index_value = Resolve(add->index, index, it);
+            if (!index_value)
+                continue;
+            const InductionVariable &iv = m_inductionVariables.at(index_value->iv);
+            if ((iv.narrow && !index_value->extended) || !fitsDisplacement(iv.step, add->scale))
+                continue;
+            accesses.push_back(Location{ index, it });
+        }
+    }
+    if (accesses.empty())
+        return false;
+    if (loop.preheader == NoNode) {
+        insertPreheader(m_context, m_blocks, loop, m_nextBlockId);
+        return true;
+    }
+
+    // The variables live at the exits of the loop, before any is created
+    BitSet live_out(m_variables.size());
+    for (uint32_t index : loop.blocks) {
+        for (uint32_t succ : m_blocks[index].successors) {
+            if (!loop.Contains(succ))
+                live_out |= live.In(m_blocks[succ]);
+        }
+    }
+
+    std::vector<PointerVariable> pointers;
+    for (const Location &access : accesses) {
+        AddPtr add = std::get<AddPtr>(*access.instr);
+        IndexValue index_value = *Resolve(add.index, access.block, access.instr);
+        const InductionVariable &iv = m_inductionVariables.at(index_value.iv);
+        auto it = std::find_if(pointers.begin(), pointers.end(), [&](const PointerVariable &p) {
+            return p.base == add.ptr && p.iv == index_value.iv && p.scale == add.scale;
+        });
+        if (it == pointers.end()) {
+            // The pointer starts from the value of the variable at the entry
+            // of the loop and follows its updates
+            Variant var = NewVariable(std::get<Variant>(add.dst).name);
+            Value iv_value = Variant{ m_variables[index_value.iv], index_value.iv };
+            Symbol index_model = std::get<Variant>(add.index).name;
+            Value start = iv_value;
+            if (index_value.extended) {
+                start = NewVariable(index_model);
+                InsertIntoPreheader(loop, SignExtend{ iv_value, start });
+            }
+            InsertIntoPreheader(loop, AddPtr{ add.ptr, start, add.scale, var });
+            m_blocks[iv.block].instructions.insert(
+                std::next(iv.update),
+                AddPtr{ var, Constant{ static_cast<long>(iv.step) }, add.scale, var });
+            it = pointers.insert(pointers.end(), PointerVariable{
+                .base = add.ptr,
+                .iv = index_value.iv,
+                .scale = add.scale,
+                .var = var,
+                .index_model = index_model
+            });
+        }
+        *access.instr = Copy{ it->var, add.dst };
+    }
+
+    for (const PointerVariable &pointer : pointers) {
+        if (m_inductionVariables.contains(pointer.iv))
+            ReplaceTests(loop, pointer, live_out);
+    }
+    return true;
+}
+
+void InductionVariableOptimization::Run()
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        DominatorTree dominators(m_blocks);
+        std::vector<Loop> loops = findLoops(m_blocks, dominators);
+        if (loops.empty())
+            return;
+
+        size_t count = m_variables.size();
+        DataFlow live(m_blocks, DataFlow::Backward, DataFlow::Union, count);
+        live.Solve(BitSet(count), [](const CFGBlock &block, BitSet &live_vars) {
+            for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+                if (const Value *dst = GetDestination(*it)) {
+                    if (const Variant *var = std::get_if<Variant>(dst))
+                        live_vars.reset(var->id);
+                }
+                ForEachUse(*it, [&](const Value &value) {
+                    if (const Variant *var = std::get_if<Variant>(&value))
+                        live_vars.set(var->id);
+                });
+            }
+        });
+
+        for (const Loop &loop : loops) {
+            if (Optimize(loop, live)) {
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+} // namespace
+
+// Strength reduction of array accesses in loops: pointer arithmetic indexed
+// by a basic induction variable (i = i + c, the only definition of i in the
+// loop) is replaced with a pointer variable, which is advanced by c * scale
+// next to the updates of i. When i is left to count the iterations only,
+// the exit tests are rewritten to compare the pointer and i is removed.
+// The new variables are collected in new_variables, with a variable of the
+// same type; preheaders are created on demand, their ids start at
+// next_block_id.
+void optimizeInductionVariables(
+    CFG &blocks,
+    std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    std::vector<SplitVariable> &new_variables)
+{
+    InductionVariableOptimization optimization(
+        blocks,
+        variables,
+        aliased_vars,
+        static_vars,
+        context,
+        next_block_id,
+        new_variables);
+    optimization.Run();
+}
+
+} // namespace tac
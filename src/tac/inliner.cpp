@@ -0,0 +1,323 @@
+#include "common/context.h"
+#include "common/labeling.h"
+#include "tac_nodes.h"
+#include "tac_helper.h"
+#include <format>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tac {
+
+// Cost model of the inliner, in TAC instructions: callees up to
+// InlineMaxCalleeSize are inlined at every call site, static functions with
+// a single call site up to InlineSingleCallMaxSize. Callers don't grow
+// beyond InlineMaxCallerSize.
+static constexpr size_t InlineMaxCalleeSize = 40;
+static constexpr size_t InlineSingleCallMaxSize = 400;
+static constexpr size_t InlineMaxCallerSize = 4000;
+
+template <typename Fn>
+static void forEachLabel(Instruction &instr, Fn &&fn)
+{
+    std::visit([&](auto &i) {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, Label>)
+            fn(i.identifier);
+        else if constexpr (std::is_same_v<T, Jump>
+            || std::is_same_v<T, JumpIfZero>
+            || std::is_same_v<T, JumpIfNotZero>)
+            fn(i.target);
+        else if constexpr (std::is_same_v<T, JumpTable>) {
+            for (auto &target : i.targets)
+                fn(target);
+        }
+    }, instr);
+}
+
+namespace {
+
+class Inliner {
+public:
+    Inliner(std::list<TopLevel> &list, Context *context);
+
+    void Run();
+
+private:
+    // The functions in post-order of the call graph, so callees come
+    // before their callers; calls closing a cycle are marked recursive
+    std::vector<FunctionDefinition *> CallGraphOrder();
+    void InlineCalls(FunctionDefinition &caller);
+    bool ShouldInline(
+        const FunctionDefinition &caller,
+        const FunctionCall &call,
+        size_t caller_size) const;
+    // Replaces the call at the end of the block with the body of the callee,
+    // moving the instructions after it to a new block. Returns the number
+    // of blocks inserted after the block.
+    size_t InlineCall(
+        FunctionDefinition &caller,
+        size_t index,
+        const FunctionCall &call,
+        InstructionList &rest);
+    void RemoveUnusedFunctions();
+
+    static uint64_t EdgeKey(Symbol caller, Symbol callee)
+    {
+        return uint64_t(caller.id()) << 32 | callee.id();
+    }
+
+    std::list<TopLevel> &m_list;
+    Context *m_context;
+    std::unordered_map<Symbol, FunctionDefinition *> m_functions;
+    std::unordered_map<Symbol, size_t> m_callSites;
+    std::unordered_set<uint64_t> m_recursiveCalls;
+    size_t m_nextBlockId = 0;
+};
+
+Inliner::Inliner(std::list<TopLevel> &list, Context *context)
+    : m_list(list)
+    , m_context(context)
+{
+    for (auto &top_level : m_list) {
+        if (FunctionDefinition *f = std::get_if<FunctionDefinition>(&top_level))
+            m_functions[f->name] = f;
+    }
+    for (auto &[name, func] : m_functions) {
+        for (auto &block : func->blocks) {
+            for (auto &instr : block.instructions) {
+                if (const FunctionCall *call = std::get_if<FunctionCall>(&instr))
+                    ++m_callSites[call->identifier];
+            }
+        }
+    }
+}
+
+std::vector<FunctionDefinition *> Inliner::CallGraphOrder()
+{
+    std::unordered_map<Symbol, std::vector<Symbol>> callees;
+    for (auto &[name, func] : m_functions) {
+        std::vector<Symbol> &list = callees[name];
+        for (auto &block : func->blocks) {
+            for (auto &instr : block.instructions) {
+                const FunctionCall *call = std::get_if<FunctionCall>(&instr);
+                if (call && m_functions.contains(call->identifier))
+                    list.push_back(call->identifier);
+            }
+        }
+    }
+
+    enum State { Unvisited, OnStack, Done };
+    std::unordered_map<Symbol, State> state;
+    std::vector<FunctionDefinition *> order;
+    struct Frame {
+        Symbol function;
+        size_t callee;
+    };
+    std::vector<Frame> stack;
+    // In the order of the translation unit, so the output is deterministic
+    for (auto &top_level : m_list) {
+        const FunctionDefinition *root = std::get_if<FunctionDefinition>(&top_level);
+        if (!root || state[root->name] != Unvisited)
+            continue;
+        stack.push_back(Frame{ root->name, 0 });
+        state[root->name] = OnStack;
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            const std::vector<Symbol> &list = callees[frame.function];
+            if (frame.callee == list.size()) {
+                state[frame.function] = Done;
+                order.push_back(m_functions[frame.function]);
+                stack.pop_back();
+                continue;
+            }
+            Symbol callee = list[frame.callee++];
+            if (state[callee] == OnStack)
+                m_recursiveCalls.insert(EdgeKey(frame.function, callee));
+            else if (state[callee] == Unvisited) {
+                state[callee] = OnStack;
+                stack.push_back(Frame{ callee, 0 });
+            }
+        }
+    }
+    return order;
+}
+
+bool Inliner::ShouldInline(
+    const FunctionDefinition &caller,
+    const FunctionCall &call,
+    size_t caller_size) const
+{
+    auto it = m_functions.find(call.identifier);
+    if (it == m_functions.end() || m_recursiveCalls.contains(EdgeKey(caller.name, call.identifier)))
+        return false;
+    const FunctionDefinition &callee = *it->second;
+    if (call.args.size() != callee.params.size())
+        return false;
+    size_t callee_size = callee.blocks.instructionCount();
+    if (caller_size + callee_size > InlineMaxCallerSize)
+        return false;
+    if (callee_size <= InlineMaxCalleeSize)
+        return true;
+    // The only copy of a static function can move into its caller
+    return !callee.global
+        && m_callSites.at(call.identifier) == 1
+        && callee_size <= InlineSingleCallMaxSize;
+}
+
+size_t Inliner::InlineCall(
+    FunctionDefinition &caller,
+    size_t index,
+    const FunctionCall &call,
+    InstructionList &rest)
+{
+    const FunctionDefinition &callee = *m_functions.at(call.identifier);
+    SymbolTable *symbol_table = m_context->symbolTable.get();
+
+    // The local variables and labels of the callee get new names at each
+    // call site; static variables keep referring to the same object
+    std::unordered_map<Symbol, Symbol> variables;
+    auto rename_variable = [&](Symbol name) {
+        auto [it, inserted] = variables.try_emplace(name, name);
+        if (inserted) {
+            const SymbolEntry *entry = symbol_table->get(name);
+            assert(entry);
+            if (entry->attrs.type == IdentifierAttributes::Local) {
+                it->second = MakeNameUnique(m_context, name.str());
+                symbol_table->insert(it->second, entry->type, entry->attrs);
+            }
+        }
+        return it->second;
+    };
+    auto rename_value = [&](Value value) {
+        if (Variant *var = std::get_if<Variant>(&value))
+            *var = Variant{ rename_variable(var->name) };
+        return value;
+    };
+    std::unordered_map<Symbol, Symbol> labels;
+    auto rename_label = [&](Symbol &label) {
+        auto [it, inserted] = labels.try_emplace(label);
+        if (inserted)
+            it->second = MakeNameUnique(m_context, label.str());
+        label = it->second;
+    };
+    Symbol label_return = MakeNameUnique(m_context, std::format("return_{}", callee.name.str()));
+
+    // The arguments are already converted to the types of the parameters
+    InstructionList &instructions = caller.blocks[index].instructions;
+    for (size_t i = 0; i < call.args.size(); ++i)
+        instructions.push_back(Copy{ call.args[i], Variant{ rename_variable(callee.params[i]) } });
+
+    // The body, without the entry and exit blocks
+    std::vector<CFGBlock> blocks;
+    for (size_t b = 1; b + 1 < callee.blocks.size(); ++b) {
+        CFGBlock &block = blocks.emplace_back(CFGBlock{
+            .instructions = caller.blocks.newList(),
+            .id = m_nextBlockId++
+        });
+        for (const Instruction &original : callee.blocks[b].instructions) {
+            if (const Return *ret = std::get_if<Return>(&original)) {
+                if (ret->val && call.dst)
+                    block.instructions.push_back(Copy{ rename_value(*ret->val), *call.dst });
+                block.instructions.push_back(Jump{ label_return });
+                continue;
+            }
+            Instruction &instr = block.instructions.emplace_back(original);
+            ForEachVariant(instr, [&](Variant &var) {
+                var = Variant{ rename_variable(var.name) };
+            });
+            forEachLabel(instr, rename_label);
+        }
+    }
+
+    CFGBlock &continuation = blocks.emplace_back(CFGBlock{
+        .instructions = std::move(rest),
+        .id = m_nextBlockId++
+    });
+    continuation.instructions.push_front(Label{ label_return });
+    size_t count = blocks.size();
+    caller.blocks.insert(index + 1, std::move(blocks));
+    return count;
+}
+
+void Inliner::InlineCalls(FunctionDefinition &caller)
+{
+    m_nextBlockId = 0;
+    for (auto &block : caller.blocks)
+        m_nextBlockId = std::max(m_nextBlockId, block.id + 1);
+
+    size_t caller_size = caller.blocks.instructionCount();
+    for (size_t b = 0; b < caller.blocks.size(); ++b) {
+        InstructionList &instructions = caller.blocks[b].instructions;
+        for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+            const FunctionCall *call = std::get_if<FunctionCall>(&*it);
+            if (!call || !ShouldInline(caller, *call, caller_size))
+                continue;
+            FunctionCall inlined = *call;
+            InstructionList rest = caller.blocks.newList();
+            for (auto next = instructions.erase(it); next != instructions.end();) {
+                rest.push_back(std::move(*next));
+                next = instructions.erase(next);
+            }
+            caller_size += m_functions.at(inlined.identifier)->blocks.instructionCount();
+            // The callee was processed before, its body is not scanned again;
+            // the scan goes on with the instructions after the call
+            b += InlineCall(caller, b, inlined, rest) - 1;
+            break;
+        }
+    }
+    // The edges are rebuilt by the pass manager
+    caller.blocks.clearEdges();
+}
+
+void Inliner::RemoveUnusedFunctions()
+{
+    // Static functions are only reachable through calls in this
+    // translation unit; removing one can leave others unused
+    bool removed = true;
+    while (removed) {
+        removed = false;
+        std::unordered_set<Symbol> called;
+        for (auto &top_level : m_list) {
+            const FunctionDefinition *f = std::get_if<FunctionDefinition>(&top_level);
+            if (!f)
+                continue;
+            for (auto &block : f->blocks) {
+                for (auto &instr : block.instructions) {
+                    if (const FunctionCall *call = std::get_if<FunctionCall>(&instr))
+                        called.insert(call->identifier);
+                }
+            }
+        }
+        for (auto it = m_list.begin(); it != m_list.end();) {
+            const FunctionDefinition *f = std::get_if<FunctionDefinition>(&*it);
+            if (f && !f->global && !called.contains(f->name)) {
+                m_functions.erase(f->name);
+                it = m_list.erase(it);
+                removed = true;
+            } else
+                ++it;
+        }
+    }
+}
+
+void Inliner::Run()
+{
+    for (FunctionDefinition *func : CallGraphOrder())
+        InlineCalls(*func);
+    RemoveUnusedFunctions();
+}
+
+} // namespace
+
+// Inlines the calls to small functions defined in the translation unit,
+// callees first, so they arrive already inlined into their callers. Calls
+// in cycles of the call graph are not inlined. Static functions which are
+// not called anymore are removed; global ones are kept, other translation
+// units may call them.
+void inlineFunctions(std::list<TopLevel> &list, Context *context)
+{
+    Inliner inliner(list, context);
+    inliner.Run();
+}
+
+} // namespace tac
@@ -0,0 +1,302 @@
+#include "common/context.h"
+#include "data_flow.h"
+#include "loops.h"
+#include "pass_manager.h"
+#include "tac_helper.h"
+
+namespace tac {
+
+// Every hoisted value occupies a register through the whole loop; nothing
+// is hoisted beyond this many values live into the loop header, where the
+// spills would cost more than the hoisting saves
+static constexpr size_t MaxLiveIntoLoop = 12;
+
+// Division traps on a zero divisor and on the overflowing signed division
+// by -1; it is only moved when a constant divisor rules both out
+static bool isSafeDivisor(const Value &divisor)
+{
+    const Constant *c = std::get_if<Constant>(&divisor);
+    if (!c)
+        return false;
+    return std::visit([](auto v) -> bool {
+        using T = decltype(v);
+        if constexpr (std::is_floating_point_v<T>)
+            return true;
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+            return v != 0 && v != -1;
+        else if constexpr (std::is_integral_v<T>)
+            return v != 0;
+        else
+            return false;
+    }, c->value);
+}
+
+// Instructions without side effects, which can be executed even where the
+// loop wouldn't execute them
+static bool isMovable(const Instruction &instr)
+{
+    if (const Binary *binary = std::get_if<Binary>(&instr)) {
+        if (binary->op == BinaryOperator::Divide || binary->op == BinaryOperator::Remainder)
+            return isSafeDivisor(binary->src2);
+        return true;
+    }
+    return std::holds_alternative<Unary>(instr)
+        || std::holds_alternative<Copy>(instr)
+        || std::holds_alternative<GetAddress>(instr)
+        || std::holds_alternative<AddPtr>(instr)
+        || std::holds_alternative<SignExtend>(instr)
+        || std::holds_alternative<Truncate>(instr)
+        || std::holds_alternative<ZeroExtend>(instr)
+        || std::holds_alternative<DoubleToInt>(instr)
+        || std::holds_alternative<DoubleToUInt>(instr)
+        || std::holds_alternative<IntToDouble>(instr)
+        || std::holds_alternative<UIntToDouble>(instr);
+}
+
+namespace {
+
+class LoopInvariantCodeMotion {
+public:
+    LoopInvariantCodeMotion(
+        CFG &blocks,
+        const std::vector<Symbol> &variables,
+        const BitSet &aliased_vars,
+        const BitSet &static_vars,
+        Context *context,
+        size_t &next_block_id,
+        Changes &changes);
+
+    void Run();
+
+private:
+    // Hoists the invariant instructions of the loop into its preheader,
+    // inserting the preheader first if the loop doesn't have one. Returns
+    // whether the function changed; the loops and the liveness are
+    // outdated then.
+    bool Optimize(const Loop &loop, const DataFlow &live);
+    void CountDefinitions(const Loop &loop);
+    bool IsInvariant(const Value &value) const;
+    bool IsCandidate(const Instruction &instr, const BitSet &live_in) const;
+    void MarkBlock(const CFGBlock &block);
+
+    CFG &m_blocks;
+    const std::vector<Symbol> &m_variables;
+    const BitSet &m_aliasedVars;
+    const BitSet &m_staticVars;
+    Context *m_context;
+    size_t &m_nextBlockId;
+    Changes &m_changes;
+    // Blocks from this id on are created by the pass
+    size_t m_firstNewId;
+
+    // By variable id: the definitions in the current loop not hoisted yet
+    std::vector<uint32_t> m_definitions;
+    // Stores and calls in the loop may change the aliased and static variables
+    bool m_memoryWritten = false;
+};
+
+LoopInvariantCodeMotion::LoopInvariantCodeMotion(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    Changes &changes)
+    : m_blocks(blocks)
+    , m_variables(variables)
+    , m_aliasedVars(aliased_vars)
+    , m_staticVars(static_vars)
+    , m_context(context)
+    , m_nextBlockId(next_block_id)
+    , m_changes(changes)
+    , m_firstNewId(next_block_id)
+{
+}
+
+void LoopInvariantCodeMotion::CountDefinitions(const Loop &loop)
+{
+    m_definitions.assign(m_variables.size(), 0);
+    m_memoryWritten = false;
+    for (uint32_t index : loop.blocks) {
+        for (const Instruction &instr : m_blocks[index].instructions) {
+            if (std::holds_alternative<Store>(instr) || std::holds_alternative<FunctionCall>(instr))
+                m_memoryWritten = true;
+            if (const CopyToOffset *cto = std::get_if<CopyToOffset>(&instr))
+                ++m_definitions[cto->dst_identifier.id];
+            else if (const Value *dst = GetDestination(instr)) {
+                if (const Variant *var = std::get_if<Variant>(dst))
+                    ++m_definitions[var->id];
+            }
+        }
+    }
+}
+
+bool LoopInvariantCodeMotion::IsInvariant(const Value &value) const
+{
+    const Variant *var = std::get_if<Variant>(&value);
+    if (!var)
+        return true;
+    if (m_definitions[var->id] != 0)
+        return false;
+    return !m_memoryWritten
+        || (!m_aliasedVars.test(var->id) && !m_staticVars.test(var->id));
+}
+
+bool LoopInvariantCodeMotion::IsCandidate(const Instruction &instr, const BitSet &live_in) const
+{
+    if (!isMovable(instr))
+        return false;
+    const Variant *dst = std::get_if<Variant>(GetDestination(instr));
+    if (!dst || m_aliasedVars.test(dst->id) || m_staticVars.test(dst->id))
+        return false;
+    // With a single definition which is not live into the header, every
+    // use in the loop and after it reads the value of this instruction
+    if (m_definitions[dst->id] != 1 || live_in.test(dst->id))
+        return false;
+    if (!m_context->symbolTable->getType(dst->name).isScalar())
+        return false;
+    // A constant is an immediate operand anyway, hoisting its copy would
+    // only keep a register busy
+    if (const Copy *copy = std::get_if<Copy>(&instr); copy && std::holds_alternative<Constant>(copy->src))
+        return false;
+    // Only the address of the operand is taken, which doesn't change
+    if (std::holds_alternative<GetAddress>(instr))
+        return true;
+    bool invariant = true;
+    ForEachUse(instr, [&](const Value &value) {
+        invariant = invariant && IsInvariant(value);
+    });
+    return invariant;
+}
+
+void LoopInvariantCodeMotion::MarkBlock(const CFGBlock &block)
+{
+    // The new blocks are recorded as a whole
+    if (block.id < m_firstNewId)
+        m_changes.MarkBlock(block);
+}
+
+bool LoopInvariantCodeMotion::Optimize(const Loop &loop, const DataFlow &live)
+{
+    CountDefinitions(loop);
+    const BitSet &live_in = live.In(m_blocks[loop.header]);
+
+    // Hoisting an instruction can make the ones using its result invariant
+    struct Candidate {
+        uint32_t block;
+        InstructionList::iterator instr;
+    };
+    std::vector<Candidate> candidates;
+    size_t live_count = live_in.count();
+    bool found = true;
+    while (found) {
+        found = false;
+        for (uint32_t index : loop.blocks) {
+            InstructionList &instructions = m_blocks[index].instructions;
+            for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+                if (live_count + candidates.size() >= MaxLiveIntoLoop)
+                    break;
+                if (!IsCandidate(*it, live_in))
+                    continue;
+                --m_definitions[std::get<Variant>(*GetDestination(*it)).id];
+                candidates.push_back(Candidate{ index, it });
+                found = true;
+            }
+        }
+    }
+    if (candidates.empty())
+        return false;
+
+    if (loop.preheader == NoNode) {
+        // The jumps into the header and the block before it are rewritten
+        for (uint32_t pred : m_blocks[loop.header].predecessors)
+            MarkBlock(m_blocks[pred]);
+        MarkBlock(m_blocks[loop.header - 1]);
+        insertPreheader(m_context, m_blocks, loop, m_nextBlockId);
+        m_changes.MarkNewBlocks();
+        m_changes.MarkControlFlow();
+        return true;
+    }
+
+    // In the order they were found, so the operands are computed first
+    CFGBlock &preheader = m_blocks[loop.preheader];
+    auto pos = preheader.instructions.end();
+    if (!preheader.instructions.empty() && std::holds_alternative<Jump>(preheader.instructions.back()))
+        pos = std::prev(pos);
+    for (const Candidate &candidate : candidates) {
+        preheader.instructions.insert(pos, std::move(*candidate.instr));
+        m_blocks[candidate.block].instructions.erase(candidate.instr);
+        MarkBlock(m_blocks[candidate.block]);
+    }
+    MarkBlock(preheader);
+    return true;
+}
+
+void LoopInvariantCodeMotion::Run()
+{
+    size_t count = m_variables.size();
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        DominatorTree dominators(m_blocks);
+        std::vector<Loop> loops = findLoops(m_blocks, dominators);
+        if (loops.empty())
+            return;
+
+        // Only the local variables matter here, which are not live at the exit
+        DataFlow live(m_blocks, DataFlow::Backward, DataFlow::Union, count);
+        live.Solve(BitSet(count), [](const CFGBlock &block, BitSet &live_vars) {
+            for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+                if (const Value *dst = GetDestination(*it)) {
+                    if (const Variant *var = std::get_if<Variant>(dst))
+                        live_vars.reset(var->id);
+                }
+                ForEachUse(*it, [&](const Value &value) {
+                    if (const Variant *var = std::get_if<Variant>(&value))
+                        live_vars.set(var->id);
+                });
+            }
+        });
+
+        // Inner loops first, their hoisted instructions may move further out
+        for (const Loop &loop : loops) {
+            if (Optimize(loop, live)) {
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+} // namespace
+
+// Moves the instructions of loops which compute the same value in every
+// iteration into the preheaders of the loops. Only pure instructions are
+// moved, writing a local scalar defined nowhere else in the loop and not
+// live into its header; their operands must not be defined in the loop.
+// Aliased and static variables count as defined by the stores and calls.
+// Hoisting stops when too many values would be live through the loop, and
+// copies of constants are left in place.
+// Preheaders are created on demand, their ids start at next_block_id.
+void loopInvariantCodeMotion(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    Changes &changes)
+{
+    LoopInvariantCodeMotion licm(
+        blocks,
+        variables,
+        aliased_vars,
+        static_vars,
+        context,
+        next_block_id,
+        changes);
+    licm.Run();
+}
+
+} // namespace tac
@@ -0,0 +1,194 @@
+#include "loops.h"
+#include "common/labeling.h"
+#include <algorithm>
+
+namespace tac {
+
+bool Loop::Contains(uint32_t block) const
+{
+    return std::binary_search(blocks.begin(), blocks.end(), block);
+}
+
+// Instructions after which the control doesn't fall through to the next block
+static bool endsBlock(const CFGBlock &block)
+{
+    if (block.instructions.empty())
+        return false;
+    const Instruction &last = block.instructions.back();
+    return std::holds_alternative<Jump>(last)
+        || std::holds_alternative<JumpTable>(last)
+        || std::holds_alternative<Return>(last);
+}
+
+static bool endsWithBranch(const CFGBlock &block)
+{
+    if (block.instructions.empty())
+        return false;
+    const Instruction &last = block.instructions.back();
+    return std::holds_alternative<JumpIfZero>(last)
+        || std::holds_alternative<JumpIfNotZero>(last)
+        || std::holds_alternative<JumpTable>(last);
+}
+
+static void retarget(Instruction &instr, Symbol from, Symbol to)
+{
+    auto replace = [&](Symbol &target) {
+        if (target == from)
+            target = to;
+    };
+    if (Jump *j = std::get_if<Jump>(&instr))
+        replace(j->target);
+    else if (JumpIfZero *jz = std::get_if<JumpIfZero>(&instr))
+        replace(jz->target);
+    else if (JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&instr))
+        replace(jnz->target);
+    else if (JumpTable *table = std::get_if<JumpTable>(&instr)) {
+        for (Symbol &target : table->targets)
+            replace(target);
+    }
+}
+
+static Symbol jumpTarget(const Instruction &instr)
+{
+    if (const JumpIfZero *jz = std::get_if<JumpIfZero>(&instr))
+        return jz->target;
+    if (const JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&instr))
+        return jnz->target;
+    return Symbol();
+}
+
+std::vector<Loop> findLoops(const CFG &blocks, const DominatorTree &dominators)
+{
+    std::vector<Loop> loops;
+    std::vector<uint32_t> loop_of_header(blocks.size(), NoNode);
+    for (uint32_t block : dominators.ReversePostorder()) {
+        for (uint32_t succ : blocks[block].successors) {
+            if (!dominators.Dominates(succ, block))
+                continue;
+            if (loop_of_header[succ] == NoNode) {
+                loop_of_header[succ] = static_cast<uint32_t>(loops.size());
+                loops.push_back(Loop{ .header = succ, .blocks = {}, .latches = {} });
+            }
+            loops[loop_of_header[succ]].latches.push_back(block);
+        }
+    }
+
+    std::vector<bool> in_loop(blocks.size(), false);
+    std::vector<uint32_t> worklist;
+    for (Loop &loop : loops) {
+        // Walking backwards from the latches, the header stops the walk
+        in_loop[loop.header] = true;
+        loop.blocks.push_back(loop.header);
+        for (uint32_t latch : loop.latches) {
+            if (!in_loop[latch]) {
+                in_loop[latch] = true;
+                loop.blocks.push_back(latch);
+                worklist.push_back(latch);
+            }
+        }
+        while (!worklist.empty()) {
+            uint32_t block = worklist.back();
+            worklist.pop_back();
+            for (uint32_t pred : blocks[block].predecessors) {
+                if (in_loop[pred] || !dominators.Reachable(pred))
+                    continue;
+                in_loop[pred] = true;
+                loop.blocks.push_back(pred);
+                worklist.push_back(pred);
+            }
+        }
+        for (uint32_t block : loop.blocks)
+            in_loop[block] = false;
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+
+        uint32_t entry = NoNode;
+        size_t entries = 0;
+        for (uint32_t pred : blocks[loop.header].predecessors) {
+            if (!loop.Contains(pred) && dominators.Reachable(pred)) {
+                entry = pred;
+                ++entries;
+            }
+        }
+        // The entry block of the function stays empty
+        if (entries == 1 && entry != 0
+            && blocks[entry].successors.size() == 1
+            && !endsWithBranch(blocks[entry]))
+            loop.preheader = entry;
+    }
+
+    // A loop can only contain bigger ones
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) {
+        return a.blocks.size() < b.blocks.size();
+    });
+    for (size_t i = 0; i < loops.size(); ++i) {
+        for (size_t j = i + 1; j < loops.size(); ++j) {
+            if (loops[j].blocks.size() > loops[i].blocks.size()
+                && loops[j].Contains(loops[i].header)) {
+                loops[i].parent = static_cast<uint32_t>(j);
+                break;
+            }
+        }
+    }
+    return loops;
+}
+
+void insertPreheader(Context *context, CFG &blocks, const Loop &loop, size_t &next_block_id)
+{
+    uint32_t header = loop.header;
+    // Every entry and back edge jumps to the header, except the block
+    // before it, which may fall through
+    assert(std::holds_alternative<Label>(blocks[header].instructions.front()));
+    Symbol header_label = std::get<Label>(blocks[header].instructions.front()).identifier;
+    Symbol preheader_label = MakeNameUnique(context, "preheader");
+
+    std::vector<uint32_t> entries;
+    for (uint32_t pred : blocks[header].predecessors) {
+        if (loop.Contains(pred))
+            continue;
+        entries.push_back(pred);
+        if (!blocks[pred].instructions.empty())
+            retarget(blocks[pred].instructions.back(), header_label, preheader_label);
+    }
+
+    // A back edge falling through to the header must jump over the preheader;
+    // after a conditional jump it needs a block of its own for that
+    std::vector<CFGBlock> new_blocks;
+    uint32_t before = header - 1;
+    bool trampoline = false;
+    if (loop.Contains(before) && !endsBlock(blocks[before])) {
+        if (endsWithBranch(blocks[before])) {
+            trampoline = true;
+            CFGBlock &block = new_blocks.emplace_back(CFGBlock{
+                .instructions = blocks.newList(),
+                .id = next_block_id++
+            });
+            block.instructions.push_back(Jump{ header_label });
+        } else
+            blocks[before].instructions.push_back(Jump{ header_label });
+    }
+    CFGBlock &preheader = new_blocks.emplace_back(CFGBlock{
+        .instructions = blocks.newList(),
+        .id = next_block_id++
+    });
+    preheader.instructions.push_back(Label{ preheader_label });
+
+    uint32_t count = static_cast<uint32_t>(new_blocks.size());
+    blocks.insert(header, std::move(new_blocks));
+    auto shifted = [&](uint32_t block) { return block >= header ? block + count : block; };
+    uint32_t new_header = header + count;
+    uint32_t preheader_index = new_header - 1;
+    for (uint32_t entry : entries) {
+        blocks.disconnect(shifted(entry), new_header);
+        blocks.connect(shifted(entry), preheader_index);
+    }
+    blocks.connect(preheader_index, new_header);
+    if (trampoline) {
+        // The conditional jump may target the header too
+        if (jumpTarget(blocks[before].instructions.back()) != header_label)
+            blocks.disconnect(before, new_header);
+        blocks.connect(before, header);
+        blocks.connect(header, new_header);
+    }
+}
+
+} // namespace tac
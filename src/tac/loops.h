@@ -0,0 +1,40 @@
+#pragma once
+
+#include "dominators.h"
+#include "tac_nodes.h"
+#include <vector>
+
+class Context;
+
+namespace tac {
+
+// A natural loop: a header dominating the sources of its back edges, and
+// the blocks which reach a back edge without passing through the header.
+// Loops sharing a header are merged. Blocks are referred to by their index.
+struct Loop {
+    uint32_t header;
+    // Sorted, the header included
+    std::vector<uint32_t> blocks;
+    // Sources of the back edges
+    std::vector<uint32_t> latches;
+    // The only way into the loop from outside: a block whose only successor
+    // is the header, and which ends without a conditional jump. NoNode if
+    // the loop doesn't have one.
+    uint32_t preheader = NoNode;
+    // The innermost loop containing this one, NoNode for outermost loops
+    uint32_t parent = NoNode;
+
+    bool Contains(uint32_t block) const;
+};
+
+// The natural loops of the function, inner loops before the loops containing
+// them. The control flow edges must be up to date.
+std::vector<Loop> findLoops(const CFG &blocks, const DominatorTree &dominators);
+
+// Adds a preheader to the loop, right before its header, and redirects the
+// entries of the loop there. The new blocks take their ids from
+// next_block_id. The edges are kept up to date; the indices of the blocks
+// after it change, so the loops and the dominator tree become outdated.
+void insertPreheader(Context *context, CFG &blocks, const Loop &loop, size_t &next_block_id);
+
+} // namespace tac
@@ -0,0 +1,436 @@
+#include "pass_manager.h"
+#include "common/context.h"
+#include "tac_helper.h"
+#include <unordered_map>
+
+namespace tac {
+
+// constant_folding.cpp
+void constantFolding(
+    CFGBlock &block,
+    Context *context,
+    Changes &changes
+);
+
+// unreachable_code_elimination.cpp
+void unreachableCodeElimination(
+    CFG &blocks,
+    Changes &changes
+);
+
+// copy_propagation.cpp
+void copyPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    Changes &changes
+);
+
+// dead_store_elimination.cpp
+void deadStoreElimination(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Changes &changes
+);
+
+// induction_variables.cpp
+void optimizeInductionVariables(
+    CFG &blocks,
+    std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    std::vector<SplitVariable> &new_variables
+);
+
+// loop_invariant_code_motion.cpp
+void loopInvariantCodeMotion(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    Context *context,
+    size_t &next_block_id,
+    Changes &changes
+);
+
+// sparse_constant_propagation.cpp
+bool sparseConstantPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    Context *context
+);
+
+// value_numbering.cpp
+void globalValueNumbering(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    const DominatorTree &dominators,
+    Context *context
+);
+
+// sparse_copy_propagation.cpp
+void sparseCopyPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    Context *context
+);
+
+// dead_code_elimination.cpp
+void deadCodeElimination(
+    CFG &blocks,
+    const SSAVariables &ssa
+);
+
+// Gives the variables of the function dense ids in the order of their
+// first appearance and collects their names in func.variables
+static void numberVariables(FunctionDefinition &func)
+{
+    std::unordered_map<Symbol, uint32_t> ids;
+    func.variables.clear();
+    for (auto &block : func.blocks) {
+        for (auto &instr : block.instructions) {
+            ForEachVariant(instr, [&](Variant &var) {
+                auto [it, inserted] = ids.try_emplace(
+                    var.name,
+                    static_cast<uint32_t>(func.variables.size()));
+                if (inserted)
+                    func.variables.push_back(var.name);
+                var.id = it->second;
+            });
+        }
+    }
+}
+
+static BitSet collectAliasedVariants(const FunctionDefinition &func)
+{
+    BitSet ret(func.variables.size());
+    for (auto &block : func.blocks) {
+        for (const auto &instr : block.instructions) {
+            if (const GetAddress *ga = std::get_if<GetAddress>(&instr)) {
+                if (const Variant *var = std::get_if<Variant>(&ga->src))
+                    ret.set(var->id);
+            }
+        }
+    }
+    return ret;
+}
+
+static BitSet collectStaticVariants(
+    const FunctionDefinition &func,
+    SymbolTable *symbol_table)
+{
+    BitSet ret(func.variables.size());
+    for (size_t id = 0; id < func.variables.size(); ++id) {
+        const SymbolEntry *entry = symbol_table->get(func.variables[id]);
+        assert(entry);
+        if (entry->attrs.type == IdentifierAttributes::Static)
+            ret.set(id);
+    }
+    return ret;
+}
+
+static void rebuildControlFlowEdges(CFG &blocks)
+{
+    // Map labels to their blocks
+    std::unordered_map<Symbol, size_t> blockLabels;
+    blocks.clearEdges();
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const CFGBlock &block = blocks[i];
+        if (block.instructions.empty())
+            continue;
+        if (const Label *label = std::get_if<Label>(&block.instructions.front()))
+            blockLabels[label->identifier] = i;
+    }
+    auto connect_label = [&](size_t from, Symbol label) {
+        if (auto it = blockLabels.find(label); it != blockLabels.end())
+            blocks.connect(from, it->second);
+    };
+
+    // Connect blocks
+    size_t exit_block = blocks.size() - 1;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const CFGBlock &block = blocks[i];
+        size_t next_block = (i == exit_block) ? exit_block : i + 1;
+        if (i == 0 || block.instructions.empty()) {
+            blocks.connect(i, next_block);
+            continue;
+        }
+        const Instruction &last = block.instructions.back();
+        if (std::holds_alternative<Return>(last))
+            blocks.connect(i, exit_block);
+        else if (const Jump *j = std::get_if<Jump>(&last))
+            connect_label(i, j->target);
+        else if (const JumpIfZero *jz = std::get_if<JumpIfZero>(&last)) {
+            connect_label(i, jz->target);
+            blocks.connect(i, next_block);
+        } else if (const JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&last)) {
+            connect_label(i, jnz->target);
+            blocks.connect(i, next_block);
+        } else if (const JumpTable *jt = std::get_if<JumpTable>(&last)) {
+            for (Symbol target : jt->targets)
+                connect_label(i, target);
+        } else
+            blocks.connect(i, next_block);
+    }
+}
+
+PassManager::PassManager(FunctionDefinition &function, Context *context)
+    : m_function(function)
+    , m_context(context)
+{
+    // Everything counts as changed before the first runs
+    m_blockChanged.assign(BlockCount(), m_lastChange);
+}
+
+size_t PassManager::BlockCount() const
+{
+    // The ids don't change; new blocks get ids beyond the existing ones
+    size_t ret = 0;
+    for (auto &block : m_function.blocks)
+        ret = std::max(ret, block.id + 1);
+    return ret;
+}
+
+bool PassManager::Enabled(Pass pass) const
+{
+    switch (pass) {
+    case ConstantFolding: return m_context->constant_folding;
+    case UnreachableCodeElimination: return m_context->unreachable_code_elimination;
+    case CopyPropagation: return m_context->copy_propagation;
+    case DeadStoreElimination: return m_context->dead_store_elimination;
+    case LoopInvariantCodeMotion: return m_context->loop_invariant_code_motion;
+    case PassCount: break;
+    }
+    return false;
+}
+
+bool PassManager::Pending(Pass pass) const
+{
+    // Changes made by the pass itself count, since they can enable more of them
+    return m_lastChange >= m_passStarted[pass];
+}
+
+void PassManager::Run()
+{
+    // We don't care about the phase ordering problem of optimizations,
+    // we simply run them until they can't change the program anymore.
+    bool ran = true;
+    while (ran) {
+        ran = false;
+        for (size_t pass = 0; pass < PassCount; ++pass) {
+            if (Enabled(Pass(pass)) && Pending(Pass(pass))) {
+                RunPass(Pass(pass));
+                ran = true;
+            }
+        }
+    }
+}
+
+void PassManager::RunSSA(std::vector<SplitVariable> &split_variables)
+{
+    PassTimer *timer = m_context->passTimer.get();
+    auto count = [&]() { return m_function.blocks.instructionCount(); };
+
+    // The unreachable blocks would not get the versions of the variables
+    RunPass(UnreachableCodeElimination);
+    UpdateControlFlow();
+    UpdateVariables();
+
+    SSAVariables ssa;
+    DominatorTree dominators(m_function.blocks);
+    {
+        auto t = timer->Time("SSA construction");
+        t.Count("instructions", count);
+        ssa = constructSSA(
+            m_function,
+            dominators,
+            m_aliasedVars,
+            m_staticVars,
+            m_context->symbolTable.get());
+    }
+    bool jump_changed = false;
+    if (m_context->constant_folding) {
+        auto t = timer->Time("Sparse conditional constant propagation");
+        t.Count("instructions", count);
+        jump_changed = sparseConstantPropagation(
+            m_function.blocks,
+            m_function.variables,
+            ssa,
+            m_context);
+    }
+    if (m_context->common_subexpression_elimination) {
+        // Resolving branches only removes edges, the dominators still hold
+        auto t = timer->Time("Global value numbering");
+        t.Count("instructions", count);
+        globalValueNumbering(m_function.blocks, m_function.variables, ssa, dominators, m_context);
+    }
+    if (m_context->copy_propagation) {
+        auto t = timer->Time("Sparse copy propagation");
+        t.Count("instructions", count);
+        sparseCopyPropagation(m_function.blocks, m_function.variables, ssa, m_context);
+    }
+    if (m_context->dead_store_elimination) {
+        auto t = timer->Time("Dead code elimination");
+        t.Count("instructions", count);
+        deadCodeElimination(m_function.blocks, ssa);
+    }
+    {
+        auto t = timer->Time("SSA destruction");
+        t.Count("instructions", count);
+        destructSSA(m_function, ssa, split_variables);
+    }
+
+    // Every block may have changed; the edges are still valid unless
+    // branches were resolved
+    Changes changes(m_blockChanged.size());
+    for (auto &block : m_function.blocks)
+        changes.MarkBlock(block);
+    changes.MarkVariables();
+    if (jump_changed)
+        changes.MarkControlFlow();
+    ++m_clock;
+    Record(changes);
+}
+
+void PassManager::RunLoopOptimizations(std::vector<SplitVariable> &new_variables)
+{
+    UpdateControlFlow();
+    UpdateVariables();
+    {
+        auto t = m_context->passTimer->Time("Induction variable optimization");
+        t.Count("instructions", [&]() { return m_function.blocks.instructionCount(); });
+        size_t next_block_id = BlockCount();
+        optimizeInductionVariables(
+            m_function.blocks,
+            m_function.variables,
+            m_aliasedVars,
+            m_staticVars,
+            m_context,
+            next_block_id,
+            new_variables);
+    }
+    // The new variables are not numbered and blocks may have been created
+    m_controlFlowValid = false;
+    m_variablesValid = false;
+}
+
+void PassManager::RunPass(Pass pass)
+{
+    PassTimer *timer = m_context->passTimer.get();
+    auto count = [&]() { return m_function.blocks.instructionCount(); };
+    size_t previous_start = m_passStarted[pass];
+    m_passStarted[pass] = ++m_clock;
+    Changes changes(m_blockChanged.size());
+
+    switch (pass) {
+    case ConstantFolding: {
+        auto t = timer->Time("Constant folding");
+        t.Count("instructions", count);
+        for (auto &block : m_function.blocks) {
+            if (m_blockChanged[block.id] >= previous_start)
+                constantFolding(block, m_context, changes);
+        }
+        break;
+    }
+    case UnreachableCodeElimination: {
+        UpdateControlFlow();
+        auto t = timer->Time("Unreachable code elimination");
+        t.Count("instructions", count);
+        unreachableCodeElimination(m_function.blocks, changes);
+        break;
+    }
+    case CopyPropagation: {
+        UpdateControlFlow();
+        UpdateVariables();
+        auto t = timer->Time("Copy propagation");
+        t.Count("instructions", count);
+        copyPropagation(
+            m_function.blocks,
+            m_function.variables,
+            m_aliasedVars,
+            m_staticVars,
+            m_context,
+            changes);
+        break;
+    }
+    case DeadStoreElimination: {
+        UpdateControlFlow();
+        UpdateVariables();
+        auto t = timer->Time("Dead store elimination");
+        t.Count("instructions", count);
+        deadStoreElimination(
+            m_function.blocks,
+            m_function.variables,
+            m_aliasedVars,
+            m_staticVars,
+            changes);
+        break;
+    }
+    case LoopInvariantCodeMotion: {
+        UpdateControlFlow();
+        UpdateVariables();
+        auto t = timer->Time("Loop invariant code motion");
+        t.Count("instructions", count);
+        size_t next_block_id = BlockCount();
+        loopInvariantCodeMotion(
+            m_function.blocks,
+            m_function.variables,
+            m_aliasedVars,
+            m_staticVars,
+            m_context,
+            next_block_id,
+            changes);
+        break;
+    }
+    case PassCount:
+        break;
+    }
+    Record(changes);
+}
+
+void PassManager::Record(const Changes &changes)
+{
+    if (!changes.Any())
+        return;
+    m_lastChange = m_clock;
+    if (changes.NewBlocks())
+        m_blockChanged.resize(BlockCount(), m_clock);
+    changes.Blocks().forEach([&](size_t id) { m_blockChanged[id] = m_clock; });
+    if (changes.ControlFlow())
+        m_controlFlowValid = false;
+    if (changes.Variables())
+        m_variablesValid = false;
+}
+
+void PassManager::UpdateControlFlow()
+{
+    if (m_controlFlowValid)
+        return;
+    auto t = m_context->passTimer->Time("Control flow graph");
+    t.Count("instructions", [&]() { return m_function.blocks.instructionCount(); });
+    rebuildControlFlowEdges(m_function.blocks);
+    m_controlFlowValid = true;
+}
+
+void PassManager::UpdateVariables()
+{
+    if (m_variablesValid)
+        return;
+    auto t = m_context->passTimer->Time("Alias and static analysis");
+    t.Count("instructions", [&]() { return m_function.blocks.instructionCount(); });
+    numberVariables(m_function);
+    m_aliasedVars = collectAliasedVariants(m_function);
+    m_staticVars = collectStaticVariants(m_function, m_context->symbolTable.get());
+    m_variablesValid = true;
+}
+
+} // namespace tac
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common/bit_set.h"
+#include "ssa.h"
+#include "tac_nodes.h"
+#include <array>
+
+class Context;
+
+namespace tac {
+
+// What an optimization pass changed in a function. The pass manager decides
+// from it which passes have to run again, on which blocks, and which of its
+// cached analyses became outdated.
+class Changes {
+public:
+    explicit Changes(size_t block_count) : m_blocks(block_count) {}
+
+    // The instructions of the block changed
+    void MarkBlock(const CFGBlock &block)
+    {
+        m_blocks.set(block.id);
+        m_any = true;
+    }
+    // Jumps were rewritten or blocks were removed, the edges are outdated
+    void MarkControlFlow()
+    {
+        m_controlFlow = true;
+        m_any = true;
+    }
+    // A GetAddress may have been removed, so a variable may not be aliased anymore
+    void MarkVariables()
+    {
+        m_variables = true;
+        m_any = true;
+    }
+    // Blocks were created, with ids beyond the ones known before the pass
+    void MarkNewBlocks()
+    {
+        m_newBlocks = true;
+        m_any = true;
+    }
+
+    bool Any() const { return m_any; }
+    const BitSet &Blocks() const { return m_blocks; }
+    bool ControlFlow() const { return m_controlFlow; }
+    bool Variables() const { return m_variables; }
+    bool NewBlocks() const { return m_newBlocks; }
+
+private:
+    BitSet m_blocks;
+    bool m_controlFlow = false;
+    bool m_variables = false;
+    bool m_newBlocks = false;
+    bool m_any = false;
+};
+
+// Runs the enabled optimization passes on a function until none of them can
+// change it anymore. A pass runs again only if the function changed since its
+// previous run; constant folding, which is local to blocks, only visits the
+// blocks changed since then. The control flow graph and the variable analyses
+// (numbering, aliased and static variables) are cached between the passes
+// and recomputed only when a pass invalidated them.
+class PassManager {
+public:
+    PassManager(FunctionDefinition &function, Context *context);
+
+    void Run();
+    // Optimizes the function in SSA form with the sparse passes, before the
+    // iterative ones. Leaving SSA form may split variables, they are
+    // collected in split_variables.
+    void RunSSA(std::vector<SplitVariable> &split_variables);
+    // Strength reduction of the induction variables of loops. The variables
+    // it creates are collected in new_variables; they have to be added to
+    // the symbol table before the function is optimized again.
+    void RunLoopOptimizations(std::vector<SplitVariable> &new_variables);
+
+private:
+    enum Pass {
+        ConstantFolding,
+        UnreachableCodeElimination,
+        CopyPropagation,
+        DeadStoreElimination,
+        LoopInvariantCodeMotion,
+        PassCount
+    };
+
+    bool Enabled(Pass pass) const;
+    // The function changed since the pass last started
+    bool Pending(Pass pass) const;
+    void RunPass(Pass pass);
+    void Record(const Changes &changes);
+    void UpdateControlFlow();
+    void UpdateVariables();
+    size_t BlockCount() const;
+
+    FunctionDefinition &m_function;
+    Context *m_context;
+
+    // Logical clock, advanced by each pass run
+    size_t m_clock = 1;
+    size_t m_lastChange = 1;
+    // By block id: the clock of the last change of the block
+    std::vector<size_t> m_blockChanged;
+    // The clock when the pass last started, 0 if it never ran
+    std::array<size_t, PassCount> m_passStarted = {};
+
+    bool m_controlFlowValid = false;
+    bool m_variablesValid = false;
+    BitSet m_aliasedVars;
+    BitSet m_staticVars;
+};
+
+} // namespace tac
@@ -0,0 +1,380 @@
+#include "common/context.h"
+#include "ssa.h"
+#include "tac_helper.h"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tac {
+
+// constant_folding.cpp
+std::optional<ConstantValue> evaluate(
+    BinaryOperator op,
+    const ConstantValue &a,
+    const ConstantValue &b
+);
+std::optional<ConstantValue> evaluate(
+    UnaryOperator op,
+    const ConstantValue &a
+);
+
+namespace {
+
+bool isBranch(const Instruction &instr)
+{
+    return std::holds_alternative<JumpIfZero>(instr)
+        || std::holds_alternative<JumpIfNotZero>(instr)
+        || std::holds_alternative<JumpTable>(instr);
+}
+
+// Value of a version: not known yet (Top), the same constant on every
+// executable path, or not a constant (Bottom)
+struct LatticeValue {
+    enum State { Top, Const, Bottom };
+    State state = Top;
+    ConstantValue value;
+};
+
+struct Use {
+    uint32_t block;
+    Instruction *instruction;
+};
+
+class SparseConstantPropagation {
+public:
+    SparseConstantPropagation(
+        CFG &blocks,
+        const std::vector<Symbol> &variables,
+        const SSAVariables &ssa,
+        Context *context);
+
+    void Solve();
+    bool Rewrite();
+
+private:
+    const Type &TypeOf(uint32_t id) const
+    {
+        return m_context->symbolTable->getType(m_variables[id]);
+    }
+    LatticeValue ValueOf(const Value &value) const;
+    void Lower(const Value &dst, const LatticeValue &value);
+    void MarkEdge(uint32_t from, uint32_t to);
+    void MarkSuccessors(uint32_t block);
+    void Visit(uint32_t block, const Instruction &instr);
+    void VisitPhi(uint32_t block, const Phi &phi);
+    // The successor a branch with a known condition takes; NoNode if it
+    // can take any of them
+    uint32_t TakenSuccessor(uint32_t block, const Instruction &instr) const;
+    bool Executable(uint32_t from, uint32_t to) const;
+
+    CFG &m_blocks;
+    const std::vector<Symbol> &m_variables;
+    const SSAVariables &m_ssa;
+    Context *m_context;
+
+    std::vector<LatticeValue> m_values;
+    std::vector<std::vector<Use>> m_uses;
+    std::unordered_map<Symbol, uint32_t> m_labels;
+    std::unordered_map<size_t, uint32_t> m_blockIndex;
+    std::unordered_set<uint64_t> m_executableEdges;
+    std::vector<bool> m_visited;
+    std::vector<std::pair<uint32_t, uint32_t>> m_edgeWorklist;
+    std::vector<uint32_t> m_valueWorklist;
+};
+
+SparseConstantPropagation::SparseConstantPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    Context *context)
+    : m_blocks(blocks)
+    , m_variables(variables)
+    , m_ssa(ssa)
+    , m_context(context)
+    , m_values(variables.size())
+    , m_uses(variables.size())
+    , m_visited(blocks.size(), false)
+{
+    // The values at the entry of the function are unknown
+    for (uint32_t id = 0; id < variables.size(); ++id) {
+        if (!ssa.promotable.test(ssa.original[id]) || ssa.original[id] == id)
+            m_values[id].state = LatticeValue::Bottom;
+    }
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        m_blockIndex[blocks[b].id] = b;
+        for (auto &instr : blocks[b].instructions) {
+            if (const Label *label = std::get_if<Label>(&instr))
+                m_labels[label->identifier] = b;
+            ForEachUse(instr, [&](const Value &value) {
+                if (m_ssa.IsVersion(value))
+                    m_uses[std::get<Variant>(value).id].push_back(Use{ b, &instr });
+            });
+        }
+    }
+}
+
+bool SparseConstantPropagation::Executable(uint32_t from, uint32_t to) const
+{
+    return m_executableEdges.contains(uint64_t(from) << 32 | to);
+}
+
+LatticeValue SparseConstantPropagation::ValueOf(const Value &value) const
+{
+    if (const Constant *c = std::get_if<Constant>(&value))
+        return LatticeValue{ LatticeValue::Const, c->value };
+    return m_values[std::get<Variant>(value).id];
+}
+
+void SparseConstantPropagation::Lower(const Value &dst, const LatticeValue &value)
+{
+    const Variant *var = std::get_if<Variant>(&dst);
+    if (!var || !m_ssa.IsVersion(*var))
+        return;
+    LatticeValue &current = m_values[var->id];
+    if (current.state == LatticeValue::Bottom || value.state == LatticeValue::Top)
+        return;
+    if (current.state == LatticeValue::Const) {
+        // The values can only go down in the lattice
+        if (value.state == LatticeValue::Const && value.value == current.value)
+            return;
+        current.state = LatticeValue::Bottom;
+    } else
+        current = value;
+    m_valueWorklist.push_back(var->id);
+}
+
+void SparseConstantPropagation::MarkEdge(uint32_t from, uint32_t to)
+{
+    m_edgeWorklist.emplace_back(from, to);
+}
+
+void SparseConstantPropagation::MarkSuccessors(uint32_t block)
+{
+    for (uint32_t succ : m_blocks[block].successors)
+        MarkEdge(block, succ);
+}
+
+uint32_t SparseConstantPropagation::TakenSuccessor(
+    uint32_t block,
+    const Instruction &instr) const
+{
+    // Zero tests of NaN are left to the backend
+    auto constant = [&](const Value &value) -> std::optional<ConstantValue> {
+        LatticeValue lattice = ValueOf(value);
+        if (lattice.state != LatticeValue::Const || isNan(lattice.value))
+            return std::nullopt;
+        return lattice.value;
+    };
+    auto target = [&](Symbol label) { return m_labels.at(label); };
+
+    if (const JumpIfZero *jz = std::get_if<JumpIfZero>(&instr)) {
+        if (auto c = constant(jz->condition))
+            return isZero(*c) ? target(jz->target) : block + 1;
+    } else if (const JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&instr)) {
+        if (auto c = constant(jnz->condition))
+            return isZero(*c) ? block + 1 : target(jnz->target);
+    } else if (const JumpTable *table = std::get_if<JumpTable>(&instr)) {
+        auto c = constant(table->index);
+        if (c && castTo<uint64_t>(*c) < table->targets.size())
+            return target(table->targets[castTo<size_t>(*c)]);
+    }
+    return NoNode;
+}
+
+void SparseConstantPropagation::VisitPhi(uint32_t block, const Phi &phi)
+{
+    LatticeValue result;
+    for (auto &arg : phi.args) {
+        if (!Executable(m_blockIndex.at(arg.block), block))
+            continue;
+        LatticeValue value = ValueOf(arg.value);
+        if (value.state == LatticeValue::Top)
+            continue;
+        if (value.state == LatticeValue::Const) {
+            value.value = ConvertValue(value.value, TypeOf(std::get<Variant>(phi.dst).id));
+            if (result.state == LatticeValue::Top) {
+                result = value;
+                continue;
+            }
+            if (result.state == LatticeValue::Const && result.value == value.value)
+                continue;
+        }
+        result.state = LatticeValue::Bottom;
+        break;
+    }
+    Lower(phi.dst, result);
+}
+
+void SparseConstantPropagation::Visit(uint32_t block, const Instruction &instr)
+{
+    if (const Phi *phi = std::get_if<Phi>(&instr)) {
+        VisitPhi(block, *phi);
+        return;
+    }
+    if (isBranch(instr)) {
+        // A branch with an unknown condition takes no edge yet
+        bool pending = false;
+        ForEachUse(instr, [&](const Value &value) {
+            pending |= ValueOf(value).state == LatticeValue::Top;
+        });
+        if (pending)
+            return;
+        uint32_t taken = TakenSuccessor(block, instr);
+        if (taken != NoNode)
+            MarkEdge(block, taken);
+        else
+            MarkSuccessors(block);
+        return;
+    }
+
+    const Value *dst = GetDestination(instr);
+    if (!dst || !m_ssa.IsVersion(*dst))
+        return;
+    const Type &dst_type = TypeOf(std::get<Variant>(*dst).id);
+    // Meet of the operands: any unknown one makes the result unknown
+    auto operands = [&](auto &&...values) -> LatticeValue::State {
+        LatticeValue::State state = LatticeValue::Const;
+        for (const Value *value : { &values... }) {
+            LatticeValue::State s = ValueOf(*value).state;
+            if (s == LatticeValue::Bottom)
+                return LatticeValue::Bottom;
+            if (s == LatticeValue::Top)
+                state = LatticeValue::Top;
+        }
+        return state;
+    };
+    auto result = [&](const std::optional<ConstantValue> &value) {
+        if (!value)
+            return LatticeValue{ LatticeValue::Bottom, {} };
+        return LatticeValue{ LatticeValue::Const, ConvertValue(*value, dst_type) };
+    };
+
+    LatticeValue value{ LatticeValue::Bottom, {} };
+    std::visit([&](const auto &obj) {
+        using T = std::decay_t<decltype(obj)>;
+        if constexpr (std::is_same_v<T, Unary>) {
+            value.state = operands(obj.src);
+            if (value.state == LatticeValue::Const)
+                value = result(evaluate(obj.op, ValueOf(obj.src).value));
+        } else if constexpr (std::is_same_v<T, Binary>) {
+            value.state = operands(obj.src1, obj.src2);
+            if (value.state == LatticeValue::Const) {
+                value = result(evaluate(
+                    obj.op,
+                    ValueOf(obj.src1).value,
+                    ValueOf(obj.src2).value));
+            }
+        } else if constexpr (std::is_same_v<T, Copy>
+            || std::is_same_v<T, SignExtend>
+            || std::is_same_v<T, Truncate>
+            || std::is_same_v<T, ZeroExtend>
+            || std::is_same_v<T, DoubleToInt>
+            || std::is_same_v<T, DoubleToUInt>
+            || std::is_same_v<T, IntToDouble>
+            || std::is_same_v<T, UIntToDouble>) {
+            value.state = operands(obj.src);
+            if (value.state == LatticeValue::Const)
+                value = result(ValueOf(obj.src).value);
+        }
+    }, instr);
+    Lower(*dst, value);
+}
+
+void SparseConstantPropagation::Solve()
+{
+    MarkEdge(NoNode, 0);
+    while (!m_edgeWorklist.empty() || !m_valueWorklist.empty()) {
+        if (!m_edgeWorklist.empty()) {
+            auto [from, to] = m_edgeWorklist.back();
+            m_edgeWorklist.pop_back();
+            if (from != NoNode) {
+                if (Executable(from, to))
+                    continue;
+                m_executableEdges.insert(uint64_t(from) << 32 | to);
+            }
+            // A new incoming edge can only change the Phi nodes
+            if (m_visited[to]) {
+                for (auto &instr : m_blocks[to].instructions) {
+                    if (const Phi *phi = std::get_if<Phi>(&instr))
+                        VisitPhi(to, *phi);
+                }
+                continue;
+            }
+            m_visited[to] = true;
+            CFGBlock &block = m_blocks[to];
+            for (auto &instr : block.instructions)
+                Visit(to, instr);
+            if (block.instructions.empty() || !isBranch(block.instructions.back()))
+                MarkSuccessors(to);
+            continue;
+        }
+        uint32_t id = m_valueWorklist.back();
+        m_valueWorklist.pop_back();
+        for (const Use &use : m_uses[id]) {
+            if (m_visited[use.block])
+                Visit(use.block, *use.instruction);
+        }
+    }
+}
+
+bool SparseConstantPropagation::Rewrite()
+{
+    bool jump_changed = false;
+    for (uint32_t b = 0; b < m_blocks.size(); ++b) {
+        // Unreachable blocks are left to the unreachable code elimination
+        if (!m_visited[b])
+            continue;
+        InstructionList &instructions = m_blocks[b].instructions;
+        for (auto it = instructions.begin(); it != instructions.end();) {
+            if (Phi *phi = std::get_if<Phi>(&*it)) {
+                std::erase_if(phi->args, [&](const PhiArgument &arg) {
+                    return !Executable(m_blockIndex.at(arg.block), b);
+                });
+            }
+            if (uint32_t taken = TakenSuccessor(b, *it); taken != NoNode) {
+                jump_changed = true;
+                if (taken == b + 1) {
+                    it = instructions.erase(it);
+                    continue;
+                }
+                *it = Jump{ std::get<Label>(m_blocks[taken].instructions.front()).identifier };
+                ++it;
+                continue;
+            }
+            const Value *dst = GetDestination(*it);
+            const Variant *var = dst ? std::get_if<Variant>(dst) : nullptr;
+            if (var && m_ssa.IsVersion(*var) && !std::holds_alternative<FunctionCall>(*it)
+                && m_values[var->id].state == LatticeValue::Const) {
+                *it = Copy{ Constant{ m_values[var->id].value }, *var };
+                ++it;
+                continue;
+            }
+            ForEachUse(*it, [&](Value &value) {
+                const Variant *use = std::get_if<Variant>(&value);
+                if (use && m_ssa.IsVersion(*use) && m_values[use->id].state == LatticeValue::Const)
+                    value = Constant{ m_values[use->id].value };
+            });
+            ++it;
+        }
+    }
+    return jump_changed;
+}
+
+} // namespace
+
+// Wegman-Zadeck sparse conditional constant propagation: the values of the
+// versions and the executable edges are solved together, so a value defined
+// only on untaken paths doesn't spoil a Phi node. Branches with a known
+// condition become jumps (the control flow edges become outdated, which is
+// returned) and the constant definitions become copies of constants.
+bool sparseConstantPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    Context *context)
+{
+    SparseConstantPropagation propagation(blocks, variables, ssa, context);
+    propagation.Solve();
+    return propagation.Rewrite();
+}
+
+} // namespace tac
@@ -0,0 +1,127 @@
+#include "common/context.h"
+#include "ssa.h"
+#include "tac_helper.h"
+
+namespace tac {
+
+// Same rules as for the copies in copy_propagation.cpp: a copy can be
+// propagated if it doesn't change the type, or if it's between characters
+static bool isPropagatable(const Value &src, const Type &src_type, const Type &dst_type)
+{
+    return std::holds_alternative<Constant>(src)
+        || src_type == dst_type
+        || (src_type.isCharacter() && dst_type.isCharacter());
+}
+
+static bool sameValue(const Value &a, const Value &b)
+{
+    if (const Variant *va = std::get_if<Variant>(&a)) {
+        const Variant *vb = std::get_if<Variant>(&b);
+        return vb && va->id == vb->id;
+    }
+    return std::holds_alternative<Constant>(b)
+        && std::get<Constant>(a).value == std::get<Constant>(b).value;
+}
+
+// In SSA form a copy holds on every path from its definition, so every use
+// of its destination can read the source instead; Phi nodes whose arguments
+// are all the same value (or the Phi itself) are copies too.
+void sparseCopyPropagation(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    Context *context)
+{
+    auto type_of = [&](uint32_t id) -> const Type & {
+        return context->symbolTable->getType(variables[id]);
+    };
+    std::vector<std::optional<Value>> replacements(variables.size());
+    // The value a version is replaced with, following chains of copies;
+    // constants are converted to the type of the version they replace
+    auto resolve = [&](const Value &value) -> Value {
+        const Variant *var = std::get_if<Variant>(&value);
+        if (!var || !replacements[var->id])
+            return value;
+        uint32_t id = var->id;
+        Value ret = value;
+        while (const Variant *next = std::get_if<Variant>(&ret)) {
+            if (!replacements[next->id])
+                break;
+            ret = *replacements[next->id];
+        }
+        if (const Constant *c = std::get_if<Constant>(&ret))
+            return Constant{ ConvertValue(c->value, type_of(id)) };
+        return ret;
+    };
+
+    std::vector<Phi *> phis;
+    for (auto &block : blocks) {
+        for (auto &instr : block.instructions) {
+            if (Phi *phi = std::get_if<Phi>(&instr)) {
+                phis.push_back(phi);
+                continue;
+            }
+            const Copy *copy = std::get_if<Copy>(&instr);
+            if (!copy || !ssa.IsVersion(copy->dst))
+                continue;
+            if (!std::holds_alternative<Constant>(copy->src) && !ssa.IsVersion(copy->src))
+                continue;
+            uint32_t dst = std::get<Variant>(copy->dst).id;
+            Type constant_type;
+            const Type *src_type = &constant_type;
+            if (const Variant *src = std::get_if<Variant>(&copy->src))
+                src_type = &type_of(src->id);
+            if (isPropagatable(copy->src, *src_type, type_of(dst)))
+                replacements[dst] = copy->src;
+        }
+    }
+
+    // Phi nodes can become copies when other ones are resolved
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Phi *phi : phis) {
+            uint32_t dst = std::get<Variant>(phi->dst).id;
+            if (replacements[dst])
+                continue;
+            std::optional<Value> unique;
+            bool is_copy = true;
+            for (auto &arg : phi->args) {
+                Value value = resolve(arg.value);
+                if (const Variant *var = std::get_if<Variant>(&value); var && var->id == dst)
+                    continue;
+                if (const Constant *c = std::get_if<Constant>(&value))
+                    value = Constant{ ConvertValue(c->value, type_of(dst)) };
+                if (!unique)
+                    unique = value;
+                else if (!sameValue(*unique, value)) {
+                    is_copy = false;
+                    break;
+                }
+            }
+            if (is_copy && unique) {
+                replacements[dst] = *unique;
+                changed = true;
+            }
+        }
+    }
+
+    // Rewrite the uses and remove the definitions which were replaced
+    for (auto &block : blocks) {
+        for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+            const Value *dst = GetDestination(*it);
+            if ((std::holds_alternative<Copy>(*it) || std::holds_alternative<Phi>(*it))
+                && replacements[std::get<Variant>(*dst).id]) {
+                it = block.instructions.erase(it);
+                continue;
+            }
+            ForEachUse(*it, [&](Value &value) {
+                if (ssa.IsVersion(value))
+                    value = resolve(value);
+            });
+            ++it;
+        }
+    }
+}
+
+} // namespace tac
@@ -0,0 +1,307 @@
+#include "ssa.h"
+#include "common/symbol_table.h"
+#include "data_flow.h"
+#include "tac_helper.h"
+#include <format>
+
+namespace tac {
+
+// Backward transfer of a single instruction for the liveness of variables
+static void transferLiveness(const Instruction &instr, BitSet &live)
+{
+    if (const Value *dst = GetDestination(instr)) {
+        if (const Variant *var = std::get_if<Variant>(dst))
+            live.reset(var->id);
+    }
+    ForEachUse(instr, [&](const Value &value) {
+        if (const Variant *var = std::get_if<Variant>(&value))
+            live.set(var->id);
+    });
+}
+
+static void solveLiveness(DataFlow &liveness, size_t variable_count)
+{
+    liveness.Solve(BitSet(variable_count), [](const CFGBlock &block, BitSet &live) {
+        for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it)
+            transferLiveness(*it, live);
+    });
+}
+
+// Phi nodes go to the start of the block, after its label
+static InstructionList::iterator phiPosition(CFGBlock &block)
+{
+    auto it = block.instructions.begin();
+    if (it != block.instructions.end() && std::holds_alternative<Label>(*it))
+        ++it;
+    return it;
+}
+
+static bool isJump(const Instruction &instr)
+{
+    return std::holds_alternative<Jump>(instr)
+        || std::holds_alternative<JumpIfZero>(instr)
+        || std::holds_alternative<JumpIfNotZero>(instr)
+        || std::holds_alternative<JumpTable>(instr);
+}
+
+SSAVariables constructSSA(
+    FunctionDefinition &func,
+    const DominatorTree &dominators,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    const SymbolTable *symbol_table)
+{
+    CFG &blocks = func.blocks;
+    size_t variable_count = func.variables.size();
+    SSAVariables ssa;
+    ssa.promotable = BitSet(variable_count);
+    ssa.original.resize(variable_count);
+    for (uint32_t id = 0; id < variable_count; ++id) {
+        ssa.original[id] = id;
+        if (!aliased_vars.test(id) && !static_vars.test(id)
+            && symbol_table->getType(func.variables[id]).isScalar())
+            ssa.promotable.set(id);
+    }
+
+    // Blocks defining the variables; the entry block defines all of them
+    std::vector<std::vector<uint32_t>> def_blocks(variable_count);
+    for (uint32_t b = 0; b < blocks.size(); ++b) {
+        for (auto &instr : blocks[b].instructions) {
+            const Value *dst = GetDestination(instr);
+            const Variant *var = dst ? std::get_if<Variant>(dst) : nullptr;
+            if (!var || !ssa.promotable.test(var->id))
+                continue;
+            std::vector<uint32_t> &defs = def_blocks[var->id];
+            if (defs.empty() || defs.back() != b)
+                defs.push_back(b);
+        }
+    }
+
+    // Pruned SSA: Phi nodes only where the variable is live
+    DataFlow liveness(blocks, DataFlow::Backward, DataFlow::Union, variable_count);
+    solveLiveness(liveness, variable_count);
+
+    // Phi placement on the iterated dominance frontiers of the definitions
+    std::vector<std::vector<uint32_t>> phi_variables(blocks.size());
+    std::vector<uint32_t> has_phi(blocks.size(), NoNode);
+    std::vector<uint32_t> queued(blocks.size(), NoNode);
+    std::vector<uint32_t> worklist;
+    ssa.promotable.forEach([&](size_t index) {
+        uint32_t v = static_cast<uint32_t>(index);
+        worklist = def_blocks[v];
+        worklist.push_back(0);
+        for (uint32_t b : worklist)
+            queued[b] = v;
+        while (!worklist.empty()) {
+            uint32_t b = worklist.back();
+            worklist.pop_back();
+            for (uint32_t frontier : dominators.Frontier(b)) {
+                if (has_phi[frontier] == v || !liveness.In(blocks[frontier]).test(v))
+                    continue;
+                has_phi[frontier] = v;
+                phi_variables[frontier].push_back(v);
+                if (queued[frontier] != v) {
+                    queued[frontier] = v;
+                    worklist.push_back(frontier);
+                }
+            }
+        }
+    });
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        auto position = phiPosition(blocks[b]);
+        for (uint32_t v : phi_variables[b]) {
+            Variant var = Variant{ func.variables[v], v };
+            Phi phi{ .args = {}, .dst = var };
+            for (uint32_t pred : blocks[b].predecessors)
+                phi.args.push_back(PhiArgument{ blocks[pred].id, var });
+            blocks[b].instructions.emplace(position, std::move(phi));
+        }
+    }
+
+    // Renaming in the preorder of the dominator tree; the stacks hold the
+    // current version of each variable
+    std::vector<std::vector<uint32_t>> stacks(variable_count);
+    ssa.promotable.forEach([&](size_t v) { stacks[v].push_back(static_cast<uint32_t>(v)); });
+    std::vector<uint32_t> pushed;
+    auto define = [&](Variant &var) {
+        uint32_t original = var.id;
+        uint32_t version = static_cast<uint32_t>(func.variables.size());
+        func.variables.push_back(func.variables[original]);
+        ssa.original.push_back(original);
+        stacks[original].push_back(version);
+        pushed.push_back(original);
+        var.id = version;
+    };
+
+    struct Frame {
+        uint32_t block;
+        size_t child;
+        size_t pushed;
+    };
+    std::vector<Frame> frames = { Frame{ 0, 0, 0 } };
+    bool entering = true;
+    while (!frames.empty()) {
+        Frame &frame = frames.back();
+        CFGBlock &block = blocks[frame.block];
+        if (entering) {
+            for (auto &instr : block.instructions) {
+                if (Phi *phi = std::get_if<Phi>(&instr)) {
+                    define(std::get<Variant>(phi->dst));
+                    continue;
+                }
+                ForEachUse(instr, [&](Value &value) {
+                    Variant *var = std::get_if<Variant>(&value);
+                    if (var && ssa.promotable.test(var->id))
+                        var->id = stacks[var->id].back();
+                });
+                Value *dst = GetDestination(instr);
+                Variant *var = dst ? std::get_if<Variant>(dst) : nullptr;
+                if (var && ssa.promotable.test(var->id))
+                    define(*var);
+            }
+            for (uint32_t succ : block.successors) {
+                for (auto &instr : blocks[succ].instructions) {
+                    Phi *phi = std::get_if<Phi>(&instr);
+                    if (!phi)
+                        continue;
+                    uint32_t original = ssa.original[std::get<Variant>(phi->dst).id];
+                    for (auto &arg : phi->args) {
+                        if (arg.block == block.id)
+                            std::get<Variant>(arg.value).id = stacks[original].back();
+                    }
+                }
+            }
+            entering = false;
+        }
+
+        const std::vector<uint32_t> &children = dominators.Children(frame.block);
+        if (frame.child < children.size()) {
+            uint32_t child = children[frame.child++];
+            frames.push_back(Frame{ child, 0, pushed.size() });
+            entering = true;
+            continue;
+        }
+        while (pushed.size() > frame.pushed) {
+            stacks[pushed.back()].pop_back();
+            pushed.pop_back();
+        }
+        frames.pop_back();
+    }
+    return ssa;
+}
+
+void destructSSA(
+    FunctionDefinition &func,
+    const SSAVariables &ssa,
+    std::vector<SplitVariable> &split_variables)
+{
+    CFG &blocks = func.blocks;
+    std::vector<uint32_t> original = ssa.original;
+    std::unordered_map<size_t, size_t> block_index;
+    for (size_t b = 0; b < blocks.size(); ++b)
+        block_index[blocks[b].id] = b;
+
+    // Each Phi becomes a copy from a new version, which is set at the end
+    // of the predecessors. The new version is only read by the Phi's copy,
+    // so the copies of the predecessors can't overwrite each other's sources.
+    for (auto &block : blocks) {
+        for (auto &instr : block.instructions) {
+            Phi *phi = std::get_if<Phi>(&instr);
+            if (!phi)
+                continue;
+            const Variant &dst = std::get<Variant>(phi->dst);
+            Variant temp = Variant{ dst.name, static_cast<uint32_t>(func.variables.size()) };
+            func.variables.push_back(dst.name);
+            original.push_back(original[dst.id]);
+            for (auto &arg : phi->args) {
+                CFGBlock &pred = blocks[block_index[arg.block]];
+                auto position = pred.instructions.end();
+                if (!pred.instructions.empty() && isJump(pred.instructions.back()))
+                    --position;
+                pred.instructions.emplace(position, Copy{ arg.value, temp });
+            }
+            instr = Copy{ temp, dst };
+        }
+    }
+
+    size_t variable_count = func.variables.size();
+    DataFlow liveness(blocks, DataFlow::Backward, DataFlow::Union, variable_count);
+    solveLiveness(liveness, variable_count);
+
+    // Versions of the same variable interfere if one is defined while the
+    // other is live, unless the definition copies the other one
+    std::vector<std::vector<uint32_t>> versions(ssa.promotable.size());
+    for (uint32_t id = 0; id < variable_count; ++id) {
+        if (ssa.promotable.test(original[id]))
+            versions[original[id]].push_back(id);
+    }
+    std::vector<std::vector<uint32_t>> interference(variable_count);
+    BitSet live(variable_count);
+    for (auto &block : blocks) {
+        live = liveness.Out(block);
+        for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+            const Value *dst = GetDestination(*it);
+            const Variant *def = dst ? std::get_if<Variant>(dst) : nullptr;
+            if (def && ssa.promotable.test(original[def->id])) {
+                const Copy *copy = std::get_if<Copy>(&*it);
+                const Variant *src = copy ? std::get_if<Variant>(&copy->src) : nullptr;
+                for (uint32_t other : versions[original[def->id]]) {
+                    if (other == def->id || !live.test(other) || (src && src->id == other))
+                        continue;
+                    interference[def->id].push_back(other);
+                    interference[other].push_back(def->id);
+                }
+            }
+            transferLiveness(*it, live);
+        }
+    }
+
+    // Greedy coloring of the versions of each variable; the first color
+    // keeps the name of the variable
+    std::vector<Symbol> names(variable_count);
+    std::vector<uint32_t> colors(variable_count, NoNode);
+    std::vector<bool> used;
+    for (uint32_t v = 0; v < versions.size(); ++v) {
+        std::vector<Symbol> color_names;
+        for (uint32_t version : versions[v]) {
+            used.assign(versions[v].size(), false);
+            for (uint32_t other : interference[version]) {
+                if (colors[other] != NoNode)
+                    used[colors[other]] = true;
+            }
+            uint32_t color = 0;
+            while (used[color])
+                ++color;
+            colors[version] = color;
+            if (color == color_names.size()) {
+                Symbol name = func.variables[v];
+                if (color > 0) {
+                    name = Symbol(std::format("{}.v{}", func.variables[v].str(), color));
+                    split_variables.push_back(SplitVariable{ name, func.variables[v] });
+                }
+                color_names.push_back(name);
+            }
+            names[version] = color_names[color];
+        }
+    }
+
+    for (auto &block : blocks) {
+        for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+            ForEachVariant(*it, [&](Variant &var) {
+                if (ssa.promotable.test(original[var.id]))
+                    var.name = names[var.id];
+            });
+            // The versions keep their ids, the copies between the ones
+            // named the same are the redundant ones
+            const Copy *copy = std::get_if<Copy>(&*it);
+            const Variant *src = copy ? std::get_if<Variant>(&copy->src) : nullptr;
+            const Variant *dst = copy ? std::get_if<Variant>(&copy->dst) : nullptr;
+            if (src && dst && src->name == dst->name)
+                it = block.instructions.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+} // namespace tac
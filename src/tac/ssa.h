@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common/bit_set.h"
+#include "dominators.h"
+#include "tac_nodes.h"
+
+class SymbolTable;
+
+namespace tac {
+
+// Variables of a function in SSA form. Each definition of a promotable
+// variable (scalar, not aliased and not static) creates a new version of it:
+// a new variable id with the name of the original. The original id is the
+// version holding the value at the entry of the function.
+struct SSAVariables {
+    // By variable id, versions included
+    std::vector<uint32_t> original;
+    // By original variable id
+    BitSet promotable;
+
+    bool IsVersion(const Variant &var) const { return promotable.test(original[var.id]); }
+    bool IsVersion(const Value &value) const
+    {
+        const Variant *var = std::get_if<Variant>(&value);
+        return var && IsVersion(*var);
+    }
+};
+
+// Variable created when leaving SSA form for versions which are live at the
+// same time as the original; it gets the type and attributes of the original.
+// Other passes creating variables describe them the same way.
+struct SplitVariable {
+    Symbol name;
+    Symbol original;
+};
+
+// Puts the function into SSA form, placing Phi nodes only where the variable
+// is live. The control flow edges and the variable numbering must be up to
+// date and every block must be reachable.
+SSAVariables constructSSA(
+    FunctionDefinition &func,
+    const DominatorTree &dominators,
+    const BitSet &aliased_vars,
+    const BitSet &static_vars,
+    const SymbolTable *symbol_table);
+
+// Replaces the Phi nodes with copies and names the versions: they share the
+// name of their original unless they interfere with each other. The variable
+// numbering is outdated afterwards.
+void destructSSA(
+    FunctionDefinition &func,
+    const SSAVariables &ssa,
+    std::vector<SplitVariable> &split_variables);
+
+} // namespace tac
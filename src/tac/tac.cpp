@@ -1,118 +1,27 @@
 #include "tac.h"
 #include "common/context.h"
+#include "pass_manager.h"
 #include "tac_builder.h"
-#include "tac_helper.h"
 
 namespace tac {
 
-// constant_folding.cpp
-void constantFolding(
-    std::list<CFGBlock> &instructions,
-    Context *context,
-    bool &changed
-);
-
-// unreachable_code_elimination.cpp
-void unreachableCodeElimination(
-    std::list<CFGBlock> &blocks,
-    bool &changed
-);
-
-// copy_propagation.cpp
-void copyPropagation(
-    std::list<CFGBlock> &blocks,
-    const std::set<Value> &aliased_vars,
-    const std::set<Value> &static_vars,
-    Context *context,
-    bool &changed
-);
-
-// dead_store_elimination.cpp
-void deadStoreElimination(
-    std::list<CFGBlock> &blocks,
-    const std::set<Value> &aliased_vars,
-    const std::set<Value> &static_vars,
-    bool &changed
+// inliner.cpp
+void inlineFunctions(
+    std::list<TopLevel> &list,
+    Context *context
 );
 
-static std::set<Value> collectAliasedVariants(std::list<CFGBlock> &blocks)
-{
-    std::set<Value> ret;
-    for (auto &block : blocks) {
-        for (const auto &instr : block.instructions) {
-            if (const GetAddress *ga = std::get_if<GetAddress>(&instr))
-                ret.insert(ga->src);
-        }
-    }
-    return ret;
-}
-
-static std::set<Value> collectStaticVariants(
-    std::list<CFGBlock> &blocks,
-    SymbolTable *symbol_table)
-{
-    std::set<Value> ret;
-    for (auto &block : blocks) {
-        for (const auto &instr : block.instructions) {
-            ForEachValue(instr, [&](const Value &v) {
-                if (const Variant *var = std::get_if<Variant>(&v)) {
-                    const SymbolEntry *entry = symbol_table->get(var->name);
-                    assert(entry);
-                    if (entry->attrs.type == IdentifierAttributes::Static)
-                        ret.insert(v);
-                }
-            });
-        }
-    }
-    return ret;
-}
-
-static inline void connect(CFGBlock *from, CFGBlock *to)
-{
-    from->successors.insert(to);
-    to->predecessors.insert(from);
-}
-
-static void rebuildControlFlowEdges(std::list<CFGBlock> &blocks)
+// Variables created while the functions were optimized in parallel; the
+// symbol table is read-only until they are done
+static void addVariables(
+    const std::vector<std::vector<SplitVariable>> &lists,
+    Context *context)
 {
-    // Map labels to their blocks
-    std::map<std::string, CFGBlock *> blockLabels;
-    for (auto &block : blocks) {
-        block.predecessors.clear();
-        block.successors.clear();
-        if (block.instructions.empty())
-            continue;
-        if (const Label *label = std::get_if<Label>(&block.instructions.front()))
-            blockLabels[label->identifier] = &block;
-    }
-
-    // Connect blocks
-    CFGBlock *entry_block = &blocks.front();
-    CFGBlock *exit_block = &blocks.back();
-    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-        CFGBlock *block = &*it;
-        CFGBlock *next_block = (block == exit_block)
-            ? exit_block : &*std::next(it);
-        if (block == entry_block || block->instructions.empty()) {
-            connect(block, next_block);
-            continue;
+    for (auto &variables : lists) {
+        for (auto &variable : variables) {
+            const SymbolEntry *entry = context->symbolTable->get(variable.original);
+            context->symbolTable->insert(variable.name, entry->type, entry->attrs);
         }
-        Instruction &last = block->instructions.back();
-        if (std::holds_alternative<Return>(last))
-            connect(block, exit_block);
-        else if (const Jump *j = std::get_if<Jump>(&last)) {
-            if (CFGBlock *target = blockLabels[j->target])
-                connect(block, target);
-        } else if (const JumpIfZero *jz = std::get_if<JumpIfZero>(&last)) {
-            if (CFGBlock *target = blockLabels[jz->target])
-                connect(block, target);
-            connect(block, next_block);
-        } else if (const JumpIfNotZero *jnz = std::get_if<JumpIfNotZero>(&last)) {
-            if (CFGBlock *target = blockLabels[jnz->target])
-                connect(block, target);
-            connect(block, next_block);
-        } else
-            connect(block, next_block);
     }
 }
 
@@ -129,33 +38,63 @@ void apply_optimizations(
     std::list<TopLevel> &list,
     Context *context)
 {
-    // Intraprocedural optimization: we work on separate functions.
+    PassTimer *timer = context->passTimer.get();
+    // Interprocedural optimization first, so the intraprocedural passes
+    // can clean up after it
+    if (context->inlining) {
+        auto t = timer->Time("Inlining");
+        t.Count("instructions", [&]() { return count_instructions(list); });
+        inlineFunctions(list, context);
+    }
+
+    std::vector<FunctionDefinition *> functions;
+    for (auto &top_level_obj : list) {
+        if (FunctionDefinition *f = std::get_if<FunctionDefinition>(&top_level_obj))
+            functions.push_back(f);
+    }
+
+    // Intraprocedural optimization: we work on separate functions,
+    // so they can be processed in parallel.
+    PassTimer::Stack timer_stack = timer->CurrentStack();
+    if (context->ssa) {
+        // The symbol table is read-only while the functions are optimized in
+        // parallel, the variables split when leaving SSA form are added after
+        std::vector<std::vector<SplitVariable>> split_variables(functions.size());
+        RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+            PassTimer::Attach attach(timer, timer_stack);
+            PassManager(*functions[i], context).RunSSA(split_variables[i]);
+        });
+        addVariables(split_variables, context);
+    }
+    RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+        PassTimer::Attach attach(timer, timer_stack);
+        PassManager(*functions[i], context).Run();
+    });
+    if (context->induction_variables) {
+        // The functions which got new variables are optimized again,
+        // to clean up after the strength reduction
+        std::vector<std::vector<SplitVariable>> new_variables(functions.size());
+        RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+            PassTimer::Attach attach(timer, timer_stack);
+            PassManager(*functions[i], context).RunLoopOptimizations(new_variables[i]);
+        });
+        addVariables(new_variables, context);
+        RunParallel(context->threadPool.get(), functions.size(), [&](size_t i) {
+            PassTimer::Attach attach(timer, timer_stack);
+            if (!new_variables[i].empty())
+                PassManager(*functions[i], context).Run();
+        });
+    }
+}
+
+size_t count_instructions(const std::list<TopLevel> &list)
+{
+    size_t ret = 0;
     for (auto &top_level_obj : list) {
-        std::visit([&](auto &obj) {
-            using T = std::decay_t<decltype(obj)>;
-            if constexpr (std::is_same_v<T, FunctionDefinition>) {
-                // We don't care about the phase ordering problem of optimizations,
-                // we simply run them until they can't change the program anymore.
-                bool changed = false;
-                do {
-                    changed = false;
-                    std::set<Value> aliased_vars = collectAliasedVariants(obj.blocks);
-                    std::set<Value> static_vars = collectStaticVariants(
-                        obj.blocks,
-                        context->symbolTable.get());
-                    if (context->constant_folding)
-                        constantFolding(obj.blocks, context, changed);
-                    rebuildControlFlowEdges(obj.blocks);
-                    if (context->unreachable_code_elimination)
-                        unreachableCodeElimination(obj.blocks, changed);
-                    if (context->copy_propagation)
-                        copyPropagation(obj.blocks, aliased_vars, static_vars, context, changed);
-                    if (context->dead_store_elimination)
-                        deadStoreElimination(obj.blocks, aliased_vars, static_vars, changed);
-                } while (changed);
-            }
-        }, top_level_obj);
+        if (const FunctionDefinition *f = std::get_if<FunctionDefinition>(&top_level_obj))
+            ret += f->blocks.instructionCount();
     }
+    return ret;
 }
 
 } // namespace tac
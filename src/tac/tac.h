@@ -17,4 +17,7 @@ void apply_optimizations(
     Context *context
 );
 
+// Number of instructions in all function bodies
+size_t count_instructions(const std::list<TopLevel> &list);
+
 } // namespace tac
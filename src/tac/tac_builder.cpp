@@ -7,7 +7,7 @@ namespace tac {
 
 Variant TACBuilder::CreateTemporaryVariable(const Type &type)
 {
-    Variant var = Variant{ GenerateTempVariableName() };
+    Variant var = Variant{ GenerateTempVariableName(m_context) };
     m_context->symbolTable->insert(var.name, type,
         IdentifierAttributes{ .type = IdentifierAttributes::Local }
     );
@@ -15,7 +15,7 @@ Variant TACBuilder::CreateTemporaryVariable(const Type &type)
 }
 
 Variant TACBuilder::CastValue(
-    std::list<Instruction> &i,
+    InstructionList &i,
     const Value &value,
     const Type &from_type,
     const Type &to_type)
@@ -71,7 +71,7 @@ std::pair<ExpResult, Type> TACBuilder::VisitLHS(const parser::Expression &expr)
     assert(false);
 }
 
-void TACBuilder::EmitZeroBytes(const std::string &base, size_t &offset, size_t size)
+void TACBuilder::EmitZeroBytes(const Variant &base, size_t &offset, size_t size)
 {
     while (size >= 4 && offset % 4 == 0) {
         AddInstruction(CopyToOffset{
@@ -94,7 +94,7 @@ void TACBuilder::EmitZeroBytes(const std::string &base, size_t &offset, size_t s
     }
 }
 
-void TACBuilder::EmitZeroInit(const Type &type, const std::string &base, size_t &offset)
+void TACBuilder::EmitZeroInit(const Type &type, const Variant &base, size_t &offset)
 {
     if (const ArrayType *array = type.getAs<ArrayType>()) {
         for (size_t i = 0; i < array->count; i++)
@@ -119,7 +119,7 @@ void TACBuilder::EmitZeroInit(const Type &type, const std::string &base, size_t
 
 void TACBuilder::EmitRuntimeInitNested(
     const parser::Initializer *init,
-    const std::string &base,
+    const Variant &base,
     const Type &type,
     size_t &offset)
 {
@@ -249,7 +249,7 @@ void TACBuilder::EmitRuntimeInitNested(
 
 void TACBuilder::EmitRuntimeInitTopLevel(
     const parser::Initializer *init,
-    const std::string &base,
+    const Variant &base,
     const Type &type)
 {
     // Use only Copy instructions to be able to differentiate later
@@ -260,12 +260,12 @@ void TACBuilder::EmitRuntimeInitTopLevel(
     if (!single->expr) {
         AddInstruction(Copy{
             Constant{ MakeConstantValue(0, type) },
-            Variant{ base }
+            base
         });
     } else {
         AddInstruction(Copy{
             VisitAndConvert(*single->expr),
-            Variant{ base }
+            base
         });
     }
 }
@@ -299,11 +299,11 @@ ExpResult TACBuilder::operator()(const parser::ConstantExpression &n)
 
 ExpResult TACBuilder::operator()(const parser::StringExpression &s)
 {
-    std::string name = MakeNameUnique("string");
+    std::string name = MakeNameUnique(m_context, "string");
     m_context->symbolTable->insert(
         name,
         Type { ArrayType{
-            .element = std::make_shared<Type>(BasicType::Char),
+            .element = Type{ BasicType::Char }.interned(),
             .count = s.value.size()
         } },
         IdentifierAttributes{
@@ -414,9 +414,9 @@ ExpResult TACBuilder::operator()(const parser::BinaryExpression &b)
     if (b.op == BinaryOperator::And || b.op == BinaryOperator::Or) {
         Variant result = CreateTemporaryVariable(Type{ BasicType::Int });
         auto lhs_val = VisitAndConvert(*b.lhs);
-        auto label_true = MakeNameUnique("true_label");
-        auto label_false = MakeNameUnique("false_label");
-        auto label_end = MakeNameUnique("end_label");
+        auto label_true = MakeNameUnique(m_context, "true_label");
+        auto label_false = MakeNameUnique(m_context, "false_label");
+        auto label_end = MakeNameUnique(m_context, "end_label");
         if (b.op == BinaryOperator::And) {
             AddInstruction(JumpIfZero{lhs_val, label_false});
             auto rhs = VisitAndConvert(*b.rhs);
@@ -614,8 +614,8 @@ ExpResult TACBuilder::operator()(const parser::CompoundAssignmentExpression &c)
 
 ExpResult TACBuilder::operator()(const parser::ConditionalExpression &c)
 {
-    auto label_end = MakeNameUnique("end");
-    auto label_false_branch = MakeNameUnique("false_branch");
+    auto label_end = MakeNameUnique(m_context, "end");
+    auto label_false_branch = MakeNameUnique(m_context, "false_branch");
     Value result = c.type.isVoid() ? Variant{ "DUMMY" } : CreateTemporaryVariable(c.type);
 
     Value condition = VisitAndConvert(*c.condition);
@@ -658,7 +658,7 @@ ExpResult TACBuilder::operator()(const parser::AddressOfExpression &a)
     ExpResult inner = std::visit(*this, *a.expr);
     if (PlainOperand *plain = std::get_if<PlainOperand>(&inner)) {
         Variant dst = CreateTemporaryVariable(Type{
-            PointerType{ .referenced = std::make_shared<Type>(GetType(plain->val)) }
+            PointerType{ .referenced = GetType(plain->val).interned() }
         });
         AddInstruction(GetAddress{ plain->val, dst });
         return PlainOperand{ dst };
@@ -666,7 +666,7 @@ ExpResult TACBuilder::operator()(const parser::AddressOfExpression &a)
         return PlainOperand{ deref->ptr };
     else if (SubObject *sub = std::get_if<SubObject>(&inner)) {
         Variant base_ptr = CreateTemporaryVariable(a.type);
-        AddInstruction(GetAddress{ Variant{ sub->base_identifier }, base_ptr });
+        AddInstruction(GetAddress{ sub->base_identifier, base_ptr });
         if (sub->offset != 0) {
             AddInstruction(AddPtr{
                 .ptr = base_ptr,
@@ -690,7 +690,7 @@ ExpResult TACBuilder::operator()(const parser::SubscriptExpression &s)
     // Support both ptr[i] and i[ptr]
     Value pointer_operand = lhs_type.isPointer() ? lhs : rhs;
     Value integer_operand = lhs_type.isPointer() ? rhs : lhs;
-    std::shared_ptr<Type> element_type = std::make_shared<Type>(s.type);
+    const Type *element_type = s.type.interned();
 
     auto add_ptr = AddPtr{
         .ptr = pointer_operand,
@@ -731,11 +731,11 @@ ExpResult TACBuilder::operator()(const parser::DotExpression &d)
     if (PlainOperand *plain = std::get_if<PlainOperand>(&inner_object)) {
         Variant *var = std::get_if<Variant>(&plain->val);
         assert(var);
-        return SubObject{ var->name, member_offset };
+        return SubObject{ *var, member_offset };
     } else if (DereferencedPointer *deref = std::get_if<DereferencedPointer>(&inner_object)) {
         // TODO: If member_offset is 0, we don't need the AddPtr
         Variant dst_ptr = CreateTemporaryVariable(
-            Type{ PointerType{ .referenced = std::make_shared<Type>(d.type) } }
+            Type{ PointerType{ .referenced = d.type.interned() } }
         );
         AddInstruction(AddPtr{
             .ptr = deref->ptr,
@@ -761,7 +761,7 @@ ExpResult TACBuilder::operator()(const parser::ArrowExpression &a)
     size_t member_offset = aggr_entry->find(a.identifier)->offset;
     Value base_ptr = VisitAndConvert(*a.expr);
     Variant dst_ptr = CreateTemporaryVariable(
-        Type{ PointerType{ .referenced = std::make_shared<Type>(a.type) } }
+        Type{ PointerType{ .referenced = a.type.interned() } }
     );
     AddInstruction(AddPtr{
         .ptr = base_ptr,
@@ -783,9 +783,9 @@ ExpResult TACBuilder::operator()(const parser::ReturnStatement &r)
 ExpResult TACBuilder::operator()(const parser::IfStatement &i)
 {
     Value condition = VisitAndConvert(*i.condition);
-    auto label_end = MakeNameUnique("end");
+    auto label_end = MakeNameUnique(m_context, "end");
     if (i.falseBranch) {
-        auto label_else = MakeNameUnique("else");
+        auto label_else = MakeNameUnique(m_context, "else");
         AddInstruction(JumpIfZero{ condition, label_else });
         std::visit(*this, *i.trueBranch);
         AddInstruction(Jump{ label_end });
@@ -892,32 +892,115 @@ ExpResult TACBuilder::operator()(const parser::ForStatement &f)
     return std::monostate();
 }
 
+// Dispatching switch statements: a set of at least JumpTableMinCases cases
+// is dense enough for a jump table when it covers at least 1/JumpTableDensity
+// of its range. Bigger sparse sets are split by binary search until they are
+// dense or have at most LinearSearchMaxCases cases left to compare linearly.
+static constexpr size_t JumpTableMinCases = 4;
+static constexpr size_t JumpTableDensity = 4;
+static constexpr size_t LinearSearchMaxCases = 3;
+
+static Symbol caseLabel(const parser::SwitchStatement &s, const ConstantValue &c)
+{
+    return std::format("case_{}_{}", s.label, toLabel(c));
+}
+
+// Distance of two case values; b is not less than a
+static uint64_t caseDistance(const ConstantValue &a, const ConstantValue &b)
+{
+    // Two's complement subtraction gives the distance of signed values too
+    return castTo<uint64_t>(b) - castTo<uint64_t>(a);
+}
+
 ExpResult TACBuilder::operator()(const parser::SwitchStatement &s)
 {
     auto label_break = std::format("break_{}", s.label);
+    Symbol fallback = s.hasDefault ? std::format("default_{}", s.label) : label_break;
 
     Value condition = VisitAndConvert(*s.condition);
-    for (auto &c : s.cases) {
-        auto binary = Binary{};
-        binary.op = BinaryOperator::Subtract;
-        binary.src1 = condition;
-        binary.src2 = Constant { c };
-        binary.dst = CreateTemporaryVariable(s.type);
-        AddInstruction(binary);
-        AddInstruction(JumpIfZero{
-            binary.dst,
-            std::format("case_{}_{}", s.label, toLabel(c))
-        });
-    }
-    if (s.hasDefault)
-        AddInstruction(Jump{ std::format("default_{}", s.label) });
-    else
-        AddInstruction(Jump{ label_break });
+    std::vector<ConstantValue> cases(s.cases.begin(), s.cases.end());
+    EmitCaseDispatch(s, condition, cases, fallback);
     std::visit(*this, *s.body);
     AddInstruction(Label{ label_break });
     return std::monostate();
 }
 
+void TACBuilder::EmitCaseDispatch(
+    const parser::SwitchStatement &s,
+    const Value &condition,
+    std::span<const ConstantValue> cases,
+    Symbol fallback)
+{
+    if (cases.size() >= JumpTableMinCases
+        && caseDistance(cases.front(), cases.back()) / JumpTableDensity < cases.size()) {
+        EmitJumpTable(s, condition, cases, fallback);
+        return;
+    }
+
+    if (cases.size() <= LinearSearchMaxCases) {
+        for (auto &c : cases) {
+            auto binary = Binary{};
+            binary.op = BinaryOperator::Subtract;
+            binary.src1 = condition;
+            binary.src2 = Constant { c };
+            binary.dst = CreateTemporaryVariable(s.type);
+            AddInstruction(binary);
+            AddInstruction(JumpIfZero{ binary.dst, caseLabel(s, c) });
+        }
+        AddInstruction(Jump{ fallback });
+        return;
+    }
+
+    size_t middle = cases.size() / 2;
+    auto label_upper = MakeNameUnique(m_context, "switch_upper");
+    Variant is_upper = CreateTemporaryVariable(Type{ BasicType::Int });
+    AddInstruction(Binary{
+        BinaryOperator::GreaterOrEqual,
+        condition,
+        Constant{ cases[middle] },
+        is_upper
+    });
+    AddInstruction(JumpIfNotZero{ is_upper, label_upper });
+    EmitCaseDispatch(s, condition, cases.first(middle), fallback);
+    AddInstruction(Label{ label_upper });
+    EmitCaseDispatch(s, condition, cases.subspan(middle), fallback);
+}
+
+void TACBuilder::EmitJumpTable(
+    const parser::SwitchStatement &s,
+    const Value &condition,
+    std::span<const ConstantValue> cases,
+    Symbol fallback)
+{
+    // The offset from the first case is unsigned, so the values below
+    // the range are above it after the subtraction: one check covers both
+    bool is_long = s.type.isBasic(BasicType::Long) || s.type.isBasic(BasicType::ULong);
+    Type index_type = Type{ is_long ? BasicType::ULong : BasicType::UInt };
+    Variant value = CastValue(m_instructions, condition, s.type, index_type);
+    Variant index = CreateTemporaryVariable(index_type);
+    AddInstruction(Binary{
+        BinaryOperator::Subtract,
+        value,
+        Constant{ ConvertValue(cases.front(), index_type) },
+        index
+    });
+
+    uint64_t last = caseDistance(cases.front(), cases.back());
+    Variant out_of_range = CreateTemporaryVariable(Type{ BasicType::Int });
+    AddInstruction(Binary{
+        BinaryOperator::GreaterThan,
+        index,
+        Constant{ ConvertValue(ConstantValue(last), index_type) },
+        out_of_range
+    });
+    AddInstruction(JumpIfNotZero{ out_of_range, fallback });
+
+    std::vector<Symbol> targets(last + 1, fallback);
+    for (auto &c : cases)
+        targets[caseDistance(cases.front(), c)] = caseLabel(s, c);
+    AddInstruction(JumpTable{ index, std::move(targets) });
+}
+
 ExpResult TACBuilder::operator()(const parser::CaseStatement &c)
 {
     AddInstruction(Label{ c.label });
@@ -945,7 +1028,7 @@ ExpResult TACBuilder::operator()(const parser::FunctionDeclaration &f)
     func.name = f.name;
     // Nothing to do here with parameters. They already have unique names
     // after semantic analysis and they will be pseudo-registers in ASM.
-    func.params = f.params;
+    func.params.assign(f.params.begin(), f.params.end());
 
     if (auto body = std::get_if<parser::BlockStatement>(f.body.get())) {
         TACBuilder builder(m_context);
@@ -987,9 +1070,9 @@ ExpResult TACBuilder::operator()(const parser::VariableDeclaration &v)
     // a single initializer; and use CopyToOffset for all subobjects.
     size_t offset = 0;
     if (entry->type.isScalar() || (entry->type.isAggregate() && std::holds_alternative<parser::SingleInit>(*v.init)))
-        EmitRuntimeInitTopLevel(v.init.get(), v.identifier, entry->type);
+        EmitRuntimeInitTopLevel(v.init.get(), Variant{ v.identifier }, entry->type);
     else
-        EmitRuntimeInitNested(v.init.get(), v.identifier, entry->type, offset);
+        EmitRuntimeInitNested(v.init.get(), Variant{ v.identifier }, entry->type, offset);
     return std::monostate();
 }
 
@@ -1035,9 +1118,10 @@ void TACBuilder::ConvertTopLevel(
 
 void TACBuilder::ConvertFunctionBlock(
     const std::vector<parser::BlockItem> &list,
-    std::list<CFGBlock> &block_list_out)
+    CFG &block_list_out)
 {
     m_blocks = &block_list_out;
+    m_instructions = block_list_out.newList();
     for (auto &i : list)
         std::visit(*this, i);
     FinalizeControlFlowBlocks();
@@ -1045,7 +1129,8 @@ void TACBuilder::ConvertFunctionBlock(
 
 void TACBuilder::ProcessStaticSymbols()
 {
-    for (const auto &[name, entry] : m_context->symbolTable->m_table) {
+    for (const auto &[name, entry_ptr] : m_context->symbolTable->sortedEntries()) {
+        const SymbolEntry &entry = *entry_ptr;
         if (entry.attrs.type == IdentifierAttributes::Static) {
             if (std::holds_alternative<Tentative>(entry.attrs.init)) {
                 std::vector<ConstantValue> initializer;
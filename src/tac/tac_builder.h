@@ -4,6 +4,7 @@
 #include "tac_nodes.h"
 #include <list>
 #include <map>
+#include <span>
 
 class Context;
 
@@ -16,7 +17,7 @@ struct DereferencedPointer {
     Value ptr;
 };
 struct SubObject {
-    std::string base_identifier;
+    Variant base_identifier;
     size_t offset;
 };
 using ExpResult = std::variant<PlainOperand, DereferencedPointer, SubObject, std::monostate>;
@@ -69,12 +70,12 @@ public:
         std::list<tac::TopLevel> &top_level_out);
     void ConvertFunctionBlock(
         const std::vector<parser::BlockItem> &list,
-        std::list<CFGBlock> &block_list_out);
+        CFG &block_list_out);
 
 private:
     Variant CreateTemporaryVariable(const Type &type);
     Variant CastValue(
-        std::list<Instruction> &i,
+        InstructionList &i,
         const Value &result,
         const Type &from_type,
         const Type &to_type);
@@ -89,7 +90,7 @@ private:
             return plain->val;
         else if (DereferencedPointer *deref = std::get_if<DereferencedPointer>(&result)) {
             Type type = GetType(deref->ptr);
-            PointerType *ptr_type = type.getAs<PointerType>();
+            const PointerType *ptr_type = type.getAs<PointerType>();
             assert(ptr_type);
             Variant dst = CreateTemporaryVariable(ptr_type->referenced->storedType());
             AddInstruction(Load{ deref->ptr, dst });
@@ -108,17 +109,29 @@ private:
     }
 
     std::pair<ExpResult, Type> VisitLHS(const parser::Expression &expr);
-    void EmitZeroBytes(const std::string &base, size_t &offset, size_t size);
-    void EmitZeroInit(const Type &type, const std::string &base, size_t &offset);
+    // Jumps to the case of the switch matching the condition, or to the
+    // fallback label; the cases are sorted
+    void EmitCaseDispatch(
+        const parser::SwitchStatement &s,
+        const Value &condition,
+        std::span<const ConstantValue> cases,
+        Symbol fallback);
+    void EmitJumpTable(
+        const parser::SwitchStatement &s,
+        const Value &condition,
+        std::span<const ConstantValue> cases,
+        Symbol fallback);
+    void EmitZeroBytes(const Variant &base, size_t &offset, size_t size);
+    void EmitZeroInit(const Type &type, const Variant &base, size_t &offset);
     void EmitRuntimeInitNested(
         const parser::Initializer *init,
-        const std::string &base,
+        const Variant &base,
         const Type &type,
         size_t &offset
     );
     void EmitRuntimeInitTopLevel(
         const parser::Initializer *init,
-        const std::string &base,
+        const Variant &base,
         const Type &type
     );
 
@@ -126,9 +139,9 @@ private:
     std::list<TopLevel> *m_topLevel;
     // Building blocks for a Control Flow Graph
     size_t m_nextBlockId = 1;
-    std::list<CFGBlock> *m_blocks;
+    CFG *m_blocks;
     // Storing the instructions of the currently built CFGBlock
-    std::list<Instruction> m_instructions;
+    InstructionList m_instructions;
 
     // Add instruction to the currently built CFGBlock
     template <typename T>
@@ -142,6 +155,7 @@ private:
         } else if constexpr (std::same_as<U, Jump>
             || std::same_as<U, JumpIfZero>
             || std::same_as<U, JumpIfNotZero>
+            || std::same_as<U, JumpTable>
             || std::same_as<U, Return>) {
             m_instructions.emplace_back(std::forward<T>(instruction));
             CommitBlock();
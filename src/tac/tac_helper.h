@@ -34,6 +34,8 @@ static void ForEachValue(const Instruction &instr, Fn &&fn)
             fn(i.condition);
         } else if constexpr (std::is_same_v<T, JumpIfNotZero>) {
             fn(i.condition);
+        } else if constexpr (std::is_same_v<T, JumpTable>) {
+            fn(i.index);
         } else if constexpr (std::is_same_v<T, Label>) {
         } else if constexpr (std::is_same_v<T, FunctionCall>) {
             for (const auto &arg : i.args)
@@ -67,12 +69,128 @@ static void ForEachValue(const Instruction &instr, Fn &&fn)
             fn(i.dst);
         } else if constexpr (std::is_same_v<T, CopyToOffset>) {
             fn(i.src);
-            fn(Variant{ i.dst_identifier });
+            fn(Value{ i.dst_identifier });
         } else if constexpr (std::is_same_v<T, CopyFromOffset>) {
-            fn(Variant{ i.src_identifier });
+            fn(Value{ i.src_identifier });
+            fn(i.dst);
+        } else if constexpr (std::is_same_v<T, Phi>) {
+            for (const auto &arg : i.args)
+                fn(arg.value);
             fn(i.dst);
         }
     }, instr);
 }
 
+// Calls fn with a reference to every variable operand of the instruction
+template <typename Fn>
+static void ForEachVariant(Instruction &instr, Fn &&fn)
+{
+    auto visit = [&](Value &v) {
+        if (Variant *var = std::get_if<Variant>(&v))
+            fn(*var);
+    };
+    std::visit([&](auto &i) {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, Return>) {
+            if (i.val)
+                visit(*i.val);
+        } else if constexpr (std::is_same_v<T, Binary>) {
+            visit(i.src1);
+            visit(i.src2);
+            visit(i.dst);
+        } else if constexpr (std::is_same_v<T, Load>) {
+            visit(i.src_ptr);
+            visit(i.dst);
+        } else if constexpr (std::is_same_v<T, Store>) {
+            visit(i.src);
+            visit(i.dst_ptr);
+        } else if constexpr (std::is_same_v<T, JumpIfZero> || std::is_same_v<T, JumpIfNotZero>) {
+            visit(i.condition);
+        } else if constexpr (std::is_same_v<T, JumpTable>) {
+            visit(i.index);
+        } else if constexpr (std::is_same_v<T, FunctionCall>) {
+            for (auto &arg : i.args)
+                visit(arg);
+            if (i.dst)
+                visit(*i.dst);
+        } else if constexpr (std::is_same_v<T, AddPtr>) {
+            visit(i.ptr);
+            visit(i.index);
+            visit(i.dst);
+        } else if constexpr (std::is_same_v<T, CopyToOffset>) {
+            visit(i.src);
+            fn(i.dst_identifier);
+        } else if constexpr (std::is_same_v<T, CopyFromOffset>) {
+            fn(i.src_identifier);
+            visit(i.dst);
+        } else if constexpr (std::is_same_v<T, Phi>) {
+            for (auto &arg : i.args)
+                visit(arg.value);
+            visit(i.dst);
+        } else if constexpr (requires { i.src; i.dst; }) {
+            // Unary, Copy, GetAddress and the conversions
+            visit(i.src);
+            visit(i.dst);
+        }
+    }, instr);
+}
+
+// Calls fn with a reference to every value read by the instruction.
+// The aggregate operands of CopyToOffset and CopyFromOffset are not values.
+template <typename Instr, typename Fn>
+static void ForEachUse(Instr &instr, Fn &&fn)
+{
+    std::visit([&](auto &i) {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, Return>) {
+            if (i.val)
+                fn(*i.val);
+        } else if constexpr (std::is_same_v<T, Binary>) {
+            fn(i.src1);
+            fn(i.src2);
+        } else if constexpr (std::is_same_v<T, Load>)
+            fn(i.src_ptr);
+        else if constexpr (std::is_same_v<T, Store>) {
+            fn(i.src);
+            fn(i.dst_ptr);
+        } else if constexpr (std::is_same_v<T, JumpIfZero> || std::is_same_v<T, JumpIfNotZero>)
+            fn(i.condition);
+        else if constexpr (std::is_same_v<T, JumpTable>)
+            fn(i.index);
+        else if constexpr (std::is_same_v<T, FunctionCall>) {
+            for (auto &arg : i.args)
+                fn(arg);
+        } else if constexpr (std::is_same_v<T, AddPtr>) {
+            fn(i.ptr);
+            fn(i.index);
+        } else if constexpr (std::is_same_v<T, Phi>) {
+            for (auto &arg : i.args)
+                fn(arg.value);
+        } else if constexpr (requires { i.src; }) {
+            // Unary, Copy, GetAddress, CopyToOffset and the conversions
+            fn(i.src);
+        }
+    }, instr);
+}
+
+// The value written by the instruction, if there is one. CopyToOffset
+// writes only a part of its aggregate, it doesn't count as a definition.
+static inline Value *GetDestination(Instruction &instr)
+{
+    return std::visit([](auto &i) -> Value * {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, FunctionCall>)
+            return i.dst ? &*i.dst : nullptr;
+        else if constexpr (requires { i.dst; })
+            return &i.dst;
+        else
+            return nullptr;
+    }, instr);
+}
+
+static inline const Value *GetDestination(const Instruction &instr)
+{
+    return GetDestination(const_cast<Instruction &>(instr));
+}
+
 } // namespace tac
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "common/cfg.h"
 #include "common/macro.h"
 #include "common/operator.h"
+#include "common/symbol.h"
 #include "common/types.h"
 #include "common/values.h"
 #include <cassert>
@@ -11,11 +13,18 @@
 
 namespace tac {
 
+// Variants are numbered densely per function before optimizing it
+// (virtual register ids), so the data-flow passes can index flat arrays and
+// bit sets with them. The name identifies them in the symbol table.
+// Until then their id is NoVariantId.
+static constexpr uint32_t NoVariantId = UINT32_MAX;
+
 #define TAC_VALUE_TYPE_LIST(X) \
     X(Constant, \
         ConstantValue value;) \
     X(Variant, \
-        std::string name;)
+        Symbol name; \
+        uint32_t id = NoVariantId;)
 
 #define TAC_INSTRUCTION_LIST(X) \
     X(Return, \
@@ -42,17 +51,20 @@ namespace tac {
         Value src; \
         Value dst_ptr;) \
     X(Jump, \
-        std::string target;) \
+        Symbol target;) \
     X(JumpIfZero, \
         Value condition; \
-        std::string target;) \
+        Symbol target;) \
     X(JumpIfNotZero, \
         Value condition; \
-        std::string target;) \
+        Symbol target;) \
+    X(JumpTable, \
+        Value index; \
+        std::vector<Symbol> targets;) \
     X(Label, \
-        std::string identifier;) \
+        Symbol identifier;) \
     X(FunctionCall, \
-        std::string identifier; \
+        Symbol identifier; \
         std::vector<Value> args; \
         std::optional<Value> dst;) \
     X(SignExtend, \
@@ -83,51 +95,61 @@ namespace tac {
         Value dst;) \
     X(CopyToOffset, \
         Value src; \
-        std::string dst_identifier; \
+        Variant dst_identifier; \
         size_t offset;) \
     X(CopyFromOffset, \
-        std::string src_identifier; \
+        Variant src_identifier; \
         size_t offset; \
+        Value dst;) \
+    X(Phi, \
+        std::vector<PhiArgument> args; \
         Value dst;)
 
 #define TAC_TOP_LEVEL_LIST(X) \
     X(FunctionDefinition, \
-        std::string name; \
+        Symbol name; \
         bool global; \
-        std::vector<std::string> params; \
-        std::list<CFGBlock> blocks;) \
+        std::vector<Symbol> params; \
+        CFG blocks; \
+        std::vector<Symbol> variables;) \
     X(StaticVariable, \
-        std::string name; \
+        Symbol name; \
         Type type = Type{}; \
         bool global; \
         std::vector<ConstantValue> list;) \
     X(StaticConstant, \
-        std::string name; \
+        Symbol name; \
         Type type; \
         ConstantValue static_init;)
 
-class CFGBlock;
-
 DEFINE_NODES_WITH_COMMON_VARIANT(Value, TAC_VALUE_TYPE_LIST);
-DEFINE_NODES_WITH_COMMON_VARIANT(Instruction, TAC_INSTRUCTION_LIST);
-DEFINE_NODES_WITH_COMMON_VARIANT(TopLevel, TAC_TOP_LEVEL_LIST);
 
-class CFGBlock {
-public:
-    std::list<Instruction> instructions = {};
-    std::set<CFGBlock *> predecessors = {};
-    std::set<CFGBlock *> successors = {};
-    size_t id;
+// Only in SSA form: the value of a Phi when control comes from the block
+// with the given id
+struct PhiArgument {
+    size_t block;
+    Value value;
 };
+DEFINE_NODES_WITH_COMMON_VARIANT(Instruction, TAC_INSTRUCTION_LIST);
+
+using InstructionList = PooledList<Instruction>;
+using CFGBlock = BasicBlock<Instruction>;
+using CFG = ControlFlowGraph<Instruction>;
+
+DEFINE_NODES_WITH_COMMON_VARIANT(TopLevel, TAC_TOP_LEVEL_LIST);
 
 inline bool operator==(const Constant &a, const Constant &b)
 {
     return a.value == b.value;
 }
 
+// By id, like the ordering below: in SSA form the versions of a variable
+// share its name. Variants which aren't numbered yet are compared by name.
 inline bool operator==(const Variant &a, const Variant &b)
 {
-    return a.name == b.name;
+    if (a.id == NoVariantId || b.id == NoVariantId)
+        return a.name == b.name;
+    return a.id == b.id;
 }
 
 inline bool operator<(const Value &a, const Value &b)
@@ -136,8 +158,12 @@ inline bool operator<(const Value &a, const Value &b)
         return a.index() < b.index();
     if (const Constant *ca = std::get_if<Constant>(&a))
         return ca->value < std::get<Constant>(b).value;
-    if (const Variant *va = std::get_if<Variant>(&a))
-        return va->name < std::get<Variant>(b).name;
+    if (const Variant *va = std::get_if<Variant>(&a)) {
+        const Variant &vb = std::get<Variant>(b);
+        // Only ordered while the variables are numbered
+        assert(va->id != NoVariantId && vb.id != NoVariantId);
+        return va->id < vb.id;
+    }
     return false;
 }
 
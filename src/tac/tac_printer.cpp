@@ -113,6 +113,18 @@ void TACPrinter::operator()(const tac::JumpIfNotZero &j)
     pad(); std::cout << ")" << std::endl;
 }
 
+void TACPrinter::operator()(const tac::JumpTable &j)
+{
+    pad(); std::cout << "JumpTable(" << std::endl;
+    tab();
+    std::visit(*this, j.index);
+    for (size_t i = 0; i < j.targets.size(); ++i) {
+        pad(); std::cout << i << ": " << j.targets[i] << std::endl;
+    }
+    shift_tab();
+    pad(); std::cout << ")" << std::endl;
+}
+
 void TACPrinter::operator()(const tac::Label &j)
 {
     pad(); std::cout << "Label(" << j.identifier << ")" << std::endl;
@@ -216,7 +228,7 @@ void TACPrinter::operator()(const tac::CopyToOffset &c)
     pad(); std::cout << "CopyToOffset(" << std::endl;
     tab();
     std::visit(*this, c.src);
-    pad(); std::cout << "dst_identifier = " << c.dst_identifier << std::endl;
+    pad(); std::cout << "dst_identifier = " << c.dst_identifier.name << std::endl;
     pad(); std::cout << "offset = " << c.offset << std::endl;
     shift_tab();
     pad(); std::cout << ")" << std::endl;
@@ -226,13 +238,26 @@ void TACPrinter::operator()(const tac::CopyFromOffset &c)
 {
     pad(); std::cout << "CopyFromOffset(" << std::endl;
     tab();
-    pad(); std::cout << "src_identifier = " << c.src_identifier << std::endl;
+    pad(); std::cout << "src_identifier = " << c.src_identifier.name << std::endl;
     pad(); std::cout << "offset = " << c.offset << std::endl;
     std::visit(*this, c.dst);
     shift_tab();
     pad(); std::cout << ")" << std::endl;
 }
 
+void TACPrinter::operator()(const tac::Phi &p)
+{
+    pad(); std::cout << "Phi(" << std::endl;
+    tab();
+    for (auto &arg : p.args) {
+        pad(); std::cout << "block " << arg.block << ":" << std::endl;
+        std::visit(*this, arg.value);
+    }
+    std::visit(*this, p.dst);
+    shift_tab();
+    pad(); std::cout << ")" << std::endl;
+}
+
 void TACPrinter::operator()(const tac::FunctionDefinition &)
 {
     assert(false);
@@ -274,7 +299,7 @@ void TACPrinter::PrintFunction(const FunctionDefinition &f)
         if (m_printBlocks) {
             std::cout << "-" << block.id <<  "-----------------prev: ";
             for (auto &pred : block.predecessors)
-                std::cout << pred->id << " ";
+                std::cout << f.blocks[pred].id << " ";
             std::cout << std::endl;
             tab();
         }
@@ -284,7 +309,7 @@ void TACPrinter::PrintFunction(const FunctionDefinition &f)
             shift_tab();
             std::cout << "--------------------next: ";
             for (auto &successor : block.successors)
-                std::cout << successor->id << " ";
+                std::cout << f.blocks[successor].id << " ";
             std::cout << std::endl;
         }
     }
@@ -21,6 +21,7 @@ struct TACPrinter : public ITACVisitor<void> {
     void operator()(const tac::Jump &j) override;
     void operator()(const tac::JumpIfZero &j) override;
     void operator()(const tac::JumpIfNotZero &j) override;
+    void operator()(const tac::JumpTable &j) override;
     void operator()(const tac::Label &j) override;
     void operator()(const tac::FunctionCall &f) override;
     void operator()(const tac::SignExtend &s) override;
@@ -33,6 +34,7 @@ struct TACPrinter : public ITACVisitor<void> {
     void operator()(const tac::AddPtr &a) override;
     void operator()(const tac::CopyToOffset &c) override;
     void operator()(const tac::CopyFromOffset &c) override;
+    void operator()(const tac::Phi &p) override;
     void operator()(const tac::FunctionDefinition &f) override;
     void operator()(const tac::StaticVariable &s) override;
     void operator()(const tac::StaticConstant &s) override;
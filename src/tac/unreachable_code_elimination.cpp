@@ -1,91 +1,111 @@
+#include "pass_manager.h"
 #include "tac_nodes.h"
-#include <algorithm>
 
 namespace tac {
 
-static void visitBlocks(CFGBlock *current_block, std::set<CFGBlock *> &visited_blocks)
+static std::vector<bool> visitBlocks(const CFG &blocks)
 {
-    if (visited_blocks.contains(current_block))
-        return;
-    visited_blocks.insert(current_block);
-    for (auto &block : current_block->successors)
-        visitBlocks(block, visited_blocks);
+    std::vector<bool> visited(blocks.size(), false);
+    visited[blocks.size() - 1] = true;
+    std::vector<uint32_t> stack = { 0 };
+    visited[0] = true;
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        for (uint32_t succ : blocks[index].successors) {
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back(succ);
+            }
+        }
+    }
+    return visited;
 }
 
-static std::list<CFGBlock>::iterator removeBlock(
-    std::list<CFGBlock> &blocks,
-    std::list<CFGBlock>::iterator it)
+// Disconnects the block, linking its predecessors to its successors
+static void bypassBlock(CFG &blocks, size_t index)
 {
-    CFGBlock *block = &*it;
-    for (CFGBlock *pred : block->predecessors) {
-        pred->successors.erase(block);
-        for (CFGBlock *succ : block->successors) {
-            if (std::find(pred->successors.begin(), pred->successors.end(), succ) == pred->successors.end()) {
-                pred->successors.insert(succ);
-                succ->predecessors.insert(pred);
-            }
+    // Copies, the edges change in the loops
+    EdgeList predecessors = blocks[index].predecessors;
+    EdgeList successors = blocks[index].successors;
+    for (uint32_t pred : predecessors)
+        blocks.disconnect(pred, index);
+    for (uint32_t succ : successors)
+        blocks.disconnect(index, succ);
+    for (uint32_t pred : predecessors) {
+        for (uint32_t succ : successors) {
+            if (pred != index && succ != index)
+                blocks.connect(pred, succ);
         }
     }
-    for (CFGBlock *succ : block->successors)
-        succ->predecessors.erase(block);
-    return blocks.erase(it);
 }
 
-void unreachableCodeElimination(std::list<CFGBlock> &blocks, bool &changed)
+void unreachableCodeElimination(CFG &blocks, Changes &changes)
 {
-    std::set<CFGBlock *> visited_blocks;
-    visited_blocks.insert(&blocks.back());
-    visitBlocks(&blocks.front(), visited_blocks);
-    for (auto it = blocks.begin(); it != blocks.end();) {
-        // Removing unreachable blocks
-        if (!visited_blocks.contains(&*it)) {
-            it = removeBlock(blocks, it);
-            changed = true;
-            continue;
-        } else
-            ++it;
+    // Removing unreachable blocks
+    std::vector<bool> reachable = visitBlocks(blocks);
+    std::vector<bool> removed(blocks.size(), false);
+    bool any_removed = false;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (!reachable[i]) {
+            bypassBlock(blocks, i);
+            removed[i] = true;
+            any_removed = true;
+            // It could have taken the last GetAddress of a variable
+            changes.MarkControlFlow();
+            changes.MarkVariables();
+        }
     }
+    if (any_removed)
+        blocks.removeBlocks(removed);
 
-    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-        if (it == blocks.begin() || it == std::prev(blocks.end()))
+    for (size_t i = 1; i + 1 < blocks.size(); ++i) {
+        CFGBlock &block = blocks[i];
+        if (block.instructions.empty())
             continue;
 
         // Removing useless jumps
-        Instruction &last_instruction = it->instructions.back();
+        Instruction &last_instruction = block.instructions.back();
         if (std::holds_alternative<Jump>(last_instruction)
             || std::holds_alternative<JumpIfZero>(last_instruction)
-            || std::holds_alternative<JumpIfNotZero>(last_instruction)) {
-            CFGBlock *default_successor = &*std::next(it);
-            if (it->successors.size() == 1 && *it->successors.begin() == default_successor) {
-                it->instructions.pop_back();
-                changed = true;
+            || std::holds_alternative<JumpIfNotZero>(last_instruction)
+            || std::holds_alternative<JumpTable>(last_instruction)) {
+            if (block.successors.size() == 1 && block.successors.front() == i + 1) {
+                block.instructions.pop_back();
+                changes.MarkBlock(block);
             }
         }
+        if (block.instructions.empty())
+            continue;
 
         // Removing useless labels
-        Instruction &first_instruction = it->instructions.front();
+        Instruction &first_instruction = block.instructions.front();
         if (std::holds_alternative<Label>(first_instruction)) {
-            CFGBlock *default_predecessor = &*std::prev(it);
-            if (it->predecessors.size() == 1 && *it->predecessors.begin() == default_predecessor) {
-                it->instructions.pop_front();
-                changed = true;
+            // A jump table can still refer to the next block
+            const CFGBlock &pred = blocks[i - 1];
+            bool jump_table = !pred.instructions.empty()
+                && std::holds_alternative<JumpTable>(pred.instructions.back());
+            if (block.predecessors.size() == 1 && block.predecessors.front() == i - 1
+                && !jump_table) {
+                block.instructions.pop_front();
+                changes.MarkBlock(block);
             }
         }
     }
 
     // Removing empty blocks
-    for (auto it = blocks.begin(); it != blocks.end();) {
-        if (it == blocks.begin() || it == std::prev(blocks.end())) {
-            ++it;
-            continue;
+    removed.assign(blocks.size(), false);
+    any_removed = false;
+    for (size_t i = 1; i + 1 < blocks.size(); ++i) {
+        if (blocks[i].instructions.empty()) {
+            bypassBlock(blocks, i);
+            removed[i] = true;
+            any_removed = true;
+            changes.MarkControlFlow();
         }
-        if (it->instructions.empty()) {
-            it = removeBlock(blocks, it);
-            changed = true;
-            continue;
-        } else
-            ++it;
     }
+    if (any_removed)
+        blocks.removeBlocks(removed);
 }
 
 } // namespace tac
@@ -0,0 +1,275 @@
+#include "common/context.h"
+#include "ssa.h"
+#include "tac_helper.h"
+#include <map>
+
+namespace tac {
+
+static bool isCommutative(BinaryOperator op)
+{
+    return op == BinaryOperator::Add
+        || op == BinaryOperator::Multiply
+        || op == BinaryOperator::Equal
+        || op == BinaryOperator::NotEqual
+        || op == BinaryOperator::BitwiseAnd
+        || op == BinaryOperator::BitwiseXor
+        || op == BinaryOperator::BitwiseOr;
+}
+
+namespace {
+
+// A computation: the kind of the instruction, its operator and operands
+// (by their value numbers), and the type of its result. Computations
+// reading memory or variables which are not versions hold only until the
+// next write, they carry the generation of memory they read.
+struct Expression {
+    size_t kind;
+    int op = 0;
+    Value src1;
+    Value src2;
+    size_t extra = 0;
+    const Type *type = nullptr;
+    size_t generation = 0;
+
+    bool operator<(const Expression &other) const
+    {
+        if (kind != other.kind)
+            return kind < other.kind;
+        if (op != other.op)
+            return op < other.op;
+        if (src1 < other.src1 || other.src1 < src1)
+            return src1 < other.src1;
+        if (src2 < other.src2 || other.src2 < src2)
+            return src2 < other.src2;
+        if (extra != other.extra)
+            return extra < other.extra;
+        if (type != other.type)
+            return type < other.type;
+        return generation < other.generation;
+    }
+};
+
+class ValueNumbering {
+public:
+    ValueNumbering(
+        CFG &blocks,
+        const std::vector<Symbol> &variables,
+        const SSAVariables &ssa,
+        const DominatorTree &dominators,
+        Context *context);
+
+    void Run();
+
+private:
+    void VisitBlock(uint32_t index);
+    // The value number of an operand: the version it was copied from,
+    // or itself
+    Value Number(const Value &value) const;
+    std::optional<Expression> MakeExpression(const Instruction &instr);
+
+    CFG &m_blocks;
+    const std::vector<Symbol> &m_variables;
+    const SSAVariables &m_ssa;
+    const DominatorTree &m_dominators;
+    Context *m_context;
+
+    // By variable id
+    std::vector<std::optional<Value>> m_numbers;
+    // The computations available in the current block, with the version
+    // holding their result; scoped by the dominator tree
+    std::map<Expression, Variant> m_available;
+    std::vector<Expression> m_scope;
+    // Stores, calls and writes to variables which are not versions start a
+    // new generation of memory; a block continues the generation of its
+    // immediate dominator only if that is its single predecessor
+    std::vector<size_t> m_generationAtEnd;
+    size_t m_generation = 0;
+    size_t m_lastGeneration = 0;
+    bool m_readsMemory = false;
+};
+
+ValueNumbering::ValueNumbering(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    const DominatorTree &dominators,
+    Context *context)
+    : m_blocks(blocks)
+    , m_variables(variables)
+    , m_ssa(ssa)
+    , m_dominators(dominators)
+    , m_context(context)
+    , m_numbers(variables.size())
+    , m_generationAtEnd(blocks.size(), 0)
+{
+}
+
+Value ValueNumbering::Number(const Value &value) const
+{
+    const Variant *var = std::get_if<Variant>(&value);
+    if (var && m_numbers[var->id])
+        return *m_numbers[var->id];
+    return value;
+}
+
+std::optional<Expression> ValueNumbering::MakeExpression(const Instruction &instr)
+{
+    m_readsMemory = false;
+    auto number = [&](const Value &value) {
+        if (const Variant *var = std::get_if<Variant>(&value)) {
+            if (!m_ssa.IsVersion(*var))
+                m_readsMemory = true;
+        }
+        return Number(value);
+    };
+    const Value *dst = GetDestination(instr);
+    const Variant *dst_var = dst ? std::get_if<Variant>(dst) : nullptr;
+    if (!dst_var)
+        return std::nullopt;
+    Expression ret{ .kind = instr.index(), .src1 = {}, .src2 = {} };
+    ret.type = m_context->symbolTable->getType(m_variables[dst_var->id]).interned();
+
+    bool ok = std::visit([&](const auto &i) -> bool {
+        using T = std::decay_t<decltype(i)>;
+        if constexpr (std::is_same_v<T, Binary>) {
+            ret.op = static_cast<int>(i.op);
+            ret.src1 = number(i.src1);
+            ret.src2 = number(i.src2);
+            if (isCommutative(i.op) && ret.src2 < ret.src1)
+                std::swap(ret.src1, ret.src2);
+            return true;
+        } else if constexpr (std::is_same_v<T, Unary>) {
+            ret.op = static_cast<int>(i.op);
+            ret.src1 = number(i.src);
+            return true;
+        } else if constexpr (std::is_same_v<T, GetAddress>) {
+            // The address of a variable doesn't change
+            ret.src1 = i.src;
+            return true;
+        } else if constexpr (std::is_same_v<T, Load>) {
+            m_readsMemory = true;
+            ret.src1 = number(i.src_ptr);
+            return true;
+        } else if constexpr (std::is_same_v<T, AddPtr>) {
+            ret.src1 = number(i.ptr);
+            ret.src2 = number(i.index);
+            ret.extra = i.scale;
+            return true;
+        } else if constexpr (std::is_same_v<T, CopyFromOffset>) {
+            m_readsMemory = true;
+            ret.src1 = Value{ i.src_identifier };
+            ret.extra = i.offset;
+            return true;
+        } else if constexpr (std::is_same_v<T, SignExtend>
+            || std::is_same_v<T, Truncate>
+            || std::is_same_v<T, ZeroExtend>
+            || std::is_same_v<T, DoubleToInt>
+            || std::is_same_v<T, DoubleToUInt>
+            || std::is_same_v<T, IntToDouble>
+            || std::is_same_v<T, UIntToDouble>) {
+            ret.src1 = number(i.src);
+            return true;
+        } else
+            return false;
+    }, instr);
+    if (!ok)
+        return std::nullopt;
+    if (m_readsMemory)
+        ret.generation = m_generation;
+    return ret;
+}
+
+void ValueNumbering::VisitBlock(uint32_t index)
+{
+    CFGBlock &block = m_blocks[index];
+    uint32_t idom = m_dominators.Idom(index);
+    if (idom != NoNode && block.predecessors.size() == 1 && *block.predecessors.begin() == idom)
+        m_generation = m_generationAtEnd[idom];
+    else
+        m_generation = ++m_lastGeneration;
+
+    for (auto &instr : block.instructions) {
+        std::optional<Expression> expression = MakeExpression(instr);
+        const Value *dst = GetDestination(instr);
+        const Variant *dst_var = dst ? std::get_if<Variant>(dst) : nullptr;
+        bool version = dst_var && m_ssa.IsVersion(*dst_var);
+
+        if (expression) {
+            auto it = m_available.find(*expression);
+            if (it != m_available.end()) {
+                // Computed before on every path to here
+                if (version)
+                    m_numbers[dst_var->id] = it->second;
+                instr = Copy{ it->second, *dst };
+            } else if (version) {
+                m_available.emplace(*expression, *dst_var);
+                m_scope.push_back(*expression);
+            }
+        } else if (const Copy *copy = std::get_if<Copy>(&instr); copy && version) {
+            // The versions copied from each other have the same value
+            const Variant *src = std::get_if<Variant>(&copy->src);
+            if (src && m_ssa.IsVersion(*src)
+                && m_context->symbolTable->getType(m_variables[src->id])
+                    == m_context->symbolTable->getType(m_variables[dst_var->id]))
+                m_numbers[dst_var->id] = Number(copy->src);
+        }
+
+        if (std::holds_alternative<Store>(instr)
+            || std::holds_alternative<FunctionCall>(instr)
+            || std::holds_alternative<CopyToOffset>(instr)
+            || (dst_var && !version))
+            m_generation = ++m_lastGeneration;
+    }
+    m_generationAtEnd[index] = m_generation;
+}
+
+void ValueNumbering::Run()
+{
+    // Walking the dominator tree; the computations of a block are
+    // available in the blocks it dominates
+    struct Frame {
+        uint32_t block;
+        size_t child;
+        size_t scope;
+    };
+    std::vector<Frame> stack;
+    VisitBlock(0);
+    stack.push_back(Frame{ 0, 0, 0 });
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        const std::vector<uint32_t> &children = m_dominators.Children(frame.block);
+        if (frame.child == children.size()) {
+            while (m_scope.size() > frame.scope) {
+                m_available.erase(m_scope.back());
+                m_scope.pop_back();
+            }
+            stack.pop_back();
+            continue;
+        }
+        uint32_t child = children[frame.child++];
+        size_t scope = m_scope.size();
+        VisitBlock(child);
+        stack.push_back(Frame{ child, 0, scope });
+    }
+}
+
+} // namespace
+
+// Dominator-based global value numbering in SSA form: a computation whose
+// operands have the same value numbers as one in a dominating block (or
+// earlier in the block) is replaced with a copy of its result, which the
+// copy propagation cleans up. Loads, member reads and computations on
+// variables which are not versions are only reused until the next store,
+// call or write to such a variable, and within extended basic blocks.
+void globalValueNumbering(
+    CFG &blocks,
+    const std::vector<Symbol> &variables,
+    const SSAVariables &ssa,
+    const DominatorTree &dominators,
+    Context *context)
+{
+    ValueNumbering numbering(blocks, variables, ssa, dominators, context);
+    numbering.Run();
+}
+
+} // namespace tac
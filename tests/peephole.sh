@@ -0,0 +1,31 @@
+#!/bin/bash
+# Regression tests of the peephole optimizer: compiles every program in
+# tests/peephole with and without --peephole, and checks that both exit
+# with the same code, which is 0 for every program.
+#
+# Usage: tests/peephole.sh [compiler]
+
+COMPILER=${1:-./build/csompiler}
+TEST_DIR=$(dirname "$0")/peephole
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+failed=0
+for source in "$TEST_DIR"/*.c; do
+    name=$(basename "$source" .c)
+    for flags in "" "--peephole"; do
+        "$COMPILER" "$source" $flags -o "$WORK_DIR/$name" || {
+            echo "$name: compilation with '$flags' failed"
+            failed=1
+            continue
+        }
+        "$WORK_DIR/$name"
+        result=$?
+        if [ "$result" -ne 0 ]; then
+            echo "$name: returned $result with '$flags'"
+            failed=1
+        fi
+    done
+done
+[ "$failed" -eq 0 ] && echo "Peephole tests passed"
+exit $failed
@@ -0,0 +1,17 @@
+// The reload of a stored 32-bit value clears the upper half of the
+// register, which the zero extension to unsigned long relies on.
+long g(void) { return 4294967301l; }
+
+unsigned long f(void)
+{
+    unsigned i;
+    unsigned *p = &i;
+    i = (unsigned)g();
+    unsigned long u = i;
+    return u;
+}
+
+int main(void)
+{
+    return f() == 5ul ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#!/bin/bash
+# Regression tests of the built-in preprocessor: compiles and runs every
+# program in tests/preprocessor, each of them exits with 0 when it passes.
+#
+# Usage: tests/preprocessor.sh [compiler]
+
+COMPILER=${1:-./build/csompiler}
+TEST_DIR=$(dirname "$0")/preprocessor
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+failed=0
+for source in "$TEST_DIR"/*.c; do
+    name=$(basename "$source" .c)
+    "$COMPILER" "$source" -o "$WORK_DIR/$name" || {
+        echo "$name: compilation failed"
+        failed=1
+        continue
+    }
+    "$WORK_DIR/$name"
+    result=$?
+    if [ "$result" -ne 0 ]; then
+        echo "$name: returned $result"
+        failed=1
+    fi
+done
+[ "$failed" -eq 0 ] && echo "Preprocessor tests passed"
+exit $failed
@@ -0,0 +1,8 @@
+// A #pragma once in a skipped block doesn't stop the second include
+int main(void)
+{
+    int x = 0;
+#include "pragma_once_skipped.h"
+#include "pragma_once_skipped.h"
+    return x == 2 ? 0 : 1;
+}
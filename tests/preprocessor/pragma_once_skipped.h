@@ -0,0 +1,4 @@
+#if 0
+#pragma once
+#endif
+x = x + 1;